@@ -0,0 +1,4 @@
+@ECHO OFF
+SETLOCAL
+SET PATH=%PATH%;..\nvstitch\binary;..\external\cuda;..\external\opencv-3.2\binary;..\external\memtest;
+testVRWorks.exe --input_dir_base .\ --rig_spec calib_rig_spec.xml --image_input image_input.xml --pano_width 2560 --remap_bench 50
\ No newline at end of file
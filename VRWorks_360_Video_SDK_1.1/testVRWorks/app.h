@@ -54,13 +54,17 @@
 #include <opencv2/opencv.hpp>
 
 #include "nvss_video.h"
+#include "cpu_stitcher.h"
+#include "stitch_session.h"
+#include "pano_publisher.h"
 
 #include <iostream>
-#include <tchar.h>
 #include <stdio.h>
+#if defined(_WIN32) || defined(_WIN64)
+#include <tchar.h>
 #include <windows.h>
 #include <winsock2.h>
-#include <mutex>
+#endif
 
 #define RETURN_NVSS_ERROR(err) \
 do { \
@@ -75,6 +79,7 @@ do { \
 
 typedef struct _appParams {
 	uint32_t pano_width;
+	cpussProjection projection;  // from the stitcher spec; other than equirectangular, CPU backend only
 	nvstitchStitcherQuality quality;
 	std::vector<nvstitchCameraProperties_t> cam_properties;
 	nvstitchVideoRigProperties_t rig_properties;
@@ -82,25 +87,85 @@ typedef struct _appParams {
 	std::string input_base_dir;
 	std::string out_file;
 	bool stereo_flag;
+	bool host_backend;
+	bool cpu_backend;
+	std::string lut_cache_dir;     // where the CPU backend keeps remap tables, empty for none
+	float feather_width;           // mono seam width in output pixels
+	bool feather_blend;            // CPU backend: feather seams instead of blending them multi-band
+	std::string coverage_dump;     // CPU backend: prefix for camera coverage masks, empty for none
+	int gain_mode;                 // CPU backend: cpussGainMode
+	float gain_smoothing;          // CPU backend: share of each frame in the smoothed gains
+	uint32_t output_levels;        // CPU backend: the panorama and output_levels - 1 halvings of it
+	std::vector<float> cam_vignetting; // CPU backend: 3 lens vignetting coefficients per camera, empty for none
+	int stabilize_mode;            // CPU backend: cpussStabilizeMode
+	float stabilize_tolerance_deg; // CPU backend: tilt left before the remap tables are rebuilt
+	int input_format;              // stitchFrameFormat of the decoded frames; 4:2:0 is CPU backend only
+	int output_format;             // stitchOutputFormat of the panorama; 4:2:0 is CPU backend only
 } appParams;
 
-struct memBuf
+// Backend selected by the command line flags
+inline stitchBackendType
+appStitchBackend(const appParams *params)
 {
-	unsigned char* buf;
-	float* pos;
-	memBuf() {
-		buf = new unsigned char[3276800 * 3];
-		pos = new float[3];
-	};
-};
+	if (params->cpu_backend)
+		return STITCH_BACKEND_CPU;
+	return params->host_backend ? STITCH_BACKEND_HOST : STITCH_BACKEND_NVSS;
+}
+
+// The session's output levels as they lie in pano, laid out as its output(),
+// for PanoPublisher::publishLevels; returns how many there are
+inline uint32_t
+appOutputLevels(const StitchSession &session, const unsigned char *pano, panoFrameLevel_t levels[PANO_SHM_MAX_LEVELS])
+{
+	for (uint32_t level = 0; level < session.outputLevels(); level++)
+	{
+		levels[level].data = pano + session.outputLevelOffset(level);
+		levels[level].width = session.outputLevelWidth(level);
+		levels[level].height = session.outputLevelHeight(level);
+		levels[level].stride = session.outputLevelWidth(level) * 4;
+	}
+	return session.outputLevels();
+}
 
-void pushImg
-(unsigned char* FileMapping, char* camPos, unsigned char* framedata, int imageWidth, int imageHeight);
+// The session's 4:2:0 output planes as they lie in pano, for
+// PanoPublisher::publishPlanes; returns how many there are
+inline uint32_t
+appOutputPlanes(const StitchSession &session, const unsigned char *pano, panoFrameLevel_t planes[PANO_SHM_MAX_PLANES])
+{
+	for (uint32_t plane = 0; plane < session.outputPlanes(); plane++)
+	{
+		planes[plane].data = pano + session.outputPlaneOffset(plane);
+		planes[plane].width = plane == 0 ? session.outputWidth() : session.outputWidth() / 2;
+		planes[plane].height = session.outputPlaneHeight(plane);
+		planes[plane].stride = (uint32_t)session.outputPlanePitch(plane);
+	}
+	return session.outputPlanes();
+}
+
+// Format of the published panorama. Stitcher input keeps the decoded byte
+// order, so the panorama from BGR frames is BGRA; 4:2:0 frames are converted
+// to RGB as they are sampled.
+inline panoPixelFormat
+appPanoFormat(const appParams *params)
+{
+	switch (params->output_format)
+	{
+	case STITCH_OUTPUT_I420: return PANO_FORMAT_I420;
+	case STITCH_OUTPUT_NV12: return PANO_FORMAT_NV12;
+	default: return params->input_format == STITCH_FRAME_BGR ? PANO_FORMAT_BGRA8 : PANO_FORMAT_RGBA8;
+	}
+}
 
 class app
 {
 public:
-	nvstitchResult run(appParams *params, cv::Mat leftCamera, cv::Mat rightCamera, HANDLE FileMappingHandle, unsigned char* FileMapping, char* orientations);
+	// Create the stitch session once; the pipeline reuses it for every frame
+	nvstitchResult init(appParams *params);
+
+	StitchSession& getSession() { return session; }
+
+private:
+	StitchSession session;
 };
 
 
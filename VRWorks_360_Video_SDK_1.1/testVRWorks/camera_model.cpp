@@ -0,0 +1,338 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "camera_model.h"
+#include "fast_math.h"
+
+#include <iostream>
+
+static const float PI = 3.14159265358979f;
+
+// Fisheye: theta_d = theta (1 + k0 theta^2 + k1 theta^4 + k2 theta^6 + k3 theta^8)
+static inline float fisheyeDistort(const float k[5], float theta)
+{
+	float t2 = theta * theta;
+	return theta * (1.0f + t2 * (k[0] + t2 * (k[1] + t2 * (k[2] + t2 * k[3]))));
+}
+
+static inline float fisheyeSlope(const float k[5], float theta)
+{
+	float t2 = theta * theta;
+	return 1.0f + t2 * (3.0f * k[0] + t2 * (5.0f * k[1] + t2 * (7.0f * k[2] + t2 * 9.0f * k[3])));
+}
+
+// Brown radial factor 1 + k0 r^2 + k1 r^4 + k4 r^6, and d(r factor)/dr
+static inline float brownRadial(const float k[5], float r2)
+{
+	return 1.0f + r2 * (k[0] + r2 * (k[1] + r2 * k[4]));
+}
+
+static inline float brownSlope(const float k[5], float r2)
+{
+	return 1.0f + r2 * (3.0f * k[0] + r2 * (5.0f * k[1] + r2 * 7.0f * k[4]));
+}
+
+//***********************************************************************************
+CameraModel::CameraModel()
+	: m_type(NVSTITCH_DISTORTION_TYPE_FISHEYE), m_cx(0.0f), m_cy(0.0f), m_focal(0.0f), m_radius(0.0f),
+	m_maxAngle(0.0f), m_minZ(-1.0f), m_maxTan2(0.0f), m_width(0), m_height(0)
+{
+	for (int i = 0; i < 9; i++)
+		m_worldToCamera[i] = (i % 4 == 0) ? 1.0f : 0.0f;
+	for (int i = 0; i < 5; i++)
+		m_k[i] = 0.0f;
+}
+
+nvstitchResult
+CameraModel::init(const nvstitchCameraProperties_t &camera)
+{
+	if (camera.image_size.x < 2 || camera.image_size.y < 2 || !(camera.focal_length > 0.0f))
+	{
+		std::cerr << "Camera needs an image size and a positive focal length" << std::endl;
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	}
+	if (camera.distortion_type != NVSTITCH_DISTORTION_TYPE_FISHEYE && camera.distortion_type != NVSTITCH_DISTORTION_TYPE_BROWN)
+	{
+		std::cerr << "Unsupported lens distortion type " << camera.distortion_type << std::endl;
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	}
+
+	m_type = camera.distortion_type;
+	m_width = camera.image_size.x;
+	m_height = camera.image_size.y;
+	m_cx = camera.principal_point.x;
+	m_cy = camera.principal_point.y;
+	m_focal = camera.focal_length;
+	m_radius = camera.fisheye_radius > 0.0f ? camera.fisheye_radius : 0.0f;
+	for (int i = 0; i < 5; i++)
+		m_k[i] = camera.distortion_coefficients[i];
+
+	// The extrinsic rotation takes camera directions into the world (math_util
+	// layout), so its transpose, read as rows, takes world into camera
+	for (int i = 0; i < 9; i++)
+		m_worldToCamera[i] = camera.extrinsics.rotation[i];
+
+	// Past the first turning point of the lens polynomial, directions fold
+	// back into the image; nothing beyond it is usable
+	const int STEPS = 4096;
+	m_maxAngle = PI;
+	for (int i = 1; i <= STEPS; i++)
+	{
+		float theta = PI * i / STEPS;
+		if (fisheyeSlope(m_k, theta) <= 0.0f)
+		{
+			m_maxAngle = PI * (i - 1) / STEPS;
+			break;
+		}
+	}
+
+	// Nothing further off axis than the furthest image corner (or the circle)
+	// can be visible, which rejects most directions before the atan2
+	float reach = 0.0f;
+	float corners[4][2] = { { 0.0f, 0.0f }, { (float)(m_width - 1), 0.0f },
+		{ 0.0f, (float)(m_height - 1) }, { (float)(m_width - 1), (float)(m_height - 1) } };
+	for (int i = 0; i < 4; i++)
+	{
+		float d = hypotf(corners[i][0] - m_cx, corners[i][1] - m_cy);
+		if (d > reach)
+			reach = d;
+	}
+	if (m_radius > 0.0f && m_radius < reach)
+		reach = m_radius;
+	float reachAngle = m_maxAngle;
+	for (int i = 1; i <= STEPS; i++)
+	{
+		float theta = m_maxAngle * i / STEPS;
+		if (m_focal * fisheyeDistort(m_k, theta) > reach)
+		{
+			reachAngle = theta;
+			break;
+		}
+	}
+	m_minZ = cosf(reachAngle);
+
+	// Brown: search tan(theta) up to 89 degrees
+	float maxTan = tanf(89.0f * PI / 180.0f);
+	m_maxTan2 = maxTan * maxTan;
+	for (int i = 1; i <= STEPS; i++)
+	{
+		float t = maxTan * i / STEPS;
+		if (brownSlope(m_k, t * t) <= 0.0f)
+		{
+			t = maxTan * (i - 1) / STEPS;
+			m_maxTan2 = t * t;
+			break;
+		}
+	}
+
+	return NVSTITCH_SUCCESS;
+}
+
+float
+CameraModel::edgeDistance(float u, float v, float r) const
+{
+	float d = u;
+	if ((float)(m_width - 1) - u < d)
+		d = (float)(m_width - 1) - u;
+	if (v < d)
+		d = v;
+	if ((float)(m_height - 1) - v < d)
+		d = (float)(m_height - 1) - v;
+	if (m_radius > 0.0f && m_radius - r < d)
+		d = m_radius - r;
+	return d;
+}
+
+bool
+CameraModel::projectFisheye(float x, float y, float z, float *u, float *v, float *margin) const
+{
+	if (z < m_minZ)
+		return false;
+
+	float rho = sqrtf(x * x + y * y);
+	float theta = fastAtan2(rho, z);
+	if (theta > m_maxAngle)
+		return false;
+
+	float r = m_focal * fisheyeDistort(m_k, theta);
+	float s = rho > 1e-9f ? r / rho : m_focal;
+
+	// Image rows grow downward, camera Y up
+	*u = m_cx + s * x;
+	*v = m_cy - s * y;
+
+	float d = edgeDistance(*u, *v, r);
+	if (d < 0.0f)
+		return false;
+
+	// Edges are mostly met radially, so convert with the radial scale
+	*margin = d / (m_focal * fisheyeSlope(m_k, theta));
+	return true;
+}
+
+bool
+CameraModel::projectBrown(float x, float y, float z, float *u, float *v, float *margin) const
+{
+	if (z <= 0.0f)
+		return false;
+
+	// OpenCV convention: normalized image coordinates with y down
+	float a = x / z;
+	float b = -y / z;
+	float r2 = a * a + b * b;
+	if (r2 > m_maxTan2)
+		return false;
+
+	float radial = brownRadial(m_k, r2);
+	float p1 = m_k[2];
+	float p2 = m_k[3];
+	float ad = a * radial + 2.0f * p1 * a * b + p2 * (r2 + 2.0f * a * a);
+	float bd = b * radial + p1 * (r2 + 2.0f * b * b) + 2.0f * p2 * a * b;
+	*u = m_cx + m_focal * ad;
+	*v = m_cy + m_focal * bd;
+
+	float r = m_focal * sqrtf(ad * ad + bd * bd);
+	float d = edgeDistance(*u, *v, r);
+	if (d < 0.0f)
+		return false;
+
+	// d(tan theta)/d(theta) = 1 + tan^2
+	*margin = d / (m_focal * brownSlope(m_k, r2) * (1.0f + r2));
+	return true;
+}
+
+bool
+CameraModel::project(const float dir[3], float *u, float *v, float *margin) const
+{
+	const float *R = m_worldToCamera;
+	float x = R[0] * dir[0] + R[1] * dir[1] + R[2] * dir[2];
+	float y = R[3] * dir[0] + R[4] * dir[1] + R[5] * dir[2];
+	float z = R[6] * dir[0] + R[7] * dir[1] + R[8] * dir[2];
+
+	if (m_type == NVSTITCH_DISTORTION_TYPE_BROWN)
+		return projectBrown(x, y, z, u, v, margin);
+	return projectFisheye(x, y, z, u, v, margin);
+}
+
+//***********************************************************************************
+LensVignetting::LensVignetting()
+	: m_enabled(false), m_cx(0.0f), m_cy(0.0f), m_invNorm(0.0f), m_peak(1.0f)
+{
+	for (int i = 0; i < VIGNETTING_COEFFICIENTS; i++)
+		m_v[i] = 0.0f;
+}
+
+float
+LensVignetting::evaluate(const float coefficients[VIGNETTING_COEFFICIENTS], float r)
+{
+	float r2 = r * r;
+	return 1.0f + r2 * (coefficients[0] + r2 * (coefficients[1] + r2 * coefficients[2]));
+}
+
+nvstitchResult
+LensVignetting::init(const nvstitchCameraProperties_t &camera, const float coefficients[VIGNETTING_COEFFICIENTS])
+{
+	if (camera.image_size.x < 2 || camera.image_size.y < 2)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+
+	m_enabled = false;
+	for (int i = 0; i < VIGNETTING_COEFFICIENTS; i++)
+	{
+		m_v[i] = coefficients != nullptr ? coefficients[i] : 0.0f;
+		if (!(fabsf(m_v[i]) < 1e6f))
+		{
+			std::cerr << "Vignetting coefficients must be finite" << std::endl;
+			return NVSTITCH_ERROR_BAD_PARAMETER;
+		}
+		m_enabled = m_enabled || m_v[i] != 0.0f;
+	}
+
+	m_cx = camera.principal_point.x;
+	m_cy = camera.principal_point.y;
+	float width = (float)camera.image_size.x;
+	float height = (float)camera.image_size.y;
+	bool circle = camera.distortion_type == NVSTITCH_DISTORTION_TYPE_FISHEYE && camera.fisheye_radius > 0.0f;
+	m_invNorm = 1.0f / (circle ? camera.fisheye_radius : 0.5f * hypotf(width, height));
+
+	// The peak over every radius the image reaches, up to the circle
+	float reach = 0.0f;
+	float corners[4][2] = { { 0.0f, 0.0f }, { width - 1.0f, 0.0f }, { 0.0f, height - 1.0f }, { width - 1.0f, height - 1.0f } };
+	for (int i = 0; i < 4; i++)
+	{
+		float d = hypotf(corners[i][0] - m_cx, corners[i][1] - m_cy) * m_invNorm;
+		if (d > reach)
+			reach = d;
+	}
+	if (circle && reach > 1.0f)
+		reach = 1.0f;
+	const int STEPS = 1024;
+	m_peak = 1.0f;
+	for (int i = 0; i <= STEPS; i++)
+	{
+		float c = correction(reach * i / STEPS);
+		if (c > m_peak)
+			m_peak = c;
+	}
+	return NVSTITCH_SUCCESS;
+}
+
+float
+LensVignetting::radius(float u, float v) const
+{
+	return hypotf(u - m_cx, v - m_cy) * m_invNorm;
+}
+
+float
+LensVignetting::correction(float r) const
+{
+	if (!m_enabled)
+		return 1.0f;
+	float c = evaluate(m_v, r);
+	return c < 1.0f ? 1.0f : (c > VIGNETTING_MAX_CORRECTION ? VIGNETTING_MAX_CORRECTION : c);
+}
@@ -0,0 +1,136 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nvstitch_common_video.h"
+
+// Lens and orientation of one rig camera, for projecting world directions
+// (Y-up, X-right, Z-in, as in the rig XML) into its image. Translation is
+// ignored: mono stitching treats the scene as infinitely far away.
+class CameraModel
+{
+public:
+	CameraModel();
+
+	nvstitchResult init(const nvstitchCameraProperties_t &camera);
+
+	// Image position of the unit world direction dir, in pixels with pixel
+	// centers on integers. False if the direction falls outside the usable
+	// image (behind the lens, past the fisheye circle or the image border).
+	// margin is the angle, in radians, from the direction to that edge.
+	bool project(const float dir[3], float *u, float *v, float *margin) const;
+
+	uint32_t width() const { return m_width; }
+	uint32_t height() const { return m_height; }
+
+private:
+	bool projectFisheye(float x, float y, float z, float *u, float *v, float *margin) const;
+	bool projectBrown(float x, float y, float z, float *u, float *v, float *margin) const;
+
+	// Distance, in pixels, from (u, v) to the nearest edge of the usable image
+	float edgeDistance(float u, float v, float r) const;
+
+	nvstitchDistortionType m_type;
+	float m_worldToCamera[9];   // row major
+	float m_cx, m_cy;
+	float m_focal;
+	float m_k[5];
+	float m_radius;             // fisheye circle in pixels, 0 for none
+	float m_maxAngle;           // fisheye: largest angle off axis the lens polynomial is monotonic to
+	float m_minZ;               // fisheye: cosine of the largest angle that can land in the image
+	float m_maxTan2;            // Brown: same, as squared tangent
+	uint32_t m_width;
+	uint32_t m_height;
+};
+
+// Radial brightness falloff of a lens, toward the edge of its image circle.
+// At r, an image position's distance from the principal point over the
+// fisheye radius (or, without one, over half the image diagonal), the image
+// is brightened by
+//   1 + v1 r^2 + v2 r^4 + v3 r^6
+// held to [1, VIGNETTING_MAX_CORRECTION], a stop. The coefficients come from
+// the <vignetting> node of the camera's <optics> in the rig XML.
+#define VIGNETTING_COEFFICIENTS 3
+#define VIGNETTING_MAX_CORRECTION 2.0f
+
+class LensVignetting
+{
+public:
+	LensVignetting();
+
+	// coefficients holds v1, v2 and v3; nullptr, or all 0, corrects nothing
+	nvstitchResult init(const nvstitchCameraProperties_t &camera, const float coefficients[VIGNETTING_COEFFICIENTS]);
+
+	bool enabled() const { return m_enabled; }
+	const float* coefficients() const { return m_v; }
+
+	// Normalized radius of image position (u, v), pixel centers on integers
+	float radius(float u, float v) const;
+
+	float correction(float r) const;
+	float correction(float u, float v) const { return correction(radius(u, v)); }
+
+	// Largest correction anywhere the camera sees, and the correction at
+	// (u, v) as a share of it, in (0, 1]
+	float peak() const { return m_peak; }
+	float share(float u, float v) const { return correction(u, v) / m_peak; }
+
+	static float evaluate(const float coefficients[VIGNETTING_COEFFICIENTS], float r);
+
+private:
+	bool m_enabled;
+	float m_v[VIGNETTING_COEFFICIENTS];
+	float m_cx, m_cy;
+	float m_invNorm;            // 1 / the radius r is measured against
+	float m_peak;
+};
@@ -0,0 +1,167 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "color_convert.h"
+#include "cpu_features.h"
+
+#include <immintrin.h>
+
+static inline void convertRowScalar(const unsigned char *src, unsigned char *dst, uint32_t x, uint32_t width, bool swapRB)
+{
+	const int r = swapRB ? 2 : 0;
+	const int b = swapRB ? 0 : 2;
+	for (; x < width; x++)
+	{
+		dst[4 * x + 0] = src[3 * x + r];
+		dst[4 * x + 1] = src[3 * x + 1];
+		dst[4 * x + 2] = src[3 * x + b];
+		dst[4 * x + 3] = 255;
+	}
+}
+
+void convertBgrToRgbaScalar(const unsigned char *src, size_t srcPitch,
+	unsigned char *dst, size_t dstPitch,
+	uint32_t width, uint32_t height, bool swapRB)
+{
+	for (uint32_t y = 0; y < height; y++)
+		convertRowScalar(src + y * srcPitch, dst + y * dstPitch, 0, width, swapRB);
+}
+
+// 16 pixels (48 source bytes) per iteration; reads never pass the end of the row
+CPU_TARGET_SSSE3
+static void convertBgrToRgbaSsse3(const unsigned char *src, size_t srcPitch,
+	unsigned char *dst, size_t dstPitch,
+	uint32_t width, uint32_t height, bool swapRB)
+{
+	const __m128i shuffle = swapRB ?
+		_mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1) :
+		_mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const unsigned char *s = src + y * srcPitch;
+		unsigned char *d = dst + y * dstPitch;
+
+		uint32_t x = 0;
+		for (; x + 16 <= width; x += 16)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i *)(s + 3 * x));
+			__m128i b = _mm_loadu_si128((const __m128i *)(s + 3 * x + 16));
+			__m128i c = _mm_loadu_si128((const __m128i *)(s + 3 * x + 32));
+
+			__m128i p0 = a;
+			__m128i p1 = _mm_alignr_epi8(b, a, 12);
+			__m128i p2 = _mm_alignr_epi8(c, b, 8);
+			__m128i p3 = _mm_srli_si128(c, 4);
+
+			_mm_storeu_si128((__m128i *)(d + 4 * x), _mm_or_si128(_mm_shuffle_epi8(p0, shuffle), alpha));
+			_mm_storeu_si128((__m128i *)(d + 4 * x + 16), _mm_or_si128(_mm_shuffle_epi8(p1, shuffle), alpha));
+			_mm_storeu_si128((__m128i *)(d + 4 * x + 32), _mm_or_si128(_mm_shuffle_epi8(p2, shuffle), alpha));
+			_mm_storeu_si128((__m128i *)(d + 4 * x + 48), _mm_or_si128(_mm_shuffle_epi8(p3, shuffle), alpha));
+		}
+		convertRowScalar(s, d, x, width, swapRB);
+	}
+}
+
+// 32 pixels per iteration, 8 per register: each 128-bit lane takes 4 pixels
+// from its own unaligned 16-byte load. The last load reads 4 bytes past the
+// 96 consumed, so the loop stops 2 pixels early and the tail goes scalar.
+CPU_TARGET_AVX2
+static void convertBgrToRgbaAvx2(const unsigned char *src, size_t srcPitch,
+	unsigned char *dst, size_t dstPitch,
+	uint32_t width, uint32_t height, bool swapRB)
+{
+	const __m256i shuffle = swapRB ?
+		_mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+			2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1) :
+		_mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const unsigned char *s = src + y * srcPitch;
+		unsigned char *d = dst + y * dstPitch;
+
+		uint32_t x = 0;
+		for (; x + 34 <= width; x += 32)
+		{
+			for (int k = 0; k < 4; k++)
+			{
+				const unsigned char *p = s + 3 * (x + 8 * k);
+				__m256i v = _mm256_inserti128_si256(
+					_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+					_mm_loadu_si128((const __m128i *)(p + 12)), 1);
+				_mm256_storeu_si256((__m256i *)(d + 4 * (x + 8 * k)),
+					_mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), alpha));
+			}
+		}
+		convertRowScalar(s, d, x, width, swapRB);
+	}
+}
+
+void convertBgrToRgba(const unsigned char *src, size_t srcPitch,
+	unsigned char *dst, size_t dstPitch,
+	uint32_t width, uint32_t height, bool swapRB)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		convertBgrToRgbaAvx2(src, srcPitch, dst, dstPitch, width, height, swapRB);
+		break;
+	case CPU_SIMD_SSE41:
+	case CPU_SIMD_SSSE3:
+		convertBgrToRgbaSsse3(src, srcPitch, dst, dstPitch, width, height, swapRB);
+		break;
+	default:
+		convertBgrToRgbaScalar(src, srcPitch, dst, dstPitch, width, height, swapRB);
+		break;
+	}
+}
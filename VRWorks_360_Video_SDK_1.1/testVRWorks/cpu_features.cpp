@@ -0,0 +1,178 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "cpu_features.h"
+
+#include <atomic>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+static std::atomic<int> s_simdLimit(CPU_SIMD_AVX2);
+
+static cpuSimdLevel detectSimdLevel()
+{
+#if defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 0);
+	int max_leaf = regs[0];
+
+	__cpuid(regs, 1);
+	bool ssse3 = (regs[2] & (1 << 9)) != 0;
+	bool sse41 = (regs[2] & (1 << 19)) != 0;
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	bool avx = (regs[2] & (1 << 28)) != 0;
+
+	bool avx2 = false;
+	if (max_leaf >= 7 && osxsave && avx)
+	{
+		// The OS must save the YMM registers on context switch
+		bool ymm_enabled = (_xgetbv(0) & 6) == 6;
+		__cpuidex(regs, 7, 0);
+		avx2 = ymm_enabled && (regs[1] & (1 << 5)) != 0;
+	}
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	bool ssse3 = __builtin_cpu_supports("ssse3") != 0;
+	bool sse41 = __builtin_cpu_supports("sse4.1") != 0;
+	bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#else
+	bool ssse3 = false, sse41 = false, avx2 = false;
+#endif
+
+	if (avx2 && sse41 && ssse3)
+		return CPU_SIMD_AVX2;
+	if (sse41 && ssse3)
+		return CPU_SIMD_SSE41;
+	if (ssse3)
+		return CPU_SIMD_SSSE3;
+	return CPU_SIMD_SCALAR;
+}
+
+cpuSimdLevel cpuGetSimdLevel()
+{
+	static const cpuSimdLevel detected = detectSimdLevel();
+	int limit = s_simdLimit.load(std::memory_order_relaxed);
+	return detected < limit ? detected : (cpuSimdLevel)limit;
+}
+
+void cpuSetSimdLimit(cpuSimdLevel limit)
+{
+	s_simdLimit.store(limit, std::memory_order_relaxed);
+}
+
+const char* cpuSimdLevelName(cpuSimdLevel level)
+{
+	switch (level)
+	{
+	case CPU_SIMD_SCALAR: return "scalar";
+	case CPU_SIMD_SSSE3: return "ssse3";
+	case CPU_SIMD_SSE41: return "sse4.1";
+	case CPU_SIMD_AVX2: return "avx2";
+	default: return "unknown";
+	}
+}
+
+static void cpuid(unsigned regs[4], unsigned leaf, unsigned subleaf)
+{
+#if defined(_MSC_VER)
+	__cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#else
+	regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+static size_t detectL2CacheBytes()
+{
+	unsigned regs[4];
+	cpuid(regs, 0, 0);
+	unsigned maxLeaf = regs[0];
+
+	// Deterministic cache parameters, one subleaf per cache until type 0
+	if (maxLeaf >= 4)
+	{
+		for (unsigned subleaf = 0; subleaf < 16; subleaf++)
+		{
+			cpuid(regs, 4, subleaf);
+			unsigned type = regs[0] & 0x1f;
+			if (type == 0)
+				break;
+			unsigned level = (regs[0] >> 5) & 0x7;
+			if (level != 2 || type == 2)
+				continue;
+			size_t ways = (regs[1] >> 22) + 1;
+			size_t partitions = ((regs[1] >> 12) & 0x3ff) + 1;
+			size_t line = (regs[1] & 0xfff) + 1;
+			size_t sets = (size_t)regs[2] + 1;
+			return ways * partitions * line * sets;
+		}
+	}
+
+	// AMD reports L2 size in KB in the extended leaves
+	cpuid(regs, 0x80000000, 0);
+	if (regs[0] >= 0x80000006)
+	{
+		cpuid(regs, 0x80000006, 0);
+		size_t kb = regs[2] >> 16;
+		if (kb > 0)
+			return kb * 1024;
+	}
+	return 256 * 1024;
+}
+
+size_t cpuGetL2CacheBytes()
+{
+	static const size_t detected = detectL2CacheBytes();
+	return detected;
+}
@@ -0,0 +1,1392 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "cpu_stitcher.h"
+#include "camera_model.h"
+#include "cpu_features.h"
+#include "downsample_kernels.h"
+#include "gain_compensation.h"
+#include "multiband_blend.h"
+#include "output_projection.h"
+#include "pack_yuv_kernels.h"
+#include "quaternion.h"
+#include "remap_fused_kernels.h"
+#include "remap_kernels.h"
+#include "remap_lut.h"
+#include "remap_yuv_kernels.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <memory>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// Pixels accumulated at a time; wider tiles, such as whole rows, are
+// walked in runs of this many
+static const uint32_t ACC_PIXELS = 512;
+
+static const size_t ROW_ALIGN = 64;
+
+static_assert((1 << CPUSS_MAX_OUTPUT_LEVELS) <= MULTIBAND_BLOCK_ALIGN, "blended blocks must not split a band of cells");
+
+static const float PI = 3.14159265358979f;
+
+static inline size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// Remap tiles get half of L2, the rest going to the accumulators and the
+// lines still in flight from the previous tile
+static size_t tileBudget()
+{
+	return cpuGetL2CacheBytes() / 2;
+}
+
+// RGBA image, or one plane of a YUV one, in system memory, rows ROW_ALIGN
+// apart; the kernels may read REMAP_SOURCE_ROW_SLACK bytes past the last
+struct CpuImage
+{
+	std::vector<unsigned char> storage;
+	unsigned char *data;
+	uint32_t width;
+	uint32_t height;
+	uint32_t bytesPerPixel;
+	size_t pitch;
+
+	CpuImage() : data(nullptr), width(0), height(0), bytesPerPixel(4), pitch(0) {}
+
+	void allocate(uint32_t w, uint32_t h, uint32_t pixelBytes = 4)
+	{
+		width = w;
+		height = h;
+		bytesPerPixel = pixelBytes;
+		pitch = alignUp((size_t)w * pixelBytes, ROW_ALIGN);
+		storage.assign(pitch * h + ROW_ALIGN + REMAP_SOURCE_ROW_SLACK, 0);
+		size_t misalign = (size_t)(uintptr_t)storage.data() % ROW_ALIGN;
+		data = storage.data() + (misalign ? ROW_ALIGN - misalign : 0);
+	}
+
+	void clear()
+	{
+		std::fill(storage.begin(), storage.end(), (unsigned char)0);
+	}
+
+	// Every pixel of a 4-byte image set to pixel
+	void fill(const unsigned char pixel[4])
+	{
+		for (uint32_t y = 0; y < height; y++)
+			for (uint32_t x = 0; x < width; x++)
+				memcpy(data + (size_t)y * pitch + (size_t)x * 4, pixel, 4);
+	}
+
+	void describe(nvstitchImageBuffer_t *buffer) const
+	{
+		buffer->dev_ptr = data;
+		buffer->pitch = pitch;
+		buffer->row_bytes = (size_t)width * bytesPerPixel;
+		buffer->width = width;
+		buffer->height = height;
+	}
+};
+
+// A camera's input or the 4:2:0 output: the RGBA image, or Y, U and V
+// planes (I420), or Y and interleaved UV (NV12)
+struct CpuPlanes
+{
+	CpuImage planes[3];
+	uint32_t numPlanes;
+
+	CpuPlanes() : numPlanes(0) {}
+};
+
+//***********************************************************************************
+// Everything that follows from where the rig points: the tables, the
+// schedules and seam blocks laid out from them, and the gains' sample grid.
+// Stabilized instances build a new one in the background when the rig
+// tilts, and take it up between stitches.
+struct StitchLayout
+{
+	RemapTables tables;
+
+	// Each order keeps its own copy of the packed tables, laid out in the
+	// order it reads them. Row-major is only built when asked for.
+	RemapSchedule schedules[2];
+
+	MultiBandBlender blender;
+	GainCompensator gains;
+
+	// Rig to world rotation the tables undo; identity unless stabilized
+	Quat rotation;
+};
+
+struct cpussVideo_t
+{
+	cpussVideo_t();
+	~cpussVideo_t();
+
+	nvstitchResult init(const nvssVideoStitcherProperties_t &props, const nvstitchVideoRigProperties_t &rig,
+		const char *cacheDir);
+	nvstitchResult init(const nvssVideoStitcherProperties_t &props, const nvstitchCameraMapping_t &mapping);
+	nvstitchResult allocate();
+	nvstitchResult allocateInputs(cpussInputFormat format);
+	nvstitchResult allocateOutput(cpussOutputFormat format);
+	nvstitchResult stitch();
+	nvstitchResult layOut();
+	bool layoutCache(std::string *path, uint64_t *key) const;
+	nvstitchResult schedule(cpussRemapOrder order, const PackedRemapTables *packed = nullptr);
+	nvstitchResult setVignetting(const float *coefficients);
+	void planCells();
+	void stitchTile(size_t tile);
+	void finish(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+	void reduce(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+	void pack(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+	void clearOutput();
+	void stabilize();
+	void buildLayout(Quat target, cpussRemapOrder layoutOrder, uint32_t tileWidth, uint32_t tileHeight);
+	uint32_t columnOffset(uint32_t level) const;
+
+	const CpuImage& level(uint32_t index) const { return index == 0 ? output : levels[index - 1]; }
+	const LensVignetting* lenses() const { return vignetting.empty() ? nullptr : vignetting.data(); }
+
+	// Rows of the cells the panorama is finished in, or 1 if there is
+	// nothing to do once it is stitched
+	uint32_t cellBand() const { return std::max(1u << levels.size(), outputFormat == CPUSS_OUTPUT_RGBA8 ? 1u : 2u); }
+
+	std::unique_ptr<StitchLayout> layout;
+	std::string cacheDir;       // of the tables and their layouts; empty if none
+	cpussInputFormat inputFormat;
+	std::vector<CpuPlanes> inputs;
+	std::vector<remapSource_t> sources;
+	CpuImage output;
+
+	// Kernels for fused spans and copy runs, by camera count, for the input
+	// format and keepYuv of the current stitch
+	remapSpanKernel spanKernels[REMAP_SPAN_MAX_CAMERAS + 1];
+	float featherWidth;
+
+	// 4:2:0 output, packed from output, which holds Y, U, V and alpha
+	// rather than RGBA while keepYuv is set
+	cpussOutputFormat outputFormat;
+	CpuPlanes packed;
+	bool keepYuv;
+
+	cpussRemapOrder order;
+	cpussBlendMode blendMode;
+	cpussGainMode gainMode;
+
+	// One model per camera while vignetting is corrected, otherwise none
+	std::vector<LensVignetting> vignetting;
+
+	// Reduced outputs, each half the size of the one before. The panorama
+	// is reduced and packed in cells, bands of cellBand() rows across one
+	// column of tiles; the last tile to finish a cell finishes it.
+	std::vector<CpuImage> levels;
+	std::vector<uint32_t> cellTiles;
+	std::unique_ptr<std::atomic<uint32_t>[]> cellsPending;
+	uint32_t cellColumns;
+
+	// Stabilization. The rig is kept to build layouts for other rotations;
+	// instances made from projection maps have none. The layout for
+	// rotation is built on its own thread into next, from a budget of
+	// CPUSS_STABILIZE_BUDGET of the stitch time; yaw is shifted out when
+	// the output is copied.
+	nvssVideoStitcherProperties_t props;
+	std::vector<nvstitchCameraProperties_t> cameras;
+	nvstitchVideoRigProperties_t rig;
+	cpussStabilizeMode stabilizeMode;
+	float tolerance;            // radians
+	Quat orientation;           // rig to world, as last set
+	Quat rotation;              // what the tables should undo for it
+	uint32_t shift;             // output columns of yaw
+	std::thread builder;
+	std::unique_ptr<StitchLayout> next;
+	std::atomic<bool> nextReady;
+	double nextMs;
+	double budgetMs;
+	double buildMs;
+	uint32_t rebuilds;
+
+	std::unique_ptr<ThreadPool> pool;
+};
+
+static nvstitchResult
+checkProperties(const nvssVideoStitcherProperties_t &props)
+{
+	if (props.pipeline != NVSTITCH_STITCHER_PIPELINE_MONO || props.format != NVSS_STITCHER_FORMAT_RGBA8UI)
+	{
+		std::cerr << "CPU stitcher only supports mono RGBA output" << std::endl;
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	}
+
+	OutputProjection projection;
+	nvstitchResult result = projection.init((cpussProjection)props.projection, props.pano_width);
+	if (result == NVSTITCH_ERROR_UNSUPPORTED_CONFIG)
+		std::cerr << "CPU stitcher does not support output projection " << (int)props.projection << std::endl;
+	else if (result != NVSTITCH_SUCCESS)
+		std::cerr << "pano_width " << props.pano_width << " does not divide into a " << OutputProjection::name((cpussProjection)props.projection)
+			<< " panorama" << std::endl;
+	return result;
+}
+
+cpussVideo_t::cpussVideo_t() :
+	inputFormat(CPUSS_INPUT_RGBA8),
+	spanKernels(),
+	featherWidth(0.0f),
+	outputFormat(CPUSS_OUTPUT_RGBA8),
+	keepYuv(false),
+	order(CPUSS_REMAP_ORDER_TILED),
+	blendMode(CPUSS_BLEND_MULTIBAND),
+	gainMode(CPUSS_GAIN_OFF),
+	cellColumns(0),
+	stabilizeMode(CPUSS_STABILIZE_OFF),
+	tolerance(0.0f),
+	orientation(quatIdentity()),
+	rotation(quatIdentity()),
+	shift(0),
+	nextReady(false),
+	nextMs(0.0),
+	budgetMs(0.0),
+	buildMs(0.0),
+	rebuilds(0)
+{
+	props = nvssVideoStitcherProperties_t();
+	rig = nvstitchVideoRigProperties_t();
+}
+
+cpussVideo_t::~cpussVideo_t()
+{
+	if (builder.joinable())
+		builder.join();
+}
+
+nvstitchResult
+cpussVideo_t::init(const nvssVideoStitcherProperties_t &props, const nvstitchVideoRigProperties_t &rig,
+	const char *cacheDir)
+{
+	nvstitchResult result = checkProperties(props);
+	if (result != NVSTITCH_SUCCESS)
+		return result;
+
+	featherWidth = props.feather_width;
+	pool.reset(new ThreadPool());
+	layout.reset(new StitchLayout());
+	layout->rotation = quatIdentity();
+	auto start = std::chrono::steady_clock::now();
+	result = layout->tables.loadOrBuild(cacheDir != nullptr ? cacheDir : "", props, rig, tileBudget(), *pool);
+	if (result != NVSTITCH_SUCCESS)
+		return result;
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "CPU stitcher " << OutputProjection::name((cpussProjection)props.projection) << " remap tables, " << layout->tables.panoWidth() << "x"
+		<< layout->tables.panoHeight() << ", " << (layout->tables.fromCache() ? "loaded" : "built") << " in " << ms << " ms" << std::endl;
+
+	this->props = props;
+	this->rig = rig;
+	this->cacheDir = cacheDir != nullptr ? cacheDir : "";
+	cameras.assign(rig.cameras, rig.cameras + rig.num_cameras);
+	this->rig.cameras = cameras.data();
+	return allocate();
+}
+
+nvstitchResult
+cpussVideo_t::init(const nvssVideoStitcherProperties_t &props, const nvstitchCameraMapping_t &mapping)
+{
+	nvstitchResult result = checkProperties(props);
+	if (result != NVSTITCH_SUCCESS)
+		return result;
+	if ((cpussProjection)props.projection != CPUSS_PROJECTION_EQUIRECTANGULAR)
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	if (mapping.reference_resolution.x != props.pano_width || mapping.reference_resolution.y != props.pano_width / 2)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+
+	featherWidth = props.feather_width;
+	pool.reset(new ThreadPool());
+	layout.reset(new StitchLayout());
+	layout->rotation = quatIdentity();
+	result = layout->tables.build(mapping, props.feather_width);
+	if (result != NVSTITCH_SUCCESS)
+		return result;
+	this->props = props;
+	return allocate();
+}
+
+nvstitchResult
+cpussVideo_t::allocate()
+{
+	const RemapTables &tables = layout->tables;
+	nvstitchResult result = allocateInputs(inputFormat);
+	if (result != NVSTITCH_SUCCESS)
+		return result;
+	output.allocate(tables.panoWidth(), tables.panoHeight());
+
+	result = layOut();
+	if (result != NVSTITCH_SUCCESS)
+		return result;
+	blendMode = CPUSS_BLEND_MULTIBAND;
+	gainMode = CPUSS_GAIN_OFF;
+	return NVSTITCH_SUCCESS;
+}
+
+// The layout cache file for the current tables and vignetting, and its key;
+// false if the tables are not cached
+bool
+cpussVideo_t::layoutCache(std::string *path, uint64_t *key) const
+{
+	const RemapTables &tables = layout->tables;
+	if (cacheDir.empty() || tables.cacheKey() == 0)
+		return false;
+	*key = RemapTables::layoutKey(tables.cacheKey(), featherWidth, lenses(), tables.numCameras(), tileBudget(),
+		ACC_PIXELS, REMAP_SPAN_MAX_CAMERAS);
+	*path = RemapTables::layoutCachePath(cacheDir, *key);
+	return true;
+}
+
+static void
+reportBlocks(const MultiBandBlender &blender, const RemapTables &tables, const char *how, double ms)
+{
+	double panoPixels = (double)tables.panoWidth() * tables.panoHeight();
+	std::cout << "CPU stitcher blends " << blender.numBlocks() << " seam blocks of up to " << blender.blockSize()
+		<< " pixels in " << blender.levels() + 1 << " bands (" << 100.0 * blender.blendedPixels() / panoPixels
+		<< "% of the panorama, " << 100.0 * blender.windowPixels() / panoPixels << "% with their padding), "
+		<< how << " in " << ms << " ms" << std::endl;
+}
+
+static void
+reportSchedule(const RemapSchedule &plan, const RemapTables &tables, const char *how, double ms)
+{
+	std::cout << "CPU stitcher remap tiles " << plan.tileWidth() << "x" << plan.tileHeight()
+		<< ", about " << plan.meanFootprint() / 1024 << " KB each, "
+		<< 100.0 * plan.overlapPixels() / ((size_t)tables.panoWidth() * tables.panoHeight())
+		<< "% overlap, " << (plan.overlapPixels() ? 100.0 * plan.fusedPixels() / plan.overlapPixels() : 0.0)
+		<< "% of it fused, " << how << " in " << ms << " ms" << std::endl;
+}
+
+// The seam blocks, the tiled schedule and the gains' sample grid for the
+// layout's tables and the current vignetting; other schedules are dropped.
+// Cached tables keep the blocks and schedule, with the packed tables they
+// came from, in a layout cache file beside their own, and later starts
+// read them back from it. Without it, the blocks and schedule are most of
+// a start from cached tables.
+nvstitchResult
+cpussVideo_t::layOut()
+{
+	const RemapTables &tables = layout->tables;
+	MultiBandBlender &blender = layout->blender;
+	RemapSchedule &tiled = layout->schedules[CPUSS_REMAP_ORDER_TILED];
+	for (RemapSchedule &plan : layout->schedules)
+		plan = RemapSchedule();
+	layout->gains.build(tables, lenses());
+
+	std::string path;
+	uint64_t key = 0;
+	bool cached = layoutCache(&path, &key);
+	RemapLayoutReader reader;
+	auto start = std::chrono::steady_clock::now();
+	bool loaded = cached && reader.open(path, key) && blender.load(reader, tables, *pool);
+	double blocksMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if (loaded && tiled.load(reader, tables))
+	{
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		reportBlocks(blender, tables, "loaded", blocksMs);
+		reportSchedule(tiled, tables, "loaded", ms - blocksMs);
+		return schedule(CPUSS_REMAP_ORDER_TILED);
+	}
+	start = std::chrono::steady_clock::now();
+
+	// Packed once for the seam blocks and the tiled schedule
+	PackedRemapTables packed;
+	nvstitchResult result = packed.build(tables, *pool, lenses());
+	if (result != NVSTITCH_SUCCESS)
+		return result;
+	result = blender.build(tables, packed, featherWidth, *pool, lenses());
+	if (result != NVSTITCH_SUCCESS)
+		return result;
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	reportBlocks(blender, tables, "laid out", ms);
+	result = schedule(CPUSS_REMAP_ORDER_TILED, &packed);
+	if (result != NVSTITCH_SUCCESS || !cached)
+		return result;
+
+	RemapLayoutWriter writer;
+	bool saved = writer.open(path, key);
+	if (saved)
+	{
+		packed.save(writer);
+		tiled.save(writer);
+		blender.save(writer);
+		saved = writer.finish();
+	}
+	if (!saved)
+		std::cerr << "Could not write layout cache " << path << std::endl;
+	return NVSTITCH_SUCCESS;
+}
+
+// Chroma planes are half the luma size, rounded up, and need 2x2 samples
+// for the kernels, so 4:2:0 inputs are at least 3x3. BGR8 rows need no
+// slack: the kernels never read past a block's second pixel.
+nvstitchResult
+cpussVideo_t::allocateInputs(cpussInputFormat format)
+{
+	const RemapTables &tables = layout->tables;
+	uint32_t minSize = format == CPUSS_INPUT_I420 || format == CPUSS_INPUT_NV12 ? 3 : 2;
+	for (uint32_t camera = 0; camera < tables.numCameras(); camera++)
+	{
+		const nvstitchCameraMappingMatrix_t &matrix = tables.matrix(camera);
+		if (matrix.input_size.x < minSize || matrix.input_size.y < minSize)
+			return NVSTITCH_ERROR_BAD_PARAMETER;
+	}
+
+	inputs.clear();
+	inputs.resize(tables.numCameras());
+	sources.assign(tables.numCameras(), remapSource_t());
+	for (uint32_t camera = 0; camera < tables.numCameras(); camera++)
+	{
+		const nvstitchCameraMappingMatrix_t &matrix = tables.matrix(camera);
+		uint32_t width = matrix.input_size.x;
+		uint32_t height = matrix.input_size.y;
+		uint32_t chromaWidth = (width + 1) / 2;
+		uint32_t chromaHeight = (height + 1) / 2;
+		CpuPlanes &input = inputs[camera];
+		remapSource_t &source = sources[camera];
+		switch (format)
+		{
+		case CPUSS_INPUT_I420:
+			input.planes[0].allocate(width, height, 1);
+			input.planes[1].allocate(chromaWidth, chromaHeight, 1);
+			input.planes[2].allocate(chromaWidth, chromaHeight, 1);
+			input.numPlanes = 3;
+			source.format = REMAP_SOURCE_I420;
+			break;
+		case CPUSS_INPUT_NV12:
+			input.planes[0].allocate(width, height, 1);
+			input.planes[1].allocate(chromaWidth, chromaHeight, 2);
+			input.numPlanes = 2;
+			source.format = REMAP_SOURCE_NV12;
+			break;
+		case CPUSS_INPUT_BGR8:
+			input.planes[0].allocate(width, height, 3);
+			input.numPlanes = 1;
+			source.format = REMAP_SOURCE_BGR8;
+			break;
+		default:
+			input.planes[0].allocate(width, height);
+			input.numPlanes = 1;
+			source.format = REMAP_SOURCE_RGBA8;
+			break;
+		}
+		for (uint32_t plane = 0; plane < input.numPlanes; plane++)
+			source.plane[plane] = input.planes[plane].data;
+		source.pitch[0] = input.planes[0].pitch;
+		source.pitch[1] = input.numPlanes > 1 ? input.planes[1].pitch : 0;
+		source.chromaWidth = chromaWidth;
+		source.chromaHeight = chromaHeight;
+		source.keepYuv = keepYuv ? 1 : 0;
+	}
+	inputFormat = format;
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideo_t::allocateOutput(cpussOutputFormat format)
+{
+	if (format != CPUSS_OUTPUT_RGBA8 && (output.width % 2 || output.height % 2))
+	{
+		std::cerr << "A " << output.width << "x" << output.height << " panorama does not subsample to 4:2:0" << std::endl;
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	}
+
+	packed = CpuPlanes();
+	switch (format)
+	{
+	case CPUSS_OUTPUT_I420:
+		packed.planes[0].allocate(output.width, output.height, 1);
+		packed.planes[1].allocate(output.width / 2, output.height / 2, 1);
+		packed.planes[2].allocate(output.width / 2, output.height / 2, 1);
+		packed.numPlanes = 3;
+		break;
+	case CPUSS_OUTPUT_NV12:
+		packed.planes[0].allocate(output.width, output.height, 1);
+		packed.planes[1].allocate(output.width / 2, output.height / 2, 2);
+		packed.numPlanes = 2;
+		break;
+	default:
+		break;
+	}
+	outputFormat = format;
+	planCells();
+	return NVSTITCH_SUCCESS;
+}
+
+// packed, if given, was built from the layout's tables with the current
+// vignetting; otherwise they are packed again
+nvstitchResult
+cpussVideo_t::schedule(cpussRemapOrder newOrder, const PackedRemapTables *packed)
+{
+	const RemapTables &tables = layout->tables;
+	RemapSchedule &target = layout->schedules[newOrder];
+	if (target.tiles().empty())
+	{
+		auto start = std::chrono::steady_clock::now();
+		PackedRemapTables own;
+		if (packed == nullptr)
+		{
+			// The layout cache keeps the packed tables for orders asked for
+			// after the first
+			std::string path;
+			uint64_t key;
+			RemapLayoutReader reader;
+			if (!layoutCache(&path, &key) || !reader.open(path, key) || !own.load(reader, tables))
+			{
+				nvstitchResult result = own.build(tables, *pool, lenses());
+				if (result != NVSTITCH_SUCCESS)
+					return result;
+			}
+			packed = &own;
+		}
+
+		// The shape search costs as much as the layout; tables bring the
+		// shape they were first saved with. Only a shape read back with the
+		// tables from their cache file counts as cached; built tables had
+		// it searched for just now.
+		uint32_t tileWidth, tileHeight;
+		bool knownShape = newOrder == CPUSS_REMAP_ORDER_TILED && tables.tileShape(tileBudget(), &tileWidth, &tileHeight);
+		if (knownShape)
+			target.buildShape(*packed, tileWidth, tileHeight, *pool);
+		else if (newOrder == CPUSS_REMAP_ORDER_TILED)
+			target.buildTiled(*packed, tileBudget(), *pool);
+		else
+			target.buildRows(*packed, *pool);
+		target.layout(*packed, ACC_PIXELS, REMAP_SPAN_MAX_CAMERAS, *pool);
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		reportSchedule(target, tables, knownShape && tables.fromCache() ? "scheduled from the cached shape" : "scheduled", ms);
+	}
+	order = newOrder;
+	planCells();
+	return NVSTITCH_SUCCESS;
+}
+
+// Vignetting changes the packed weights, the blocks' samples and the gains'
+// sample grid, so all of them are laid out again; the tables themselves stay
+nvstitchResult
+cpussVideo_t::setVignetting(const float *coefficients)
+{
+	std::vector<LensVignetting> models(rig.num_cameras);
+	bool enabled = false;
+	for (uint32_t camera = 0; camera < rig.num_cameras; camera++)
+	{
+		const float *own = coefficients != nullptr ? coefficients + camera * VIGNETTING_COEFFICIENTS : nullptr;
+		nvstitchResult result = models[camera].init(cameras[camera], own);
+		if (result != NVSTITCH_SUCCESS)
+			return result;
+		enabled = enabled || models[camera].enabled();
+	}
+
+	// A layout being built for another rotation has the old weights
+	if (builder.joinable())
+		builder.join();
+	nextReady.store(false, std::memory_order_relaxed);
+	next.reset();
+
+	if (enabled)
+		vignetting.swap(models);
+	else
+		vignetting.clear();
+	cpussRemapOrder current = order;
+	nvstitchResult result = layOut();
+	if (result != NVSTITCH_SUCCESS)
+		return result;
+	return schedule(current);
+}
+
+void
+cpussVideo_t::planCells()
+{
+	cellTiles.clear();
+	cellsPending.reset();
+	uint32_t band = cellBand();
+	if (band == 1)
+		return;
+
+	const RemapSchedule &plan = layout->schedules[order];
+	cellColumns = (output.width + plan.tileWidth() - 1) / plan.tileWidth();
+	cellTiles.assign((size_t)output.height / band * cellColumns, 0);
+	for (const remapTile_t &tile : plan.tiles())
+		for (uint32_t y = tile.y0 / band; y < (tile.y1 + band - 1) / band; y++)
+			cellTiles[(size_t)y * cellColumns + tile.x0 / plan.tileWidth()]++;
+	cellsPending.reset(new std::atomic<uint32_t>[cellTiles.size()]);
+}
+
+// Everything made from a cell or block of the panorama once it is final
+void
+cpussVideo_t::finish(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+	if (!levels.empty())
+		reduce(x0, y0, x1, y1);
+	if (outputFormat != CPUSS_OUTPUT_RGBA8)
+		pack(x0, y0, x1, y1);
+}
+
+// Every level from the one before, a band of 2^levels.size() rows at a time,
+// so the rows each level is reduced from were written just before
+void
+cpussVideo_t::reduce(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+	uint32_t band = 1u << levels.size();
+	for (uint32_t y = y0; y < y1; y += band)
+	{
+		for (uint32_t index = 1; index <= levels.size(); index++)
+		{
+			const CpuImage &src = level(index - 1);
+			const CpuImage &dst = level(index);
+			uint32_t left = x0 >> index;
+			uint32_t width = (x1 - x0) >> index;
+			for (uint32_t row = y >> index; row < (y + band) >> index; row++)
+			{
+				const unsigned char *top = src.data + (size_t)row * 2 * src.pitch + (size_t)left * 8;
+				downsampleRow(top, top + src.pitch, width, dst.data + (size_t)row * dst.pitch + (size_t)left * 4);
+			}
+		}
+	}
+}
+
+// Pairs of rows into the 4:2:0 planes; x0, y0, x1 and y1 are even
+void
+cpussVideo_t::pack(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+	const packYuvMatrix_t *matrix = keepYuv ? &packYuvSplit :
+		(inputFormat == CPUSS_INPUT_BGR8 ? &packYuvBt601Bgr : &packYuvBt601);
+	const CpuImage &luma = packed.planes[0];
+	const CpuImage &chroma = packed.planes[1];
+	uint32_t step = outputFormat == CPUSS_OUTPUT_NV12 ? 2 : 1;
+	for (uint32_t y = y0; y < y1; y += 2)
+	{
+		const unsigned char *top = output.data + (size_t)y * output.pitch + (size_t)x0 * 4;
+		unsigned char *lumaTop = luma.data + (size_t)y * luma.pitch + x0;
+		size_t offset = (size_t)(y / 2) * chroma.pitch + (size_t)(x0 / 2) * step;
+		unsigned char *u = chroma.data + offset;
+		unsigned char *v = step == 2 ? u + 1 : packed.planes[2].data + offset;
+		packYuvRows(matrix, top, top + output.pitch, x1 - x0, lumaTop, lumaTop + luma.pitch, u, v, step);
+	}
+}
+
+// Pixels no camera sees are never written, so they keep what this leaves:
+// black, as Y, U and V when the working image holds them
+void
+cpussVideo_t::clearOutput()
+{
+	const unsigned char black[4] = { 16, 128, 128, 0 };
+	if (keepYuv)
+		output.fill(black);
+	else
+		output.clear();
+	for (CpuImage &image : levels)
+		image.clear();
+}
+
+void
+cpussVideo_t::stitchTile(size_t index)
+{
+	const RemapSchedule &plan = layout->schedules[order];
+	const remapTile_t &tile = plan.tiles()[index];
+	const RemapSchedule::Run *run = plan.tileRunsBegin(index);
+	const RemapSchedule::Run *end = plan.tileRunsEnd(index);
+
+	uint32_t acc[ACC_PIXELS * 4];
+	const remapSource_t *spanSources[REMAP_SPAN_MAX_CAMERAS];
+	remapTaps_t taps[REMAP_SPAN_MAX_CAMERAS];
+	for (uint32_t y = tile.y0; y < tile.y1; y++)
+	{
+		for (uint32_t x0 = tile.x0; x0 < tile.x1; x0 += ACC_PIXELS)
+		{
+			uint32_t x1 = x0 + ACC_PIXELS < tile.x1 ? x0 + ACC_PIXELS : tile.x1;
+			unsigned char *dst = output.data + (size_t)y * output.pitch;
+
+			// Fused spans lead the block, each written in one pass from the
+			// blend runs that follow it
+			for (; run != end && run->y == y && run->x < x1 && run->kind == RemapSchedule::RUN_FUSED; run += run->camera + 1)
+			{
+				uint32_t cameras = run->camera;
+				for (uint32_t k = 0; k < cameras; k++)
+				{
+					const RemapSchedule::Run &blend = run[k + 1];
+					spanSources[k] = &sources[blend.camera];
+					taps[k].xy = plan.xy() + blend.offset;
+					taps[k].frac = plan.frac() + blend.offset;
+					taps[k].weight = plan.weight() + blend.offset;
+					taps[k].gain = layout->gains.fixedGains(blend.camera);
+				}
+				spanKernels[cameras](spanSources, taps, run->count, dst + (size_t)run->x * 4);
+			}
+
+			// The other overlap spans come next; only they are accumulated
+			const RemapSchedule::Run *spans = run;
+			for (; run != end && run->y == y && run->x < x1 && run->kind == RemapSchedule::RUN_OVERLAP; run++)
+				memset(acc + (run->x - x0) * 4, 0, sizeof(uint32_t) * run->count * 4);
+			const RemapSchedule::Run *spansEnd = run;
+
+			// Pixels one camera sees alone are written directly; in the
+			// spans each camera adds its weighted samples, and the weights
+			// sum to 1, or to what the gains' vignetting peaks make up
+			for (; run != end && run->y == y && run->x < x1; run++)
+			{
+				const remapSource_t *source = &sources[run->camera];
+				const uint32_t *gain = layout->gains.fixedGains(run->camera);
+				if (run->kind == RemapSchedule::RUN_COPY)
+				{
+					taps[0].xy = plan.xy() + run->offset;
+					taps[0].frac = plan.frac() + run->offset;
+					taps[0].weight = plan.weight() + run->offset;
+					taps[0].gain = gain;
+					spanKernels[1](&source, taps, run->count, dst + (size_t)run->x * 4);
+				}
+				else
+					remapAccumulateSourceRow(source,
+						plan.xy() + run->offset, plan.frac() + run->offset, plan.weight() + run->offset,
+						gain, run->count, acc + (run->x - x0) * 4);
+			}
+
+			for (const RemapSchedule::Run *span = spans; span != spansEnd; span++)
+				remapResolveRow(acc + (span->x - x0) * 4, span->count, dst + (size_t)span->x * 4);
+		}
+	}
+
+	// Tiles at least a band tall finish their own rows; shorter ones leave
+	// it to whichever finishes the band
+	uint32_t band = cellBand();
+	if (band == 1)
+		return;
+	for (uint32_t y = tile.y0 / band; y < (tile.y1 + band - 1) / band; y++)
+	{
+		std::atomic<uint32_t> &pending = cellsPending[(size_t)y * cellColumns + tile.x0 / plan.tileWidth()];
+		if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			finish(tile.x0, y * band, tile.x1, (y + 1) * band);
+	}
+}
+
+nvstitchResult
+cpussVideo_t::stitch()
+{
+	auto start = std::chrono::steady_clock::now();
+	stabilize();
+
+	// 4:2:0 in and out need RGB only for the gains and the levels
+	bool keep = (inputFormat == CPUSS_INPUT_I420 || inputFormat == CPUSS_INPUT_NV12) &&
+		outputFormat != CPUSS_OUTPUT_RGBA8 && gainMode == CPUSS_GAIN_OFF && levels.empty() && vignetting.empty();
+	if (keep != keepYuv)
+	{
+		keepYuv = keep;
+		for (remapSource_t &source : sources)
+			source.keepYuv = keep ? 1 : 0;
+		clearOutput();
+	}
+	for (uint32_t cameras = 1; cameras <= REMAP_SPAN_MAX_CAMERAS; cameras++)
+		spanKernels[cameras] = remapSelectSpanKernel(sources[0].format, keepYuv, cameras, !vignetting.empty());
+
+	StitchLayout &current = *layout;
+	if (gainMode != CPUSS_GAIN_OFF)
+		current.gains.update(sources.data());
+	for (size_t cell = 0; cell < cellTiles.size(); cell++)
+		cellsPending[cell].store(cellTiles[cell], std::memory_order_relaxed);
+	pool->parallelFor(current.schedules[order].tiles().size(), [this](size_t tile) { stitchTile(tile); });
+
+	// Blended blocks replace what their tiles finished, so they are reduced
+	// and packed again as each is written back. They are reported out to
+	// multiples of MULTIBAND_BLOCK_ALIGN pixels, so they never split a band.
+	if (blendMode == CPUSS_BLEND_MULTIBAND)
+	{
+		MultiBandBlender::BlockWritten written;
+		if (cellBand() > 1)
+			written = [this](uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) { finish(x0, y0, x1, y1); };
+		current.blender.blend(sources.data(), current.gains.fixedGains(), output.data, output.pitch,
+			*pool, written);
+	}
+
+	// Every thread's stitch time earns the layout builder its share, up to
+	// one build's worth
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	budgetMs += CPUSS_STABILIZE_BUDGET * ms * pool->size();
+	if (budgetMs > buildMs)
+		budgetMs = buildMs;
+	return NVSTITCH_SUCCESS;
+}
+
+// Angle of the rotation taking one orientation to the other
+static float
+quatAngle(const Quat &a, const Quat &b)
+{
+	float dot = fabsf(a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z);
+	return 2.0f * acosf(dot < 1.0f ? dot : 1.0f);
+}
+
+// Before each stitch: take up a layout built since the last one, split the
+// rig's orientation, and start a build for the rotation if the layout is
+// off by more than the tolerance and the budget allows
+void
+cpussVideo_t::stabilize()
+{
+	if (nextReady.load(std::memory_order_acquire))
+	{
+		builder.join();
+		nextReady.store(false, std::memory_order_relaxed);
+		budgetMs -= nextMs;
+		buildMs = nextMs;
+		if (next)
+		{
+			// The layout was built for the order of its time; if packing
+			// another one fails, the old layout stays in use
+			next->gains.carryOver(layout->gains);
+			std::unique_ptr<StitchLayout> previous = std::move(layout);
+			layout = std::move(next);
+			if (schedule(order) != NVSTITCH_SUCCESS)
+			{
+				std::cerr << "CPU stitcher could not schedule the layout for the rig's orientation" << std::endl;
+				layout = std::move(previous);
+			}
+			else
+			{
+				rebuilds++;
+
+				// Pixels no camera sees are never written, and those of the
+				// old tables are elsewhere
+				clearOutput();
+			}
+		}
+	}
+	if (rig.num_cameras == 0)
+		return;
+
+	// The rig's yaw, about the vertical, turns an equirectangular panorama
+	// by whole columns, so the output is shifted by it as it is copied. The
+	// tilt left over is remapped.
+	Quat yaw = quatNormalize(Quat{ orientation.w, 0.0f, orientation.y, 0.0f });
+	Quat tilt = quatMultiply(quatConjugate(yaw), orientation);
+	shift = 0;
+	switch (stabilizeMode)
+	{
+	case CPUSS_STABILIZE_HORIZON:
+		rotation = tilt;
+		break;
+	case CPUSS_STABILIZE_WORLD:
+		if ((cpussProjection)props.projection == CPUSS_PROJECTION_EQUIRECTANGULAR)
+		{
+			// Whole chroma columns for 4:2:0 output
+			float turn = atan2f(yaw.y, yaw.w) / PI;
+			long step = outputFormat == CPUSS_OUTPUT_RGBA8 ? 1 : 2;
+			long columns = lroundf(turn * output.width / step) * step % (long)output.width;
+			shift = (uint32_t)(columns < 0 ? columns + output.width : columns);
+			rotation = tilt;
+		}
+		else
+			rotation = orientation;
+		break;
+	default:
+		rotation = quatIdentity();
+		break;
+	}
+
+	if (builder.joinable() || quatAngle(rotation, layout->rotation) <= tolerance || budgetMs < buildMs)
+		return;
+	const RemapSchedule &plan = layout->schedules[order];
+	builder = std::thread(&cpussVideo_t::buildLayout, this, rotation, order, plan.tileWidth(), plan.tileHeight());
+}
+
+// On the builder thread, which has one core to itself so the stitches keep
+// the pool. The tile shape is kept from the current layout rather than
+// searched for again.
+void
+cpussVideo_t::buildLayout(Quat target, cpussRemapOrder layoutOrder, uint32_t tileWidth, uint32_t tileHeight)
+{
+	auto start = std::chrono::steady_clock::now();
+	ThreadPool single(1);
+	std::unique_ptr<StitchLayout> built(new StitchLayout());
+	built->rotation = target;
+
+	float turn[9];
+	quatToTransform(quatConjugate(target), turn);
+	PackedRemapTables packed;
+	if (built->tables.build(props, rig, single, turn) == NVSTITCH_SUCCESS &&
+		packed.build(built->tables, single, lenses()) == NVSTITCH_SUCCESS &&
+		built->blender.build(built->tables, packed, featherWidth, single, lenses()) == NVSTITCH_SUCCESS)
+	{
+		RemapSchedule &plan = built->schedules[layoutOrder];
+		plan.buildShape(packed, tileWidth, tileHeight, single);
+		plan.layout(packed, ACC_PIXELS, REMAP_SPAN_MAX_CAMERAS, single);
+		built->gains.build(built->tables, lenses());
+	}
+	else
+	{
+		std::cerr << "CPU stitcher could not lay out the panorama for the rig's orientation" << std::endl;
+		built.reset();
+	}
+
+	next = std::move(built);
+	nextMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	nextReady.store(true, std::memory_order_release);
+}
+
+// Columns a level is shifted by as it is copied out
+uint32_t
+cpussVideo_t::columnOffset(uint32_t index) const
+{
+	return ((shift + ((1u << index) >> 1)) >> index) % level(index).width;
+}
+
+//***********************************************************************************
+nvstitchResult
+cpussVideoCreateInstance(const nvssVideoStitcherProperties_t *stitcher_props,
+	const nvstitchVideoRigProperties_t *rig_props, cpussVideoHandle *handle)
+{
+	return cpussVideoCreateInstanceWithCache(stitcher_props, rig_props, nullptr, handle);
+}
+
+nvstitchResult
+cpussVideoCreateInstanceWithCache(const nvssVideoStitcherProperties_t *stitcher_props,
+	const nvstitchVideoRigProperties_t *rig_props, const char *cache_dir, cpussVideoHandle *handle)
+{
+	if (stitcher_props == nullptr || rig_props == nullptr || handle == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (stitcher_props->version != NVSTITCH_VERSION)
+		return NVSTITCH_ERROR_INVALID_VERSION;
+
+	std::unique_ptr<cpussVideo_t> instance(new cpussVideo_t());
+	nvstitchResult result = instance->init(*stitcher_props, *rig_props, cache_dir);
+	if (result != NVSTITCH_SUCCESS)
+		return result;
+	*handle = instance.release();
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoCreateInstanceWithMapping(const nvssVideoStitcherProperties_t *stitcher_props,
+	const nvstitchCameraMapping_t *cam_mappings, cpussVideoHandle *handle)
+{
+	if (stitcher_props == nullptr || cam_mappings == nullptr || handle == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (stitcher_props->version != NVSTITCH_VERSION)
+		return NVSTITCH_ERROR_INVALID_VERSION;
+
+	std::unique_ptr<cpussVideo_t> instance(new cpussVideo_t());
+	nvstitchResult result = instance->init(*stitcher_props, *cam_mappings);
+	if (result != NVSTITCH_SUCCESS)
+		return result;
+	*handle = instance.release();
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoGetMapping(cpussVideoHandle handle, const nvstitchCameraMapping_t **cam_mappings)
+{
+	if (handle == nullptr || cam_mappings == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	*cam_mappings = &handle->layout->tables.mapping();
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoWriteCoverage(cpussVideoHandle handle, const char *prefix)
+{
+	if (handle == nullptr || prefix == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (!handle->layout->tables.writeCoverage(prefix))
+	{
+		std::cerr << "Could not write coverage masks to " << prefix << "_*.pgm" << std::endl;
+		return NVSTITCH_ERROR_GENERAL;
+	}
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoSetRemapOrder(cpussVideoHandle handle, cpussRemapOrder order)
+{
+	if (handle == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (order != CPUSS_REMAP_ORDER_ROWS && order != CPUSS_REMAP_ORDER_TILED)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+
+	return handle->schedule(order);
+}
+
+nvstitchResult
+cpussVideoGetRemapSchedule(cpussVideoHandle handle, cpussRemapOrder order, cpussRemapSchedule_t *schedule)
+{
+	if (handle == nullptr || schedule == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (order != CPUSS_REMAP_ORDER_ROWS && order != CPUSS_REMAP_ORDER_TILED)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+
+	const RemapSchedule &source = handle->layout->schedules[order];
+	if (source.tiles().empty())
+		return NVSTITCH_ERROR_BAD_STATE;
+	schedule->tile_width = source.tileWidth();
+	schedule->tile_height = source.tileHeight();
+	schedule->num_tiles = (uint32_t)source.tiles().size();
+	schedule->mean_footprint = source.meanFootprint();
+	schedule->max_footprint = source.maxFootprint();
+	schedule->copy_pixels = source.copyPixels();
+	schedule->overlap_pixels = source.overlapPixels();
+	schedule->fused_pixels = source.fusedPixels();
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoSetBlendMode(cpussVideoHandle handle, cpussBlendMode mode)
+{
+	if (handle == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (mode != CPUSS_BLEND_FEATHER && mode != CPUSS_BLEND_MULTIBAND)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+
+	handle->blendMode = mode;
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoGetBlendBands(cpussVideoHandle handle, cpussBlendBands_t *bands)
+{
+	if (handle == nullptr || bands == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+
+	const MultiBandBlender &blender = handle->layout->blender;
+	bands->levels = blender.levels();
+	bands->block_size = blender.blockSize();
+	bands->num_blocks = (uint32_t)blender.numBlocks();
+	bands->blended_pixels = blender.blendedPixels();
+	bands->window_pixels = blender.windowPixels();
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoSetGainCompensation(cpussVideoHandle handle, cpussGainMode mode, float smoothing)
+{
+	if (handle == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if ((mode != CPUSS_GAIN_OFF && mode != CPUSS_GAIN_CAMERA && mode != CPUSS_GAIN_CHANNEL) ||
+		!(smoothing > 0.0f && smoothing <= 1.0f))
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+
+	GainCompensator &gains = handle->layout->gains;
+	if (mode != handle->gainMode)
+		gains.reset();
+	gains.setPerChannel(mode == CPUSS_GAIN_CHANNEL);
+	gains.setSmoothing(smoothing);
+	handle->gainMode = mode;
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoGetCameraGains(cpussVideoHandle handle, uint32_t camera, float gains[3])
+{
+	if (handle == nullptr || gains == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (camera >= handle->layout->gains.numCameras())
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+
+	memcpy(gains, handle->layout->gains.gains(camera), 3 * sizeof(float));
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoSetVignetting(cpussVideoHandle handle, const float *coefficients)
+{
+	if (handle == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (handle->rig.num_cameras == 0)
+	{
+		std::cerr << "CPU stitcher needs the rig, not projection maps, to correct vignetting" << std::endl;
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	}
+
+	return handle->setVignetting(coefficients);
+}
+
+nvstitchResult
+cpussVideoDestroyInstance(cpussVideoHandle handle)
+{
+	if (handle == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	delete handle;
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoGetInputBuffer(cpussVideoHandle handle, uint32_t camera, nvstitchImageBuffer_t *buffer)
+{
+	if (handle == nullptr || buffer == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (camera >= handle->inputs.size())
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	if (handle->inputFormat != CPUSS_INPUT_RGBA8)
+		return NVSTITCH_ERROR_BAD_STATE;
+
+	handle->inputs[camera].planes[0].describe(buffer);
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoSetInputFormat(cpussVideoHandle handle, cpussInputFormat format)
+{
+	if (handle == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (format != CPUSS_INPUT_RGBA8 && format != CPUSS_INPUT_I420 && format != CPUSS_INPUT_NV12 &&
+		format != CPUSS_INPUT_BGR8)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	if (format == handle->inputFormat)
+		return NVSTITCH_SUCCESS;
+	return handle->allocateInputs(format);
+}
+
+nvstitchResult
+cpussVideoGetInputPlanes(cpussVideoHandle handle, uint32_t camera, cpussInputPlanes_t *planes)
+{
+	if (handle == nullptr || planes == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (camera >= handle->inputs.size())
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+
+	const CpuPlanes &input = handle->inputs[camera];
+	*planes = cpussInputPlanes_t();
+	planes->format = handle->inputFormat;
+	planes->num_planes = input.numPlanes;
+	for (uint32_t plane = 0; plane < input.numPlanes; plane++)
+		input.planes[plane].describe(&planes->planes[plane]);
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoGetOutputBuffer(cpussVideoHandle handle, nvstitchEye eye, nvstitchImageBuffer_t *buffer)
+{
+	if (handle == nullptr || buffer == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (eye != NVSTITCH_EYE_MONO)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	if (handle->outputFormat != CPUSS_OUTPUT_RGBA8)
+		return NVSTITCH_ERROR_BAD_STATE;
+
+	handle->output.describe(buffer);
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoSetOutputFormat(cpussVideoHandle handle, cpussOutputFormat format)
+{
+	if (handle == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (format != CPUSS_OUTPUT_RGBA8 && format != CPUSS_OUTPUT_I420 && format != CPUSS_OUTPUT_NV12)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	if (format == handle->outputFormat)
+		return NVSTITCH_SUCCESS;
+	return handle->allocateOutput(format);
+}
+
+nvstitchResult
+cpussVideoGetOutputPlanes(cpussVideoHandle handle, cpussOutputPlanes_t *planes)
+{
+	if (handle == nullptr || planes == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+
+	*planes = cpussOutputPlanes_t();
+	planes->format = handle->outputFormat;
+	if (handle->outputFormat == CPUSS_OUTPUT_RGBA8)
+	{
+		planes->num_planes = 1;
+		handle->output.describe(&planes->planes[0]);
+		return NVSTITCH_SUCCESS;
+	}
+	planes->num_planes = handle->packed.numPlanes;
+	for (uint32_t plane = 0; plane < handle->packed.numPlanes; plane++)
+		handle->packed.planes[plane].describe(&planes->planes[plane]);
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoSetOutputLevels(cpussVideoHandle handle, uint32_t levels)
+{
+	if (handle == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (levels < 1 || levels > CPUSS_MAX_OUTPUT_LEVELS)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	uint32_t band = 1u << (levels - 1);
+	if (handle->output.width % band || handle->output.height % band)
+	{
+		std::cerr << "A " << handle->output.width << "x" << handle->output.height << " panorama does not halve "
+			<< levels - 1 << " times" << std::endl;
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	}
+
+	handle->levels.resize(levels - 1);
+	for (uint32_t index = 1; index < levels; index++)
+		handle->levels[index - 1].allocate(handle->output.width >> index, handle->output.height >> index);
+	handle->planCells();
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoGetOutputLevel(cpussVideoHandle handle, uint32_t level, nvstitchImageBuffer_t *buffer)
+{
+	if (handle == nullptr || buffer == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (level > handle->levels.size())
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	if (level == 0 && handle->outputFormat != CPUSS_OUTPUT_RGBA8)
+		return NVSTITCH_ERROR_BAD_STATE;
+
+	handle->level(level).describe(buffer);
+	return NVSTITCH_SUCCESS;
+}
+
+// Column x of the image is copied to x + columns, wrapping around
+static void
+copyShifted(const CpuImage &image, uint32_t columns, void *dst, size_t pitch)
+{
+	size_t shift = (size_t)columns * image.bytesPerPixel;
+	size_t rowBytes = (size_t)image.width * image.bytesPerPixel;
+	for (uint32_t y = 0; y < image.height; y++)
+	{
+		const unsigned char *src = image.data + (size_t)y * image.pitch;
+		unsigned char *row = (unsigned char *)dst + (size_t)y * pitch;
+		memcpy(row + shift, src, rowBytes - shift);
+		memcpy(row, src + rowBytes - shift, shift);
+	}
+}
+
+nvstitchResult
+cpussVideoCopyOutput(cpussVideoHandle handle, uint32_t level, void *dst, size_t pitch)
+{
+	if (handle == nullptr || dst == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if (level > handle->levels.size())
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	if (level == 0 && handle->outputFormat != CPUSS_OUTPUT_RGBA8)
+		return NVSTITCH_ERROR_BAD_STATE;
+
+	copyShifted(handle->level(level), handle->columnOffset(level), dst, pitch);
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoCopyOutputPlanes(cpussVideoHandle handle, void *const dst[3], const size_t pitches[3])
+{
+	if (handle == nullptr || dst == nullptr || pitches == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+
+	// The shift is even for 4:2:0, so it halves exactly for chroma
+	uint32_t columns = handle->columnOffset(0);
+	if (handle->outputFormat == CPUSS_OUTPUT_RGBA8)
+	{
+		if (dst[0] == nullptr)
+			return NVSTITCH_ERROR_NULL_POINTER;
+		copyShifted(handle->output, columns, dst[0], pitches[0]);
+		return NVSTITCH_SUCCESS;
+	}
+	for (uint32_t plane = 0; plane < handle->packed.numPlanes; plane++)
+	{
+		if (dst[plane] == nullptr)
+			return NVSTITCH_ERROR_NULL_POINTER;
+		const CpuImage &image = handle->packed.planes[plane];
+		copyShifted(image, plane == 0 ? columns : columns / 2, dst[plane], pitches[plane]);
+	}
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoSetStabilization(cpussVideoHandle handle, cpussStabilizeMode mode, float tolerance_deg)
+{
+	if (handle == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	if ((mode != CPUSS_STABILIZE_OFF && mode != CPUSS_STABILIZE_HORIZON && mode != CPUSS_STABILIZE_WORLD) ||
+		!(tolerance_deg >= 0.0f && tolerance_deg < 180.0f))
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	if (handle->rig.num_cameras == 0)
+	{
+		std::cerr << "CPU stitcher needs the rig, not projection maps, to stabilize the panorama" << std::endl;
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	}
+
+	handle->stabilizeMode = mode;
+	handle->tolerance = tolerance_deg * PI / 180.0f;
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoSetRigOrientation(cpussVideoHandle handle, const float orientation[4])
+{
+	if (handle == nullptr || orientation == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+
+	handle->orientation = quatNormalize(Quat{ orientation[0], orientation[1], orientation[2], orientation[3] });
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoGetStabilization(cpussVideoHandle handle, cpussStabilization_t *stabilization)
+{
+	if (handle == nullptr || stabilization == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+
+	stabilization->residual_deg = quatAngle(handle->rotation, handle->layout->rotation) * 180.0f / PI;
+	stabilization->column_offset = handle->shift;
+	stabilization->rebuilds = handle->rebuilds;
+	stabilization->rebuilding = handle->builder.joinable() ? 1 : 0;
+	stabilization->rebuild_ms = (float)handle->buildMs;
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+cpussVideoStitch(cpussVideoHandle handle)
+{
+	if (handle == nullptr)
+		return NVSTITCH_ERROR_NULL_POINTER;
+	return handle->stitch();
+}
@@ -0,0 +1,348 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nvss_video.h"
+
+// ==== CPU mono stitcher ====
+// Drop-in for the nvssVideo* lifecycle on machines without a CUDA device:
+// create an instance from the same stitcher and rig properties, write RGBA
+// (or 4:2:0 YUV, see cpussVideoSetInputFormat) camera images into the input
+// buffers, stitch, read the panorama from the output buffer (or 4:2:0
+// planes, see cpussVideoSetOutputFormat). Buffers are in system memory, so
+// dev_ptr in nvstitchImageBuffer_t is a host pointer and needs no
+// cudaMemcpy.
+//
+// Only NVSTITCH_STITCHER_PIPELINE_MONO is supported. num_gpus and ptr_gpus
+// are ignored; the output is split into tiles stitched on one thread per core.
+// Besides equirectangular, the output can be a 3x2 cubemap or equi-angular
+// cubemap (output_projection.h). pano_width still sets the resolution at the
+// equator, so the output is 3/4 pano_width by 1/2 pano_width, a quarter fewer
+// pixels, and the remap tables are built and cached for that projection.
+//
+// Each output pixel is a weighted sum of camera samples looked up in remap
+// tables (remap_lut.h), built from the rig when the instance is created, and
+// sampled in fixed point by the SIMD kernels in remap_kernels.h. Pixels only
+// one camera sees are plain remapped copies; pixels no camera sees stay
+// black. Seams are then blended multi-band (multiband_blend.h), the coarsest
+// band over about feather_width output pixels. Optionally, each camera's
+// exposure is matched to its neighbours' by gains (gain_compensation.h)
+// applied as it is sampled, and lens vignetting is corrected through the
+// blend weights.
+
+typedef struct cpussVideo_t* cpussVideoHandle;
+
+// Output projections. nvss knows only equirectangular; the cubemaps are the
+// CPU stitcher's own, so nvstitchPanoramaProjectionType leaves them out.
+// The CPU stitcher takes any of these in the projection of its
+// nvssVideoStitcherProperties_t, cast; they must never reach nvss.
+typedef enum
+{
+	CPUSS_PROJECTION_EQUIRECTANGULAR = NVSTITCH_PANORAMA_PROJECTION_EQUIRECTANGULAR,
+	CPUSS_PROJECTION_CUBEMAP = 1,               //!< Six 90 degree faces in a 3x2 layout, pano_width / 4 pixels each
+	CPUSS_PROJECTION_EQUIANGULAR_CUBEMAP = 2,   //!< Cubemap layout with pixels spaced by equal angles
+}
+cpussProjection;
+
+nvstitchResult cpussVideoCreateInstance(const nvssVideoStitcherProperties_t *stitcher_props,
+	const nvstitchVideoRigProperties_t *rig_props, cpussVideoHandle *handle);
+
+// As above, keeping the remap tables in cache_dir: a later instance for the
+// same rig and output size maps them from there instead of building them.
+// What is laid out from them, the packed tables, the tiled schedule and the
+// seam blocks, is kept beside them for each feather width and vignetting
+// set, and read back the same way. A null cache_dir builds every time.
+nvstitchResult cpussVideoCreateInstanceWithCache(const nvssVideoStitcherProperties_t *stitcher_props,
+	const nvstitchVideoRigProperties_t *rig_props, const char *cache_dir, cpussVideoHandle *handle);
+
+// From projection maps instead of a rig, as
+// nvssVideoCreateInstanceWithMapping. The maps must be equirectangular at
+// the output resolution; (u, v) outside the camera image marks pixels the
+// camera does not see.
+nvstitchResult cpussVideoCreateInstanceWithMapping(const nvssVideoStitcherProperties_t *stitcher_props,
+	const nvstitchCameraMapping_t *cam_mappings, cpussVideoHandle *handle);
+
+// The instance's projection maps, valid until it is destroyed or, when it
+// is stabilized, until a stitch takes up tables for a new orientation
+nvstitchResult cpussVideoGetMapping(cpussVideoHandle handle, const nvstitchCameraMapping_t **cam_mappings);
+
+// Debug: write where each camera sees, inside its fisheye circle and image,
+// as prefix_camN.pgm, and how many cameras see each pixel as prefix_count.pgm
+nvstitchResult cpussVideoWriteCoverage(cpussVideoHandle handle, const char *prefix);
+
+// Order in which output tiles are remapped. Tiled, the default, is chosen
+// when the instance is created so each tile's source footprint fits in L2;
+// rows walk the panorama top to bottom, for comparison.
+typedef enum
+{
+	CPUSS_REMAP_ORDER_ROWS = 0,
+	CPUSS_REMAP_ORDER_TILED = 1,
+}
+cpussRemapOrder;
+
+typedef struct cpussRemapSchedule_st
+{
+	uint32_t tile_width;
+	uint32_t tile_height;
+	uint32_t num_tiles;
+	size_t mean_footprint;      //!< Estimated bytes of source, tables and output one tile touches
+	size_t max_footprint;
+	size_t copy_pixels;         //!< Output pixels one camera sees alone, remapped without blending
+	size_t overlap_pixels;      //!< Output pixels several cameras share, blended by weight
+	size_t fused_pixels;        //!< Overlap pixels blended in one pass over all their cameras
+}
+cpussRemapSchedule_t;
+
+nvstitchResult cpussVideoSetRemapOrder(cpussVideoHandle handle, cpussRemapOrder order);
+
+// Shape of a schedule; NVSTITCH_ERROR_BAD_STATE until the order has been used
+nvstitchResult cpussVideoGetRemapSchedule(cpussVideoHandle handle, cpussRemapOrder order, cpussRemapSchedule_t *schedule);
+
+// How the cameras are blended across seams. Multi-band, the default, blends
+// each frequency band over a width matching its scale; feathered only
+// crossfades the cameras over feather_width, at no extra cost.
+typedef enum
+{
+	CPUSS_BLEND_FEATHER = 0,
+	CPUSS_BLEND_MULTIBAND = 1,
+}
+cpussBlendMode;
+
+typedef struct cpussBlendBands_st
+{
+	uint32_t levels;            //!< Laplacian levels below full resolution
+	uint32_t block_size;        //!< Seams are blended in square blocks at most this many pixels wide
+	uint32_t num_blocks;        //!< Blocks on a seam or an overlap
+	size_t blended_pixels;      //!< Output pixels those blocks blend
+	size_t window_pixels;       //!< Pixels their pyramids cover, with their padding
+}
+cpussBlendBands_t;
+
+nvstitchResult cpussVideoSetBlendMode(cpussVideoHandle handle, cpussBlendMode mode);
+
+// Where and how finely the multi-band blend works on this rig
+nvstitchResult cpussVideoGetBlendBands(cpussVideoHandle handle, cpussBlendBands_t *bands);
+
+// Exposure compensation between cameras. Off, the default, samples the
+// images as they are; otherwise every stitch estimates a gain per camera, or
+// per camera and color channel, from where the cameras overlap. smoothing,
+// in (0, 1], is the share of each frame's estimate in the gains used, so
+// they follow exposure changes without flickering; 1 uses each frame's own.
+typedef enum
+{
+	CPUSS_GAIN_OFF = 0,
+	CPUSS_GAIN_CAMERA = 1,
+	CPUSS_GAIN_CHANNEL = 2,
+}
+cpussGainMode;
+
+nvstitchResult cpussVideoSetGainCompensation(cpussVideoHandle handle, cpussGainMode mode, float smoothing);
+
+// Gains applied to a camera's first three channels in the last stitch
+nvstitchResult cpussVideoGetCameraGains(cpussVideoHandle handle, uint32_t camera, float gains[3]);
+
+// Lens vignetting correction, three coefficients per camera in rig order:
+// each sample is brightened by 1 + v1 r^2 + v2 r^4 + v3 r^6, r its distance
+// from the principal point relative to the fisheye radius, or to half the
+// image diagonal (camera_model.h). The correction is folded into the blend
+// weights and gains when the tables are packed, so stitches cost the same
+// with it. Setting it packs the tables and lays out the seams again, or
+// reads them from the cache, and restarts the gains; null, or all 0, turns it off. 4:2:0 samples are then
+// converted to RGB, as with gains. Only for instances created from a rig.
+nvstitchResult cpussVideoSetVignetting(cpussVideoHandle handle, const float *coefficients);
+
+nvstitchResult cpussVideoDestroyInstance(cpussVideoHandle handle);
+
+// Host memory for one camera's RGBA input, valid until the instance is
+// destroyed or the input format changes. NVSTITCH_ERROR_BAD_STATE unless the
+// input format is CPUSS_INPUT_RGBA8.
+nvstitchResult cpussVideoGetInputBuffer(cpussVideoHandle handle, uint32_t camera, nvstitchImageBuffer_t *buffer);
+
+// Format of the camera inputs. Besides RGBA, the default, the inputs can take
+// a video decoder's 4:2:0 planes as they are, 1.5 bytes a pixel instead of 4,
+// with no conversion ahead of the stitch: I420 (Y, U, V planes) or NV12 (Y,
+// then interleaved UV). The remap kernels read luma at each table position
+// and chroma at half of it, converting BT.601 limited-range YUV to RGB per
+// sample (remap_yuv_kernels.h); gains, blending and the output stay RGBA.
+// BGR8 takes OpenCV's 3-byte frames as they are, 3 bytes a pixel; the
+// panorama then comes out in their byte order, B, G, R, alpha. Changing the
+// format reallocates the inputs, zeroed.
+typedef enum
+{
+	CPUSS_INPUT_RGBA8 = 0,
+	CPUSS_INPUT_I420 = 1,
+	CPUSS_INPUT_NV12 = 2,
+	CPUSS_INPUT_BGR8 = 3,
+} cpussInputFormat;
+
+typedef struct cpussInputPlanes_st
+{
+	cpussInputFormat format;
+	uint32_t num_planes;            //!< 1 for RGBA8 and BGR8, 3 for I420, 2 for NV12
+	nvstitchImageBuffer_t planes[3];    //!< Chroma planes are half the luma size, rounded up
+} cpussInputPlanes_t;
+
+nvstitchResult cpussVideoSetInputFormat(cpussVideoHandle handle, cpussInputFormat format);
+
+// Host memory for each plane of one camera's input, in any format, valid
+// until the instance is destroyed or the input format changes
+nvstitchResult cpussVideoGetInputPlanes(cpussVideoHandle handle, uint32_t camera, cpussInputPlanes_t *planes);
+
+// The stitched panorama; only NVSTITCH_EYE_MONO. NVSTITCH_ERROR_BAD_STATE
+// unless the output format is CPUSS_OUTPUT_RGBA8.
+nvstitchResult cpussVideoGetOutputBuffer(cpussVideoHandle handle, nvstitchEye eye, nvstitchImageBuffer_t *buffer);
+
+// Format of the panorama. Besides RGBA, the default, it can be written as an
+// encoder takes it, 1.5 bytes a pixel: I420 (Y, U, V planes) or NV12 (Y,
+// then interleaved UV), BT.601 limited range. The tiles are still remapped
+// and blended into an RGBA working image, and each band of two rows is
+// converted to the planes as soon as its tiles are done, while it is still
+// in cache; blended seam blocks are converted again as they are written
+// back (pack_yuv_kernels.h). With 4:2:0 inputs, no gain compensation and no
+// reduced levels, nothing needs RGB: the remap kernels leave the samples as
+// Y, U and V, which are blended as they are and only split into planes.
+// Both sides of the panorama must be even. The reduced levels stay RGBA.
+typedef enum
+{
+	CPUSS_OUTPUT_RGBA8 = 0,
+	CPUSS_OUTPUT_I420 = 1,
+	CPUSS_OUTPUT_NV12 = 2,
+} cpussOutputFormat;
+
+typedef struct cpussOutputPlanes_st
+{
+	cpussOutputFormat format;
+	uint32_t num_planes;            //!< 1 for RGBA8, 3 for I420, 2 for NV12
+	nvstitchImageBuffer_t planes[3];    //!< Chroma planes are half the luma width and height
+} cpussOutputPlanes_t;
+
+nvstitchResult cpussVideoSetOutputFormat(cpussVideoHandle handle, cpussOutputFormat format);
+
+// Host memory for each plane of the panorama, in any format, valid until
+// the instance is destroyed or the output format changes
+nvstitchResult cpussVideoGetOutputPlanes(cpussVideoHandle handle, cpussOutputPlanes_t *planes);
+
+// Copy each plane of the panorama into dst[i], rows pitches[i] bytes apart,
+// shifted for the yaw of the last stitch as cpussVideoCopyOutput; 4:2:0
+// panoramas are shifted by whole chroma columns
+nvstitchResult cpussVideoCopyOutputPlanes(cpussVideoHandle handle, void *const dst[3], const size_t pitches[3]);
+
+// Reduced copies of the panorama, for consumers that want it smaller. With
+// levels above 1, every stitch also writes levels - 1 images, each half the
+// width and height of the one before, its pixels the means of 2x2 boxes.
+// They are reduced band by band as the tiles are stitched, while the output
+// rows are still in cache, and blended seam blocks again as they are written
+// back. Width and height of the panorama must divide by 2^(levels - 1); one
+// level, the default, is the panorama alone.
+#define CPUSS_MAX_OUTPUT_LEVELS 4
+
+nvstitchResult cpussVideoSetOutputLevels(cpussVideoHandle handle, uint32_t levels);
+
+// One level of the output, valid until the levels change; level 0 is the
+// panorama, as cpussVideoGetOutputBuffer, and RGBA8 output only
+nvstitchResult cpussVideoGetOutputLevel(cpussVideoHandle handle, uint32_t level, nvstitchImageBuffer_t *buffer);
+
+// Stabilization against the rig's orientation, from an IMU. Horizon mode
+// levels the panorama and keeps the rig's heading; world mode also holds the
+// heading, so the panorama stays put as the rig turns. Off, the default,
+// stitches as the rig points.
+//
+// The orientation splits into yaw, about the vertical, and the tilt left
+// over. On an equirectangular panorama yaw is a circular shift of columns,
+// applied by cpussVideoCopyOutput as it copies the output out, so it costs
+// nothing and follows every frame. Tilt takes new remap tables: when the
+// tables in use are more than tolerance_deg off, tables for the current
+// orientation are built on a thread of their own, composing the rotation
+// with the panorama's directions, and the first stitch after they are done
+// takes them up. Builds take about as long as creating the instance, so
+// they are paced to cost on average no more than CPUSS_STABILIZE_BUDGET of
+// the stitch time, and meanwhile the output lags the tilt by the residual.
+// Cubemaps have no free yaw, so world mode remaps all of the rotation.
+//
+// Only for instances created from a rig.
+typedef enum
+{
+	CPUSS_STABILIZE_OFF = 0,
+	CPUSS_STABILIZE_HORIZON = 1,
+	CPUSS_STABILIZE_WORLD = 2,
+}
+cpussStabilizeMode;
+
+#define CPUSS_STABILIZE_BUDGET 0.1f
+
+typedef struct cpussStabilization_st
+{
+	float residual_deg;         //!< Rotation left between the tables in use and the last orientation
+	uint32_t column_offset;     //!< Columns the output is shifted by for yaw
+	uint32_t rebuilds;          //!< Tables taken up since the instance was created
+	uint32_t rebuilding;        //!< 1 while tables are being built
+	float rebuild_ms;           //!< How long the last build took
+}
+cpussStabilization_t;
+
+nvstitchResult cpussVideoSetStabilization(cpussVideoHandle handle, cpussStabilizeMode mode, float tolerance_deg);
+
+// Rig to world rotation as a unit quaternion w, x, y, z, in the rig's frame:
+// y up, z forward. Takes effect from the next stitch.
+nvstitchResult cpussVideoSetRigOrientation(cpussVideoHandle handle, const float orientation[4]);
+
+nvstitchResult cpussVideoGetStabilization(cpussVideoHandle handle, cpussStabilization_t *stabilization);
+
+// Copy a level of the output, as cpussVideoGetOutputLevel, into dst rows of
+// pitch bytes, shifted for the yaw of the last stitch; level 0 is RGBA8
+// output only
+nvstitchResult cpussVideoCopyOutput(cpussVideoHandle handle, uint32_t level, void *dst, size_t pitch);
+
+// Stitch the current inputs into the output buffer. Synchronous: the output
+// is complete when this returns.
+nvstitchResult cpussVideoStitch(cpussVideoHandle handle);
@@ -0,0 +1,148 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "downsample_kernels.h"
+#include "cpu_features.h"
+
+#include <immintrin.h>
+
+void downsampleRowScalar(const unsigned char *top, const unsigned char *bottom, uint32_t dstPixels, unsigned char *dst)
+{
+	for (uint32_t i = 0; i < dstPixels; i++)
+	{
+		const unsigned char *t = top + (size_t)i * 8;
+		const unsigned char *b = bottom + (size_t)i * 8;
+		for (int c = 0; c < 4; c++)
+			dst[(size_t)i * 4 + c] = (unsigned char)((t[c] + t[c + 4] + b[c] + b[c + 4] + 2) >> 2);
+	}
+}
+
+//***********************************************************************************
+// SSE4.1: four output pixels per iteration. Columns are summed in 16 bits,
+// then the pixel pairs are gathered into one half each by 64-bit unpacks.
+
+CPU_TARGET_SSE41
+static inline __m128i downsampleQuadSse41(__m128i top, __m128i bottom)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_add_epi16(_mm_cvtepu8_epi16(top), _mm_cvtepu8_epi16(bottom));
+	__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+	return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+}
+
+CPU_TARGET_SSE41
+static void downsampleRowSse41(const unsigned char *top, const unsigned char *bottom, uint32_t dstPixels, unsigned char *dst)
+{
+	const __m128i two = _mm_set1_epi16(2);
+	uint32_t i = 0;
+	for (; i + 4 <= dstPixels; i += 4)
+	{
+		const unsigned char *t = top + (size_t)i * 8;
+		const unsigned char *b = bottom + (size_t)i * 8;
+		__m128i s0 = downsampleQuadSse41(_mm_loadu_si128((const __m128i*)t), _mm_loadu_si128((const __m128i*)b));
+		__m128i s1 = downsampleQuadSse41(_mm_loadu_si128((const __m128i*)(t + 16)), _mm_loadu_si128((const __m128i*)(b + 16)));
+		s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+		s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+		_mm_storeu_si128((__m128i*)(dst + (size_t)i * 4), _mm_packus_epi16(s0, s1));
+	}
+	downsampleRowScalar(top + (size_t)i * 8, bottom + (size_t)i * 8, dstPixels - i, dst + (size_t)i * 4);
+}
+
+//***********************************************************************************
+// AVX2: eight output pixels per iteration. The unpacks work within 128-bit
+// lanes, which leaves the pixels interleaved across lanes until the final
+// permute.
+
+CPU_TARGET_AVX2
+static inline __m256i downsampleOctAvx2(__m256i top, __m256i bottom)
+{
+	__m256i lo = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(top)),
+		_mm256_cvtepu8_epi16(_mm256_castsi256_si128(bottom)));
+	__m256i hi = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(top, 1)),
+		_mm256_cvtepu8_epi16(_mm256_extracti128_si256(bottom, 1)));
+	return _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+}
+
+CPU_TARGET_AVX2
+static void downsampleRowAvx2(const unsigned char *top, const unsigned char *bottom, uint32_t dstPixels, unsigned char *dst)
+{
+	const __m256i two = _mm256_set1_epi16(2);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	uint32_t i = 0;
+	for (; i + 8 <= dstPixels; i += 8)
+	{
+		const unsigned char *t = top + (size_t)i * 8;
+		const unsigned char *b = bottom + (size_t)i * 8;
+		// Pixels 0 2 | 1 3 and 4 6 | 5 7
+		__m256i s0 = downsampleOctAvx2(_mm256_loadu_si256((const __m256i*)t), _mm256_loadu_si256((const __m256i*)b));
+		__m256i s1 = downsampleOctAvx2(_mm256_loadu_si256((const __m256i*)(t + 32)), _mm256_loadu_si256((const __m256i*)(b + 32)));
+		s0 = _mm256_srli_epi16(_mm256_add_epi16(s0, two), 2);
+		s1 = _mm256_srli_epi16(_mm256_add_epi16(s1, two), 2);
+		_mm256_storeu_si256((__m256i*)(dst + (size_t)i * 4),
+			_mm256_permutevar8x32_epi32(_mm256_packus_epi16(s0, s1), order));
+	}
+	downsampleRowScalar(top + (size_t)i * 8, bottom + (size_t)i * 8, dstPixels - i, dst + (size_t)i * 4);
+}
+
+//***********************************************************************************
+void downsampleRow(const unsigned char *top, const unsigned char *bottom, uint32_t dstPixels, unsigned char *dst)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		downsampleRowAvx2(top, bottom, dstPixels, dst);
+		break;
+	case CPU_SIMD_SSE41:
+		downsampleRowSse41(top, bottom, dstPixels, dst);
+		break;
+	default:
+		downsampleRowScalar(top, bottom, dstPixels, dst);
+		break;
+	}
+}
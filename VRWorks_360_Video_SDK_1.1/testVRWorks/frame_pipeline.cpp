@@ -0,0 +1,503 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "frame_pipeline.h"
+#include "frame_trace.h"
+
+#include <iostream>
+#include <string.h>
+#include <thread>
+#include <utility>
+
+using std::chrono::steady_clock;
+
+static double elapsedMs(const steady_clock::time_point &start)
+{
+	return std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+}
+
+const char* frameStageName(frameStage stage)
+{
+	switch (stage)
+	{
+	case FRAME_STAGE_CAPTURE: return "capture";
+	case FRAME_STAGE_SPLIT: return "split";
+	case FRAME_STAGE_CONVERT: return "convert";
+	case FRAME_STAGE_STITCH: return "stitch";
+	case FRAME_STAGE_PUBLISH: return "publish";
+	default: return "unknown";
+	}
+}
+
+//***********************************************************************************
+GstreamerFrameSource::GstreamerFrameSource(const std::string &pipeline)
+	: m_cap(pipeline, cv::CAP_GSTREAMER)
+{
+}
+
+bool
+GstreamerFrameSource::read(cv::Mat &frame)
+{
+	// grab() waits for the next decoded buffer; retrieve() converts it into
+	// frame, reusing frame's buffer when the size does not change
+	{
+		TraceScope trace(TRACE_RECEIVE);
+		if (!m_cap.grab())
+			return false;
+	}
+	TraceScope trace(TRACE_DECODE);
+	return m_cap.retrieve(frame) && !frame.empty();
+}
+
+//***********************************************************************************
+SyntheticFrameSource::SyntheticFrameSource(uint32_t eyeWidth, uint32_t eyeHeight, uint64_t numFrames,
+	stitchFrameFormat format)
+	: m_eyeWidth(eyeWidth), m_eyeHeight(eyeHeight), m_numFrames(numFrames), m_produced(0), m_format(format)
+{
+}
+
+bool
+SyntheticFrameSource::read(cv::Mat &frame)
+{
+	if (m_produced >= m_numFrames)
+		return false;
+
+	TraceScope trace(TRACE_DECODE);
+
+	int rows = (int)m_eyeHeight;
+	int cols = (int)m_eyeWidth * 2;
+	cv::Mat &bgr = m_format == STITCH_FRAME_BGR ? frame : m_bgr;
+	if (bgr.rows != rows || bgr.cols != cols || bgr.type() != CV_8UC3)
+	{
+		bgr.create(rows, cols, CV_8UC3);
+		for (int y = 0; y < rows; y++)
+		{
+			unsigned char *row = bgr.ptr<unsigned char>(y);
+			for (int x = 0; x < cols; x++)
+			{
+				row[3 * x + 0] = (unsigned char)(x * 255 / cols);
+				row[3 * x + 1] = (unsigned char)(y * 255 / rows);
+				row[3 * x + 2] = (unsigned char)(x < cols / 2 ? 64 : 192);
+			}
+		}
+	}
+
+	// Move an 8 pixel white bar across both eyes so consecutive frames differ
+	if (m_eyeWidth > 8)
+	{
+		int bar = (int)(m_produced * 16 % (m_eyeWidth - 8));
+		for (int y = 0; y < rows; y++)
+		{
+			unsigned char *row = bgr.ptr<unsigned char>(y);
+			memset(row + 3 * bar, 255, 3 * 8);
+			memset(row + 3 * (bar + m_eyeWidth), 255, 3 * 8);
+		}
+	}
+
+	if (m_format != STITCH_FRAME_BGR)
+	{
+		cv::cvtColor(bgr, frame, cv::COLOR_BGR2YUV_I420);
+		if (m_format == STITCH_FRAME_NV12)
+		{
+			// Interleave the U and V planes in place, from a copy of both
+			size_t quarter = (size_t)rows * cols / 4;
+			unsigned char *chroma = frame.data + (size_t)rows * cols;
+			std::vector<unsigned char> planes(chroma, chroma + 2 * quarter);
+			for (size_t i = 0; i < quarter; i++)
+			{
+				chroma[2 * i] = planes[i];
+				chroma[2 * i + 1] = planes[quarter + i];
+			}
+		}
+	}
+
+	m_produced++;
+	return true;
+}
+
+//***********************************************************************************
+FramePipeline::FramePipeline(StitchSession &session, FrameSource &source, size_t depth)
+	: m_session(session), m_source(source), m_slots(depth < 2 ? 2 : depth),
+	m_schedule(FRAME_SCHEDULE_QUEUED), m_maxStalenessMs(0.0),
+	m_stop(false), m_result(NVSTITCH_SUCCESS)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+
+	for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+		m_queues.push_back(std::unique_ptr<SpscQueue<size_t> >(new SpscQueue<size_t>(m_slots.size())));
+
+	// Output and converted input buffers are sized once, up front
+	for (size_t i = 0; i < m_slots.size(); i++)
+	{
+		FrameSlot &slot = m_slots[i];
+		slot.index = 0;
+		slot.end_of_stream = false;
+		slot.dropped = false;
+		slot.pano_width = m_session.outputWidth();
+		slot.pano_height = m_session.outputHeight();
+		slot.pano.resize(m_session.outputBytes());
+		for (uint32_t camera = 0; camera < 2 && camera < m_session.numCameras() &&
+			m_session.convertsFrames(); camera++)
+			slot.rgba[camera].create(m_session.inputHeight(camera), m_session.inputWidth(camera), CV_8UC4);
+		memset(&slot.orientation, 0, sizeof(slot.orientation));
+	}
+}
+
+void
+FramePipeline::fail(nvstitchResult result)
+{
+	int expected = NVSTITCH_SUCCESS;
+	m_result.compare_exchange_strong(expected, (int)result);
+	m_stop.store(true);
+}
+
+void
+FramePipeline::captureStage()
+{
+	SpscQueue<size_t> &in = *m_queues[FRAME_STAGE_CAPTURE];
+	SpscQueue<size_t> &out = *m_queues[FRAME_STAGE_SPLIT];
+	double &busy = m_stats.stage_ms[FRAME_STAGE_CAPTURE];
+	traceSetThreadName(frameStageName(FRAME_STAGE_CAPTURE));
+
+	for (uint64_t index = 0;; index++)
+	{
+		size_t id;
+		if (!in.waitPop(id, m_stop))
+			return;
+
+		FrameSlot &slot = m_slots[id];
+		auto start = steady_clock::now();
+		slot.index = index;
+		slot.dropped = false;
+		traceSetFrame(index);
+		slot.end_of_stream = m_stop.load() || !m_source.read(slot.frame);
+		slot.ingest_time = steady_clock::now();
+		if (!m_source.lastCaptureTime(&slot.capture_time))
+			slot.capture_time = slot.ingest_time;
+		if (!slot.end_of_stream)
+		{
+			m_stats.captured++;
+			if (m_onCapture)
+				m_onCapture(slot);
+		}
+		busy += elapsedMs(start);
+
+		if (!out.waitPush(id, m_stop) || slot.end_of_stream)
+			return;
+	}
+}
+
+// Capture owns two slots: one being read into and one holding the newest
+// complete frame. Each read supersedes the held frame; it is forwarded only
+// when a free slot comes back to replace it, so the source is never left to
+// queue frames up while the stitcher is busy.
+void
+FramePipeline::captureLiveStage()
+{
+	SpscQueue<size_t> &in = *m_queues[FRAME_STAGE_CAPTURE];
+	SpscQueue<size_t> &out = *m_queues[FRAME_STAGE_SPLIT];
+	double &busy = m_stats.stage_ms[FRAME_STAGE_CAPTURE];
+	traceSetThreadName(frameStageName(FRAME_STAGE_CAPTURE));
+
+	size_t reading, newest;
+	if (!in.waitPop(reading, m_stop) || !in.waitPop(newest, m_stop))
+		return;
+	bool pending = false;
+
+	for (uint64_t index = 0;; index++)
+	{
+		FrameSlot &slot = m_slots[reading];
+		auto start = steady_clock::now();
+		slot.index = index;
+		slot.dropped = false;
+		traceSetFrame(index);
+		slot.end_of_stream = m_stop.load() || !m_source.read(slot.frame);
+		slot.ingest_time = steady_clock::now();
+		if (!m_source.lastCaptureTime(&slot.capture_time))
+			slot.capture_time = slot.ingest_time;
+
+		if (slot.end_of_stream)
+		{
+			// Finish with the held frame, then let end of stream follow it
+			if (pending && !out.waitPush(newest, m_stop))
+				return;
+			out.waitPush(reading, m_stop);
+			return;
+		}
+
+		m_stats.captured++;
+		if (m_onCapture)
+			m_onCapture(slot);
+		if (pending)
+			m_stats.dropped_superseded++;
+		std::swap(reading, newest);
+		pending = true;
+		busy += elapsedMs(start);
+
+		size_t free;
+		if (in.pop(free))
+		{
+			if (!out.waitPush(newest, m_stop))
+				return;
+			newest = free;
+			pending = false;
+		}
+	}
+}
+
+void
+FramePipeline::splitStage()
+{
+	SpscQueue<size_t> &in = *m_queues[FRAME_STAGE_SPLIT];
+	SpscQueue<size_t> &out = *m_queues[FRAME_STAGE_CONVERT];
+	double &busy = m_stats.stage_ms[FRAME_STAGE_SPLIT];
+	traceSetThreadName(frameStageName(FRAME_STAGE_SPLIT));
+
+	for (;;)
+	{
+		size_t id;
+		if (!in.waitPop(id, m_stop))
+			return;
+
+		FrameSlot &slot = m_slots[id];
+		if (!slot.end_of_stream)
+		{
+			auto start = steady_clock::now();
+			traceSetFrame(slot.index);
+			TraceScope trace(TRACE_SPLIT);
+			if (m_session.convertsFrames())
+			{
+				int width = slot.frame.cols;
+				int halfWidth = width / 2;
+
+				// ROI headers only; the pixel data stays in slot.frame
+				slot.eyes[0] = slot.frame(cv::Range::all(), cv::Range(0, halfWidth));
+				slot.eyes[1] = slot.frame(cv::Range::all(), cv::Range(halfWidth, width));
+			}
+			else
+			{
+				nvstitchResult res = m_session.splitPlanes(slot.frame, slot.planes);
+				if (res != NVSTITCH_SUCCESS)
+				{
+					fail(res);
+					return;
+				}
+			}
+			busy += elapsedMs(start);
+		}
+
+		if (!out.waitPush(id, m_stop) || slot.end_of_stream)
+			return;
+	}
+}
+
+void
+FramePipeline::convertStage()
+{
+	SpscQueue<size_t> &in = *m_queues[FRAME_STAGE_CONVERT];
+	SpscQueue<size_t> &out = *m_queues[FRAME_STAGE_STITCH];
+	double &busy = m_stats.stage_ms[FRAME_STAGE_CONVERT];
+	traceSetThreadName(frameStageName(FRAME_STAGE_CONVERT));
+
+	for (;;)
+	{
+		size_t id;
+		if (!in.waitPop(id, m_stop))
+			return;
+
+		FrameSlot &slot = m_slots[id];
+		if (!slot.end_of_stream)
+		{
+			auto start = steady_clock::now();
+			traceSetFrame(slot.index);
+			TraceScope trace(TRACE_CONVERT);
+
+			// Frames the backend reads as they are go to the stitcher unconverted
+			for (uint32_t camera = 0; camera < 2 && m_session.convertsFrames(); camera++)
+			{
+				nvstitchResult res = m_session.convertInput(camera, slot.eyes[camera], slot.rgba[camera]);
+				if (res != NVSTITCH_SUCCESS)
+				{
+					fail(res);
+					return;
+				}
+			}
+			busy += elapsedMs(start);
+		}
+
+		if (!out.waitPush(id, m_stop) || slot.end_of_stream)
+			return;
+	}
+}
+
+void
+FramePipeline::stitchStage()
+{
+	SpscQueue<size_t> &in = *m_queues[FRAME_STAGE_STITCH];
+	SpscQueue<size_t> &out = *m_queues[FRAME_STAGE_PUBLISH];
+	double &busy = m_stats.stage_ms[FRAME_STAGE_STITCH];
+	traceSetThreadName(frameStageName(FRAME_STAGE_STITCH));
+
+	for (;;)
+	{
+		size_t id;
+		if (!in.waitPop(id, m_stop))
+			return;
+
+		FrameSlot &slot = m_slots[id];
+		if (!slot.end_of_stream && m_maxStalenessMs > 0.0 && elapsedMs(slot.ingest_time) > m_maxStalenessMs)
+		{
+			slot.dropped = true;
+			m_stats.dropped_stale++;
+		}
+
+		if (!slot.end_of_stream && !slot.dropped)
+		{
+			auto start = steady_clock::now();
+			traceSetFrame(slot.index);
+			if (m_onStitch)
+				m_onStitch(slot);
+			nvstitchResult res = m_session.convertsFrames() ?
+				m_session.stitchRgba(slot.rgba, slot.pano.data(), m_session.outputPitch()) :
+				m_session.stitchPlanes(slot.planes, slot.pano.data(), m_session.outputPitch());
+			if (res != NVSTITCH_SUCCESS)
+			{
+				fail(res);
+				return;
+			}
+			busy += elapsedMs(start);
+		}
+
+		if (!out.waitPush(id, m_stop) || slot.end_of_stream)
+			return;
+	}
+}
+
+void
+FramePipeline::publishStage()
+{
+	SpscQueue<size_t> &in = *m_queues[FRAME_STAGE_PUBLISH];
+	SpscQueue<size_t> &out = *m_queues[FRAME_STAGE_CAPTURE];
+	double &busy = m_stats.stage_ms[FRAME_STAGE_PUBLISH];
+	traceSetThreadName(frameStageName(FRAME_STAGE_PUBLISH));
+
+	for (;;)
+	{
+		size_t id;
+		if (!in.waitPop(id, m_stop))
+			return;
+
+		FrameSlot &slot = m_slots[id];
+		if (slot.end_of_stream)
+			return;
+
+		if (!slot.dropped)
+		{
+			auto start = steady_clock::now();
+			traceSetFrame(slot.index);
+			{
+				TraceScope trace(TRACE_PUBLISH);
+				if (m_onPublish)
+					m_onPublish(slot);
+			}
+			busy += elapsedMs(start);
+			traceRecord(TRACE_FRAME, slot.index, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				slot.ingest_time.time_since_epoch()).count(), traceNowNs());
+
+			double latency = elapsedMs(slot.ingest_time);
+			m_stats.latency_ms += latency;
+			if (latency > m_stats.latency_max_ms)
+				m_stats.latency_max_ms = latency;
+			m_stats.frames++;
+		}
+
+		// Hand the slot back to capture for reuse
+		if (!out.waitPush(id, m_stop))
+			return;
+	}
+}
+
+nvstitchResult
+FramePipeline::run()
+{
+	if (!m_session.isInitialized() || m_session.numCameras() != 2)
+		return NVSTITCH_ERROR_BAD_STATE;
+	if (m_schedule == FRAME_SCHEDULE_LIVE && m_slots.size() < 3)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+
+	m_stop.store(false);
+	m_result.store(NVSTITCH_SUCCESS);
+	memset(&m_stats, 0, sizeof(m_stats));
+
+	// Every slot starts out free
+	for (size_t id = 0; id < m_slots.size(); id++)
+		m_queues[FRAME_STAGE_CAPTURE]->push(id);
+
+	auto start = steady_clock::now();
+	std::thread threads[FRAME_STAGE_COUNT] =
+	{
+		std::thread(m_schedule == FRAME_SCHEDULE_LIVE ? &FramePipeline::captureLiveStage : &FramePipeline::captureStage, this),
+		std::thread(&FramePipeline::splitStage, this),
+		std::thread(&FramePipeline::convertStage, this),
+		std::thread(&FramePipeline::stitchStage, this),
+		std::thread(&FramePipeline::publishStage, this),
+	};
+	for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+		threads[stage].join();
+	m_stats.elapsed_ms = elapsedMs(start);
+
+	// Drain whatever is left so the pipeline can be run again
+	for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+	{
+		size_t id;
+		while (m_queues[stage]->pop(id)) {}
+	}
+
+	return (nvstitchResult)m_result.load();
+}
@@ -0,0 +1,234 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "nvss_video.h"
+#include "orientation_service.h"
+#include "spsc_queue.h"
+#include "stitch_session.h"
+
+// Pipeline stages, in the order a frame passes through them
+typedef enum
+{
+	FRAME_STAGE_CAPTURE = 0,
+	FRAME_STAGE_SPLIT,
+	FRAME_STAGE_CONVERT,
+	FRAME_STAGE_STITCH,
+	FRAME_STAGE_PUBLISH,
+
+	FRAME_STAGE_COUNT
+} frameStage;
+
+const char* frameStageName(frameStage stage);
+
+// How capture hands frames to the rest of the pipeline
+typedef enum
+{
+	FRAME_SCHEDULE_QUEUED = 0,      // every frame is stitched; capture waits when the pipeline is full
+	FRAME_SCHEDULE_LIVE,            // capture keeps draining the source; only the newest frame moves on
+} frameSchedule;
+
+// One preallocated unit of work. Slots circulate between the stages by index;
+// the images inside are allocated on first use and then reused.
+struct FrameSlot
+{
+	uint64_t index;
+	bool end_of_stream;
+	bool dropped;           // too stale to stitch; passed through to be recycled
+	std::chrono::steady_clock::time_point capture_time;     // when the frame was taken; poses are looked up here
+	std::chrono::steady_clock::time_point ingest_time;      // when read() returned; latency is measured from here
+
+	cv::Mat frame;          // side-by-side frame as decoded, in the session's frameFormat()
+	cv::Mat eyes[2];        // converted frames: left/right views into frame, no copy
+	cv::Mat planes[2][3];   // other frames: each camera's planes, views into frame
+	cv::Mat rgba[2];        // stitcher input per camera, converted frames only
+	std::vector<unsigned char> pano;    // stacked output panorama, RGBA, then its reduced levels
+	uint32_t pano_width;
+	uint32_t pano_height;
+
+	OrientationSample orientation;      // latest IMU sample at capture time
+};
+
+// Producer of side-by-side frames for the capture stage
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+
+	// Fill frame with the next decoded frame; false at end of stream
+	virtual bool read(cv::Mat &frame) = 0;
+
+	// Capture time of the frame last read, for sources that know it (e.g. a
+	// replay); false means the frame was taken when read() returned
+	virtual bool lastCaptureTime(std::chrono::steady_clock::time_point *time) const { return false; }
+};
+
+// Frames from a gstreamer pipeline through cv::VideoCapture
+class GstreamerFrameSource : public FrameSource
+{
+public:
+	explicit GstreamerFrameSource(const std::string &pipeline);
+
+	bool isOpened() const { return m_cap.isOpened(); }
+	bool read(cv::Mat &frame);
+
+private:
+	cv::VideoCapture m_cap;
+};
+
+// Generated side-by-side frames for running the pipeline without a camera.
+// 4:2:0 frames are converted from the BGR pattern as a decoder would hand
+// them over; they need an even eye width and height.
+class SyntheticFrameSource : public FrameSource
+{
+public:
+	SyntheticFrameSource(uint32_t eyeWidth, uint32_t eyeHeight, uint64_t numFrames,
+		stitchFrameFormat format = STITCH_FRAME_BGR);
+
+	bool read(cv::Mat &frame);
+
+private:
+	uint32_t m_eyeWidth;
+	uint32_t m_eyeHeight;
+	uint64_t m_numFrames;
+	uint64_t m_produced;
+	stitchFrameFormat m_format;
+	cv::Mat m_bgr;
+};
+
+struct FramePipelineStats
+{
+	uint64_t frames;                        // published
+	uint64_t captured;                      // read from the source
+	uint64_t dropped_superseded;            // replaced by a newer frame before the pipeline took them
+	uint64_t dropped_stale;                 // older than the staleness bound when their turn to stitch came
+	double elapsed_ms;
+	double latency_ms;                      // ingest to publish, summed over published frames
+	double latency_max_ms;
+	double stage_ms[FRAME_STAGE_COUNT];     // busy time per stage, summed over frames
+};
+
+// Capture -> split -> convert -> stitch -> publish, one thread per stage.
+// Stages hand slot indices to each other through fixed-depth SPSC queues, so
+// capture of frame N+1 overlaps stitching of frame N and publishing of N-1.
+class FramePipeline
+{
+public:
+	typedef std::function<void(FrameSlot &slot)> SlotCallback;
+
+	FramePipeline(StitchSession &session, FrameSource &source, size_t depth = 4);
+
+	// Called on the capture thread after each decode, e.g. to attach a pose
+	void setCaptureCallback(const SlotCallback &callback) { m_onCapture = callback; }
+
+	// Called on the stitch thread before each frame is stitched, e.g. to
+	// hand the session the rig's orientation
+	void setStitchCallback(const SlotCallback &callback) { m_onStitch = callback; }
+
+	// Called on the publish thread with every stitched frame
+	void setPublishCallback(const SlotCallback &callback) { m_onPublish = callback; }
+
+	// FRAME_SCHEDULE_LIVE bounds latency under overload by dropping frames; it
+	// needs a depth of at least 3, as capture holds two slots. Frames older
+	// than maxStalenessMs (0 = no bound) when they reach the stitcher are
+	// dropped in either mode.
+	void setSchedule(frameSchedule schedule, double maxStalenessMs = 0.0)
+	{
+		m_schedule = schedule;
+		m_maxStalenessMs = maxStalenessMs;
+	}
+
+	// Run all stages until the source ends, a stage fails or stop() is called
+	nvstitchResult run();
+	void stop() { m_stop.store(true); }
+
+	const FramePipelineStats& stats() const { return m_stats; }
+
+private:
+	FramePipeline(const FramePipeline&);
+	FramePipeline& operator=(const FramePipeline&);
+
+	void captureStage();
+	void captureLiveStage();
+	void splitStage();
+	void convertStage();
+	void stitchStage();
+	void publishStage();
+
+	// Mark the pipeline failed and unblock every stage
+	void fail(nvstitchResult result);
+
+	StitchSession &m_session;
+	FrameSource &m_source;
+	std::vector<FrameSlot> m_slots;
+
+	// m_queues[s] feeds stage s; the last queue returns slots to capture
+	std::vector<std::unique_ptr<SpscQueue<size_t> > > m_queues;
+
+	SlotCallback m_onCapture;
+	SlotCallback m_onStitch;
+	SlotCallback m_onPublish;
+
+	frameSchedule m_schedule;
+	double m_maxStalenessMs;
+
+	std::atomic<bool> m_stop;
+	std::atomic<int> m_result;
+	FramePipelineStats m_stats;
+};
@@ -0,0 +1,369 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "frame_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include <string.h>
+
+#define TRACE_BUFFER_EVENTS 8192    // per thread, power of two
+#define TRACE_NAME_LEN 32
+
+struct TraceEvent
+{
+	uint64_t begin_ns;
+	uint64_t end_ns;
+	uint64_t frame;
+	uint32_t stage;
+};
+
+// Written only by its thread; count is published after each event so
+// readers know which entries are complete.
+struct TraceBuffer
+{
+	TraceEvent events[TRACE_BUFFER_EVENTS];
+	std::atomic<uint64_t> count;
+	uint64_t frame;
+	uint32_t tid;
+	char name[TRACE_NAME_LEN];
+};
+
+// Buffers outlive their threads so spans can be dumped after a pipeline run
+static std::mutex s_registryMutex;
+static std::vector<TraceBuffer*> s_buffers;
+static std::atomic<bool> s_enabled(false);
+static thread_local TraceBuffer *t_buffer = nullptr;
+
+static TraceBuffer*
+threadBuffer()
+{
+	if (t_buffer == nullptr)
+	{
+		TraceBuffer *buffer = new TraceBuffer;
+		buffer->count.store(0, std::memory_order_relaxed);
+		buffer->frame = 0;
+		memset(buffer->name, 0, sizeof(buffer->name));
+
+		std::lock_guard<std::mutex> lock(s_registryMutex);
+		buffer->tid = (uint32_t)s_buffers.size();
+		s_buffers.push_back(buffer);
+		t_buffer = buffer;
+	}
+	return t_buffer;
+}
+
+// Copy out the complete events of one buffer; entries the writer overwrote
+// while they were being copied are discarded
+static void
+snapshot(const TraceBuffer &buffer, std::vector<TraceEvent> &events)
+{
+	uint64_t end = buffer.count.load(std::memory_order_acquire);
+	uint64_t begin = end > TRACE_BUFFER_EVENTS ? end - TRACE_BUFFER_EVENTS : 0;
+	size_t first = events.size();
+	for (uint64_t n = begin; n < end; n++)
+		events.push_back(buffer.events[n & (TRACE_BUFFER_EVENTS - 1)]);
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t now = buffer.count.load(std::memory_order_relaxed);
+	// A writer that has not yet published event now is already rewriting
+	// the slot of now - TRACE_BUFFER_EVENTS, so that one is lost too
+	uint64_t overwritten = now + 1 > TRACE_BUFFER_EVENTS ? now + 1 - TRACE_BUFFER_EVENTS : 0;
+	if (overwritten > begin)
+	{
+		size_t lost = (size_t)std::min(overwritten - begin, end - begin);
+		events.erase(events.begin() + first, events.begin() + first + lost);
+	}
+}
+
+const char* traceStageName(traceStage stage)
+{
+	switch (stage)
+	{
+	case TRACE_RECEIVE: return "receive";
+	case TRACE_DECODE: return "decode";
+	case TRACE_SPLIT: return "split";
+	case TRACE_CONVERT: return "convert";
+	case TRACE_UPLOAD: return "upload";
+	case TRACE_STITCH: return "stitch";
+	case TRACE_DOWNLOAD: return "download";
+	case TRACE_PUBLISH: return "publish";
+	case TRACE_FRAME: return "frame";
+	default: return "unknown";
+	}
+}
+
+void traceEnable(bool enable)
+{
+	s_enabled.store(enable, std::memory_order_relaxed);
+}
+
+bool traceEnabled()
+{
+	return s_enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t traceNowNs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void traceSetThreadName(const char *name)
+{
+	TraceBuffer *buffer = threadBuffer();
+	std::lock_guard<std::mutex> lock(s_registryMutex);
+	strncpy(buffer->name, name, TRACE_NAME_LEN - 1);
+}
+
+void traceSetFrame(uint64_t frame)
+{
+	if (traceEnabled())
+		threadBuffer()->frame = frame;
+}
+
+void traceRecord(traceStage stage, uint64_t beginNs, uint64_t endNs)
+{
+	if (traceEnabled())
+		traceRecord(stage, threadBuffer()->frame, beginNs, endNs);
+}
+
+void traceRecord(traceStage stage, uint64_t frame, uint64_t beginNs, uint64_t endNs)
+{
+	if (!traceEnabled())
+		return;
+
+	TraceBuffer *buffer = threadBuffer();
+	uint64_t n = buffer->count.load(std::memory_order_relaxed);
+	TraceEvent &event = buffer->events[n & (TRACE_BUFFER_EVENTS - 1)];
+	event.begin_ns = beginNs;
+	event.end_ns = endNs;
+	event.frame = frame;
+	event.stage = (uint32_t)stage;
+	buffer->count.store(n + 1, std::memory_order_release);
+}
+
+//***********************************************************************************
+static double
+percentile(const std::vector<double> &sorted, double p)
+{
+	// Nearest rank
+	size_t rank = (size_t)(p * sorted.size() + 0.999999);
+	return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+void traceStats(double windowMs, TraceStageStats stats[TRACE_STAGE_COUNT])
+{
+	std::vector<TraceEvent> events;
+	{
+		std::lock_guard<std::mutex> lock(s_registryMutex);
+		for (size_t i = 0; i < s_buffers.size(); i++)
+			snapshot(*s_buffers[i], events);
+	}
+
+	uint64_t now = traceNowNs();
+	uint64_t window = (uint64_t)(windowMs * 1e6);
+	uint64_t since = now > window ? now - window : 0;
+
+	std::vector<double> durations[TRACE_STAGE_COUNT];
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		const TraceEvent &event = events[i];
+		if (event.end_ns >= since && event.stage < TRACE_STAGE_COUNT)
+			durations[event.stage].push_back((event.end_ns - event.begin_ns) * 1e-6);
+	}
+
+	for (int stage = 0; stage < TRACE_STAGE_COUNT; stage++)
+	{
+		std::vector<double> &d = durations[stage];
+		TraceStageStats &s = stats[stage];
+		memset(&s, 0, sizeof(s));
+		s.count = d.size();
+		if (d.empty())
+			continue;
+		std::sort(d.begin(), d.end());
+		s.p50_ms = percentile(d, 0.50);
+		s.p95_ms = percentile(d, 0.95);
+		s.p99_ms = percentile(d, 0.99);
+		s.max_ms = d.back();
+	}
+}
+
+void tracePrintStats(std::ostream &out, double windowMs)
+{
+	TraceStageStats stats[TRACE_STAGE_COUNT];
+	traceStats(windowMs, stats);
+
+	std::ios::fmtflags flags = out.flags();
+	out << "stage       count     p50     p95     p99     max  (ms, last " << windowMs / 1000.0 << " s)" << std::endl;
+	out << std::fixed << std::setprecision(2);
+	for (int stage = 0; stage < TRACE_STAGE_COUNT; stage++)
+	{
+		const TraceStageStats &s = stats[stage];
+		if (s.count == 0)
+			continue;
+		out << std::left << std::setw(10) << traceStageName((traceStage)stage) << std::right
+			<< std::setw(7) << s.count
+			<< std::setw(8) << s.p50_ms << std::setw(8) << s.p95_ms
+			<< std::setw(8) << s.p99_ms << std::setw(8) << s.max_ms << std::endl;
+	}
+	out.flags(flags);
+}
+
+//***********************************************************************************
+TraceReporter::TraceReporter()
+	: m_intervalMs(0.0), m_windowMs(0.0), m_stop(false)
+{
+}
+
+TraceReporter::~TraceReporter()
+{
+	stop();
+}
+
+void
+TraceReporter::start(double intervalMs, double windowMs)
+{
+	stop();
+	m_intervalMs = intervalMs;
+	m_windowMs = windowMs;
+	m_stop.store(false);
+	m_thread = std::thread(&TraceReporter::run, this);
+}
+
+void
+TraceReporter::stop()
+{
+	if (!m_thread.joinable())
+		return;
+	m_stop.store(true);
+	m_thread.join();
+}
+
+void
+TraceReporter::run()
+{
+	auto next = std::chrono::steady_clock::now();
+	while (!m_stop.load())
+	{
+		next += std::chrono::microseconds((int64_t)(m_intervalMs * 1000.0));
+		while (!m_stop.load() && std::chrono::steady_clock::now() < next)
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		if (!m_stop.load())
+			tracePrintStats(std::cout, m_windowMs);
+	}
+}
+
+//***********************************************************************************
+bool traceWriteChromeJson(const std::string &path)
+{
+	std::vector<TraceEvent> events;
+	std::vector<size_t> ends;
+	std::vector<std::string> names;
+	{
+		std::lock_guard<std::mutex> lock(s_registryMutex);
+		for (size_t i = 0; i < s_buffers.size(); i++)
+		{
+			snapshot(*s_buffers[i], events);
+			ends.push_back(events.size());
+			names.push_back(s_buffers[i]->name[0] ? s_buffers[i]->name : "thread " + std::to_string(i));
+		}
+	}
+
+	std::ofstream out(path.c_str());
+	if (!out)
+		return false;
+
+	uint64_t origin = UINT64_MAX;
+	for (size_t i = 0; i < events.size(); i++)
+		origin = std::min(origin, events[i].begin_ns);
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	out << std::fixed << std::setprecision(3);
+	bool first = true;
+	for (size_t tid = 0; tid < names.size(); tid++)
+	{
+		out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+			<< ",\"args\":{\"name\":\"" << names[tid] << "\"}}";
+		first = false;
+	}
+
+	size_t tid = 0;
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		while (tid < ends.size() && i >= ends[tid])
+			tid++;
+
+		const TraceEvent &event = events[i];
+		const char *name = traceStageName((traceStage)event.stage);
+		double ts = (event.begin_ns - origin) * 1e-3;
+		double dur = (event.end_ns - event.begin_ns) * 1e-3;
+		if (event.stage == TRACE_FRAME)
+		{
+			// Frames overlap across threads; async spans keep them on their own track
+			out << ",\n{\"name\":\"" << name << "\",\"cat\":\"frame\",\"ph\":\"b\",\"id\":" << event.frame
+				<< ",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << ts << "}";
+			out << ",\n{\"name\":\"" << name << "\",\"cat\":\"frame\",\"ph\":\"e\",\"id\":" << event.frame
+				<< ",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << ts + dur << "}";
+		}
+		else
+		{
+			out << ",\n{\"name\":\"" << name << "\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+				<< ",\"ts\":" << ts << ",\"dur\":" << dur << ",\"args\":{\"frame\":" << event.frame << "}}";
+		}
+	}
+	out << "\n]}\n";
+	return (bool)out;
+}
@@ -0,0 +1,151 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Per-frame span tracing. Every thread records into its own fixed-size ring,
+// so recording takes no lock and costs a clock read and a few stores; when
+// tracing is disabled a span costs one relaxed load.
+
+typedef enum
+{
+	TRACE_RECEIVE = 0,      // waiting for the next buffer from the source
+	TRACE_DECODE,           // turning it into a BGR frame
+	TRACE_SPLIT,
+	TRACE_CONVERT,
+	TRACE_UPLOAD,
+	TRACE_STITCH,
+	TRACE_DOWNLOAD,
+	TRACE_PUBLISH,
+	TRACE_FRAME,            // source read() returning to end of publish
+
+	TRACE_STAGE_COUNT
+} traceStage;
+
+const char* traceStageName(traceStage stage);
+
+void traceEnable(bool enable);
+bool traceEnabled();
+
+// Steady clock, nanoseconds
+uint64_t traceNowNs();
+
+// Name the calling thread in trace dumps
+void traceSetThreadName(const char *name);
+
+// Frame the calling thread's spans belong to until the next call
+void traceSetFrame(uint64_t frame);
+
+void traceRecord(traceStage stage, uint64_t beginNs, uint64_t endNs);
+void traceRecord(traceStage stage, uint64_t frame, uint64_t beginNs, uint64_t endNs);
+
+// Records the lifetime of the scope for the thread's current frame
+class TraceScope
+{
+public:
+	explicit TraceScope(traceStage stage)
+		: m_stage(stage), m_begin(traceEnabled() ? traceNowNs() : 0) {}
+	~TraceScope()
+	{
+		if (m_begin != 0)
+			traceRecord(m_stage, m_begin, traceNowNs());
+	}
+
+private:
+	TraceScope(const TraceScope&);
+	TraceScope& operator=(const TraceScope&);
+
+	traceStage m_stage;
+	uint64_t m_begin;
+};
+
+struct TraceStageStats
+{
+	uint64_t count;
+	double p50_ms;
+	double p95_ms;
+	double p99_ms;
+	double max_ms;
+};
+
+// Percentiles of the spans that ended within the last windowMs
+void traceStats(double windowMs, TraceStageStats stats[TRACE_STAGE_COUNT]);
+void tracePrintStats(std::ostream &out, double windowMs);
+
+// Prints tracePrintStats to stdout every intervalMs from its own thread
+class TraceReporter
+{
+public:
+	TraceReporter();
+	~TraceReporter();
+
+	void start(double intervalMs, double windowMs);
+	void stop();
+
+private:
+	TraceReporter(const TraceReporter&);
+	TraceReporter& operator=(const TraceReporter&);
+
+	void run();
+
+	double m_intervalMs;
+	double m_windowMs;
+	std::atomic<bool> m_stop;
+	std::thread m_thread;
+};
+
+// Every span still held in the rings, as Chrome trace_event JSON
+// (load in chrome://tracing or Perfetto)
+bool traceWriteChromeJson(const std::string &path);
@@ -0,0 +1,270 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "gain_compensation.h"
+#include "camera_model.h"
+#include "remap_kernels.h"
+#include "remap_lut.h"
+
+#include <math.h>
+
+// Nearest source pixel of panorama pixel (x, y), which the camera sees,
+// and the camera's vignetting correction there
+static uint32_t nearestPixel(const nvstitchCameraMappingMatrix_t &matrix, const LensVignetting *vignetting,
+	uint32_t x, uint32_t y, float *correction)
+{
+	const float *uv = matrix.matrix +
+		((size_t)(y - matrix.map_offset.y) * matrix.map_size.x + (x - matrix.map_offset.x)) * 2;
+	*correction = vignetting != nullptr ? vignetting->correction(uv[0], uv[1]) : 1.0f;
+	int u = (int)(uv[0] + 0.5f);
+	int v = (int)(uv[1] + 0.5f);
+	u = u < (int)matrix.input_size.x - 1 ? u : (int)matrix.input_size.x - 1;
+	v = v < (int)matrix.input_size.y - 1 ? v : (int)matrix.input_size.y - 1;
+	return (uint32_t)u | (uint32_t)v << 16;
+}
+
+//***********************************************************************************
+GainCompensator::GainCompensator() :
+	m_numCameras(0),
+	m_perChannel(false),
+	m_smoothing(1.0f),
+	m_primed(false)
+{
+}
+
+void
+GainCompensator::build(const RemapTables &tables, const LensVignetting *vignetting, uint32_t maxSamples)
+{
+	m_numCameras = tables.numCameras();
+	m_pairs.clear();
+	m_samples.clear();
+	m_peaks.assign(m_numCameras, 1.0f);
+	if (vignetting != nullptr)
+		for (uint32_t camera = 0; camera < m_numCameras; camera++)
+			m_peaks[camera] = vignetting[camera].peak();
+
+	// One grid over the panorama, coarse enough that all overlaps together
+	// give at most maxSamples
+	size_t overlap = 0;
+	for (uint32_t a = 0; a < m_numCameras; a++)
+		for (uint32_t b = a + 1; b < m_numCameras; b++)
+			for (uint32_t y = 0; y < tables.panoHeight(); y++)
+				remapForEachOverlap(tables.spans(a), tables.spans(b), y,
+					[&](uint32_t begin, uint32_t end) { overlap += end - begin; });
+	uint32_t stride = 1;
+	while ((overlap + (size_t)stride * stride - 1) / ((size_t)stride * stride) > maxSamples)
+		stride++;
+
+	uint32_t start = stride / 2;
+	for (uint32_t a = 0; a < m_numCameras; a++)
+	{
+		for (uint32_t b = a + 1; b < m_numCameras; b++)
+		{
+			Pair pair = { { a, b }, m_samples.size(), 0 };
+			for (uint32_t y = start; y < tables.panoHeight(); y += stride)
+			{
+				remapForEachOverlap(tables.spans(a), tables.spans(b), y, [&](uint32_t begin, uint32_t end) {
+					uint32_t x = begin + (stride - begin % stride + start) % stride;
+					for (; x < end; x += stride)
+					{
+						Sample sample;
+						sample.xy[0] = nearestPixel(tables.matrix(a), vignetting != nullptr ? vignetting + a : nullptr,
+							x, y, &sample.correction[0]);
+						sample.xy[1] = nearestPixel(tables.matrix(b), vignetting != nullptr ? vignetting + b : nullptr,
+							x, y, &sample.correction[1]);
+						m_samples.push_back(sample);
+					}
+				});
+			}
+			pair.numSamples = m_samples.size() - pair.firstSample;
+			if (pair.numSamples > 0)
+				m_pairs.push_back(pair);
+		}
+	}
+
+	m_means.assign(m_pairs.size() * 8, 0.0);
+	reset();
+}
+
+void
+GainCompensator::reset()
+{
+	m_gains.assign((size_t)m_numCameras * 3, 1.0f);
+	m_primed = false;
+	storeFixed();
+}
+
+void
+GainCompensator::carryOver(const GainCompensator &previous)
+{
+	if (previous.m_numCameras != m_numCameras)
+		return;
+	m_perChannel = previous.m_perChannel;
+	m_smoothing = previous.m_smoothing;
+	m_primed = previous.m_primed;
+	m_gains = previous.m_gains;
+	storeFixed();
+}
+
+void
+GainCompensator::storeFixed()
+{
+	m_fixed.resize((size_t)m_numCameras * 4);
+	for (uint32_t camera = 0; camera < m_numCameras; camera++)
+	{
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			float gain = m_gains[camera * 3 + c] * m_peaks[camera];
+			m_fixed[camera * 4 + c] = gain < GAIN_MAX ? (uint32_t)(gain * REMAP_GAIN_ONE + 0.5f) :
+				(uint32_t)(GAIN_MAX * REMAP_GAIN_ONE + 0.5f);
+		}
+		// Alpha takes the peak too, so vignetted weights still sum to opaque
+		m_fixed[camera * 4 + 3] = (uint32_t)(m_peaks[camera] * REMAP_GAIN_ONE + 0.5f);
+	}
+}
+
+// Gains for one channel of the pair means, k = 3 for luma, into every third
+// float of target. The error is quadratic in the gains, so they solve
+// A g = b, with A symmetric positive definite.
+void
+GainCompensator::solve(uint32_t k, float *target) const
+{
+	const double noise = 1.0 / (GAIN_NOISE_SIGMA * GAIN_NOISE_SIGMA);
+	const double prior = 1.0 / (GAIN_PRIOR_SIGMA * GAIN_PRIOR_SIGMA);
+	uint32_t n = m_numCameras;
+	double a[REMAP_LUT_MAX_CAMERAS][REMAP_LUT_MAX_CAMERAS + 1] = {};
+
+	for (size_t p = 0; p < m_pairs.size(); p++)
+	{
+		const Pair &pair = m_pairs[p];
+		double count = (double)pair.numSamples;
+		for (uint32_t side = 0; side < 2; side++)
+		{
+			uint32_t i = pair.camera[side], j = pair.camera[1 - side];
+			double mine = m_means[p * 8 + side * 4 + k];
+			double theirs = m_means[p * 8 + (1 - side) * 4 + k];
+			a[i][i] += count * (mine * mine * noise + prior);
+			a[i][j] -= count * mine * theirs * noise;
+			a[i][n] += count * prior;
+		}
+	}
+	// Cameras that overlap nothing keep unit gain
+	for (uint32_t i = 0; i < n; i++)
+		if (a[i][i] == 0.0)
+			a[i][i] = a[i][n] = 1.0;
+
+	for (uint32_t col = 0; col < n; col++)
+	{
+		for (uint32_t row = col + 1; row < n; row++)
+		{
+			double factor = a[row][col] / a[col][col];
+			if (factor == 0.0)
+				continue;
+			for (uint32_t c = col; c <= n; c++)
+				a[row][c] -= factor * a[col][c];
+		}
+	}
+	for (uint32_t row = n; row-- > 0;)
+	{
+		double sum = a[row][n];
+		for (uint32_t c = row + 1; c < n; c++)
+			sum -= a[row][c] * target[c * 3];
+		target[row * 3] = (float)(sum / a[row][row]);
+	}
+}
+
+void
+GainCompensator::update(const remapSource_t *sources)
+{
+	for (size_t p = 0; p < m_pairs.size(); p++)
+	{
+		const Pair &pair = m_pairs[p];
+		const Sample *sample = m_samples.data() + pair.firstSample;
+		for (uint32_t side = 0; side < 2; side++)
+		{
+			const remapSource_t *source = sources + pair.camera[side];
+			double sum[3] = { 0.0, 0.0, 0.0 };
+			for (size_t s = 0; s < pair.numSamples; s++)
+			{
+				unsigned char pixel[4];
+				remapSourcePixel(source, sample[s].xy[side] & 0xffff, sample[s].xy[side] >> 16, pixel);
+				float correction = sample[s].correction[side];
+				sum[0] += pixel[0] * correction;
+				sum[1] += pixel[1] * correction;
+				sum[2] += pixel[2] * correction;
+			}
+			double *means = m_means.data() + p * 8 + side * 4;
+			for (uint32_t c = 0; c < 3; c++)
+				means[c] = sum[c] / pair.numSamples;
+			means[3] = (means[0] + means[1] + means[2]) / 3.0;
+		}
+	}
+
+	// Solved gains land in m_target, 3 per camera with the camera stride
+	m_target.resize((size_t)m_numCameras * 3);
+	if (m_perChannel)
+	{
+		for (uint32_t c = 0; c < 3; c++)
+			solve(c, m_target.data() + c);
+	}
+	else
+	{
+		solve(3, m_target.data());
+		for (uint32_t camera = 0; camera < m_numCameras; camera++)
+			m_target[camera * 3 + 1] = m_target[camera * 3 + 2] = m_target[camera * 3];
+	}
+
+	for (size_t i = 0; i < m_target.size(); i++)
+	{
+		float gain = m_target[i] < GAIN_MIN ? GAIN_MIN : (m_target[i] > GAIN_MAX ? GAIN_MAX : m_target[i]);
+		m_gains[i] = m_primed ? m_gains[i] + m_smoothing * (gain - m_gains[i]) : gain;
+	}
+	m_primed = true;
+	storeFixed();
+}
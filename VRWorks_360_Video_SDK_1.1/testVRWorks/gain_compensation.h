@@ -0,0 +1,155 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "remap_yuv_kernels.h"
+
+class LensVignetting;
+class RemapTables;
+
+// ==== Exposure gain compensation ====
+// Cameras that auto-expose on their own disagree on brightness, which shows
+// as a step across every seam. Following Brown and Lowe, each camera gets a
+// gain g_i minimising, over every ordered pair of overlapping cameras,
+//   N_ij * ((g_i * I_ij - g_j * I_ji)^2 / sigmaN^2 + (1 - g_i)^2 / sigmaG^2)
+// where I_ij is the mean of camera i over its overlap with camera j and N_ij
+// the samples in it. The second term keeps the gains near 1. The means come
+// from a sparse grid over the overlaps, fixed by build(); each frame the
+// samples are read again from the camera images, the small linear system is
+// solved, and the result is smoothed over frames by an exponential filter.
+//
+// Gains are handed to the remap kernels as REMAP_GAIN_ONE fixed point
+// (remap_kernels.h), which multiply them into the samples, so compensation
+// costs no pass over the image. With lens vignetting, the samples are
+// compared corrected, and the fixed gains also carry each camera's peak
+// correction, which the packed weights are scaled down by.
+
+#define GAIN_MAX_SAMPLES 4096       // per frame, over all overlaps
+#define GAIN_NOISE_SIGMA 10.0f      // sigmaN, in 8-bit levels
+#define GAIN_PRIOR_SIGMA 0.5f       // sigmaG
+#define GAIN_MIN 0.25f
+#define GAIN_MAX 3.99f
+
+class GainCompensator
+{
+public:
+	GainCompensator();
+
+	// Lay out the sample grid over the cameras' overlaps, and start from
+	// unit gains. vignetting, if any, holds one model per camera.
+	void build(const RemapTables &tables, const LensVignetting *vignetting = nullptr,
+		uint32_t maxSamples = GAIN_MAX_SAMPLES);
+
+	// One gain per color channel, or one for all three
+	void setPerChannel(bool perChannel) { m_perChannel = perChannel; }
+
+	// Share of each frame's estimate in the smoothed gains, in (0, 1]; 1
+	// follows every frame as is
+	void setSmoothing(float smoothing) { m_smoothing = smoothing; }
+
+	// Estimate gains from the current camera images, one source per camera,
+	// and fold them into the smoothed ones. The first frame after build() or
+	// reset() is taken as is.
+	void update(const remapSource_t *sources);
+
+	// Back to unit gains
+	void reset();
+
+	// Carry another compensator's settings and smoothed gains over to this
+	// one, built for the same cameras with a different sample grid
+	void carryOver(const GainCompensator &previous);
+
+	uint32_t numCameras() const { return m_numCameras; }
+	size_t numSamples() const { return m_samples.size(); }
+
+	// Smoothed gains of a camera's first three channels
+	const float* gains(uint32_t camera) const { return m_gains.data() + (size_t)camera * 3; }
+
+	// As the kernels take them: 4 channel gains per camera, times its peak
+	// vignetting correction, alpha the peak alone
+	const uint32_t* fixedGains() const { return m_fixed.data(); }
+	const uint32_t* fixedGains(uint32_t camera) const { return m_fixed.data() + (size_t)camera * 4; }
+
+private:
+	// Nearest source pixels of two cameras at one panorama position
+	struct Sample
+	{
+		uint32_t xy[2];         // int16 x | int16 y << 16, as in the packed tables
+		float correction[2];    // vignetting correction of each, 1 for none
+	};
+
+	// Overlapping cameras a < b and their samples
+	struct Pair
+	{
+		uint32_t camera[2];
+		size_t firstSample;     // into m_samples
+		size_t numSamples;
+	};
+
+	void solve(uint32_t k, float *target) const;
+	void storeFixed();
+
+	uint32_t m_numCameras;
+	bool m_perChannel;
+	float m_smoothing;
+	bool m_primed;
+
+	std::vector<Pair> m_pairs;
+	std::vector<Sample> m_samples;
+	std::vector<double> m_means;    // per pair, each side's 3 channel means and luma
+	std::vector<float> m_target;    // this frame's gains, 3 per camera
+	std::vector<float> m_gains;     // 3 per camera
+	std::vector<float> m_peaks;     // peak vignetting correction per camera
+	std::vector<uint32_t> m_fixed;  // 4 per camera
+};
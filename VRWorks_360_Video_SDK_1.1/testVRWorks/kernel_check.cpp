@@ -0,0 +1,561 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "kernel_check.h"
+#include "color_convert.h"
+#include "cpu_features.h"
+#include "downsample_kernels.h"
+#include "pack_yuv_kernels.h"
+#include "pyramid_kernels.h"
+#include "quaternion.h"
+#include "remap_fused_kernels.h"
+#include "viewport_renderer.h"
+
+#include <iostream>
+#include <string>
+#include <string.h>
+#include <vector>
+
+// Odd sizes, so every kernel ends on a row tail whatever its vector width
+#define CHECK_IMAGE_WIDTH 67
+#define CHECK_IMAGE_HEIGHT 41
+#define CHECK_PIXELS 203
+
+// Deterministic noise
+class CheckRandom
+{
+public:
+	explicit CheckRandom(uint32_t seed) : m_state(seed) {}
+
+	uint32_t next()
+	{
+		m_state = m_state * 1664525u + 1013904223u;
+		return m_state >> 8;
+	}
+	uint32_t below(uint32_t n) { return next() % n; }
+	void fill(std::vector<unsigned char> &data)
+	{
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = (unsigned char)next();
+	}
+	void fill(std::vector<float> &data, float low, float high)
+	{
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = low + (high - low) * (float)below(1 << 16) / (float)(1 << 16);
+	}
+
+private:
+	uint32_t m_state;
+};
+
+// Expected and actual outputs must match byte for byte
+static uint32_t
+compareBits(const std::string &kernel, const void *expected, const void *actual, size_t bytes)
+{
+	const unsigned char *e = (const unsigned char*)expected;
+	const unsigned char *a = (const unsigned char*)actual;
+	for (size_t i = 0; i < bytes; i++)
+	{
+		if (e[i] != a[i])
+		{
+			std::cout << "  " << kernel << ": byte " << i << " is " << (int)a[i]
+				<< ", the scalar kernel gives " << (int)e[i] << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static const char*
+formatName(remapSourceFormat format, bool keepYuv)
+{
+	switch (format)
+	{
+	case REMAP_SOURCE_RGBA8: return "RGBA8";
+	case REMAP_SOURCE_I420: return keepYuv ? "I420 kept YUV" : "I420";
+	case REMAP_SOURCE_NV12: return keepYuv ? "NV12 kept YUV" : "NV12";
+	case REMAP_SOURCE_BGR8: return "BGR8";
+	}
+	return "unknown";
+}
+
+//***********************************************************************************
+// Remap kernels
+
+// One camera's image of noise in any source format, with the slack the
+// kernels may read past each plane
+class CheckSource
+{
+public:
+	void init(CheckRandom &random, remapSourceFormat format, bool keepYuv);
+	const remapSource_t* source() const { return &m_source; }
+
+private:
+	std::vector<unsigned char> m_planes[3];
+	remapSource_t m_source;
+};
+
+void
+CheckSource::init(CheckRandom &random, remapSourceFormat format, bool keepYuv)
+{
+	memset(&m_source, 0, sizeof(m_source));
+	m_source.format = format;
+	m_source.keepYuv = keepYuv ? 1 : 0;
+	m_source.chromaWidth = (CHECK_IMAGE_WIDTH + 1) / 2;
+	m_source.chromaHeight = (CHECK_IMAGE_HEIGHT + 1) / 2;
+
+	uint32_t planes = 1;
+	switch (format)
+	{
+	case REMAP_SOURCE_RGBA8:
+		m_source.pitch[0] = CHECK_IMAGE_WIDTH * 4 + 12;
+		break;
+	case REMAP_SOURCE_BGR8:
+		m_source.pitch[0] = CHECK_IMAGE_WIDTH * 3 + 5;
+		break;
+	case REMAP_SOURCE_I420:
+		m_source.pitch[0] = CHECK_IMAGE_WIDTH + 3;
+		m_source.pitch[1] = m_source.chromaWidth + 1;
+		planes = 3;
+		break;
+	case REMAP_SOURCE_NV12:
+		m_source.pitch[0] = CHECK_IMAGE_WIDTH + 3;
+		m_source.pitch[1] = m_source.chromaWidth * 2 + 2;
+		planes = 2;
+		break;
+	}
+
+	for (uint32_t p = 0; p < planes; p++)
+	{
+		size_t rows = p == 0 ? CHECK_IMAGE_HEIGHT : m_source.chromaHeight;
+		m_planes[p].resize(m_source.pitch[p == 0 ? 0 : 1] * rows + REMAP_SOURCE_ROW_SLACK);
+		random.fill(m_planes[p]);
+		m_source.plane[p] = m_planes[p].data();
+	}
+}
+
+// One camera's table entries over CHECK_PIXELS output pixels. With holes,
+// about one pixel in eight is not seen by the camera. Weights are at most
+// maxWeight, so the weights of that many cameras can sum to 256.
+class CheckTaps
+{
+public:
+	void init(CheckRandom &random, bool holes, uint32_t maxWeight);
+	remapTaps_t taps() const;
+
+	std::vector<uint32_t> xy;
+	std::vector<uint16_t> frac;
+	std::vector<uint8_t> weight;
+	uint32_t gain[4];
+};
+
+void
+CheckTaps::init(CheckRandom &random, bool holes, uint32_t maxWeight)
+{
+	xy.resize(CHECK_PIXELS);
+	frac.resize(CHECK_PIXELS);
+	weight.resize(CHECK_PIXELS);
+	for (uint32_t i = 0; i < CHECK_PIXELS; i++)
+	{
+		uint32_t x = random.below(CHECK_IMAGE_WIDTH - 1);
+		uint32_t y = random.below(CHECK_IMAGE_HEIGHT - 1);
+		xy[i] = holes && random.below(8) == 0 ? 0xffffffffu : x | y << 16;
+		frac[i] = (uint16_t)random.below(1 << 16);
+		weight[i] = (uint8_t)random.below(maxWeight);
+	}
+	// Gains below 4.0, some of them exactly one
+	for (int c = 0; c < 4; c++)
+		gain[c] = random.below(4) == 0 ? REMAP_GAIN_ONE : REMAP_GAIN_ONE / 2 + random.below(REMAP_GAIN_ONE * 7 / 2);
+}
+
+remapTaps_t
+CheckTaps::taps() const
+{
+	remapTaps_t t;
+	t.xy = xy.data();
+	t.frac = frac.data();
+	t.weight = weight.data();
+	t.gain = gain;
+	return t;
+}
+
+static void
+accumulateSourceRowScalar(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	switch (src->format)
+	{
+	case REMAP_SOURCE_RGBA8:
+		remapAccumulateRowScalar(src->plane[0], src->pitch[0], xy, frac, weight, gain, count, acc);
+		break;
+	case REMAP_SOURCE_BGR8:
+		remapAccumulateBgrRowScalar(src, xy, frac, weight, gain, count, acc);
+		break;
+	default:
+		remapAccumulateYuvRowScalar(src, xy, frac, weight, gain, count, acc);
+		break;
+	}
+}
+
+static void
+copySourceRowScalar(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	switch (src->format)
+	{
+	case REMAP_SOURCE_RGBA8:
+		remapCopyRowScalar(src->plane[0], src->pitch[0], xy, frac, gain, count, dst);
+		break;
+	case REMAP_SOURCE_BGR8:
+		remapCopyBgrRowScalar(src, xy, frac, gain, count, dst);
+		break;
+	default:
+		remapCopyYuvRowScalar(src, xy, frac, gain, count, dst);
+		break;
+	}
+}
+
+static const remapSourceFormat s_formats[] =
+{
+	REMAP_SOURCE_RGBA8, REMAP_SOURCE_I420, REMAP_SOURCE_NV12, REMAP_SOURCE_BGR8
+};
+
+static uint32_t
+checkRemapRows(CheckRandom &random)
+{
+	uint32_t failures = 0;
+	for (remapSourceFormat format : s_formats)
+	{
+		bool yuv = format == REMAP_SOURCE_I420 || format == REMAP_SOURCE_NV12;
+		for (int keepYuv = 0; keepYuv < (yuv ? 2 : 1); keepYuv++)
+		{
+			std::string name = formatName(format, keepYuv != 0);
+			CheckSource source;
+			source.init(random, format, keepYuv != 0);
+
+			CheckTaps taps;
+			taps.init(random, true, 256);
+			std::vector<uint32_t> expected(CHECK_PIXELS * 4), actual;
+			for (size_t i = 0; i < expected.size(); i++)
+				expected[i] = random.below(1 << 24);
+			actual = expected;
+			accumulateSourceRowScalar(source.source(), taps.xy.data(), taps.frac.data(), taps.weight.data(), taps.gain,
+				CHECK_PIXELS, expected.data());
+			remapAccumulateSourceRow(source.source(), taps.xy.data(), taps.frac.data(), taps.weight.data(), taps.gain,
+				CHECK_PIXELS, actual.data());
+			failures += compareBits("remapAccumulateSourceRow " + name, expected.data(), actual.data(),
+				expected.size() * sizeof(uint32_t));
+
+			taps.init(random, false, 256);
+			std::vector<unsigned char> expectedCopy(CHECK_PIXELS * 4, 0), actualCopy(CHECK_PIXELS * 4, 0);
+			copySourceRowScalar(source.source(), taps.xy.data(), taps.frac.data(), taps.gain, CHECK_PIXELS, expectedCopy.data());
+			remapCopySourceRow(source.source(), taps.xy.data(), taps.frac.data(), taps.gain, CHECK_PIXELS, actualCopy.data());
+			failures += compareBits("remapCopySourceRow " + name, expectedCopy.data(), actualCopy.data(), expectedCopy.size());
+		}
+	}
+
+	// Sums past 255 in 16.16 included, to check the saturation
+	std::vector<uint32_t> acc(CHECK_PIXELS * 4);
+	for (size_t i = 0; i < acc.size(); i++)
+		acc[i] = random.below(300 << 16);
+	std::vector<unsigned char> expected(CHECK_PIXELS * 4, 0), actual(CHECK_PIXELS * 4, 0);
+	remapResolveRowScalar(acc.data(), CHECK_PIXELS, expected.data());
+	remapResolveRow(acc.data(), CHECK_PIXELS, actual.data());
+	failures += compareBits("remapResolveRow", expected.data(), actual.data(), expected.size());
+	return failures;
+}
+
+static uint32_t
+checkRemapSpans(CheckRandom &random)
+{
+	uint32_t failures = 0;
+	for (remapSourceFormat format : s_formats)
+	{
+		bool yuv = format == REMAP_SOURCE_I420 || format == REMAP_SOURCE_NV12;
+		for (int keepYuv = 0; keepYuv < (yuv ? 2 : 1); keepYuv++)
+		{
+			for (uint32_t cameras = 1; cameras <= REMAP_SPAN_MAX_CAMERAS; cameras++)
+			{
+				for (int weighted = 0; weighted < 2; weighted++)
+				{
+					std::string name = std::string("remap span ") + formatName(format, keepYuv != 0) + ", " +
+						std::to_string(cameras) + (cameras == 1 ? " camera" : " cameras") + (weighted ? ", weighted" : "");
+					remapSpanKernel kernel = remapSelectSpanKernel(format, keepYuv != 0, cameras, weighted != 0);
+					if (kernel == nullptr)
+					{
+						std::cout << "  " << name << ": no kernel" << std::endl;
+						failures++;
+						continue;
+					}
+
+					// A lone camera must see every pixel
+					CheckSource sources[REMAP_SPAN_MAX_CAMERAS];
+					CheckTaps tables[REMAP_SPAN_MAX_CAMERAS];
+					const remapSource_t *sourcePointers[REMAP_SPAN_MAX_CAMERAS];
+					remapTaps_t taps[REMAP_SPAN_MAX_CAMERAS];
+					for (uint32_t k = 0; k < cameras; k++)
+					{
+						sources[k].init(random, format, keepYuv != 0);
+						tables[k].init(random, cameras > 1, 256 / cameras);
+						sourcePointers[k] = sources[k].source();
+						taps[k] = tables[k].taps();
+					}
+
+					std::vector<unsigned char> expected(CHECK_PIXELS * 4, 0), actual(CHECK_PIXELS * 4, 0);
+					remapSpanScalar(sourcePointers, taps, cameras, CHECK_PIXELS, expected.data(), weighted != 0);
+					kernel(sourcePointers, taps, CHECK_PIXELS, actual.data());
+					failures += compareBits(name, expected.data(), actual.data(), expected.size());
+				}
+			}
+		}
+	}
+	return failures;
+}
+
+//***********************************************************************************
+// Output kernels
+
+static uint32_t
+checkDownsample(CheckRandom &random)
+{
+	std::vector<unsigned char> top(CHECK_PIXELS * 8), bottom(CHECK_PIXELS * 8);
+	random.fill(top);
+	random.fill(bottom);
+	std::vector<unsigned char> expected(CHECK_PIXELS * 4, 0), actual(CHECK_PIXELS * 4, 0);
+	downsampleRowScalar(top.data(), bottom.data(), CHECK_PIXELS, expected.data());
+	downsampleRow(top.data(), bottom.data(), CHECK_PIXELS, actual.data());
+	return compareBits("downsampleRow", expected.data(), actual.data(), expected.size());
+}
+
+static uint32_t
+checkPackYuv(CheckRandom &random)
+{
+	const uint32_t width = CHECK_PIXELS + 1;
+	const packYuvMatrix_t *matrices[] = { &packYuvBt601, &packYuvBt601Bgr, &packYuvSplit };
+	const char *matrixNames[] = { "BT.601", "BT.601 BGRA", "split" };
+
+	uint32_t failures = 0;
+	std::vector<unsigned char> top(width * 4), bottom(width * 4);
+	for (int m = 0; m < 3; m++)
+	{
+		for (uint32_t chromaStep = 1; chromaStep <= 2; chromaStep++)
+		{
+			random.fill(top);
+			random.fill(bottom);
+
+			// Luma rows, then U and V: I420 one plane after the other, NV12 interleaved
+			std::vector<unsigned char> expected(width * 3, 0), actual(width * 3, 0);
+			unsigned char *e = expected.data(), *a = actual.data();
+			size_t v = chromaStep == 1 ? width / 2 : 1;
+			packYuvRowsScalar(matrices[m], top.data(), bottom.data(), width, e, e + width, e + width * 2, e + width * 2 + v, chromaStep);
+			packYuvRows(matrices[m], top.data(), bottom.data(), width, a, a + width, a + width * 2, a + width * 2 + v, chromaStep);
+			std::string name = std::string("packYuvRows ") + matrixNames[m] + (chromaStep == 1 ? " I420" : " NV12");
+			failures += compareBits(name, expected.data(), actual.data(), expected.size());
+		}
+	}
+	return failures;
+}
+
+static uint32_t
+checkColorConvert(CheckRandom &random)
+{
+	const size_t srcPitch = CHECK_IMAGE_WIDTH * 3 + 7;
+	const size_t dstPitch = CHECK_IMAGE_WIDTH * 4 + 8;
+	std::vector<unsigned char> src(srcPitch * CHECK_IMAGE_HEIGHT);
+	random.fill(src);
+
+	uint32_t failures = 0;
+	for (int swapRB = 0; swapRB < 2; swapRB++)
+	{
+		std::vector<unsigned char> expected(dstPitch * CHECK_IMAGE_HEIGHT, 0), actual(dstPitch * CHECK_IMAGE_HEIGHT, 0);
+		convertBgrToRgbaScalar(src.data(), srcPitch, expected.data(), dstPitch, CHECK_IMAGE_WIDTH, CHECK_IMAGE_HEIGHT, swapRB != 0);
+		convertBgrToRgba(src.data(), srcPitch, actual.data(), dstPitch, CHECK_IMAGE_WIDTH, CHECK_IMAGE_HEIGHT, swapRB != 0);
+		failures += compareBits(swapRB ? "convertBgrToRgba swapped" : "convertBgrToRgba", expected.data(), actual.data(), expected.size());
+	}
+	return failures;
+}
+
+static uint32_t
+checkViewport(CheckRandom &random)
+{
+	const uint32_t panoWidth = 256, panoHeight = 128;
+	const size_t panoPitch = panoWidth * 4 + 16;
+	std::vector<unsigned char> pano(panoPitch * panoHeight);
+	random.fill(pano);
+
+	ViewportRenderer renderer;
+	renderer.init(CHECK_IMAGE_WIDTH, CHECK_IMAGE_HEIGHT, 100.0f);
+	const size_t dstPitch = CHECK_IMAGE_WIDTH * 4;
+
+	// Ahead, turned across the seam of the panorama, and up into the pole
+	const Quat orientations[] =
+	{
+		quatIdentity(),
+		quatFromYawPitchRoll(3.0f, -0.4f, 0.2f),
+		quatFromYawPitchRoll(0.7f, 1.5f, -0.3f),
+	};
+	uint32_t failures = 0;
+	for (const Quat &orientation : orientations)
+	{
+		std::vector<unsigned char> expected(dstPitch * CHECK_IMAGE_HEIGHT, 0), actual(dstPitch * CHECK_IMAGE_HEIGHT, 0);
+		renderer.renderScalar(pano.data(), panoWidth, panoHeight, panoPitch, orientation, expected.data(), dstPitch);
+		renderer.render(pano.data(), panoWidth, panoHeight, panoPitch, orientation, actual.data(), dstPitch);
+		failures += compareBits("ViewportRenderer::render", expected.data(), actual.data(), expected.size());
+	}
+	return failures;
+}
+
+//***********************************************************************************
+// Pyramid kernels. Float outputs must match to the bit as well.
+
+static uint32_t
+checkPyramid(CheckRandom &random)
+{
+	const size_t floats = CHECK_PIXELS * 4;
+	uint32_t failures = 0;
+
+	std::vector<unsigned char> bytes(floats);
+	random.fill(bytes);
+	std::vector<float> expected(floats * 2), actual(floats * 2);
+	pyramidLoadRowScalar(bytes.data(), CHECK_PIXELS, expected.data());
+	pyramidLoadRow(bytes.data(), CHECK_PIXELS, actual.data());
+	failures += compareBits("pyramidLoadRow", expected.data(), actual.data(), floats * sizeof(float));
+
+	// Quarter steps, so ties round to even, and values past both ends
+	std::vector<float> src(floats * 2);
+	for (size_t i = 0; i < floats; i++)
+		src[i] = (float)random.below(1360) * 0.25f - 40.0f;
+	std::vector<unsigned char> expectedBytes(floats, 0), actualBytes(floats, 0);
+	pyramidStoreRowScalar(src.data(), CHECK_PIXELS, expectedBytes.data());
+	pyramidStoreRow(src.data(), CHECK_PIXELS, actualBytes.data());
+	failures += compareBits("pyramidStoreRow", expectedBytes.data(), actualBytes.data(), floats);
+
+	std::vector<float> rows[5];
+	const float *rowPointers[5];
+	for (int r = 0; r < 5; r++)
+	{
+		rows[r].resize(floats);
+		random.fill(rows[r], -64.0f, 320.0f);
+		rowPointers[r] = rows[r].data();
+	}
+	pyramidFilterColumnsScalar(rowPointers, CHECK_PIXELS, expected.data());
+	pyramidFilterColumns(rowPointers, CHECK_PIXELS, actual.data());
+	failures += compareBits("pyramidFilterColumns", expected.data(), actual.data(), floats * sizeof(float));
+
+	// Short rows as well, which take the scalar path at either end
+	const uint32_t lengths[] = { 1, 2, 3, 4, CHECK_PIXELS };
+	random.fill(src, -64.0f, 320.0f);
+	for (uint32_t pixels : lengths)
+	{
+		std::string suffix = " of " + std::to_string(pixels);
+		pyramidDecimateRowScalar(src.data(), pixels, expected.data());
+		pyramidDecimateRow(src.data(), pixels, actual.data());
+		failures += compareBits("pyramidDecimateRow" + suffix, expected.data(), actual.data(), pixels * 4 * sizeof(float));
+
+		pyramidExpandRowScalar(src.data(), pixels, expected.data());
+		pyramidExpandRow(src.data(), pixels, actual.data());
+		failures += compareBits("pyramidExpandRow" + suffix, expected.data(), actual.data(), pixels * 8 * sizeof(float));
+	}
+
+	std::vector<float> expectedOdd(floats), actualOdd(floats);
+	pyramidInterpolateColumnsScalar(rowPointers[0], rowPointers[1], rowPointers[2], CHECK_PIXELS, expected.data(), expectedOdd.data());
+	pyramidInterpolateColumns(rowPointers[0], rowPointers[1], rowPointers[2], CHECK_PIXELS, actual.data(), actualOdd.data());
+	failures += compareBits("pyramidInterpolateColumns even", expected.data(), actual.data(), floats * sizeof(float));
+	failures += compareBits("pyramidInterpolateColumns odd", expectedOdd.data(), actualOdd.data(), floats * sizeof(float));
+
+	std::vector<float> mask(CHECK_PIXELS);
+	random.fill(mask, 0.0f, 1.0f);
+	for (int coarsest = 0; coarsest < 2; coarsest++)
+	{
+		random.fill(expected, -64.0f, 64.0f);
+		actual = expected;
+		const float *expanded = coarsest ? nullptr : rowPointers[4];
+		pyramidAccumulateBandScalar(rowPointers[3], expanded, mask.data(), CHECK_PIXELS, expected.data());
+		pyramidAccumulateBand(rowPointers[3], expanded, mask.data(), CHECK_PIXELS, actual.data());
+		failures += compareBits(coarsest ? "pyramidAccumulateBand coarsest" : "pyramidAccumulateBand",
+			expected.data(), actual.data(), floats * sizeof(float));
+	}
+
+	random.fill(expected, -64.0f, 64.0f);
+	actual = expected;
+	pyramidAddRowScalar(rowPointers[0], CHECK_PIXELS, expected.data());
+	pyramidAddRow(rowPointers[0], CHECK_PIXELS, actual.data());
+	failures += compareBits("pyramidAddRow", expected.data(), actual.data(), floats * sizeof(float));
+	pyramidSubtractRowScalar(rowPointers[1], CHECK_PIXELS, expected.data());
+	pyramidSubtractRow(rowPointers[1], CHECK_PIXELS, actual.data());
+	failures += compareBits("pyramidSubtractRow", expected.data(), actual.data(), floats * sizeof(float));
+	return failures;
+}
+
+//***********************************************************************************
+uint32_t
+kernelCheckRun()
+{
+	cpuSetSimdLimit(CPU_SIMD_AVX2);
+	cpuSimdLevel supported = cpuGetSimdLevel();
+
+	CheckRandom random(1);
+	uint32_t failures = 0;
+	for (int level = CPU_SIMD_SCALAR; level <= supported; level++)
+	{
+		cpuSetSimdLimit((cpuSimdLevel)level);
+		std::cout << cpuSimdLevelName((cpuSimdLevel)level) << " kernels:" << std::endl;
+		uint32_t levelFailures = checkRemapRows(random) + checkRemapSpans(random) + checkDownsample(random) +
+			checkPackYuv(random) + checkPyramid(random) + checkColorConvert(random) + checkViewport(random);
+		if (levelFailures == 0)
+			std::cout << "  all match the scalar kernels" << std::endl;
+		failures += levelFailures;
+	}
+	cpuSetSimdLimit(CPU_SIMD_AVX2);
+
+	if (supported < CPU_SIMD_AVX2)
+		std::cout << "Levels above " << cpuSimdLevelName(supported) << " are not supported here and were not checked" << std::endl;
+	return failures;
+}
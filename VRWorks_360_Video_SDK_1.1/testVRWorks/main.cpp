@@ -50,29 +50,405 @@
 #include <stdint.h>
 #include <iostream>
 #include <string>
-#include <tchar.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "CmdArgsMap.hpp"
 
 #include "app.h"
-
+#include "cpu_stitcher.h"
+#include "frame_pipeline.h"
+#include "frame_trace.h"
+#include "kernel_check.h"
+#include "remap_lut.h"
+#include "session_recording.h"
+#include "thread_pool.h"
+#include "viewport_renderer.h"
+#include "vignetting_fit.h"
+
+#include "xml_util/xml_utility_hl.h"
 #include "xml_util/xml_utility_video.h"
 #include <opencv2/opencv.hpp>
 #include <thread>
 #include <chrono>
 
-// socket include
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#include <stdlib.h>
-#include <stdio.h>
-
-#pragma comment (lib, "Ws2_32.lib")
-
-#define DEFAULT_BUFLEN 1024
 #define SERVER_IP "192.168.0.144"
 #define DEFAULT_PORT "5001"
 
+static panoShmPose_t
+toShmPose(const Quat &orientation, uint64_t timeUs, poseLookup lookup)
+{
+	panoShmPose_t pose;
+	memset(&pose, 0, sizeof(pose));
+	pose.quat[0] = orientation.w;
+	pose.quat[1] = orientation.x;
+	pose.quat[2] = orientation.y;
+	pose.quat[3] = orientation.z;
+	pose.timestamp_us = timeUs;
+	pose.valid = lookup;
+	return pose;
+}
+
+static panoShmPose_t
+lookupPose(const PoseHistory &history, uint64_t timeUs)
+{
+	Quat orientation = quatIdentity();
+	poseLookup lookup = history.lookup(timeUs, &orientation);
+	return toShmPose(orientation, timeUs, lookup);
+}
+
+static void
+printPipelineStats(const FramePipelineStats &stats)
+{
+	if (stats.frames == 0)
+		return;
+
+	std::cout << stats.frames << " frames in " << stats.elapsed_ms << " ms ("
+		<< stats.frames * 1000.0 / stats.elapsed_ms << " fps)" << std::endl;
+	std::cout << "  captured " << stats.captured << ", dropped " << stats.dropped_superseded << " superseded and "
+		<< stats.dropped_stale << " stale" << std::endl;
+	std::cout << "  latency " << stats.latency_ms / stats.frames << " ms average, "
+		<< stats.latency_max_ms << " ms max" << std::endl;
+	for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+		std::cout << "  " << frameStageName((frameStage)stage) << ": "
+			<< stats.stage_ms[stage] / stats.frames << " ms/frame" << std::endl;
+}
+
+// Stitch frames on the CPU backend in row-major and in tiled remap order and
+// compare, feathering the seams so only the remap is timed, then once more
+// with the seams blended multi-band, again with exposure compensation, with
+// the reduced output levels asked for, if any, from 4:2:0 inputs, if asked
+// for, and stabilized against a rig that tilts and turns steadily, if asked
+// for.
+// Inputs are noise, so neighbouring lookups share no cache lines by accident
+// of the content.
+static int
+runRemapBench(const appParams &params, int frames)
+{
+	nvssVideoStitcherProperties_t stitcher_props{ 0 };
+	stitcher_props.version = NVSTITCH_VERSION;
+	stitcher_props.format = NVSS_STITCHER_FORMAT_RGBA8UI;
+	stitcher_props.pipeline = NVSTITCH_STITCHER_PIPELINE_MONO;
+	stitcher_props.projection = (nvstitchPanoramaProjectionType)params.projection;
+	stitcher_props.pano_width = params.pano_width;
+	stitcher_props.quality = params.quality;
+	stitcher_props.feather_width = params.feather_width;
+
+	cpussVideoHandle stitcher;
+	const char *cacheDir = params.lut_cache_dir.empty() ? nullptr : params.lut_cache_dir.c_str();
+	if (cpussVideoCreateInstanceWithCache(&stitcher_props, &params.rig_properties, cacheDir, &stitcher) != NVSTITCH_SUCCESS)
+	{
+		std::cout << "Failed to create the CPU stitcher." << std::endl;
+		return 1;
+	}
+	if (!params.cam_vignetting.empty() && cpussVideoSetVignetting(stitcher, params.cam_vignetting.data()) != NVSTITCH_SUCCESS)
+	{
+		cpussVideoDestroyInstance(stitcher);
+		return 1;
+	}
+
+	uint32_t seed = 1;
+	for (uint32_t camera = 0; camera < params.rig_properties.num_cameras; camera++)
+	{
+		nvstitchImageBuffer_t input;
+		cpussVideoGetInputBuffer(stitcher, camera, &input);
+		for (uint32_t y = 0; y < input.height; y++)
+		{
+			unsigned char *row = (unsigned char*)input.dev_ptr + y * input.pitch;
+			for (size_t x = 0; x < input.row_bytes; x++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				row[x] = (unsigned char)(seed >> 24);
+			}
+		}
+	}
+
+	const cpussRemapOrder orders[] = { CPUSS_REMAP_ORDER_ROWS, CPUSS_REMAP_ORDER_TILED };
+	const char *names[] = { "row-major", "tiled" };
+	cpussRemapSchedule_t schedules[2];
+	cpussVideoSetBlendMode(stitcher, CPUSS_BLEND_FEATHER);
+	for (int i = 0; i < 2; i++)
+	{
+		if (cpussVideoSetRemapOrder(stitcher, orders[i]) != NVSTITCH_SUCCESS ||
+			cpussVideoGetRemapSchedule(stitcher, orders[i], &schedules[i]) != NVSTITCH_SUCCESS)
+		{
+			cpussVideoDestroyInstance(stitcher);
+			return 1;
+		}
+		// One frame to warm the caches and fault in the tables
+		cpussVideoStitch(stitcher);
+	}
+
+	// The orders take turns frame by frame, so a machine that speeds up or
+	// slows down during the run weighs on both alike
+	double orderMs[2] = { 0.0, 0.0 };
+	for (int frame = 0; frame < frames; frame++)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			cpussVideoSetRemapOrder(stitcher, orders[i]);
+			auto start = std::chrono::steady_clock::now();
+			cpussVideoStitch(stitcher);
+			orderMs[i] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+
+	for (int i = 0; i < 2; i++)
+	{
+		const cpussRemapSchedule_t &schedule = schedules[i];
+		std::cout << names[i] << ": " << schedule.num_tiles << " tiles of " << schedule.tile_width << "x" << schedule.tile_height
+			<< ", footprint " << schedule.mean_footprint / 1024 << " KB average, " << schedule.max_footprint / 1024 << " KB max, "
+			<< schedule.overlap_pixels * 100.0 / (schedule.copy_pixels + schedule.overlap_pixels) << "% overlap, "
+			<< (schedule.overlap_pixels ? schedule.fused_pixels * 100.0 / schedule.overlap_pixels : 0.0) << "% of it fused, "
+			<< orderMs[i] / frames << " ms/frame" << std::endl;
+	}
+
+	cpussBlendBands_t bands;
+	if (cpussVideoSetBlendMode(stitcher, CPUSS_BLEND_MULTIBAND) != NVSTITCH_SUCCESS ||
+		cpussVideoGetBlendBands(stitcher, &bands) != NVSTITCH_SUCCESS)
+	{
+		cpussVideoDestroyInstance(stitcher);
+		return 1;
+	}
+	cpussVideoStitch(stitcher);
+	auto start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++)
+		cpussVideoStitch(stitcher);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	// The blend's share of the panorama should follow the overlap's
+	const cpussRemapSchedule_t &tiled = schedules[1];
+	double panoPixels = (double)(tiled.copy_pixels + tiled.overlap_pixels);
+	std::cout << "tiled, multi-band: " << bands.num_blocks << " seam blocks of up to " << bands.block_size << " pixels in "
+		<< bands.levels + 1 << " bands, " << bands.blended_pixels * 100.0 / panoPixels << "% of the panorama blended ("
+		<< bands.window_pixels * 100.0 / panoPixels << "% padded) for " << tiled.overlap_pixels * 100.0 / panoPixels
+		<< "% overlap, " << ms / frames << " ms/frame, " << (ms - orderMs[1]) / frames << " ms more than feathered" << std::endl;
+
+	cpussGainMode gainMode = params.gain_mode == CPUSS_GAIN_CHANNEL ? CPUSS_GAIN_CHANNEL : CPUSS_GAIN_CAMERA;
+	if (cpussVideoSetGainCompensation(stitcher, gainMode, params.gain_smoothing) != NVSTITCH_SUCCESS)
+	{
+		cpussVideoDestroyInstance(stitcher);
+		return 1;
+	}
+	cpussVideoStitch(stitcher);
+	start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++)
+		cpussVideoStitch(stitcher);
+	ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "tiled, multi-band, gain compensated: " << ms / frames << " ms/frame, gains";
+	for (uint32_t camera = 0; camera < params.rig_properties.num_cameras; camera++)
+	{
+		float gains[3];
+		cpussVideoGetCameraGains(stitcher, camera, gains);
+		std::cout << " " << gains[0] << "/" << gains[1] << "/" << gains[2];
+	}
+	std::cout << std::endl;
+
+	if (params.output_levels > 1)
+	{
+		if (cpussVideoSetOutputLevels(stitcher, params.output_levels) != NVSTITCH_SUCCESS)
+		{
+			cpussVideoDestroyInstance(stitcher);
+			return 1;
+		}
+		cpussVideoStitch(stitcher);
+		start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < frames; frame++)
+			cpussVideoStitch(stitcher);
+		ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "tiled, multi-band, gain compensated, " << params.output_levels << " output levels: "
+			<< ms / frames << " ms/frame" << std::endl;
+	}
+
+	// The frames as the session hands them over, BGR ones included
+	{
+		cpussInputFormat format = params.input_format == STITCH_FRAME_BGR ? CPUSS_INPUT_BGR8 :
+			(cpussInputFormat)params.input_format;
+		if (cpussVideoSetInputFormat(stitcher, format) != NVSTITCH_SUCCESS)
+		{
+			cpussVideoDestroyInstance(stitcher);
+			return 1;
+		}
+		for (uint32_t camera = 0; camera < params.rig_properties.num_cameras; camera++)
+		{
+			cpussInputPlanes_t planes;
+			cpussVideoGetInputPlanes(stitcher, camera, &planes);
+			for (uint32_t plane = 0; plane < planes.num_planes; plane++)
+			{
+				const nvstitchImageBuffer_t &input = planes.planes[plane];
+				for (uint32_t y = 0; y < input.height; y++)
+				{
+					unsigned char *row = (unsigned char*)input.dev_ptr + y * input.pitch;
+					for (size_t x = 0; x < input.row_bytes; x++)
+					{
+						seed = seed * 1664525u + 1013904223u;
+						row[x] = (unsigned char)(seed >> 24);
+					}
+				}
+			}
+		}
+		cpussVideoStitch(stitcher);
+		start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < frames; frame++)
+			cpussVideoStitch(stitcher);
+		ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		const char *formats[] = { "BGR", "I420", "NV12" };
+		std::cout << "tiled, multi-band, gain compensated, from " << formats[params.input_format]
+			<< ": " << ms / frames << " ms/frame" << std::endl;
+	}
+
+	// A degree of yaw and a fifth of one of pitch a frame, copying the output
+	// out as the session does; the table rebuilds run alongside
+	if (params.stabilize_mode != CPUSS_STABILIZE_OFF)
+	{
+		if (cpussVideoSetStabilization(stitcher, (cpussStabilizeMode)params.stabilize_mode,
+			params.stabilize_tolerance_deg) != NVSTITCH_SUCCESS)
+		{
+			cpussVideoDestroyInstance(stitcher);
+			return 1;
+		}
+		nvstitchImageBuffer_t output;
+		cpussVideoGetOutputBuffer(stitcher, NVSTITCH_EYE_MONO, &output);
+		std::vector<unsigned char> copy(output.pitch * output.height);
+		const float degree = 3.14159265f / 180.0f;
+		start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			Quat rig = quatFromYawPitchRoll(frame * degree, 0.2f * frame * degree, 0.0f);
+			float orientation[4] = { rig.w, rig.x, rig.y, rig.z };
+			cpussVideoSetRigOrientation(stitcher, orientation);
+			cpussVideoStitch(stitcher);
+			cpussVideoCopyOutput(stitcher, 0, copy.data(), output.pitch);
+		}
+		ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		cpussStabilization_t stabilization;
+		cpussVideoGetStabilization(stitcher, &stabilization);
+		std::cout << "tiled, multi-band, gain compensated, stabilized: " << ms / frames << " ms/frame, "
+			<< stabilization.rebuilds << " table rebuilds of " << stabilization.rebuild_ms << " ms, "
+			<< stabilization.residual_deg << " degrees behind" << std::endl;
+	}
+
+	// The panorama written as 4:2:0, copied out as the session does
+	if (params.output_format != STITCH_OUTPUT_RGBA)
+	{
+		if (cpussVideoSetOutputFormat(stitcher, (cpussOutputFormat)params.output_format) != NVSTITCH_SUCCESS)
+		{
+			cpussVideoDestroyInstance(stitcher);
+			return 1;
+		}
+		cpussOutputPlanes_t output;
+		cpussVideoGetOutputPlanes(stitcher, &output);
+		std::vector<unsigned char> copy[3];
+		void *dst[3] = { nullptr, nullptr, nullptr };
+		size_t pitches[3] = { 0, 0, 0 };
+		size_t bytes = 0;
+		for (uint32_t plane = 0; plane < output.num_planes; plane++)
+		{
+			copy[plane].resize(output.planes[plane].row_bytes * output.planes[plane].height);
+			dst[plane] = copy[plane].data();
+			pitches[plane] = output.planes[plane].row_bytes;
+			bytes += copy[plane].size();
+		}
+		cpussVideoStitch(stitcher);
+		start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			cpussVideoStitch(stitcher);
+			cpussVideoCopyOutputPlanes(stitcher, dst, pitches);
+		}
+		ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "tiled, multi-band, gain compensated, to " << (params.output_format == STITCH_OUTPUT_I420 ? "I420" : "NV12")
+			<< ": " << ms / frames << " ms/frame, " << bytes << " bytes" << std::endl;
+	}
+
+	cpussVideoDestroyInstance(stitcher);
+	return 0;
+}
+
+// Fit the rig's lens vignetting from where its calibration images overlap,
+// and write the rig spec with it to outPath. Every set of images adds to one
+// fit; they are blurred first, so small misalignments across the seams
+// average out.
+static int
+runVignettingFit(const appParams &params, const std::string &rigPath, const std::string &outPath)
+{
+	std::vector<std::vector<std::string>> calibFiles;
+	if (!xmlutil::readInputCalibFilenamesXml(rigPath, calibFiles) || calibFiles.empty())
+	{
+		std::cout << std::endl << "Failed to retrieve calibration images from XML file." << std::endl;
+		return 1;
+	}
+
+	nvssVideoStitcherProperties_t stitcher_props{ 0 };
+	stitcher_props.version = NVSTITCH_VERSION;
+	stitcher_props.format = NVSS_STITCHER_FORMAT_RGBA8UI;
+	stitcher_props.pipeline = NVSTITCH_STITCHER_PIPELINE_MONO;
+	stitcher_props.projection = NVSTITCH_PANORAMA_PROJECTION_EQUIRECTANGULAR;
+	stitcher_props.pano_width = params.pano_width;
+	stitcher_props.quality = params.quality;
+	stitcher_props.feather_width = params.feather_width;
+
+	ThreadPool pool;
+	RemapTables tables;
+	VignettingFit fit;
+	if (tables.build(stitcher_props, params.rig_properties, pool) != NVSTITCH_SUCCESS ||
+		fit.build(tables, params.rig_properties) != NVSTITCH_SUCCESS)
+	{
+		std::cout << "Failed to map the rig's overlaps." << std::endl;
+		return 1;
+	}
+
+	uint32_t numCameras = params.rig_properties.num_cameras;
+	for (const std::vector<std::string> &frame : calibFiles)
+	{
+		std::vector<cv::Mat> images(numCameras);
+		std::vector<remapSource_t> sources(numCameras);
+		for (uint32_t camera = 0; camera < numCameras; camera++)
+		{
+			const nvstitchCameraProperties_t &cam = params.rig_properties.cameras[camera];
+			if (camera < frame.size())
+				images[camera] = cv::imread(params.input_base_dir + frame[camera]);
+			if (images[camera].empty() || images[camera].cols != (int)cam.image_size.x || images[camera].rows != (int)cam.image_size.y)
+			{
+				std::cout << "Calibration image " << (camera < frame.size() ? frame[camera] : "") << " is missing or not "
+					<< cam.image_size.x << "x" << cam.image_size.y << std::endl;
+				return 1;
+			}
+			cv::blur(images[camera], images[camera], cv::Size(9, 9));
+			sources[camera].format = REMAP_SOURCE_BGR8;
+			sources[camera].plane[0] = images[camera].data;
+			sources[camera].pitch[0] = images[camera].step;
+		}
+		fit.addFrame(sources.data());
+	}
+
+	float coefficients[VIGNETTING_COEFFICIENTS];
+	float rms = 0.0f;
+	uint32_t terms = 0;
+	if (!fit.solve(coefficients, &rms, &terms))
+	{
+		std::cout << "The " << fit.numSamples() << " overlap samples do not determine the vignetting; "
+			"try calibration images with more texture and less clipping." << std::endl;
+		return 1;
+	}
+	std::cout << "Vignetting from " << fit.numSamples() << " samples: v1 " << coefficients[0] << ", v2 " << coefficients[1]
+		<< ", v3 " << coefficients[2] << ", correction " << LensVignetting::evaluate(coefficients, 1.0f)
+		<< " at the edge, rms " << rms << " in log brightness" << std::endl;
+	if (terms < VIGNETTING_COEFFICIENTS)
+		std::cout << "Warning: the overlaps see the lenses over too narrow a band of radii to tell the falloff's terms apart; "
+			"only " << terms << " of " << VIGNETTING_COEFFICIENTS << " were fitted, and the correction away from the overlaps "
+			"is extrapolated" << std::endl;
+
+	std::vector<float> all;
+	for (uint32_t camera = 0; camera < numCameras; camera++)
+		all.insert(all.end(), coefficients, coefficients + VIGNETTING_COEFFICIENTS);
+	if (!xmlutil::writeCameraVignettingXml(rigPath, outPath, all))
+	{
+		std::cout << "Failed to write " << outPath << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
 uint32_t
 main(int argc, char *argv[])
 {
@@ -82,32 +458,127 @@ main(int argc, char *argv[])
 	bool show_help = false;
 	std::string rig_spec_name;
 	std::string image_input_name;
+	std::string stitcher_spec_name;
 	//myAppParams.pano_width = 3840;
 	myAppParams.pano_width = 2560;
+	myAppParams.projection = CPUSS_PROJECTION_EQUIRECTANGULAR;
 	myAppParams.quality = NVSTITCH_STITCHER_QUALITY_HIGH;
 	myAppParams.out_file = "stacked_360.bmp";
 	myAppParams.stereo_flag = false;
+	myAppParams.host_backend = false;
+	myAppParams.cpu_backend = false;
+	myAppParams.feather_width = 2.0f;
+	myAppParams.feather_blend = false;
+	myAppParams.gain_mode = CPUSS_GAIN_CAMERA;
+	myAppParams.gain_smoothing = 0.1f;
+	myAppParams.output_levels = 1;
+	myAppParams.stabilize_mode = CPUSS_STABILIZE_OFF;
+	myAppParams.stabilize_tolerance_deg = 1.0f;
+	myAppParams.input_format = STITCH_FRAME_BGR;
+	myAppParams.output_format = STITCH_OUTPUT_RGBA;
 
 	int pano_width_arg = myAppParams.pano_width;
 	int quality_arg = myAppParams.quality;
+	int output_levels_arg = myAppParams.output_levels;
+	int bench_frames = 0;
+	int remap_bench_frames = 0;
+	int synthetic_frames = 0;
+	int shm_slots = 3;
+	std::string shm_name = PANO_SHM_DEFAULT_NAME;
+	std::string imu_host = SERVER_IP;
+	std::string imu_port = DEFAULT_PORT;
+	bool imu_poll = false;
+	bool imu_loopback = false;
+	float capture_latency_ms = 0.0f;
+	float display_latency_ms = 0.0f;
+	bool viewport = false;
+	int viewport_width = 1280;
+	int viewport_height = 1280;
+	float viewport_fov = 90.0f;
+	bool live = false;
+	float max_staleness_ms = 0.0f;
+	int pipeline_depth = 4;
+	bool trace = false;
+	float trace_report_s = 5.0f;
+	float trace_window_s = 10.0f;
+	std::string trace_file;
+	std::string record_file;
+	int record_mb = 1024;
+	std::string replay_file;
+	bool replay_fast = false;
+	bool no_lut_cache = false;
+	std::string fit_vignetting;
+	bool verify_kernels = false;
 	// Process command line arguments
 	CmdArgsMap cmdArgs = CmdArgsMap(argc, argv, "--")
 		("help", "Produce help message", &show_help)
 		("input_dir_base", "Base directory for input MP4 files", &myAppParams.input_base_dir, myAppParams.input_base_dir)
 		("rig_spec", "XML file containing rig specification", &rig_spec_name, rig_spec_name)
 		("image_input", "XML file containing footage files", &image_input_name, image_input_name)
+		("stitcher_spec", "XML file containing stitcher specification; only its output projection is used", &stitcher_spec_name, stitcher_spec_name)
 		("pano_width", "Width of the output panorama", &pano_width_arg, pano_width_arg)
 		("quality", "Stitch quality (0=high, 1=medium, 2=low)", &quality_arg, quality_arg)
 		("out_file", "Stacked output panorama", &myAppParams.out_file, myAppParams.out_file)
-		("stereo", "Stereo flag", &myAppParams.stereo_flag);
-
-	if (show_help || rig_spec_name.empty())
+		("stereo", "Stereo flag", &myAppParams.stereo_flag)
+		("host_backend", "Stitch in-process on the CPU instead of VRWorks (no GPU required)", &myAppParams.host_backend)
+		("cpu_backend", "Stitch mono on all CPU cores with the rig's lens models (no GPU required)", &myAppParams.cpu_backend)
+		("lut_cache_dir", "Directory for cached CPU remap tables and layouts (default: input_dir_base)", &myAppParams.lut_cache_dir, myAppParams.lut_cache_dir)
+		("no_lut_cache", "Rebuild the CPU remap tables and layouts on every start", &no_lut_cache)
+		("feather_width", "Width of mono seams in output pixels; the CPU backend blends bands up to this coarse", &myAppParams.feather_width, myAppParams.feather_width)
+		("feather_blend", "CPU backend: feather seams instead of blending them multi-band", &myAppParams.feather_blend)
+		("coverage_dump", "CPU backend: write each camera's coverage mask as <prefix>_camN.pgm and <prefix>_count.pgm", &myAppParams.coverage_dump, myAppParams.coverage_dump)
+		("gain_compensation", "CPU backend: match camera exposures (0=off, 1=per camera, 2=per camera and channel)", &myAppParams.gain_mode, myAppParams.gain_mode)
+		("gain_smoothing", "CPU backend: share of each frame's exposure estimate in the gains, in (0, 1]", &myAppParams.gain_smoothing, myAppParams.gain_smoothing)
+		("output_levels", "CPU backend: publish the panorama and this many - 1 halvings of it together, e.g. 3 for 2560, 1280 and 640 wide", &output_levels_arg, output_levels_arg)
+		("stabilize", "CPU backend: undo the IMU orientation (0=off, 1=level the horizon, 2=hold the panorama fixed in the world)", &myAppParams.stabilize_mode, myAppParams.stabilize_mode)
+		("stabilize_tolerance_deg", "CPU backend: tilt left uncorrected before the remap tables are rebuilt for it", &myAppParams.stabilize_tolerance_deg, myAppParams.stabilize_tolerance_deg)
+		("input_format", "Frames as decoded: 0=BGR through videoconvert, or, CPU backend only, stitched as they are 1=I420, 2=NV12", &myAppParams.input_format, myAppParams.input_format)
+		("output_format", "Panorama as published: 0=RGBA, or, CPU backend only, written as 4:2:0 by the stitcher 1=I420, 2=NV12", &myAppParams.output_format, myAppParams.output_format)
+		("bench_frames", "Stitch this many synthetic frames, report timing and exit", &bench_frames, bench_frames)
+		("remap_bench", "Time this many CPU stitches in row-major and in tiled remap order and exit", &remap_bench_frames, remap_bench_frames)
+		("fit_vignetting", "Fit lens vignetting from the rig's input_calib_file images, write the rig spec with it to this file and exit", &fit_vignetting, fit_vignetting)
+		("verify_kernels", "Compare every SIMD kernel with its scalar reference at each instruction set level and exit", &verify_kernels)
+		("synthetic_frames", "Run the stitch pipeline on this many generated frames and exit", &synthetic_frames, synthetic_frames)
+		("shm_name", "Name of the shared memory panorama output", &shm_name, shm_name)
+		("shm_slots", "Number of frame slots in the shared memory output", &shm_slots, shm_slots)
+		("imu_host", "Address of the IMU orientation server", &imu_host, imu_host)
+		("imu_port", "Port of the IMU orientation server", &imu_port, imu_port)
+		("imu_poll", "Use the legacy one-request-per-connection IMU protocol instead of a stream", &imu_poll)
+		("imu_loopback", "Serve a synthetic IMU stream on 127.0.0.1:imu_port and use it", &imu_loopback)
+		("capture_latency_ms", "Time from exposure to decoded frame; frame poses are looked up this much earlier", &capture_latency_ms, capture_latency_ms)
+		("display_latency_ms", "Also publish the pose predicted this far past publishing, for display", &display_latency_ms, display_latency_ms)
+		("viewport", "Publish a rectilinear view along the IMU pose instead of the full panorama", &viewport)
+		("viewport_width", "Width of the published view", &viewport_width, viewport_width)
+		("viewport_height", "Height of the published view", &viewport_height, viewport_height)
+		("viewport_fov", "Horizontal field of view of the published view, degrees", &viewport_fov, viewport_fov)
+		("live", "Keep draining the camera and stitch only the newest frame, dropping the rest", &live)
+		("max_staleness_ms", "Drop frames older than this when they reach the stitcher (0 = never)", &max_staleness_ms, max_staleness_ms)
+		("pipeline_depth", "Frames in flight between capture and publish", &pipeline_depth, pipeline_depth)
+		("trace", "Trace every stage of every frame and report latency percentiles", &trace)
+		("trace_report_s", "Seconds between trace reports while running (0 = only at exit)", &trace_report_s, trace_report_s)
+		("trace_window_s", "Seconds of history the trace percentiles cover", &trace_window_s, trace_window_s)
+		("trace_file", "Write the trace as Chrome trace_event JSON to this file at exit", &trace_file, trace_file)
+		("record", "Record decoded frames and IMU traffic of the session to this file", &record_file, record_file)
+		("record_mb", "Initial size of the recording file in MB; it grows as needed", &record_mb, record_mb)
+		("replay", "Replay frames and IMU traffic from this recording instead of the camera and IMU server", &replay_file, replay_file)
+		("replay_fast", "Replay as fast as the pipeline runs instead of at the recorded timing", &replay_fast);
+
+	if (show_help || (rig_spec_name.empty() && !verify_kernels))
 	{
 		std::cout << "Low-Level Video Stitch Sample Application" << std::endl;
 		std::cout << cmdArgs.help();
 		return 1;
 	}
 
+	// Needs no rig or inputs
+	if (verify_kernels)
+	{
+		uint32_t failures = kernelCheckRun();
+		std::cout << (failures == 0 ? "All SIMD kernels match their scalar references." :
+			std::to_string(failures) + " SIMD kernels differ from their scalar references.") << std::endl;
+		return failures == 0 ? 0 : 1;
+	}
+
 	if (image_input_name.empty())
 	{
 		image_input_name = rig_spec_name;
@@ -131,6 +602,44 @@ main(int argc, char *argv[])
 	}
 	myAppParams.quality = (nvstitchStitcherQuality)quality_arg;
 
+	if (myAppParams.feather_width <= 0.0f)
+	{
+		std::cout << "Invalid feather_width - must be greater than zero.\n";
+		return 1;
+	}
+
+	if (output_levels_arg < 1 || output_levels_arg > PANO_SHM_MAX_LEVELS)
+	{
+		std::cout << "Invalid output_levels: 1 to " << PANO_SHM_MAX_LEVELS << "\n";
+		return 1;
+	}
+	myAppParams.output_levels = (uint32_t)output_levels_arg;
+
+	if (myAppParams.stabilize_mode < CPUSS_STABILIZE_OFF || myAppParams.stabilize_mode > CPUSS_STABILIZE_WORLD ||
+		!(myAppParams.stabilize_tolerance_deg >= 0.0f && myAppParams.stabilize_tolerance_deg < 180.0f))
+	{
+		std::cout << "Invalid stabilize: 0 to 2, with stabilize_tolerance_deg in [0, 180)\n";
+		return 1;
+	}
+
+	if (myAppParams.input_format < STITCH_FRAME_BGR || myAppParams.input_format > STITCH_FRAME_NV12)
+	{
+		std::cout << "Invalid input_format: 0=BGR, 1=I420, 2=NV12\n";
+		return 1;
+	}
+
+	if (myAppParams.output_format < STITCH_OUTPUT_RGBA || myAppParams.output_format > STITCH_OUTPUT_NV12)
+	{
+		std::cout << "Invalid output_format: 0=RGBA, 1=I420, 2=NV12\n";
+		return 1;
+	}
+
+	if (pipeline_depth < (live ? 3 : 2))
+	{
+		std::cout << "Invalid pipeline_depth: at least 2, or 3 with --live\n";
+		return 1;
+	}
+
 	if (!myAppParams.input_base_dir.empty())
 	{
 		switch (myAppParams.input_base_dir[myAppParams.input_base_dir.size() - 1])
@@ -145,6 +654,10 @@ main(int argc, char *argv[])
 			break;
 		}
 	}
+	if (no_lut_cache)
+		myAppParams.lut_cache_dir.clear();
+	else if (myAppParams.lut_cache_dir.empty())
+		myAppParams.lut_cache_dir = myAppParams.input_base_dir.empty() ? "." : myAppParams.input_base_dir;
 
 	// Fetch rig parameters from XML file.
 	if (!xmlutil::readCameraRigXml(myAppParams.input_base_dir + rig_spec_name, myAppParams.cam_properties, &myAppParams.rig_properties))
@@ -153,6 +666,21 @@ main(int argc, char *argv[])
 		return 1;
 	}
 
+	if (!fit_vignetting.empty())
+		return runVignettingFit(myAppParams, myAppParams.input_base_dir + rig_spec_name, fit_vignetting);
+
+	// Lens vignetting, if the rig has any
+	if (!xmlutil::readCameraVignettingXml(myAppParams.input_base_dir + rig_spec_name, myAppParams.cam_vignetting))
+	{
+		std::cout << std::endl << "Failed to retrieve vignetting from XML file." << std::endl;
+		return 1;
+	}
+	bool vignetted = false;
+	for (float coefficient : myAppParams.cam_vignetting)
+		vignetted = vignetted || coefficient != 0.0f;
+	if (!vignetted)
+		myAppParams.cam_vignetting.clear();
+
 	// Fetch input media feeds from XML file.
 	if (!xmlutil::readInputMediaFeedFilenamesXml(myAppParams.input_base_dir + image_input_name, myAppParams.filenames))
 	{
@@ -160,165 +688,315 @@ main(int argc, char *argv[])
 		return 1;
 	}
 
-	/*
-	if (myApp.run(&myAppParams) != NVSTITCH_SUCCESS)
+	// Output projection from the stitcher spec, if there is one
+	if (!stitcher_spec_name.empty())
 	{
-	std::cout << "Stitcher failure." << std::endl;
-	return 1;
+		// Read the type string directly; the SDK parser rejects the cubemaps
+		std::string projection_type;
+		if (!xmlutil::readOutputProjectionTypeXml(myAppParams.input_base_dir + stitcher_spec_name, projection_type))
+		{
+			std::cout << std::endl << "Failed to retrieve the output projection from XML file." << std::endl;
+			return 1;
+		}
+		if (projection_type == "equirectangular")
+			myAppParams.projection = CPUSS_PROJECTION_EQUIRECTANGULAR;
+		else if (projection_type == "cubemap")
+			myAppParams.projection = CPUSS_PROJECTION_CUBEMAP;
+		else if (projection_type == "equiangular_cubemap")
+			myAppParams.projection = CPUSS_PROJECTION_EQUIANGULAR_CUBEMAP;
+		else
+		{
+			std::cout << std::endl << "Invalid output projection type: " << projection_type << std::endl;
+			return 1;
+		}
 	}
-	*/
-	//cv::VideoCapture cap("udpsrc port=5000 ! application/x-rtp,media=video,payload=26,clock-rate=90000,encoding-name=JPEG,framerate=30/1 ! rtpjpegdepay ! jpegdec ! videoconvert ! appsink", cv::CAP_GSTREAMER);
-	cv::VideoCapture cap("udpsrc port=5000 ! application/x-rtp,media=video,payload=96,clock-rate=90000,encoding-name=H264,framerate=30/1 ! rtph264depay ! decodebin ! videoconvert ! appsink", cv::CAP_GSTREAMER);
 
-	while (!cap.isOpened())
+	// Percentiles are printed periodically and at exit; the JSON covers the last spans of each thread
+	TraceReporter trace_reporter;
+	traceEnable(trace || !trace_file.empty());
+	if (traceEnabled())
 	{
-		std::cout << "VideoCapture or VideoWriter not opened" << std::endl;
-		std::this_thread::sleep_for(std::chrono::seconds(1));
+		traceSetThreadName("main");
+		if (trace_report_s > 0.0f)
+			trace_reporter.start(trace_report_s * 1000.0, trace_window_s * 1000.0);
 	}
-
-	cv::Mat frame;
-	HANDLE FileMappingHandle;
-	unsigned char* FileMapping;
-
-	if ((FileMappingHandle = CreateFileMapping(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, 0, sizeof(unsigned char) * 4 * 3276800 + 19, "mapping")) == 0)
+	auto finishTrace = [&]()
 	{
-		return -12;
+		trace_reporter.stop();
+		if (traceEnabled())
+			tracePrintStats(std::cout, trace_window_s * 1000.0);
+		if (!trace_file.empty() && !traceWriteChromeJson(trace_file))
+			std::cout << "Failed to write trace to " << trace_file << std::endl;
+	};
+
+	if (remap_bench_frames > 0)
+	{
+		int result = runRemapBench(myAppParams, remap_bench_frames);
+		finishTrace();
+		return result;
 	}
 
-	if ((FileMapping = (unsigned char*)MapViewOfFile(FileMappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(unsigned char) * 4 * 3276800 + 19)) == 0)
+	if (bench_frames > 0)
 	{
-		return -13;
-	}
+		const nvstitchCameraProperties_t &cam = myAppParams.rig_properties.cameras[0];
+		cv::Mat frame((int)cam.image_size.y, (int)cam.image_size.x * 2, CV_8UC3, cv::Scalar(64, 128, 192));
+		cv::Mat leftCamera = frame(cv::Range::all(), cv::Range(0, (int)cam.image_size.x));
+		cv::Mat rightCamera = frame(cv::Range::all(), cv::Range((int)cam.image_size.x, (int)cam.image_size.x * 2));
 
-	printf("file mapping created");
+		StitchSession bench;
+		if (bench.init(&myAppParams, appStitchBackend(&myAppParams)) != NVSTITCH_SUCCESS)
+			return 1;
 
-	// Initial Socket
-	WSADATA wsaData;
-	SOCKET ConnectSocket = INVALID_SOCKET;
-	struct addrinfo *result = NULL, *ptr = NULL, hints;
-	const char *sendbuf = "this is a test";
-	char recvbuf[DEFAULT_BUFLEN];
-	int iResult = 0;
-	int recvbuflen = DEFAULT_BUFLEN;
+		// 4:2:0 frames go in as planes, into a panorama of the bench's own
+		cv::Mat yuv;
+		cv::Mat planes[2][3];
+		std::vector<unsigned char> pano;
+		if (bench.frameFormat() != STITCH_FRAME_BGR)
+		{
+			yuv.create((int)cam.image_size.y * 3 / 2, (int)cam.image_size.x * 2, CV_8UC1);
+			yuv.setTo(cv::Scalar(128));
+			if (bench.splitPlanes(yuv, planes) != NVSTITCH_SUCCESS)
+				return 1;
+			pano.resize(bench.outputBytes());
+		}
 
-	// Initialize Winsock
-	iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-	if (iResult != 0) {
-		printf("WSAStartup failed with error: %d\n", iResult);
-		return 1;
-	}
+		double upload_ms = 0.0, stitch_ms = 0.0, download_ms = 0.0;
+		for (int i = 0; i < bench_frames; i++)
+		{
+			traceSetFrame(i);
+			nvstitchResult result = bench.frameFormat() == STITCH_FRAME_BGR ? bench.stitchFrame(leftCamera, rightCamera) :
+				bench.stitchPlanes(planes, pano.data(), bench.outputPitch());
+			if (result != NVSTITCH_SUCCESS)
+			{
+				std::cout << "Stitching failed." << std::endl;
+				return 1;
+			}
+			upload_ms += bench.lastUploadMs();
+			stitch_ms += bench.lastStitchMs();
+			download_ms += bench.lastDownloadMs();
+		}
 
-	ZeroMemory(&hints, sizeof(hints));
-	hints.ai_family = AF_INET;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = IPPROTO_TCP;
+		std::cout << bench_frames << " frames, average per frame: upload " << upload_ms / bench_frames
+			<< " ms, stitch " << stitch_ms / bench_frames << " ms, download " << download_ms / bench_frames << " ms" << std::endl;
+		finishTrace();
+		return 0;
+	}
 
-	// Resolve the server address and port
-	iResult = getaddrinfo(SERVER_IP, DEFAULT_PORT, &hints, &result);
-	if (iResult != 0) {
-		printf("getaddrinfo failed with error: %d\n", iResult);
-		WSACleanup();
+	// Create the stitcher once, up front, instead of per frame
+	if (myApp.init(&myAppParams) != NVSTITCH_SUCCESS)
+	{
+		std::cout << "Stitcher initialization failed." << std::endl;
 		return 1;
 	}
 
-	while (true) {
-		// receive IMU data from socket
-		// Attempt to connect to an address until one succeeds
-		for (ptr = result; ptr != NULL; ptr = ptr->ai_next) {
-
-			// Create a SOCKET for connecting to server
-			ConnectSocket = socket(ptr->ai_family, ptr->ai_socktype,
-				ptr->ai_protocol);
-			if (ConnectSocket == INVALID_SOCKET) {
-				printf("socket failed with error: %ld\n", WSAGetLastError());
-				WSACleanup();
-				return 1;
-			}
-
-			// Connect to server.
-			iResult = connect(ConnectSocket, ptr->ai_addr, (int)ptr->ai_addrlen);
-			if (iResult == SOCKET_ERROR) {
-				closesocket(ConnectSocket);
-				ConnectSocket = INVALID_SOCKET;
-				continue;
-			}
-			break;
+	// Readers always find a complete frame in one of the slots; publishing never waits on them
+	StitchSession &session = myApp.getSession();
+	// With a viewport only the view is published, so the slots shrink to match
+	ViewportRenderer renderer;
+	std::vector<unsigned char> view;
+	if (viewport)
+	{
+		if (viewport_width <= 0 || viewport_height <= 0 || !renderer.init(viewport_width, viewport_height, viewport_fov))
+		{
+			std::cout << "Invalid viewport size or field of view." << std::endl;
+			return 1;
 		}
-
-		
-		// Send an initial buffer
-		iResult = send(ConnectSocket, sendbuf, (int)strlen(sendbuf), 0);
-		if (iResult == SOCKET_ERROR) {
-			printf("send failed with error: %d\n", WSAGetLastError());
-			closesocket(ConnectSocket);
-			WSACleanup();
+		if (myAppParams.projection != CPUSS_PROJECTION_EQUIRECTANGULAR)
+		{
+			std::cout << "The viewport is rendered from an equirectangular panorama." << std::endl;
 			return 1;
 		}
-
-		printf("Bytes Sent: %ld\n", iResult);
-		
-
-		// shutdown the connection since no more data will be sent
-		iResult = shutdown(ConnectSocket, SD_SEND);
-		if (iResult == SOCKET_ERROR) {
-			printf("shutdown failed with error: %d\n", WSAGetLastError());
-			closesocket(ConnectSocket);
-			WSACleanup();
+		if (myAppParams.output_levels > 1)
+		{
+			std::cout << "The viewport is published alone, without output levels." << std::endl;
 			return 1;
 		}
-
-		iResult = recv(ConnectSocket, recvbuf, recvbuflen, 0);
-		if (iResult > 0)
+		if (myAppParams.output_format != STITCH_OUTPUT_RGBA)
 		{
-			printf("Bytes received: %d\n", iResult);
-			recvbuf[iResult] = 0;
-			fputs(recvbuf, stdout);
-			//std::this_thread::sleep_for(std::chrono::milliseconds(30));
+			std::cout << "The viewport is rendered from an RGBA panorama." << std::endl;
+			return 1;
 		}
-		else if (iResult == 0)
-			printf("Connection closed\n");
-		else
-			printf("recv failed with error: %d\n", WSAGetLastError());
-
-		// receive captured images from gstreamer
-		cap.read(frame);
-		if (frame.empty())
-			break;
-
-		//cout << "Width: " << frame.size().width << endl;
-		//cout << "Height: " << frame.size().height << endl;
+		view.resize((size_t)viewport_width * viewport_height * 4);
+	}
 
-		int width = frame.size().width;
-		int height = frame.size().height;
-		int halfWidth = width / 2;
+	PanoPublisher publisher;
+	if (!publisher.create(shm_name, shm_slots < 2 ? 2 : shm_slots,
+		viewport ? view.size() : session.outputBytes()))
+	{
+		return -12;
+	}
+	if (viewport)
+		publisher.setProjection(PANO_PROJECTION_RECTILINEAR, renderer.fovXDeg(), renderer.fovYDeg());
+	else if (myAppParams.projection == CPUSS_PROJECTION_CUBEMAP)
+		publisher.setProjection(PANO_PROJECTION_CUBEMAP, 360.0f, 180.0f);
+	else if (myAppParams.projection == CPUSS_PROJECTION_EQUIANGULAR_CUBEMAP)
+		publisher.setProjection(PANO_PROJECTION_EAC, 360.0f, 180.0f);
+	publisher.setStabilization((panoStabilization)myAppParams.stabilize_mode);
+
+	printf("shared memory %s created\n", shm_name.c_str());
+
+	// Everything the pipeline decodes and the IMU sends is appended as it arrives
+	SessionRecorder recorder;
+	if (!record_file.empty())
+	{
+		if (!recorder.create(record_file, (size_t)(record_mb > 0 ? record_mb : 1) << 20))
+			return 1;
+		printf("recording to %s\n", record_file.c_str());
+	}
 
-		cv::Mat leftCamera = frame(cv::Range::all(), cv::Range(0, halfWidth));
-		cv::Mat rightCamera = frame(cv::Range::all(), cv::Range(halfWidth, width));
+	// The IMU is read on its own thread; frames only pick up the latest sample.
+	// A replay feeds the recorded IMU traffic in from the capture thread instead.
+	OrientationLoopbackServer imu_server;
+	OrientationService imu;
+	if (!record_file.empty())
+	{
+		imu.setPacketTap([&](orientationEvent event, const char *data, size_t bytes, uint64_t receiveTimeUs)
+		{
+			recorder.appendImu(event, data, bytes, receiveTimeUs);
+		});
+	}
+	if (imu_loopback && replay_file.empty())
+	{
+		if (!imu_server.start(imu_port))
+			return 1;
+		imu_host = "127.0.0.1";
+		imu_port = imu_server.port();
+	}
+	if ((synthetic_frames == 0 || imu_loopback) && replay_file.empty())
+	{
+		imu.start(imu_host, imu_port, imu_poll ? ORIENTATION_MODE_POLL : ORIENTATION_MODE_STREAM);
+	}
 
-		//cv::namedWindow("left");
-		//imshow("left", leftCamera);
+	auto attachOrientation = [&](FrameSlot &slot)
+	{
+		if (!imu.latest(&slot.orientation))
+			memset(&slot.orientation, 0, sizeof(slot.orientation));
+		if (!record_file.empty())
+			recorder.appendFrame(slot.frame, (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+				slot.capture_time.time_since_epoch()).count());
+	};
+
+	// A stabilized stitch needs the rig's orientation before the samples
+	// after the exposure have all arrived, so it may be extrapolated
+	auto orientRig = [&](FrameSlot &slot)
+	{
+		uint64_t capture_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			slot.capture_time.time_since_epoch()).count();
+		panoShmPose_t pose = lookupPose(imu.history(), capture_us - (uint64_t)(capture_latency_ms * 1000.0f));
+		if (pose.valid != POSE_LOOKUP_NONE)
+			session.setRigOrientation(pose.quat);
+	};
+
+	panoPixelFormat pano_format = appPanoFormat(&myAppParams);
+	auto publish = [&](FrameSlot &slot)
+	{
+		uint64_t capture_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			slot.capture_time.time_since_epoch()).count();
 
-		//cv::namedWindow("right");
-		//imshow("right", rightCamera);
+		// By publish time the IMU samples around the capture have arrived, so
+		// the pose is interpolated to the moment the frame was taken
+		uint64_t exposure_us = capture_us - (uint64_t)(capture_latency_ms * 1000.0f);
+		panoShmPose_t pose = lookupPose(imu.history(), exposure_us);
 
-		//imshow("Sender", frame);
-		//if (cv::waitKey(1) == 's')
-		//break;
+		panoShmPose_t display_pose;
+		memset(&display_pose, 0, sizeof(display_pose));
+		if (display_latency_ms > 0.0f || viewport)
+			display_pose = lookupPose(imu.history(), panoSteadyTimeUs() + (uint64_t)(display_latency_ms * 1000.0f));
 
+		if (session.outputFormat() != STITCH_OUTPUT_RGBA)
+		{
+			panoFrameLevel_t planes[PANO_SHM_MAX_PLANES];
+			uint32_t num_planes = appOutputPlanes(session, slot.pano.data(), planes);
+			publisher.publishPlanes(planes, num_planes, pano_format, capture_us, &pose, &display_pose,
+				slot.orientation.text);
+			return;
+		}
+		if (!viewport)
+		{
+			panoFrameLevel_t levels[PANO_SHM_MAX_LEVELS];
+			uint32_t num_levels = appOutputLevels(session, slot.pano.data(), levels);
+			publisher.publishLevels(levels, num_levels, pano_format, capture_us, &pose, &display_pose,
+				slot.orientation.text);
+			return;
+		}
 
-		// Stitch
-		if (myApp.run(&myAppParams, leftCamera, rightCamera, FileMappingHandle, FileMapping, recvbuf) != NVSTITCH_SUCCESS)
+		// Render the view the client will display; straight ahead until the IMU reports
+		Quat look = quatIdentity();
+		if (display_pose.valid)
+		{
+			Quat q = { display_pose.quat[0], display_pose.quat[1], display_pose.quat[2], display_pose.quat[3] };
+			look = q;
+		}
+		renderer.render(slot.pano.data(), slot.pano_width, session.outputHeight() / (myAppParams.stereo_flag ? 2 : 1),
+			session.outputPitch(), look, view.data(), (size_t)renderer.width() * 4);
+		publisher.publish(view.data(), renderer.width(), renderer.height(), renderer.width() * 4,
+			pano_format, capture_us, &pose, &display_pose, slot.orientation.text);
+	};
+
+	// Capture, split, convert, stitch and publish each run on their own thread
+	auto runPipeline = [&](FrameSource &source)
+	{
+		FramePipeline pipeline(session, source, pipeline_depth);
+		pipeline.setSchedule(live ? FRAME_SCHEDULE_LIVE : FRAME_SCHEDULE_QUEUED, max_staleness_ms);
+		pipeline.setCaptureCallback(attachOrientation);
+		if (myAppParams.stabilize_mode != CPUSS_STABILIZE_OFF)
+			pipeline.setStitchCallback(orientRig);
+		pipeline.setPublishCallback(publish);
+		nvstitchResult result = pipeline.run();
+		imu.stop();
+		if (!record_file.empty())
+		{
+			std::cout << "recorded " << recorder.frameCount() << " frames, " << (recorder.dataBytes() >> 20) << " MB" << std::endl;
+			recorder.close();
+		}
+		if (result != NVSTITCH_SUCCESS)
 		{
 			std::cout << "Stitching failed." << std::endl;
 			return 1;
 		}
+		printPipelineStats(pipeline.stats());
+		finishTrace();
+		return 0;
+	};
+
+	if (!replay_file.empty())
+	{
+		// Same pipeline, fed from the recording; no camera or IMU server needed
+		ReplayFrameSource source(replay_fast);
+		if (!source.open(replay_file))
+			return 1;
+		source.setImuSink([&](orientationEvent event, const char *data, size_t bytes, uint64_t receiveTimeUs)
+		{
+			imu.inject(event, data, bytes, receiveTimeUs);
+		});
+		return runPipeline(source);
+	}
 
+	if (synthetic_frames > 0)
+	{
+		// Run the full pipeline on generated frames, without camera or (unless looped back) IMU
+		const nvstitchCameraProperties_t &cam = myAppParams.rig_properties.cameras[0];
+		SyntheticFrameSource source(cam.image_size.x, cam.image_size.y, synthetic_frames,
+			(stitchFrameFormat)myAppParams.input_format);
+		return runPipeline(source);
 	}
-	cv::destroyAllWindows();
 
-	// cleanup socket
-	closesocket(ConnectSocket);
-	WSACleanup();
+	//GstreamerFrameSource source("udpsrc port=5000 ! application/x-rtp,media=video,payload=26,clock-rate=90000,encoding-name=JPEG,framerate=30/1 ! rtpjpegdepay ! jpegdec ! videoconvert ! appsink");
+	// 4:2:0 frames leave the decoder as they are; videoconvert only steps in
+	// when it decodes to another layout
+	std::string decoded = "udpsrc port=5000 ! application/x-rtp,media=video,payload=96,clock-rate=90000,encoding-name=H264,framerate=30/1 ! rtph264depay ! decodebin ! videoconvert ! ";
+	const char *sink_caps[] = { "appsink", "video/x-raw,format=I420 ! appsink", "video/x-raw,format=NV12 ! appsink" };
+	GstreamerFrameSource source(decoded + sink_caps[myAppParams.input_format]);
 
-	return 0;
-}
\ No newline at end of file
+	while (!source.isOpened())
+	{
+		std::cout << "VideoCapture or VideoWriter not opened" << std::endl;
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+	}
+
+	int status = runPipeline(source);
+
+	cv::destroyAllWindows();
+
+	return status;
+}
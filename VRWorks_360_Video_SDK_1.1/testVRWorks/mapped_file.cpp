@@ -0,0 +1,311 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "mapped_file.h"
+
+#include <iostream>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+	: m_data(nullptr), m_size(0), m_writable(false)
+#if defined(_WIN32) || defined(_WIN64)
+	, m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+#else
+	, m_fd(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+
+bool
+MappedFile::create(const std::string &path, size_t bytes)
+{
+	close();
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, 0,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::cerr << "Cannot create " << path << ", error " << GetLastError() << std::endl;
+		return false;
+	}
+	m_file = file;
+	m_size = bytes;
+	m_writable = true;
+	if (!map(true))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool
+MappedFile::open(const std::string &path)
+{
+	close();
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 0,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::cerr << "Cannot open " << path << ", error " << GetLastError() << std::endl;
+		return false;
+	}
+	m_file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		std::cerr << path << " is empty" << std::endl;
+		close();
+		return false;
+	}
+	m_size = (size_t)size.QuadPart;
+	if (!map(false))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool
+MappedFile::map(bool writable)
+{
+	// A writable mapping larger than the file extends it
+	LARGE_INTEGER size;
+	size.QuadPart = (LONGLONG)m_size;
+	HANDLE mapping = CreateFileMappingA((HANDLE)m_file, 0, writable ? PAGE_READWRITE : PAGE_READONLY,
+		(DWORD)(size.QuadPart >> 32), (DWORD)(size.QuadPart & 0xffffffff), 0);
+	if (!mapping)
+	{
+		std::cerr << "CreateFileMapping failed with error " << GetLastError() << std::endl;
+		return false;
+	}
+
+	void *view = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, m_size);
+	if (!view)
+	{
+		std::cerr << "MapViewOfFile failed with error " << GetLastError() << std::endl;
+		CloseHandle(mapping);
+		return false;
+	}
+	m_mapping = mapping;
+	m_data = (unsigned char*)view;
+	return true;
+}
+
+void
+MappedFile::unmap()
+{
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle((HANDLE)m_mapping);
+	m_data = nullptr;
+	m_mapping = nullptr;
+}
+
+void
+MappedFile::close(size_t truncateTo)
+{
+	unmap();
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		if (m_writable && truncateTo > 0)
+		{
+			LARGE_INTEGER size;
+			size.QuadPart = (LONGLONG)truncateTo;
+			if (SetFilePointerEx((HANDLE)m_file, size, 0, FILE_BEGIN))
+				SetEndOfFile((HANDLE)m_file);
+		}
+		CloseHandle((HANDLE)m_file);
+	}
+	m_file = INVALID_HANDLE_VALUE;
+	m_size = 0;
+	m_writable = false;
+}
+
+#else
+
+bool
+MappedFile::create(const std::string &path, size_t bytes)
+{
+	close();
+
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		perror(path.c_str());
+		return false;
+	}
+	m_fd = fd;
+	m_size = bytes;
+	m_writable = true;
+	if (ftruncate(fd, (off_t)bytes) != 0)
+	{
+		perror("ftruncate");
+		close();
+		return false;
+	}
+	if (!map(true))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool
+MappedFile::open(const std::string &path)
+{
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		perror(path.c_str());
+		return false;
+	}
+	m_fd = fd;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		std::cerr << path << " is empty" << std::endl;
+		close();
+		return false;
+	}
+	m_size = (size_t)st.st_size;
+	if (!map(false))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool
+MappedFile::map(bool writable)
+{
+	void *view = mmap(nullptr, m_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m_fd, 0);
+	if (view == MAP_FAILED)
+	{
+		perror("mmap");
+		return false;
+	}
+	m_data = (unsigned char*)view;
+	return true;
+}
+
+void
+MappedFile::unmap()
+{
+	if (m_data)
+		munmap(m_data, m_size);
+	m_data = nullptr;
+}
+
+void
+MappedFile::close(size_t truncateTo)
+{
+	unmap();
+	if (m_fd >= 0)
+	{
+		if (m_writable && truncateTo > 0 && ftruncate(m_fd, (off_t)truncateTo) != 0)
+			perror("ftruncate");
+		::close(m_fd);
+	}
+	m_fd = -1;
+	m_size = 0;
+	m_writable = false;
+}
+
+#endif
+
+bool
+MappedFile::grow(size_t bytes)
+{
+	if (!m_writable || bytes <= m_size)
+		return m_writable;
+
+	unmap();
+#if !defined(_WIN32) && !defined(_WIN64)
+	if (ftruncate(m_fd, (off_t)bytes) != 0)
+	{
+		perror("ftruncate");
+		return false;
+	}
+#endif
+	size_t previous = m_size;
+	m_size = bytes;
+	if (map(true))
+		return true;
+
+	// Keep what was written so far reachable
+	m_size = previous;
+	map(true);
+	return false;
+}
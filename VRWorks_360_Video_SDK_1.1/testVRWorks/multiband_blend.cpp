@@ -0,0 +1,928 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "multiband_blend.h"
+#include "camera_model.h"
+#include "pyramid_kernels.h"
+#include "remap_kernels.h"
+#include "remap_lut.h"
+#include "thread_pool.h"
+
+#include <math.h>
+#include <string.h>
+
+static const uint8_t NO_CAMERA = 0xff;
+
+// Smallest block side. Blocks are eight pads wide: the padding stays a
+// modest share of a window, and the band's bounding box within a block
+// still hugs a seam that runs across it. Half as wide costs a fifth more
+// at feather widths of 4 and 8.
+static const uint32_t MIN_BLOCK_SIZE = 32;
+
+static inline uint32_t clampIndex(int64_t index, uint32_t size)
+{
+	return index < 0 ? 0 : (index >= (int64_t)size ? size - 1 : (uint32_t)index);
+}
+
+static inline uint32_t wrapIndex(int64_t index, uint32_t size)
+{
+	int64_t wrapped = index % (int64_t)size;
+	return (uint32_t)(wrapped < 0 ? wrapped + size : wrapped);
+}
+
+// count RGBA pixels of a panorama row from column left on, wrapping around
+// or repeating the edge pixels
+static void copyWindowRow(const unsigned char *row, uint32_t width, bool wrap, int64_t left, uint32_t count,
+	unsigned char *dst)
+{
+	if (!wrap)
+	{
+		for (uint32_t i = 0; i < count; i++)
+			memcpy(dst + (size_t)i * 4, row + (size_t)clampIndex(left + i, width) * 4, 4);
+		return;
+	}
+
+	uint32_t x = wrapIndex(left, width);
+	for (uint32_t done = 0; done < count;)
+	{
+		uint32_t n = width - x < count - done ? width - x : count - done;
+		memcpy(dst + (size_t)done * 4, row + (size_t)x * 4, (size_t)n * 4);
+		done += n;
+		x = 0;
+	}
+}
+
+// Source position of a packed entry: its 2x2 block plus the 8-bit position
+// in it
+static inline void entryPosition(uint32_t xy, uint16_t frac, float *u, float *v)
+{
+	*u = (float)(xy & 0xffff) + (float)(frac & 0xff) * (1.0f / 256.0f);
+	*v = (float)(xy >> 16) + (float)(frac >> 8) * (1.0f / 256.0f);
+}
+
+// One level of a single-channel mask pyramid: the 1 4 6 4 1 / 16 filter the
+// RGBA kernels use, clamped at the edges, at every second pixel
+static void reduceMask(const float *src, uint32_t width, uint32_t height, float *dst)
+{
+	static const float taps[5] = { 1.0f, 4.0f, 6.0f, 4.0f, 1.0f };
+	uint32_t halfWidth = width / 2;
+	uint32_t halfHeight = height / 2;
+	std::vector<float> column(width);
+	for (uint32_t r = 0; r < halfHeight; r++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			float sum = 0.0f;
+			for (int k = 0; k < 5; k++)
+				sum += taps[k] * src[(size_t)clampIndex(2 * (int64_t)r + k - 2, height) * width + x];
+			column[x] = sum * 0.0625f;
+		}
+		for (uint32_t x = 0; x < halfWidth; x++)
+		{
+			float sum = 0.0f;
+			for (int k = 0; k < 5; k++)
+				sum += taps[k] * column[clampIndex(2 * (int64_t)x + k - 2, width)];
+			dst[(size_t)r * halfWidth + x] = sum * 0.0625f;
+		}
+	}
+}
+
+// Pixels within radius, horizontally and vertically, of a nonzero mask pixel
+static void dilateMask(const float *mask, uint32_t width, uint32_t height, uint32_t radius, std::vector<uint8_t> &out)
+{
+	std::vector<uint32_t> prefix((width > height ? width : height) + 1, 0);
+	std::vector<uint8_t> rows((size_t)width * height);
+	for (uint32_t r = 0; r < height; r++)
+	{
+		for (uint32_t j = 0; j < width; j++)
+			prefix[j + 1] = prefix[j] + (mask[(size_t)r * width + j] > 0.0f ? 1 : 0);
+		for (uint32_t j = 0; j < width; j++)
+		{
+			uint32_t lo = j > radius ? j - radius : 0;
+			uint32_t hi = j + radius + 1 < width ? j + radius + 1 : width;
+			rows[(size_t)r * width + j] = prefix[hi] > prefix[lo];
+		}
+	}
+
+	out.resize((size_t)width * height);
+	for (uint32_t j = 0; j < width; j++)
+	{
+		for (uint32_t r = 0; r < height; r++)
+			prefix[r + 1] = prefix[r] + rows[(size_t)r * width + j];
+		for (uint32_t r = 0; r < height; r++)
+		{
+			uint32_t lo = r > radius ? r - radius : 0;
+			uint32_t hi = r + radius + 1 < height ? r + radius + 1 : height;
+			out[(size_t)r * width + j] = prefix[hi] > prefix[lo];
+		}
+	}
+}
+
+// The part of a grid block to blend, in block coordinates, x1 and y1
+// inclusive; empty while x0 > x1
+struct BandBox
+{
+	uint32_t x0, y0, x1, y1;
+
+	BandBox() : x0(UINT32_MAX), y0(UINT32_MAX), x1(0), y1(0) {}
+	bool empty() const { return x0 > x1; }
+	void add(uint32_t left, uint32_t top, uint32_t right, uint32_t bottom)
+	{
+		x0 = left < x0 ? left : x0;
+		y0 = top < y0 ? top : y0;
+		x1 = right > x1 ? right : x1;
+		y1 = bottom > y1 ? bottom : y1;
+	}
+};
+
+// Adds panorama columns left to right and rows top to bottom, inclusive, to
+// the boxes of the grid blocks they cross. Columns wrap around, or stop at
+// the edges of a panorama that does not.
+static void addToBand(std::vector<BandBox> &boxes, uint32_t blocksX, uint32_t blockSize, uint32_t width,
+	uint32_t height, bool wrap, int64_t left, int64_t right, int64_t top, int64_t bottom)
+{
+	top = top < 0 ? 0 : top;
+	bottom = bottom >= (int64_t)height ? height - 1 : bottom;
+	if (!wrap || right - left >= (int64_t)width)
+	{
+		left = left < 0 ? 0 : left;
+		right = right >= (int64_t)width ? width - 1 : right;
+	}
+
+	uint32_t firstRow = (uint32_t)top / blockSize;
+	uint32_t lastRow = (uint32_t)bottom / blockSize;
+	for (int64_t x = left; x <= right;)
+	{
+		uint32_t column = wrapIndex(x, width);
+		uint32_t offset = column % blockSize;
+		int64_t count = blockSize - offset;
+		count = count < (int64_t)(width - column) ? count : width - column;
+		count = count < right - x + 1 ? count : right - x + 1;
+		for (uint32_t by = firstRow; by <= lastRow; by++)
+		{
+			uint32_t r0 = by == firstRow ? (uint32_t)top % blockSize : 0;
+			uint32_t r1 = by == lastRow ? (uint32_t)bottom % blockSize : blockSize - 1;
+			boxes[(size_t)by * blocksX + column / blockSize].add(offset, r0, offset + (uint32_t)count - 1, r1);
+		}
+		x += count;
+	}
+}
+
+//***********************************************************************************
+MultiBandBlender::MultiBandBlender() :
+	m_panoWidth(0),
+	m_panoHeight(0),
+	m_wrap(true),
+	m_levels(0),
+	m_pad(0),
+	m_blockSize(0),
+	m_blendedPixels(0),
+	m_windowPixels(0)
+{
+}
+
+// Panorama column x: equirectangular panoramas wrap around, cube layouts
+// repeat their edge columns
+uint32_t
+MultiBandBlender::column(int64_t x) const
+{
+	return m_wrap ? wrapIndex(x, m_panoWidth) : clampIndex(x, m_panoWidth);
+}
+
+// Pixels before each level in a block's pyramids, and in all of them last
+void
+MultiBandBlender::levelOffsets(const Block &block, size_t *offsets) const
+{
+	offsets[0] = 0;
+	for (uint32_t level = 0; level <= m_levels; level++)
+		offsets[level + 1] = offsets[level] + (size_t)(block.windowWidth >> level) * (block.windowHeight >> level);
+}
+
+nvstitchResult
+MultiBandBlender::build(const RemapTables &tables, const PackedRemapTables &packed, float featherWidth,
+	ThreadPool &pool, const LensVignetting *vignetting)
+{
+	uint32_t width = tables.panoWidth();
+	uint32_t height = tables.panoHeight();
+	uint32_t numCameras = tables.numCameras();
+	if (width == 0 || height == 0 || packed.numCameras() != numCameras ||
+		packed.panoWidth() != width || packed.panoHeight() != height)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	if (numCameras > REMAP_LUT_MAX_CAMERAS)
+		return NVSTITCH_VIDEO_UNSUPPORTED_RIG;
+	m_panoWidth = width;
+	m_panoHeight = height;
+	m_wrap = tables.wrapsAround();
+
+	// A coarsest-level pixel covers about feather_width output pixels
+	float feather = featherWidth > 2.0f ? featherWidth : 2.0f;
+	m_levels = (uint32_t)floorf(log2f(feather) + 0.5f);
+	if (m_levels < 1)
+		m_levels = 1;
+	if (m_levels > MULTIBAND_MAX_LEVELS)
+		m_levels = MULTIBAND_MAX_LEVELS;
+
+	// A band at level L depends on the image and masks within 4 * 2^L - 4
+	// pixels, so pixels further than that from a seam come out as their
+	// owning camera, and a window padded by as much sees all its block
+	// needs. Windows start and end on whole coarsest-level pixels, so every
+	// one samples the levels on the same grid.
+	uint32_t unit = 1u << m_levels;
+	m_pad = ((4u << m_levels) - 4 + unit - 1) / unit * unit;
+	m_blockSize = 8 * m_pad > MIN_BLOCK_SIZE ? 8 * m_pad : MIN_BLOCK_SIZE;
+	m_blockSize = (m_blockSize + MULTIBAND_BLOCK_ALIGN - 1) / MULTIBAND_BLOCK_ALIGN * MULTIBAND_BLOCK_ALIGN;
+
+	// Owner of every pixel: the camera with the largest weight; and how many
+	// cameras the packed tables weigh it with
+	std::vector<uint8_t> owner((size_t)width * height, NO_CAMERA);
+	std::vector<uint8_t> weighted((size_t)width * height, 0);
+	pool.parallelFor(height, [&](size_t y) {
+		std::vector<float> best(width, 0.0f);
+		uint8_t *row = owner.data() + y * width;
+		uint8_t *count = weighted.data() + y * width;
+		for (uint32_t c = 0; c < numCameras; c++)
+		{
+			const nvstitchCameraMappingMatrix_t &matrix = tables.matrix(c);
+			if (y < matrix.map_offset.y || y >= matrix.map_offset.y + matrix.map_size.y)
+				continue;
+			const float *weights = tables.weights(c) + (y - matrix.map_offset.y) * (size_t)matrix.map_size.x;
+			const uint32_t *xy = packed.camera(c).xy.data() + (y - matrix.map_offset.y) * (size_t)matrix.map_size.x;
+			for (uint32_t i = 0; i < matrix.map_size.x; i++)
+			{
+				uint32_t x = matrix.map_offset.x + i;
+				count[x] += (int16_t)(xy[i] & 0xffff) >= 0;
+				if (weights[i] > best[x])
+				{
+					best[x] = weights[i];
+					row[x] = (uint8_t)c;
+				}
+			}
+		}
+	});
+
+	// What each grid block blends: pixels several cameras weigh, where the
+	// remap output mixes them, and pixels within reach of a seam, where
+	// neighbours are owned by different cameras, an equirectangular
+	// panorama wrapping around horizontally. Edges of what the rig sees are
+	// not seams.
+	uint32_t blocksX = (width + m_blockSize - 1) / m_blockSize;
+	uint32_t blocksY = (height + m_blockSize - 1) / m_blockSize;
+	std::vector<BandBox> boxes((size_t)blocksX * blocksY);
+	for (uint32_t y = 0; y < height; y++)
+		for (uint32_t x = 0; x < width; x++)
+		{
+			uint8_t here = owner[(size_t)y * width + x];
+			if (here == NO_CAMERA)
+				continue;
+			if (weighted[(size_t)y * width + x] > 1)
+				boxes[(size_t)(y / m_blockSize) * blocksX + x / m_blockSize].add(x % m_blockSize, y % m_blockSize,
+					x % m_blockSize, y % m_blockSize);
+
+			uint8_t right = x + 1 < width ? owner[(size_t)y * width + x + 1] :
+				(m_wrap ? owner[(size_t)y * width] : NO_CAMERA);
+			uint8_t down = y + 1 < height ? owner[(size_t)(y + 1) * width + x] : NO_CAMERA;
+			if ((right == NO_CAMERA || right == here) && (down == NO_CAMERA || down == here))
+				continue;
+			addToBand(boxes, blocksX, m_blockSize, width, height, m_wrap,
+				(int64_t)x - m_pad, (int64_t)x + 1 + m_pad, (int64_t)y - m_pad, (int64_t)y + 1 + m_pad);
+		}
+
+	// Each box, out to whole coarsest-level pixels, is a block's blended
+	// part, and padded its window
+	std::vector<Block> candidates;
+	for (size_t i = 0; i < boxes.size(); i++)
+	{
+		const BandBox &box = boxes[i];
+		if (box.empty())
+			continue;
+		uint32_t left = box.x0 / unit * unit;
+		uint32_t top = box.y0 / unit * unit;
+		uint32_t right = (box.x1 + unit) / unit * unit;
+		uint32_t bottom = (box.y1 + unit) / unit * unit;
+
+		Block block;
+		memset(&block, 0, sizeof(block));
+		block.x0 = (uint32_t)(i % blocksX) * m_blockSize + left;
+		block.y0 = (uint32_t)(i / blocksX) * m_blockSize + top;
+		block.width = width - block.x0 < right - left ? width - block.x0 : right - left;
+		block.height = height - block.y0 < bottom - top ? height - block.y0 : bottom - top;
+		block.windowWidth = right - left + 2 * m_pad;
+		block.windowHeight = bottom - top + 2 * m_pad;
+		candidates.push_back(block);
+	}
+
+	// Cameras owning any pixel of each window, and whether the block has
+	// pixels no camera sees
+	std::vector<uint32_t> owners(candidates.size(), 0);
+	std::vector<uint8_t> holes(candidates.size(), 0);
+	pool.parallelFor(candidates.size(), [&](size_t i) {
+		const Block &block = candidates[i];
+		int64_t x0 = block.x0;
+		int64_t y0 = block.y0;
+		for (uint32_t r = 0; r < block.windowHeight; r++)
+		{
+			int64_t y = y0 - m_pad + r;
+			const uint8_t *row = owner.data() + (size_t)clampIndex(y, height) * width;
+			bool inside = y >= y0 && y < y0 + block.height;
+			for (uint32_t j = 0; j < block.windowWidth; j++)
+			{
+				int64_t x = x0 - m_pad + j;
+				uint8_t camera = row[column(x)];
+				if (camera != NO_CAMERA)
+					owners[i] |= 1u << camera;
+				else if (inside && x >= x0 && x < x0 + block.width)
+					holes[i] = 1;
+			}
+		}
+	});
+
+	m_blocks.clear();
+	m_blockCameras.clear();
+	m_blendedPixels = 0;
+	m_windowPixels = 0;
+	size_t stagingBytes = 0, coveredBytes = 0;
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		uint32_t count = 0;
+		for (uint32_t c = 0; c < numCameras; c++)
+			count += (owners[i] >> c) & 1;
+		if (count == 0)
+			continue;
+
+		Block block = candidates[i];
+		block.firstCamera = (uint32_t)m_blockCameras.size();
+		block.numCameras = count;
+		block.staging = stagingBytes;
+		stagingBytes += (size_t)block.width * block.height * 4;
+		block.covered = SIZE_MAX;
+		if (holes[i])
+		{
+			block.covered = coveredBytes;
+			coveredBytes += (size_t)block.width * block.height;
+		}
+		m_blocks.push_back(block);
+		m_blendedPixels += (size_t)block.width * block.height;
+		m_windowPixels += (size_t)block.windowWidth * block.windowHeight;
+
+		for (uint32_t c = 0; c < numCameras; c++)
+		{
+			if (((owners[i] >> c) & 1) == 0)
+				continue;
+			BlockCamera entry;
+			memset(&entry, 0, sizeof(entry));
+			entry.camera = c;
+			m_blockCameras.push_back(entry);
+		}
+	}
+
+	// Each block's runs and masks, then packed one block after another
+	std::vector<BlockLayout> layouts(m_blocks.size());
+	pool.parallelFor(m_blocks.size(), [&](size_t block) {
+		layoutBlock(m_blocks[block], packed, vignetting, owner, weighted, layouts[block]);
+	});
+
+	m_runs.clear();
+	m_xy.clear();
+	m_frac.clear();
+	m_weight.clear();
+	m_masks.clear();
+	m_covered.assign(coveredBytes, 0);
+	for (size_t b = 0; b < m_blocks.size(); b++)
+	{
+		const Block &block = m_blocks[b];
+		BlockLayout &layout = layouts[b];
+		size_t offsets[MULTIBAND_MAX_LEVELS + 2];
+		levelOffsets(block, offsets);
+		size_t pixels = offsets[m_levels + 1];
+		for (uint32_t k = 0; k < block.numCameras; k++)
+		{
+			BlockCamera &entry = m_blockCameras[block.firstCamera + k];
+			entry.firstRun = m_runs.size();
+			entry.numRuns = layout.cameraRuns[k + 1] - layout.cameraRuns[k];
+			for (size_t r = layout.cameraRuns[k]; r < layout.cameraRuns[k + 1]; r++)
+			{
+				Run run = layout.runs[r];
+				run.offset += m_xy.size();
+				m_runs.push_back(run);
+			}
+			entry.masks = SIZE_MAX;
+			if (k > 0)
+			{
+				entry.masks = m_masks.size();
+				m_masks.insert(m_masks.end(), layout.masks.begin() + (k - 1) * pixels,
+					layout.masks.begin() + k * pixels);
+			}
+		}
+		m_xy.insert(m_xy.end(), layout.xy.begin(), layout.xy.end());
+		m_frac.insert(m_frac.end(), layout.frac.begin(), layout.frac.end());
+		m_weight.insert(m_weight.end(), layout.weight.begin(), layout.weight.end());
+		if (block.covered != SIZE_MAX)
+			memcpy(m_covered.data() + block.covered, layout.covered.data(), layout.covered.size());
+		BlockLayout().runs.swap(layout.runs);
+
+	}
+	m_staging.assign(stagingBytes, 0);
+	allocateScratch(pool);
+	return NVSTITCH_SUCCESS;
+}
+
+// Scratch for the largest window, and for the most samples of one camera
+// of a block
+void
+MultiBandBlender::allocateScratch(ThreadPool &pool)
+{
+	size_t windowPixels = 0, windowWidth = 0, pyramidPixels = 0, samples = 0;
+	for (const Block &block : m_blocks)
+	{
+		size_t offsets[MULTIBAND_MAX_LEVELS + 2];
+		levelOffsets(block, offsets);
+		size_t window = (size_t)block.windowWidth * block.windowHeight;
+		windowPixels = window > windowPixels ? window : windowPixels;
+		windowWidth = block.windowWidth > windowWidth ? block.windowWidth : windowWidth;
+		pyramidPixels = offsets[m_levels + 1] > pyramidPixels ? offsets[m_levels + 1] : pyramidPixels;
+		for (uint32_t k = 0; k < block.numCameras; k++)
+		{
+			const BlockCamera &entry = m_blockCameras[block.firstCamera + k];
+			if (entry.numRuns == 0)
+				continue;
+			const Run &first = m_runs[entry.firstRun];
+			const Run &last = m_runs[entry.firstRun + entry.numRuns - 1];
+			size_t count = last.offset + last.count - first.offset;
+			samples = count > samples ? count : samples;
+		}
+	}
+
+	m_scratch.resize(pool.size());
+	m_freeScratch.clear();
+	for (size_t i = 0; i < m_scratch.size(); i++)
+	{
+		Scratch &scratch = m_scratch[i];
+		scratch.composite.resize(windowPixels * 4);
+		scratch.reference.resize(windowPixels * 4);
+		scratch.gaussian.resize(pyramidPixels * 4);
+		scratch.band.resize(pyramidPixels * 4);
+		scratch.expanded.resize(windowPixels * 4);
+		scratch.halfExpanded.resize(windowPixels / 2 * 4);
+		scratch.row.resize(windowWidth * 4);
+		scratch.acc.resize(samples * 4);
+		scratch.samples.resize(samples * 4);
+		scratch.pixels.resize(windowPixels * 4);
+		m_freeScratch.push_back(&scratch);
+	}
+}
+
+void
+MultiBandBlender::save(RemapLayoutWriter &writer) const
+{
+	writer.beginSection(REMAP_LAYOUT_BLOCKS);
+	writer.value(m_panoWidth);
+	writer.value(m_panoHeight);
+	writer.value((uint32_t)m_wrap);
+	writer.value(m_levels);
+	writer.value(m_pad);
+	writer.value(m_blockSize);
+	writer.value((uint64_t)m_blendedPixels);
+	writer.value((uint64_t)m_windowPixels);
+	writer.value((uint64_t)m_staging.size());
+	writer.array(m_blocks);
+	writer.array(m_blockCameras);
+	writer.array(m_runs);
+	writer.array(m_xy);
+	writer.array(m_frac);
+	writer.array(m_weight);
+	writer.array(m_masks);
+	writer.array(m_covered);
+}
+
+bool
+MultiBandBlender::load(RemapLayoutReader &reader, const RemapTables &tables, ThreadPool &pool)
+{
+	uint32_t wrap;
+	uint64_t blendedPixels, windowPixels, stagingBytes;
+	bool ok = reader.beginSection(REMAP_LAYOUT_BLOCKS) && reader.value(m_panoWidth) && reader.value(m_panoHeight) &&
+		reader.value(wrap) && reader.value(m_levels) && reader.value(m_pad) && reader.value(m_blockSize) &&
+		reader.value(blendedPixels) && reader.value(windowPixels) && reader.value(stagingBytes) &&
+		reader.array(m_blocks) && reader.array(m_blockCameras) && reader.array(m_runs) && reader.array(m_xy) &&
+		reader.array(m_frac) && reader.array(m_weight) && reader.array(m_masks) && reader.array(m_covered);
+	m_wrap = wrap != 0;
+	m_blendedPixels = (size_t)blendedPixels;
+	m_windowPixels = (size_t)windowPixels;
+	if (ok)
+		m_staging.assign((size_t)stagingBytes, 0);
+	if (!ok || !validLayout(tables))
+	{
+		m_blocks.clear();
+		m_blockCameras.clear();
+		m_runs.clear();
+		m_xy.clear();
+		m_frac.clear();
+		m_weight.clear();
+		m_masks.clear();
+		m_staging.clear();
+		m_covered.clear();
+		m_blendedPixels = m_windowPixels = 0;
+		return false;
+	}
+	allocateScratch(pool);
+	return true;
+}
+
+// Whether loaded blocks fit tables: every window on whole coarsest-level
+// pixels around its block, and every block's cameras, runs, masks, staging
+// and coverage inside the arrays
+bool
+MultiBandBlender::validLayout(const RemapTables &tables) const
+{
+	if (m_panoWidth != tables.panoWidth() || m_panoHeight != tables.panoHeight() || m_wrap != tables.wrapsAround() ||
+		m_levels < 1 || m_levels > MULTIBAND_MAX_LEVELS || m_frac.size() != m_xy.size() || m_weight.size() != m_xy.size())
+		return false;
+
+	uint32_t unit = 1u << m_levels;
+	for (const Block &block : m_blocks)
+	{
+		if (block.x0 % unit != 0 || block.y0 % unit != 0 || block.width == 0 || block.height == 0 ||
+			block.width > m_panoWidth - block.x0 || block.height > m_panoHeight - block.y0 ||
+			block.windowWidth % unit != 0 || block.windowHeight % unit != 0 ||
+			block.windowWidth < block.width + 2 * m_pad || block.windowHeight < block.height + 2 * m_pad ||
+			block.numCameras == 0 || block.firstCamera > m_blockCameras.size() ||
+			block.numCameras > m_blockCameras.size() - block.firstCamera)
+			return false;
+		size_t pixels = (size_t)block.width * block.height;
+		if (block.staging > m_staging.size() || pixels * 4 > m_staging.size() - block.staging)
+			return false;
+		if (block.covered != SIZE_MAX && (block.covered > m_covered.size() || pixels > m_covered.size() - block.covered))
+			return false;
+
+		size_t offsets[MULTIBAND_MAX_LEVELS + 2];
+		levelOffsets(block, offsets);
+		for (uint32_t k = 0; k < block.numCameras; k++)
+		{
+			const BlockCamera &entry = m_blockCameras[block.firstCamera + k];
+			if (entry.camera >= tables.numCameras() || entry.firstRun > m_runs.size() ||
+				entry.numRuns > m_runs.size() - entry.firstRun)
+				return false;
+			if (k > 0 && (entry.masks > m_masks.size() || offsets[m_levels + 1] > m_masks.size() - entry.masks))
+				return false;
+			for (size_t r = entry.firstRun; r < entry.firstRun + entry.numRuns; r++)
+			{
+				const Run &run = m_runs[r];
+				if (run.row >= block.windowHeight || run.x > block.windowWidth || run.count > block.windowWidth - run.x ||
+					run.offset > m_xy.size() || run.count > m_xy.size() - run.offset ||
+					(r > entry.firstRun && run.offset < m_runs[r - 1].offset + m_runs[r - 1].count))
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Runs and mask pyramids of one block's cameras
+void
+MultiBandBlender::layoutBlock(const Block &block, const PackedRemapTables &packed, const LensVignetting *vignetting,
+	const std::vector<uint8_t> &owner, const std::vector<uint8_t> &weighted, BlockLayout &layout) const
+{
+	uint32_t width = block.windowWidth;
+	uint32_t height = block.windowHeight;
+	size_t windowPixels = (size_t)width * height;
+	size_t offsets[MULTIBAND_MAX_LEVELS + 2];
+	levelOffsets(block, offsets);
+	size_t pyramidPixels = offsets[m_levels + 1];
+	int64_t left = (int64_t)block.x0 - m_pad;
+	int64_t top = (int64_t)block.y0 - m_pad;
+
+	std::vector<uint32_t> columns(width), rows(height);
+	for (uint32_t j = 0; j < width; j++)
+		columns[j] = column(left + j);
+	for (uint32_t r = 0; r < height; r++)
+		rows[r] = clampIndex(top + r, m_panoHeight);
+
+	std::vector<float> masks((size_t)block.numCameras * pyramidPixels);
+	std::vector<uint8_t> nearby;
+	layout.cameraRuns.assign(1, 0);
+	for (uint32_t k = 0; k < block.numCameras; k++)
+	{
+		uint32_t camera = m_blockCameras[block.firstCamera + k].camera;
+		const PackedRemapTables::Camera &entries = packed.camera(camera);
+		const LensVignetting *lens = vignetting != nullptr && vignetting[camera].enabled() ? vignetting + camera : nullptr;
+		float *mask = masks.data() + k * pyramidPixels;
+		for (size_t i = 0; i < windowPixels; i++)
+			mask[i] = owner[(size_t)rows[i / width] * m_panoWidth + columns[i % width]] == camera ? 1.0f : 0.0f;
+
+		// The camera's samples matter within reach of its own pixels. Where
+		// it is the only camera, the remap output is those samples already.
+		dilateMask(mask, width, height, m_pad, nearby);
+		for (uint32_t r = 0; r < height; r++)
+		{
+			uint32_t y = rows[r];
+			if (y < entries.map_offset_y || y >= entries.map_offset_y + entries.map_size_y)
+				continue;
+			for (uint32_t j = 0; j < width; j++)
+			{
+				uint32_t x = columns[j];
+				if (!nearby[(size_t)r * width + j] || x < entries.map_offset_x || x >= entries.map_offset_x + entries.map_size_x)
+					continue;
+				size_t index = (size_t)(y - entries.map_offset_y) * entries.map_size_x + (x - entries.map_offset_x);
+				uint32_t xy;
+				if (!PackedRemapTables::seenEntry(entries, index, &xy) ||
+					(xy == entries.xy[index] && weighted[(size_t)y * m_panoWidth + x] == 1))
+					continue;
+
+				bool extend = layout.runs.size() > layout.cameraRuns.back() &&
+					layout.runs.back().row == r && layout.runs.back().x + layout.runs.back().count == j;
+				if (!extend)
+				{
+					Run run = { r, j, 0, layout.xy.size() };
+					layout.runs.push_back(run);
+				}
+				uint16_t frac = entries.frac[index];
+				int weight = REMAP_WEIGHT_ONE;
+				if (lens != nullptr)
+				{
+					float u, v;
+					entryPosition(xy, frac, &u, &v);
+					weight = (int)(REMAP_WEIGHT_ONE * lens->share(u, v) + 0.5f);
+					weight = weight < 1 ? 1 : weight;
+				}
+				layout.xy.push_back(xy);
+				layout.frac.push_back(frac);
+				layout.weight.push_back((uint8_t)(weight - 1));
+				layout.runs.back().count++;
+			}
+		}
+		layout.cameraRuns.push_back(layout.runs.size());
+
+		for (uint32_t level = 0; level < m_levels; level++)
+			reduceMask(mask + offsets[level], width >> level, height >> level, mask + offsets[level + 1]);
+	}
+
+	// Smoothed masks fall short of 1 next to pixels no camera sees; divide
+	// by their sum so every band keeps its gain
+	for (size_t p = 0; p < pyramidPixels; p++)
+	{
+		float sum = 0.0f;
+		for (uint32_t k = 0; k < block.numCameras; k++)
+			sum += masks[k * pyramidPixels + p];
+		if (sum > 0.0f)
+			for (uint32_t k = 0; k < block.numCameras; k++)
+				masks[k * pyramidPixels + p] /= sum;
+	}
+	layout.masks.assign(masks.begin() + pyramidPixels, masks.end());
+
+	if (block.covered != SIZE_MAX)
+	{
+		layout.covered.assign((size_t)block.width * block.height, 0);
+		for (uint32_t r = 0; r < block.height; r++)
+			for (uint32_t j = 0; j < block.width; j++)
+				layout.covered[(size_t)r * block.width + j] =
+					owner[(size_t)(block.y0 + r) * m_panoWidth + block.x0 + j] != NO_CAMERA;
+	}
+}
+
+//***********************************************************************************
+// Level + 1 of a block's pyramid from level
+void
+MultiBandBlender::reduce(const Block &block, float *pyramid, const size_t *offsets, uint32_t level,
+	Scratch &scratch) const
+{
+	uint32_t width = block.windowWidth >> level;
+	uint32_t height = block.windowHeight >> level;
+	const float *src = pyramid + offsets[level] * 4;
+	float *dst = pyramid + offsets[level + 1] * 4;
+	for (uint32_t r = 0; r < height / 2; r++)
+	{
+		const float *rows[5];
+		for (int k = 0; k < 5; k++)
+			rows[k] = src + (size_t)clampIndex(2 * (int64_t)r + k - 2, height) * width * 4;
+		pyramidFilterColumns(rows, width, scratch.row.data());
+		pyramidDecimateRow(scratch.row.data(), width / 2, dst + (size_t)r * (width / 2) * 4);
+	}
+}
+
+// Expand a level + 1 image of a block into scratch.expanded at level size:
+// the two output rows of each source row in [rowBegin, rowEnd)
+void
+MultiBandBlender::expand(const Block &block, const float *source, uint32_t level, uint32_t rowBegin, uint32_t rowEnd,
+	Scratch &scratch) const
+{
+	uint32_t sourceWidth = block.windowWidth >> (level + 1);
+	uint32_t sourceHeight = block.windowHeight >> (level + 1);
+	uint32_t width = block.windowWidth >> level;
+	size_t rowFloats = (size_t)width * 4;
+
+	uint32_t first = rowBegin > 0 ? rowBegin - 1 : 0;
+	uint32_t last = rowEnd < sourceHeight ? rowEnd + 1 : sourceHeight;
+	for (uint32_t r = first; r < last; r++)
+		pyramidExpandRow(source + (size_t)r * sourceWidth * 4, sourceWidth, scratch.halfExpanded.data() + r * rowFloats);
+
+	const float *rows = scratch.halfExpanded.data();
+	for (uint32_t r = rowBegin; r < rowEnd; r++)
+	{
+		const float *above = rows + (r > 0 ? r - 1 : 0) * rowFloats;
+		const float *below = rows + (r + 1 < sourceHeight ? r + 1 : r) * rowFloats;
+		pyramidInterpolateColumns(above, rows + r * rowFloats, below, width,
+			scratch.expanded.data() + 2 * r * rowFloats, scratch.expanded.data() + (2 * r + 1) * rowFloats);
+	}
+}
+
+// A camera's image over a block's window as it enters the pyramids: the
+// remap output with the camera's runs sampled over it. A camera's samples
+// follow one another, so they are sampled in one go and then put in place;
+// windows are small enough that per-row calls would cost more than the
+// samples.
+void
+MultiBandBlender::loadCamera(const Block &block, const BlockCamera &camera, const remapSource_t &source,
+	const uint32_t *gain, Scratch &scratch, float *dst) const
+{
+	size_t windowPixels = (size_t)block.windowWidth * block.windowHeight;
+	unsigned char *pixels = scratch.pixels.data();
+	memcpy(pixels, scratch.composite.data(), windowPixels * 4);
+	if (camera.numRuns > 0)
+	{
+		const Run *run = m_runs.data() + camera.firstRun;
+		const Run *end = run + camera.numRuns;
+		size_t first = run->offset;
+		uint32_t count = (uint32_t)(end[-1].offset + end[-1].count - first);
+		memset(scratch.acc.data(), 0, (size_t)count * 4 * sizeof(uint32_t));
+		remapAccumulateSourceRow(&source, m_xy.data() + first, m_frac.data() + first, m_weight.data() + first,
+			gain, count, scratch.acc.data());
+		remapResolveRow(scratch.acc.data(), count, scratch.samples.data());
+		for (; run != end; run++)
+			memcpy(pixels + ((size_t)run->row * block.windowWidth + run->x) * 4,
+				scratch.samples.data() + (run->offset - first) * 4, (size_t)run->count * 4);
+	}
+	pyramidLoadRow(pixels, (uint32_t)windowPixels, dst);
+}
+
+void
+MultiBandBlender::blendBlock(size_t index, const remapSource_t *sources, const uint32_t *gains,
+	const unsigned char *pano, size_t panoPitch, Scratch &scratch)
+{
+	const Block &block = m_blocks[index];
+	uint32_t width = block.windowWidth;
+	uint32_t height = block.windowHeight;
+	size_t offsets[MULTIBAND_MAX_LEVELS + 2];
+	levelOffsets(block, offsets);
+	int64_t left = (int64_t)block.x0 - m_pad;
+	int64_t top = (int64_t)block.y0 - m_pad;
+	float *reference = scratch.reference.data();
+	float *gaussian = scratch.gaussian.data();
+	float *band = scratch.band.data();
+
+	for (uint32_t r = 0; r < height; r++)
+		copyWindowRow(pano + (size_t)clampIndex(top + r, m_panoHeight) * panoPitch, m_panoWidth, m_wrap, left, width,
+			scratch.composite.data() + (size_t)r * width * 4);
+
+	const BlockCamera &first = m_blockCameras[block.firstCamera];
+	loadCamera(block, first, sources[first.camera], gains + first.camera * 4, scratch, reference);
+	memset(band, 0, offsets[m_levels + 1] * 4 * sizeof(float));
+
+	// The other cameras' differences from the reference, band by band,
+	// weighted by their masks at that level
+	for (uint32_t k = 1; k < block.numCameras; k++)
+	{
+		const BlockCamera &entry = m_blockCameras[block.firstCamera + k];
+		const float *mask = m_masks.data() + entry.masks;
+		loadCamera(block, entry, sources[entry.camera], gains + entry.camera * 4, scratch, gaussian);
+		pyramidSubtractRow(reference, width * height, gaussian);
+		for (uint32_t level = 0; level < m_levels; level++)
+			reduce(block, gaussian, offsets, level, scratch);
+
+		// Levels are whole images, so each is accumulated in one call
+		for (uint32_t level = 0; level <= m_levels; level++)
+		{
+			const float *expanded = nullptr;
+			if (level < m_levels)
+			{
+				expand(block, gaussian + offsets[level + 1] * 4, level, 0, height >> (level + 1), scratch);
+				expanded = scratch.expanded.data();
+			}
+			pyramidAccumulateBand(gaussian + offsets[level] * 4, expanded, mask + offsets[level],
+				(uint32_t)(offsets[level + 1] - offsets[level]), band + offsets[level] * 4);
+		}
+	}
+
+	// Collapse the blended bands, coarse to fine; at full resolution only
+	// the block's own rows. A block with one camera has no bands.
+	for (uint32_t level = block.numCameras > 1 ? m_levels : 0; level-- > 0;)
+	{
+		uint32_t levelWidth = width >> level;
+		uint32_t rowBegin = level == 0 ? m_pad / 2 : 0;
+		uint32_t rowEnd = level == 0 ? (m_pad + block.height + 1) / 2 : height >> (level + 1);
+		expand(block, band + offsets[level + 1] * 4, level, rowBegin, rowEnd, scratch);
+		size_t offset = (size_t)2 * rowBegin * levelWidth;
+		pyramidAddRow(scratch.expanded.data() + offset * 4, 2 * (rowEnd - rowBegin) * levelWidth,
+			band + (offsets[level] + offset) * 4);
+	}
+
+	unsigned char *staging = m_staging.data() + block.staging;
+	for (uint32_t r = 0; r < block.height; r++)
+	{
+		size_t offset = ((size_t)(m_pad + r) * width + m_pad) * 4;
+		pyramidAddRow(reference + offset, block.width, band + offset);
+		pyramidStoreRow(band + offset, block.width, staging + (size_t)r * block.width * 4);
+	}
+}
+
+MultiBandBlender::Scratch*
+MultiBandBlender::acquireScratch()
+{
+	// One per pool thread, so there is always one free
+	std::lock_guard<std::mutex> lock(m_scratchMutex);
+	Scratch *scratch = m_freeScratch.back();
+	m_freeScratch.pop_back();
+	return scratch;
+}
+
+void
+MultiBandBlender::releaseScratch(Scratch *scratch)
+{
+	std::lock_guard<std::mutex> lock(m_scratchMutex);
+	m_freeScratch.push_back(scratch);
+}
+
+void
+MultiBandBlender::blend(const remapSource_t *sources, const uint32_t *gains,
+	unsigned char *pano, size_t panoPitch, ThreadPool &pool, const BlockWritten &written)
+{
+	pool.parallelFor(m_blocks.size(), [&](size_t block) {
+		Scratch *scratch = acquireScratch();
+		blendBlock(block, sources, gains, pano, panoPitch, *scratch);
+		releaseScratch(scratch);
+	});
+
+	// Windows read the remapped pixels around their block, so nothing is
+	// written back until every block is done
+	pool.parallelFor(m_blocks.size(), [&](size_t index) {
+		const Block &block = m_blocks[index];
+		const unsigned char *staging = m_staging.data() + block.staging;
+		for (uint32_t r = 0; r < block.height; r++)
+		{
+			unsigned char *dst = pano + (size_t)(block.y0 + r) * panoPitch + (size_t)block.x0 * 4;
+			const unsigned char *src = staging + (size_t)r * block.width * 4;
+			if (block.covered == SIZE_MAX)
+			{
+				memcpy(dst, src, (size_t)block.width * 4);
+				continue;
+			}
+			const uint8_t *covered = m_covered.data() + block.covered + (size_t)r * block.width;
+			for (uint32_t j = 0; j < block.width; j++)
+				if (covered[j])
+					memcpy(dst + (size_t)j * 4, src + (size_t)j * 4, 4);
+		}
+		if (written)
+		{
+			// Out to the alignment, still inside the grid block
+			uint32_t x0 = block.x0 / MULTIBAND_BLOCK_ALIGN * MULTIBAND_BLOCK_ALIGN;
+			uint32_t y0 = block.y0 / MULTIBAND_BLOCK_ALIGN * MULTIBAND_BLOCK_ALIGN;
+			uint32_t x1 = (block.x0 + block.width + MULTIBAND_BLOCK_ALIGN - 1) / MULTIBAND_BLOCK_ALIGN * MULTIBAND_BLOCK_ALIGN;
+			uint32_t y1 = (block.y0 + block.height + MULTIBAND_BLOCK_ALIGN - 1) / MULTIBAND_BLOCK_ALIGN * MULTIBAND_BLOCK_ALIGN;
+			written(x0, y0, x1 < m_panoWidth ? x1 : m_panoWidth, y1 < m_panoHeight ? y1 : m_panoHeight);
+		}
+	});
+}
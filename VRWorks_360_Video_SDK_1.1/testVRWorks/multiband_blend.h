@@ -0,0 +1,236 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "nvss_video.h"
+#include "remap_yuv_kernels.h"
+
+class LensVignetting;
+class PackedRemapTables;
+class RemapLayoutReader;
+class RemapLayoutWriter;
+class RemapTables;
+class ThreadPool;
+
+// ==== Multi-band seam blending ====
+// Burt and Adelson's multiresolution spline across the seams of a remapped
+// panorama. Every pixel belongs to the camera with the largest blend weight.
+// Near a seam, each camera's image is split into Laplacian bands, and each
+// band is blended with a Gaussian-smoothed copy of the ownership masks. Low
+// frequencies thus cross the seam over a wide region and fine detail over a
+// narrow one. The coarsest band's transition is about feather_width output
+// pixels wide.
+//
+// Only the overlaps cost anything. Away from them the remap output already
+// is the owning camera alone, so the blend covers the pixels several cameras
+// share and those within reach of a seam, and nothing else: the panorama is
+// cut into square blocks, and each block's pyramids cover the bounding box
+// of its share of that band, padded. Within a window, a camera is sampled
+// again, from the packed tables, only where it can differ from the remap
+// output and is near enough its own pixels to matter; everywhere else its
+// image is the remap output. As the masks sum to 1, the first camera of a
+// block serves as reference and only the others' differences from it go
+// through pyramids, one fewer per block than there are cameras.
+//
+// Block tables, mask pyramids and per-thread pyramid buffers are allocated
+// once by build() and reused for every frame.
+
+#define MULTIBAND_MAX_LEVELS 5
+
+// Blocks are reported written out to multiples of this many pixels, so
+// output levels and 4:2:0 planes made from a written block in bands of up
+// to as many rows need nothing outside it
+#define MULTIBAND_BLOCK_ALIGN 16
+
+class MultiBandBlender
+{
+public:
+	MultiBandBlender();
+
+	// Find the seams between the cameras of the tables and lay out the
+	// blocks along them, with samples from packed, built from the same
+	// tables and vignetting. With vignetting, one model per camera, samples
+	// are weighted by their share of the camera's peak correction, as the
+	// packed tables are, for gains that carry the peak.
+	nvstitchResult build(const RemapTables &tables, const PackedRemapTables &packed, float featherWidth,
+		ThreadPool &pool, const LensVignetting *vignetting = nullptr);
+
+	// The REMAP_LAYOUT_BLOCKS section of a layout cache file. load() fails
+	// if the section does not fit tables.
+	void save(RemapLayoutWriter &writer) const;
+	bool load(RemapLayoutReader &reader, const RemapTables &tables, ThreadPool &pool);
+
+	// Called with the bounds of each block out to MULTIBAND_BLOCK_ALIGN, x1
+	// and y1 exclusive, right after it is written back to the panorama, on
+	// the thread that wrote it. No other block writes inside them.
+	typedef std::function<void(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)> BlockWritten;
+
+	// Blend the seam blocks of pano, already remapped with feathered
+	// weights, again from the camera images, one source per camera. gains
+	// holds the remap kernels' channel gains, 4 per camera, as pano was
+	// remapped with.
+	void blend(const remapSource_t *sources, const uint32_t *gains,
+		unsigned char *pano, size_t panoPitch, ThreadPool &pool, const BlockWritten &written = BlockWritten());
+
+	uint32_t levels() const { return m_levels; }
+	uint32_t blockSize() const { return m_blockSize; }
+	size_t numBlocks() const { return m_blocks.size(); }
+
+	// Output pixels the blocks blend, and pixels their windows cover
+	size_t blendedPixels() const { return m_blendedPixels; }
+	size_t windowPixels() const { return m_windowPixels; }
+
+private:
+	MultiBandBlender(const MultiBandBlender&);
+	MultiBandBlender& operator=(const MultiBandBlender&);
+
+	// The blended part of a grid block and its window, the part padded
+	struct Block
+	{
+		uint32_t x0, y0;            // top left in the panorama, a multiple of 2^levels
+		uint32_t width, height;     // clipped to the panorama
+		uint32_t windowWidth;       // multiples of 2^levels
+		uint32_t windowHeight;
+		uint32_t firstCamera;       // into m_blockCameras
+		uint32_t numCameras;
+		size_t staging;             // into m_staging
+		size_t covered;             // into m_covered, or SIZE_MAX if every pixel is seen
+	};
+
+	// Part of a window row where a camera is sampled
+	struct Run
+	{
+		uint32_t row;
+		uint32_t x;
+		uint32_t count;
+		size_t offset;              // into m_xy, m_frac and m_weight
+	};
+
+	struct BlockCamera
+	{
+		uint32_t camera;
+		size_t firstRun;            // into m_runs, sorted by row
+		size_t numRuns;
+		size_t masks;               // mask pyramid, into m_masks; none for the reference
+	};
+
+	// One block's share of the tables, before they are packed together
+	struct BlockLayout
+	{
+		std::vector<Run> runs;
+		std::vector<size_t> cameraRuns;
+		std::vector<uint32_t> xy;
+		std::vector<uint16_t> frac;
+		std::vector<uint8_t> weight;
+		std::vector<float> masks;
+		std::vector<uint8_t> covered;
+	};
+
+	// Pyramids and rows for one block at a time
+	struct Scratch
+	{
+		std::vector<unsigned char> composite;
+		std::vector<float> reference;
+		std::vector<float> gaussian;
+		std::vector<float> band;
+		std::vector<float> expanded;
+		std::vector<float> halfExpanded;
+		std::vector<float> row;
+		std::vector<uint32_t> acc;
+		std::vector<unsigned char> samples;
+		std::vector<unsigned char> pixels;
+	};
+
+	void levelOffsets(const Block &block, size_t *offsets) const;
+	bool validLayout(const RemapTables &tables) const;
+	void allocateScratch(ThreadPool &pool);
+	uint32_t column(int64_t x) const;
+	void layoutBlock(const Block &block, const PackedRemapTables &packed, const LensVignetting *vignetting,
+		const std::vector<uint8_t> &owner, const std::vector<uint8_t> &weighted, BlockLayout &layout) const;
+	void loadCamera(const Block &block, const BlockCamera &camera, const remapSource_t &source, const uint32_t *gain,
+		Scratch &scratch, float *dst) const;
+	void blendBlock(size_t block, const remapSource_t *sources, const uint32_t *gains,
+		const unsigned char *pano, size_t panoPitch, Scratch &scratch);
+	void reduce(const Block &block, float *pyramid, const size_t *offsets, uint32_t level, Scratch &scratch) const;
+	void expand(const Block &block, const float *source, uint32_t level, uint32_t rowBegin, uint32_t rowEnd,
+		Scratch &scratch) const;
+
+	Scratch* acquireScratch();
+	void releaseScratch(Scratch *scratch);
+
+	uint32_t m_panoWidth;
+	uint32_t m_panoHeight;
+	bool m_wrap;                    // equirectangular: the last column continues into the first
+	uint32_t m_levels;
+	uint32_t m_pad;
+	uint32_t m_blockSize;
+	size_t m_blendedPixels;
+	size_t m_windowPixels;
+
+	std::vector<Block> m_blocks;
+	std::vector<BlockCamera> m_blockCameras;
+	std::vector<Run> m_runs;
+	std::vector<uint32_t> m_xy;
+	std::vector<uint16_t> m_frac;
+	std::vector<uint8_t> m_weight;
+	std::vector<float> m_masks;
+	std::vector<unsigned char> m_staging;
+	std::vector<uint8_t> m_covered;
+
+	std::vector<Scratch> m_scratch;
+	std::vector<Scratch*> m_freeScratch;
+	std::mutex m_scratchMutex;
+};
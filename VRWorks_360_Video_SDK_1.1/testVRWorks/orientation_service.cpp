@@ -0,0 +1,669 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "orientation_service.h"
+#include "pano_publisher.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#pragma comment (lib, "Ws2_32.lib")
+
+#define SEND_FLAGS 0
+
+static int socketError() { return WSAGetLastError(); }
+static bool socketStartup() { WSADATA wsaData; return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0; }
+static void socketCleanup() { WSACleanup(); }
+static bool connectPending(int error) { return error == WSAEWOULDBLOCK; }
+
+static bool
+setNonBlocking(SOCKET s)
+{
+	u_long on = 1;
+	return ioctlsocket(s, FIONBIO, &on) == 0;
+}
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define SD_SEND SHUT_WR
+#define closesocket close
+#define SEND_FLAGS MSG_NOSIGNAL
+
+static int socketError() { return errno; }
+static bool socketStartup() { return true; }
+static void socketCleanup() {}
+static bool connectPending(int error) { return error == EINPROGRESS; }
+
+static bool
+setNonBlocking(SOCKET s)
+{
+	int flags = fcntl(s, F_GETFL, 0);
+	return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+#endif
+
+using std::chrono::steady_clock;
+using std::chrono::milliseconds;
+using std::chrono::microseconds;
+
+static const uint32_t WAIT_SLICE_MS = 100;      // how long any wait can delay stop()
+static const uint32_t CONNECT_TIMEOUT_MS = 1000;
+static const uint32_t POLL_TIMEOUT_MS = 1000;
+static const uint32_t BACKOFF_MIN_MS = 100;
+static const uint32_t BACKOFF_MAX_MS = 2000;
+static const char *POLL_REQUEST = "this is a test";
+static const int64_t CLOCK_DRIFT_US = 1;            // per sample; lets the offset follow clock drift
+static const int64_t CLOCK_RESET_US = 1000000;      // transit this much longer means the sensor clock jumped
+
+// Wait until s is readable (or writable); false on timeout
+static bool
+waitSocket(SOCKET s, bool write, uint32_t timeoutMs)
+{
+	fd_set set;
+	FD_ZERO(&set);
+	FD_SET(s, &set);
+	struct timeval tv;
+	tv.tv_sec = timeoutMs / 1000;
+	tv.tv_usec = (timeoutMs % 1000) * 1000;
+	return select((int)s + 1, write ? nullptr : &set, write ? &set : nullptr, nullptr, &tv) > 0;
+}
+
+static void
+sleepUnlessStopped(uint32_t ms, const std::atomic<bool> &stop)
+{
+	auto end = steady_clock::now() + milliseconds(ms);
+	while (!stop.load() && steady_clock::now() < end)
+		std::this_thread::sleep_for(milliseconds(ms < 10 ? ms : 10));
+}
+
+// Non-blocking connect so that an unreachable host cannot hold up stop()
+static SOCKET
+connectTo(const std::string &host, const std::string &port, const std::atomic<bool> &stop)
+{
+	struct addrinfo hints, *result = nullptr;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0)
+		return INVALID_SOCKET;
+
+	SOCKET s = INVALID_SOCKET;
+	for (struct addrinfo *ptr = result; ptr != nullptr && s == INVALID_SOCKET && !stop.load(); ptr = ptr->ai_next)
+	{
+		s = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+		if (s == INVALID_SOCKET)
+			continue;
+
+		bool connected = false;
+		if (setNonBlocking(s))
+		{
+			if (connect(s, ptr->ai_addr, (int)ptr->ai_addrlen) == 0)
+			{
+				connected = true;
+			}
+			else if (connectPending(socketError()))
+			{
+				for (uint32_t waited = 0; waited < CONNECT_TIMEOUT_MS && !stop.load(); waited += WAIT_SLICE_MS)
+				{
+					if (waitSocket(s, true, WAIT_SLICE_MS))
+					{
+						int error = 0;
+						socklen_t length = sizeof(error);
+						getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&error, &length);
+						connected = error == 0;
+						break;
+					}
+				}
+			}
+		}
+
+		if (!connected)
+		{
+			closesocket(s);
+			s = INVALID_SOCKET;
+		}
+	}
+	freeaddrinfo(result);
+
+	if (s != INVALID_SOCKET)
+	{
+		// Samples are tiny; do not let Nagle hold them back
+		int on = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+	}
+	return s;
+}
+
+static bool
+sendAll(SOCKET s, const char *data, size_t bytes)
+{
+	while (bytes > 0)
+	{
+		int sent = send(s, data, (int)bytes, SEND_FLAGS);
+		if (sent == SOCKET_ERROR)
+		{
+			if (!waitSocket(s, true, WAIT_SLICE_MS))
+				return false;
+			continue;
+		}
+		data += sent;
+		bytes -= sent;
+	}
+	return true;
+}
+
+//***********************************************************************************
+LatestOrientation::LatestOrientation()
+	: m_seq(0)
+{
+	memset(&m_sample, 0, sizeof(m_sample));
+}
+
+void
+LatestOrientation::store(const OrientationSample &sample)
+{
+	uint32_t begin = m_seq.load(std::memory_order_relaxed) + 1;
+	m_seq.store(begin, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	m_sample = sample;
+	m_seq.store(begin + 1, std::memory_order_release);
+}
+
+bool
+LatestOrientation::load(OrientationSample *sample) const
+{
+	for (;;)
+	{
+		uint32_t begin = m_seq.load(std::memory_order_acquire);
+		if (begin == 0)
+			return false;
+		if (begin & 1)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		OrientationSample copy = m_sample;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_seq.load(std::memory_order_relaxed) == begin)
+		{
+			*sample = copy;
+			return true;
+		}
+	}
+}
+
+//***********************************************************************************
+OrientationParser::OrientationParser()
+	: m_length(0)
+{
+}
+
+bool
+OrientationParser::parseBinary(const unsigned char *packet, OrientationSample *sample)
+{
+	float q[4];
+	memset(sample, 0, sizeof(*sample));
+	memcpy(&sample->sensor_time_us, packet + 4, sizeof(uint64_t));
+	memcpy(q, packet + 12, sizeof(q));
+
+	float norm = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+	if (!(norm > 1e-6f && norm < 1e6f))
+		return false;   // zero, NaN or garbage
+
+	Quat raw = { q[0], q[1], q[2], q[3] };
+	sample->orientation = quatNormalize(raw);
+	sample->valid = true;
+	return true;
+}
+
+bool
+OrientationParser::parseText(const char *line, size_t length, OrientationSample *sample)
+{
+	memset(sample, 0, sizeof(*sample));
+	sample->orientation = quatIdentity();
+
+	while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t' || line[length - 1] == 0))
+		length--;
+	if (length == 0)
+		return false;
+
+	size_t text = length < ORIENTATION_TEXT_LEN - 1 ? length : ORIENTATION_TEXT_LEN - 1;
+	memcpy(sample->text, line, text);
+
+	char copy[BUFFER_BYTES + 1];
+	if (length > BUFFER_BYTES)
+		length = BUFFER_BYTES;
+	memcpy(copy, line, length);
+	copy[length] = 0;
+
+	// Numbers separated by anything that cannot start a number
+	float values[5];
+	int count = 0;
+	for (char *p = copy; *p && count < 5;)
+	{
+		char *end;
+		float value = strtof(p, &end);
+		if (end == p)
+		{
+			p++;
+			continue;
+		}
+		values[count++] = value;
+		p = end;
+	}
+
+	if (count == 4)
+	{
+		float norm = values[0] * values[0] + values[1] * values[1] + values[2] * values[2] + values[3] * values[3];
+		if (!(norm > 1e-6f && norm < 1e6f))
+			return false;
+		Quat raw = { values[0], values[1], values[2], values[3] };
+		sample->orientation = quatNormalize(raw);
+	}
+	else if (count == 3)
+	{
+		const float toRad = (float)(M_PI / 180.0);
+		sample->orientation = quatFromYawPitchRoll(values[0] * toRad, values[1] * toRad, values[2] * toRad);
+	}
+	else
+	{
+		return false;
+	}
+
+	sample->valid = true;
+	return true;
+}
+
+//***********************************************************************************
+OrientationService::OrientationService()
+	: m_mode(ORIENTATION_MODE_STREAM), m_pollIntervalMs(10),
+	  m_clockOffsetUs(0), m_clockOffsetValid(false),
+	  m_stop(false), m_connected(false), m_samples(0), m_connections(0)
+{
+}
+
+OrientationService::~OrientationService()
+{
+	stop();
+}
+
+bool
+OrientationService::start(const std::string &host, const std::string &port, orientationMode mode, uint32_t pollIntervalMs)
+{
+	stop();
+
+	if (!socketStartup())
+	{
+		std::cerr << "Socket startup failed with error: " << socketError() << std::endl;
+		return false;
+	}
+
+	m_host = host;
+	m_port = port;
+	m_mode = mode;
+	m_pollIntervalMs = pollIntervalMs;
+	m_clockOffsetValid = false;
+	m_stop.store(false);
+	m_thread = std::thread(&OrientationService::run, this);
+	return true;
+}
+
+void
+OrientationService::stop()
+{
+	if (!m_thread.joinable())
+		return;
+
+	m_stop.store(true);
+	m_thread.join();
+	socketCleanup();
+}
+
+void
+OrientationService::publish(OrientationSample &sample)
+{
+	// Network jitter only ever delays a sample, so the minimum of receive minus
+	// sensor time is the best estimate of the clock offset
+	sample.time_us = sample.receive_time_us;
+	if (sample.sensor_time_us != 0)
+	{
+		int64_t observed = (int64_t)(sample.receive_time_us - sample.sensor_time_us);
+		int64_t change = observed - m_clockOffsetUs;
+		if (!m_clockOffsetValid || change < 0 || change > CLOCK_RESET_US)
+			m_clockOffsetUs = observed;
+		else
+			m_clockOffsetUs += change < CLOCK_DRIFT_US ? change : CLOCK_DRIFT_US;
+		m_clockOffsetValid = true;
+
+		sample.time_us = (uint64_t)((int64_t)sample.sensor_time_us + m_clockOffsetUs);
+	}
+
+	if (sample.valid)
+		m_history.push(sample.time_us, sample.orientation);
+
+	sample.sequence = m_samples.fetch_add(1, std::memory_order_relaxed) + 1;
+	m_latest.store(sample);
+}
+
+void
+OrientationService::run()
+{
+	uint32_t backoffMs = BACKOFF_MIN_MS;
+	bool reported = false;
+
+	while (!m_stop.load())
+	{
+		SOCKET s = connectTo(m_host, m_port, m_stop);
+		if (s == INVALID_SOCKET)
+		{
+			if (!reported)
+				std::cout << "IMU server " << m_host << ":" << m_port << " unavailable, retrying" << std::endl;
+			reported = true;
+			sleepUnlessStopped(backoffMs, m_stop);
+			backoffMs = backoffMs * 2 < BACKOFF_MAX_MS ? backoffMs * 2 : BACKOFF_MAX_MS;
+			continue;
+		}
+
+		// Poll mode connects for every sample; only report the first and recoveries
+		if (m_mode == ORIENTATION_MODE_STREAM || reported || m_connections.load() == 0)
+			std::cout << "IMU connected to " << m_host << ":" << m_port << std::endl;
+		reported = false;
+		backoffMs = BACKOFF_MIN_MS;
+		m_connections.fetch_add(1, std::memory_order_relaxed);
+		m_connected.store(true, std::memory_order_relaxed);
+		inject(ORIENTATION_EVENT_CONNECT, nullptr, 0, panoSteadyTimeUs());
+
+		if (m_mode == ORIENTATION_MODE_STREAM)
+			receive((intptr_t)s);
+		else
+			poll((intptr_t)s);
+
+		closesocket(s);
+		m_connected.store(false, std::memory_order_relaxed);
+
+		if (m_mode == ORIENTATION_MODE_POLL)
+			sleepUnlessStopped(m_pollIntervalMs, m_stop);
+		else if (!m_stop.load())
+			std::cout << "IMU connection lost, reconnecting" << std::endl;
+	}
+}
+
+void
+OrientationService::receive(intptr_t socket)
+{
+	SOCKET s = (SOCKET)socket;
+	char buffer[4096];
+
+	while (!m_stop.load())
+	{
+		if (!waitSocket(s, false, WAIT_SLICE_MS))
+			continue;
+
+		int received = recv(s, buffer, sizeof(buffer), 0);
+		if (received <= 0)
+			return;
+
+		inject(ORIENTATION_EVENT_DATA, buffer, received, panoSteadyTimeUs());
+	}
+}
+
+// The legacy server answers one request per connection and expects the
+// client to shut down its side before it replies.
+void
+OrientationService::poll(intptr_t socket)
+{
+	SOCKET s = (SOCKET)socket;
+	char buffer[1024];
+
+	if (!sendAll(s, POLL_REQUEST, strlen(POLL_REQUEST)) || shutdown(s, SD_SEND) == SOCKET_ERROR)
+		return;
+
+	for (uint32_t waited = 0; waited < POLL_TIMEOUT_MS && !m_stop.load();)
+	{
+		if (!waitSocket(s, false, WAIT_SLICE_MS))
+		{
+			waited += WAIT_SLICE_MS;
+			continue;
+		}
+
+		int received = recv(s, buffer, sizeof(buffer), 0);
+		if (received <= 0)
+			break;
+
+		inject(ORIENTATION_EVENT_DATA, buffer, received, panoSteadyTimeUs());
+	}
+
+	inject(ORIENTATION_EVENT_END_OF_REPLY, nullptr, 0, panoSteadyTimeUs());
+}
+
+void
+OrientationService::inject(orientationEvent event, const char *data, size_t bytes, uint64_t receiveTimeUs)
+{
+	if (m_tap)
+		m_tap(event, data, bytes, receiveTimeUs);
+
+	auto sink = [this](OrientationSample &sample) { publish(sample); };
+	switch (event)
+	{
+	case ORIENTATION_EVENT_DATA:
+		m_parser.feed(data, bytes, receiveTimeUs, sink);
+		break;
+	case ORIENTATION_EVENT_CONNECT:
+		m_parser.reset();
+		break;
+	case ORIENTATION_EVENT_END_OF_REPLY:
+		m_parser.flush(receiveTimeUs, sink);
+		break;
+	}
+}
+
+//***********************************************************************************
+OrientationLoopbackServer::OrientationLoopbackServer()
+	: m_listen((intptr_t)INVALID_SOCKET), m_rateHz(200), m_binary(true), m_startUs(0), m_stop(false)
+{
+}
+
+OrientationLoopbackServer::~OrientationLoopbackServer()
+{
+	stop();
+}
+
+bool
+OrientationLoopbackServer::start(const std::string &port, uint32_t rateHz, bool binary)
+{
+	stop();
+
+	if (!socketStartup())
+		return false;
+
+	SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == INVALID_SOCKET)
+	{
+		socketCleanup();
+		return false;
+	}
+
+	int on = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons((unsigned short)atoi(port.c_str()));
+
+	socklen_t length = sizeof(addr);
+	if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+		listen(s, 1) == SOCKET_ERROR ||
+		getsockname(s, (struct sockaddr*)&addr, &length) == SOCKET_ERROR)
+	{
+		std::cerr << "IMU loopback server could not listen on port " << port << ": " << socketError() << std::endl;
+		closesocket(s);
+		socketCleanup();
+		return false;
+	}
+
+	m_listen = (intptr_t)s;
+	m_port = std::to_string(ntohs(addr.sin_port));
+	m_rateHz = rateHz > 0 ? rateHz : 1;
+	m_binary = binary;
+	m_startUs = panoSteadyTimeUs();
+	m_stop.store(false);
+	m_thread = std::thread(&OrientationLoopbackServer::run, this);
+	return true;
+}
+
+void
+OrientationLoopbackServer::stop()
+{
+	if (!m_thread.joinable())
+		return;
+
+	m_stop.store(true);
+	m_thread.join();
+	closesocket((SOCKET)m_listen);
+	m_listen = (intptr_t)INVALID_SOCKET;
+	socketCleanup();
+}
+
+void
+OrientationLoopbackServer::run()
+{
+	SOCKET listener = (SOCKET)m_listen;
+	while (!m_stop.load())
+	{
+		if (!waitSocket(listener, false, WAIT_SLICE_MS))
+			continue;
+
+		SOCKET client = accept(listener, nullptr, nullptr);
+		if (client == INVALID_SOCKET)
+			continue;
+
+		int on = 1;
+		setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+		serve((intptr_t)client);
+		closesocket(client);
+	}
+}
+
+void
+OrientationLoopbackServer::serve(intptr_t socket)
+{
+	SOCKET s = (SOCKET)socket;
+	const uint64_t periodUs = 1000000 / m_rateHz;
+	uint64_t nextUs = panoSteadyTimeUs();
+
+	while (!m_stop.load())
+	{
+		// A poll client sends its request and shuts down its side; it gets one line back
+		bool pollClient = false;
+		uint64_t nowUs = panoSteadyTimeUs();
+		if (nowUs < nextUs)
+		{
+			uint64_t waitMs = (nextUs - nowUs + 999) / 1000;
+			if (!waitSocket(s, false, (uint32_t)(waitMs < WAIT_SLICE_MS ? waitMs : WAIT_SLICE_MS)))
+				continue;
+
+			char request[256];
+			int received = recv(s, request, sizeof(request), 0);
+			if (received < 0)
+				return;
+			if (received > 0)
+				continue;
+			pollClient = true;
+		}
+
+		// A turn every 12 s in yaw with a gentle pitch nod
+		double t = (nowUs - m_startUs) * 1e-6;
+		Quat q = quatFromYawPitchRoll((float)(t * M_PI / 6.0), (float)(0.17 * sin(t)), 0.0f);
+
+		if (m_binary && !pollClient)
+		{
+			unsigned char packet[ORIENTATION_PACKET_BYTES];
+			uint32_t magic = ORIENTATION_PACKET_MAGIC;
+			memcpy(packet, &magic, 4);
+			memcpy(packet + 4, &nowUs, 8);
+			memcpy(packet + 12, &q, 16);
+			if (!sendAll(s, (const char*)packet, sizeof(packet)))
+				return;
+		}
+		else
+		{
+			char line[96];
+			int length = snprintf(line, sizeof(line), "%.6f %.6f %.6f %.6f\n", q.w, q.x, q.y, q.z);
+			if (!sendAll(s, line, length))
+				return;
+		}
+
+		if (pollClient)
+			return;
+		nextUs += periodUs;
+		if (nextUs < nowUs)
+			nextUs = nowUs + periodUs;   // fell behind; do not burst
+	}
+}
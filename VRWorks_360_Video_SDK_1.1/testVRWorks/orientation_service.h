@@ -0,0 +1,310 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "pose_history.h"
+#include "quaternion.h"
+
+// ==== IMU wire format ====
+// The service accepts either packet kind on the same connection:
+//  binary: ORIENTATION_PACKET_BYTES little-endian bytes
+//          uint32 magic ("IMU0"), uint64 sensor time in us, float w, x, y, z
+//  text:   one line per sample, terminated by '\n'. Four numbers are a
+//          quaternion w x y z; three numbers are yaw pitch roll in degrees,
+//          rig convention. Any other line is kept as text only.
+
+#define ORIENTATION_PACKET_MAGIC    0x30554d49u     // "IMU0"
+#define ORIENTATION_PACKET_BYTES    28
+#define ORIENTATION_TEXT_LEN        32
+
+typedef enum
+{
+	ORIENTATION_MODE_STREAM = 0,    // one long-lived connection, server pushes samples
+	ORIENTATION_MODE_POLL,          // legacy request/response, one exchange per poll
+} orientationMode;
+
+struct OrientationSample
+{
+	Quat orientation;
+	uint64_t sensor_time_us;        // IMU clock, zero for text samples
+	uint64_t receive_time_us;       // steady clock (panoSteadyTimeUs) when parsed
+	uint64_t time_us;               // steady clock time the pose was measured
+	uint64_t sequence;              // running count of samples received
+	bool valid;                     // orientation holds a parsed pose
+	char text[ORIENTATION_TEXT_LEN];    // line as received, empty for binary samples
+};
+
+// Latest-value cell with one writer and any number of readers. The writer
+// never waits; readers retry while a store is in progress.
+class LatestOrientation
+{
+public:
+	LatestOrientation();
+
+	void store(const OrientationSample &sample);
+
+	// False until the first store
+	bool load(OrientationSample *sample) const;
+
+private:
+	std::atomic<uint32_t> m_seq;
+	OrientationSample m_sample;
+};
+
+// Splits a byte stream into samples. Not thread safe; one per connection.
+class OrientationParser
+{
+public:
+	OrientationParser();
+
+	void reset() { m_length = 0; }
+
+	// Append received bytes and emit every complete sample through sink
+	template <typename Sink>
+	void feed(const char *data, size_t bytes, uint64_t receiveTimeUs, Sink sink);
+
+	// Emit a trailing line that ended with the connection instead of '\n'
+	template <typename Sink>
+	void flush(uint64_t receiveTimeUs, Sink sink);
+
+	// Both fill every field but receive_time_us and sequence
+	static bool parseBinary(const unsigned char *packet, OrientationSample *sample);
+	static bool parseText(const char *line, size_t length, OrientationSample *sample);
+
+private:
+	enum { BUFFER_BYTES = 256 };
+
+	char m_buffer[BUFFER_BYTES];
+	size_t m_length;
+};
+
+typedef enum
+{
+	ORIENTATION_EVENT_DATA = 0,     // bytes received
+	ORIENTATION_EVENT_CONNECT,      // new connection, drop any partial packet
+	ORIENTATION_EVENT_END_OF_REPLY, // poll server closed, parse the remainder
+} orientationEvent;
+
+// Keeps the latest IMU orientation current from a background thread so the
+// frame loop only ever reads a local copy. Reconnects with backoff when the
+// server goes away.
+class OrientationService
+{
+public:
+	OrientationService();
+	~OrientationService();
+
+	// What the service saw on the wire, with its receive time. Called on the
+	// service thread.
+	typedef std::function<void(orientationEvent event, const char *data, size_t bytes, uint64_t receiveTimeUs)> PacketTap;
+
+	bool start(const std::string &host, const std::string &port,
+		orientationMode mode = ORIENTATION_MODE_STREAM, uint32_t pollIntervalMs = 10);
+	void stop();
+
+	// Set before start(), e.g. to record the IMU stream
+	void setPacketTap(const PacketTap &tap) { m_tap = tap; }
+
+	// Handle an event as if it had come from the socket, e.g. when replaying
+	// a recording. Only while the service is not started.
+	void inject(orientationEvent event, const char *data, size_t bytes, uint64_t receiveTimeUs);
+
+	// Non-blocking; false if nothing has been received yet
+	bool latest(OrientationSample *sample) const { return m_latest.load(sample); }
+
+	// Every valid pose received, for lookups at frame capture or display time
+	const PoseHistory& history() const { return m_history; }
+
+	bool isConnected() const { return m_connected.load(std::memory_order_relaxed); }
+	uint64_t samplesReceived() const { return m_samples.load(std::memory_order_relaxed); }
+	uint64_t connectionCount() const { return m_connections.load(std::memory_order_relaxed); }
+
+private:
+	OrientationService(const OrientationService&);
+	OrientationService& operator=(const OrientationService&);
+
+	void run();
+	void receive(intptr_t socket);
+	void poll(intptr_t socket);
+	void publish(OrientationSample &sample);
+
+	std::string m_host;
+	std::string m_port;
+	orientationMode m_mode;
+	uint32_t m_pollIntervalMs;
+
+	PacketTap m_tap;
+	OrientationParser m_parser;
+	LatestOrientation m_latest;
+	PoseHistory m_history;
+
+	// Sensor clock to steady clock, estimated as the smallest observed transit
+	int64_t m_clockOffsetUs;
+	bool m_clockOffsetValid;
+
+	std::thread m_thread;
+	std::atomic<bool> m_stop;
+	std::atomic<bool> m_connected;
+	std::atomic<uint64_t> m_samples;
+	std::atomic<uint64_t> m_connections;
+};
+
+// Stand-in IMU server on 127.0.0.1 that streams a slowly turning pose, for
+// running without the real IMU. Answers legacy poll clients with one text
+// line when they shut down their side.
+class OrientationLoopbackServer
+{
+public:
+	OrientationLoopbackServer();
+	~OrientationLoopbackServer();
+
+	// port "0" picks a free port; see port()
+	bool start(const std::string &port, uint32_t rateHz = 200, bool binary = true);
+	void stop();
+
+	std::string port() const { return m_port; }
+
+private:
+	OrientationLoopbackServer(const OrientationLoopbackServer&);
+	OrientationLoopbackServer& operator=(const OrientationLoopbackServer&);
+
+	void run();
+	void serve(intptr_t client);
+
+	intptr_t m_listen;
+	std::string m_port;
+	uint32_t m_rateHz;
+	bool m_binary;
+	uint64_t m_startUs;
+
+	std::thread m_thread;
+	std::atomic<bool> m_stop;
+};
+
+//***********************************************************************************
+template <typename Sink>
+void
+OrientationParser::feed(const char *data, size_t bytes, uint64_t receiveTimeUs, Sink sink)
+{
+	while (bytes > 0)
+	{
+		size_t take = BUFFER_BYTES - m_length < bytes ? BUFFER_BYTES - m_length : bytes;
+		memcpy(m_buffer + m_length, data, take);
+		m_length += take;
+		data += take;
+		bytes -= take;
+
+		size_t pos = 0;
+		while (pos < m_length)
+		{
+			OrientationSample sample;
+			uint32_t magic = 0;
+			if (m_length - pos >= sizeof(magic))
+				memcpy(&magic, m_buffer + pos, sizeof(magic));
+
+			if (magic == ORIENTATION_PACKET_MAGIC)
+			{
+				if (m_length - pos < ORIENTATION_PACKET_BYTES)
+					break;
+				if (parseBinary((const unsigned char*)m_buffer + pos, &sample))
+				{
+					sample.receive_time_us = receiveTimeUs;
+					sink(sample);
+				}
+				pos += ORIENTATION_PACKET_BYTES;
+				continue;
+			}
+
+			const char *newline = (const char*)memchr(m_buffer + pos, '\n', m_length - pos);
+			if (newline == nullptr)
+			{
+				// A partial magic or line; wait for more unless it can never fit
+				if (pos == 0 && m_length == BUFFER_BYTES)
+					pos = m_length;
+				break;
+			}
+
+			size_t length = newline - (m_buffer + pos);
+			if (parseText(m_buffer + pos, length, &sample) || sample.text[0] != 0)
+			{
+				sample.receive_time_us = receiveTimeUs;
+				sink(sample);
+			}
+			pos += length + 1;
+		}
+
+		memmove(m_buffer, m_buffer + pos, m_length - pos);
+		m_length -= pos;
+	}
+}
+
+template <typename Sink>
+void
+OrientationParser::flush(uint64_t receiveTimeUs, Sink sink)
+{
+	if (m_length > 0)
+	{
+		OrientationSample sample;
+		if (parseText(m_buffer, m_length, &sample) || sample.text[0] != 0)
+		{
+			sample.receive_time_us = receiveTimeUs;
+			sink(sample);
+		}
+	}
+	m_length = 0;
+}
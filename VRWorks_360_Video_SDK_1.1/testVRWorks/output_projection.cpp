@@ -0,0 +1,181 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "output_projection.h"
+
+#include <math.h>
+
+static const float PI = 3.14159265358979f;
+
+// A face of the 3x2 layout: the direction through its center and the
+// directions of increasing column and row
+struct CubeFace
+{
+	float center[3];
+	float right[3];
+	float down[3];
+};
+
+static const CubeFace CUBE_FACES[6] =
+{
+	{ { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f } },     // left
+	{ { 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } },      // front
+	{ { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f } },     // right
+	{ { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { -1.0f, 0.0f, 0.0f } },    // down
+	{ { 0.0f, 0.0f, -1.0f }, { 0.0f, 1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f } },     // back
+	{ { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f } },      // up
+};
+
+//***********************************************************************************
+OutputProjection::OutputProjection() :
+	m_type(CPUSS_PROJECTION_EQUIRECTANGULAR),
+	m_width(0),
+	m_height(0),
+	m_faceSize(0),
+	m_pixelsPerRadian(0.0f)
+{
+}
+
+nvstitchResult
+OutputProjection::init(cpussProjection projection, uint32_t panoWidth)
+{
+	m_type = projection;
+	m_pixelsPerRadian = (float)panoWidth / (2.0f * PI);
+	m_sinLon.clear();
+	m_cosLon.clear();
+	m_faceCoord.clear();
+
+	switch (projection)
+	{
+	case CPUSS_PROJECTION_EQUIRECTANGULAR:
+		if (panoWidth < 2 || (panoWidth & 1) != 0)
+			return NVSTITCH_ERROR_BAD_PARAMETER;
+		m_width = panoWidth;
+		m_height = panoWidth / 2;
+		m_sinLon.resize(m_width);
+		m_cosLon.resize(m_width);
+		for (uint32_t x = 0; x < m_width; x++)
+		{
+			float lon = ((float)x + 0.5f) / (float)m_width * 2.0f * PI - PI;
+			m_sinLon[x] = sinf(lon);
+			m_cosLon[x] = cosf(lon);
+		}
+		return NVSTITCH_SUCCESS;
+
+	case CPUSS_PROJECTION_CUBEMAP:
+	case CPUSS_PROJECTION_EQUIANGULAR_CUBEMAP:
+		// A face spans 90 degrees, a quarter of the equator
+		if (panoWidth < 4 || (panoWidth & 3) != 0)
+			return NVSTITCH_ERROR_BAD_PARAMETER;
+		m_faceSize = panoWidth / 4;
+		m_width = m_faceSize * 3;
+		m_height = m_faceSize * 2;
+		m_faceCoord.resize(m_faceSize);
+		for (uint32_t i = 0; i < m_faceSize; i++)
+		{
+			float t = ((float)i + 0.5f) / (float)m_faceSize * 2.0f - 1.0f;
+			m_faceCoord[i] = projection == CPUSS_PROJECTION_CUBEMAP ? t : tanf(t * 0.25f * PI);
+		}
+		return NVSTITCH_SUCCESS;
+
+	default:
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	}
+}
+
+void
+OutputProjection::rowDirections(uint32_t y, float *dirs) const
+{
+	if (m_type == CPUSS_PROJECTION_EQUIRECTANGULAR)
+	{
+		float lat = 0.5f * PI - ((float)y + 0.5f) / (float)m_height * PI;
+		float sinLat = sinf(lat), cosLat = cosf(lat);
+		for (uint32_t x = 0; x < m_width; x++)
+		{
+			dirs[x * 3 + 0] = cosLat * m_sinLon[x];
+			dirs[x * 3 + 1] = sinLat;
+			dirs[x * 3 + 2] = cosLat * m_cosLon[x];
+		}
+		return;
+	}
+
+	float b = m_faceCoord[y % m_faceSize];
+	for (uint32_t column = 0; column < 3; column++)
+	{
+		const CubeFace &face = CUBE_FACES[(y / m_faceSize) * 3 + column];
+		float *out = dirs + (size_t)column * m_faceSize * 3;
+		for (uint32_t i = 0; i < m_faceSize; i++)
+		{
+			float a = m_faceCoord[i];
+			float d[3];
+			for (int k = 0; k < 3; k++)
+				d[k] = face.center[k] + a * face.right[k] + b * face.down[k];
+			float scale = 1.0f / sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+			out[i * 3 + 0] = d[0] * scale;
+			out[i * 3 + 1] = d[1] * scale;
+			out[i * 3 + 2] = d[2] * scale;
+		}
+	}
+}
+
+const char*
+OutputProjection::name(cpussProjection projection)
+{
+	switch (projection)
+	{
+	case CPUSS_PROJECTION_EQUIRECTANGULAR:
+		return "equirectangular";
+	case CPUSS_PROJECTION_CUBEMAP:
+		return "cubemap";
+	case CPUSS_PROJECTION_EQUIANGULAR_CUBEMAP:
+		return "equi-angular cubemap";
+	default:
+		return "unknown";
+	}
+}
@@ -0,0 +1,114 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "cpu_stitcher.h"
+
+// ==== Output projections of the CPU stitcher ====
+// Where each output pixel looks, in world directions (Y-up, X-right, Z-in,
+// as in the rig XML). pano_width sets the angular resolution at the
+// equator, pano_width / 360 pixels per degree, whatever the projection:
+//
+// Equirectangular   pano_width x pano_width / 2. Column x is longitude
+//                   (x + 0.5) / width * 360 - 180, the middle column looking
+//                   down +Z; row 0 is the top (+Y). Wraps around horizontally.
+// Cubemap           3x2 faces of pano_width / 4 pixels, each a 90 degree
+//                   pinhole view: about 25% fewer pixels than equirectangular.
+// Equi-angular      The same layout, with face pixels spaced by equal angles
+// cubemap (EAC)     instead of equal distances on the cube, so resolution is
+//                   even across a face rather than 30% higher at its corners.
+//
+// The cube faces are laid out as YouTube's EAC streams are, each row one
+// continuous strip:
+//   top row      left (-X)    front (+Z)   right (+X)
+//   bottom row   down (-Y)    back (-Z)    up (+Y)
+// The bottom row is the band through down, back and up laid on its side:
+// image up is +X there, so the back face appears turned 90 degrees clockwise.
+class OutputProjection
+{
+public:
+	OutputProjection();
+
+	// NVSTITCH_ERROR_BAD_PARAMETER if pano_width does not divide into whole
+	// pixels, NVSTITCH_ERROR_UNSUPPORTED_CONFIG for unknown projections
+	nvstitchResult init(cpussProjection projection, uint32_t panoWidth);
+
+	cpussProjection type() const { return m_type; }
+	uint32_t width() const { return m_width; }
+	uint32_t height() const { return m_height; }
+
+	// Output pixels per radian at the center of the view, as for margins
+	float pixelsPerRadian() const { return m_pixelsPerRadian; }
+
+	// Whether column width - 1 continues into column 0
+	bool wrapsAround() const { return m_type == CPUSS_PROJECTION_EQUIRECTANGULAR; }
+
+	// Unit directions of the pixel centers of row y, 3 floats per pixel
+	void rowDirections(uint32_t y, float *dirs) const;
+
+	static const char* name(cpussProjection projection);
+
+private:
+	cpussProjection m_type;
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_faceSize;
+	float m_pixelsPerRadian;
+
+	// Equirectangular: sine and cosine of each column's longitude. Cube:
+	// position of each face pixel center on the face, in [-1, 1].
+	std::vector<float> m_sinLon;
+	std::vector<float> m_cosLon;
+	std::vector<float> m_faceCoord;
+};
@@ -0,0 +1,298 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "pack_yuv_kernels.h"
+#include "cpu_features.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+const packYuvMatrix_t packYuvBt601 =
+{
+	{ 66, 129, 25, 0 },
+	{ -38, -74, 112, 0 },
+	{ 112, -94, -18, 0 },
+	{ 16, 128, 128 },
+};
+
+const packYuvMatrix_t packYuvBt601Bgr =
+{
+	{ 25, 129, 66, 0 },
+	{ 112, -74, -38, 0 },
+	{ -18, -94, 112, 0 },
+	{ 16, 128, 128 },
+};
+
+const packYuvMatrix_t packYuvSplit =
+{
+	{ 256, 0, 0, 0 },
+	{ 0, 256, 0, 0 },
+	{ 0, 0, 256, 0 },
+	{ 0, 0, 0 },
+};
+
+static inline unsigned char clampByte(int32_t value)
+{
+	return (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static inline int32_t dot(const int16_t weights[4], const int32_t values[4])
+{
+	return weights[0] * values[0] + weights[1] * values[1] + weights[2] * values[2] + weights[3] * values[3];
+}
+
+void packYuvRowsScalar(const packYuvMatrix_t *matrix, const unsigned char *top, const unsigned char *bottom, uint32_t width,
+	unsigned char *lumaTop, unsigned char *lumaBottom, unsigned char *u, unsigned char *v, uint32_t chromaStep)
+{
+	for (uint32_t x = 0; x < width; x += 2)
+	{
+		const unsigned char *rows[2] = { top + (size_t)x * 4, bottom + (size_t)x * 4 };
+		unsigned char *luma[2] = { lumaTop + x, lumaBottom + x };
+		int32_t box[4] = { 0, 0, 0, 0 };
+		for (int r = 0; r < 2; r++)
+		{
+			for (int k = 0; k < 2; k++)
+			{
+				const unsigned char *p = rows[r] + k * 4;
+				int32_t pixel[4] = { p[0], p[1], p[2], p[3] };
+				luma[r][k] = clampByte(((dot(matrix->luma, pixel) + 128) >> 8) + matrix->offset[0]);
+				for (int c = 0; c < 4; c++)
+					box[c] += pixel[c];
+			}
+		}
+		size_t chroma = (size_t)(x / 2) * chromaStep;
+		u[chroma] = clampByte(((dot(matrix->u, box) + 512) >> 10) + matrix->offset[1]);
+		v[chroma] = clampByte(((dot(matrix->v, box) + 512) >> 10) + matrix->offset[2]);
+	}
+}
+
+//***********************************************************************************
+// Eight pixels per iteration. Pixels are widened to 16 bits, two to a
+// vector, and _mm_madd_epi16 with the weights repeated for both leaves each
+// pixel's sum in two dwords that _mm_hadd_epi32 adds up. The 2x2 boxes are
+// summed in 16 bits, rows first, then neighbouring pixels by 64-bit unpacks
+// as the downsample kernels do, and go through the same madd and hadd with
+// the U and V weights, which leaves U, U, V, V for each pair of boxes.
+
+// Weights of one pixel, repeated for the two a vector holds
+CPU_TARGET_SSE41
+static inline __m128i loadWeightsSse41(const int16_t weights[4])
+{
+	__m128i w = _mm_loadl_epi64((const __m128i*)weights);
+	return _mm_unpacklo_epi64(w, w);
+}
+
+CPU_TARGET_SSE41
+static inline __m128i lumaSse41(__m128i pixels, __m128i weights, __m128i offset)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(128);
+	__m128i sum = _mm_hadd_epi32(_mm_madd_epi16(_mm_cvtepu8_epi16(pixels), weights),
+		_mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights));
+	return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sum, round), 8), offset);
+}
+
+// U0, U1, V0, V1 of the two boxes under four pixels of each row
+CPU_TARGET_SSE41
+static inline __m128i chromaSse41(__m128i top, __m128i bottom, __m128i weightsU, __m128i weightsV, __m128i offset)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(512);
+	__m128i left = _mm_add_epi16(_mm_cvtepu8_epi16(top), _mm_cvtepu8_epi16(bottom));
+	__m128i right = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+	__m128i box = _mm_add_epi16(_mm_unpacklo_epi64(left, right), _mm_unpackhi_epi64(left, right));
+	__m128i sum = _mm_hadd_epi32(_mm_madd_epi16(box, weightsU), _mm_madd_epi16(box, weightsV));
+	return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sum, round), 10), offset);
+}
+
+CPU_TARGET_SSE41
+static inline void storeLumaSse41(__m128i first, __m128i second, unsigned char *dst)
+{
+	__m128i words = _mm_packus_epi32(first, second);
+	_mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(words, words));
+}
+
+// u and v each hold four samples, one per dword
+CPU_TARGET_SSE41
+static inline void storeChromaSse41(__m128i u, __m128i v, unsigned char *dstU, unsigned char *dstV, uint32_t chromaStep)
+{
+	__m128i words = _mm_packus_epi32(u, v);
+	__m128i bytes = _mm_packus_epi16(words, words);
+	if (chromaStep == 2)
+	{
+		const __m128i interleave = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+		_mm_storel_epi64((__m128i*)dstU, _mm_shuffle_epi8(bytes, interleave));
+	}
+	else
+	{
+		*(int*)dstU = _mm_cvtsi128_si32(bytes);
+		*(int*)dstV = _mm_extract_epi32(bytes, 1);
+	}
+}
+
+CPU_TARGET_SSE41
+static void packYuvRowsSse41(const packYuvMatrix_t *matrix, const unsigned char *top, const unsigned char *bottom, uint32_t width,
+	unsigned char *lumaTop, unsigned char *lumaBottom, unsigned char *u, unsigned char *v, uint32_t chromaStep)
+{
+	const __m128i weights = loadWeightsSse41(matrix->luma);
+	const __m128i weightsU = loadWeightsSse41(matrix->u);
+	const __m128i weightsV = loadWeightsSse41(matrix->v);
+	const __m128i lumaOffset = _mm_set1_epi32(matrix->offset[0]);
+	const __m128i chromaOffset = _mm_setr_epi32(matrix->offset[1], matrix->offset[1], matrix->offset[2], matrix->offset[2]);
+
+	uint32_t x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		__m128i t0 = _mm_loadu_si128((const __m128i*)(top + (size_t)x * 4));
+		__m128i t1 = _mm_loadu_si128((const __m128i*)(top + (size_t)x * 4 + 16));
+		__m128i b0 = _mm_loadu_si128((const __m128i*)(bottom + (size_t)x * 4));
+		__m128i b1 = _mm_loadu_si128((const __m128i*)(bottom + (size_t)x * 4 + 16));
+		storeLumaSse41(lumaSse41(t0, weights, lumaOffset), lumaSse41(t1, weights, lumaOffset), lumaTop + x);
+		storeLumaSse41(lumaSse41(b0, weights, lumaOffset), lumaSse41(b1, weights, lumaOffset), lumaBottom + x);
+
+		__m128i c0 = chromaSse41(t0, b0, weightsU, weightsV, chromaOffset);
+		__m128i c1 = chromaSse41(t1, b1, weightsU, weightsV, chromaOffset);
+		size_t chroma = (size_t)(x / 2) * chromaStep;
+		storeChromaSse41(_mm_unpacklo_epi64(c0, c1), _mm_unpackhi_epi64(c0, c1), u + chroma, v + chroma, chromaStep);
+	}
+	size_t chroma = (size_t)(x / 2) * chromaStep;
+	packYuvRowsScalar(matrix, top + (size_t)x * 4, bottom + (size_t)x * 4, width - x,
+		lumaTop + x, lumaBottom + x, u + chroma, v + chroma, chromaStep);
+}
+
+// As the SSE4.1 kernel, sixteen pixels per iteration. Widening each half of
+// a row's eight pixels leaves the sums in lane order 0 1 4 5 | 2 3 6 7 for
+// luma and U0 U2 V0 V2 | U1 U3 V1 V3 for chroma, which a dword permute
+// puts back in order before the stores.
+CPU_TARGET_AVX2
+static inline __m256i lumaAvx2(__m256i pixels, __m256i weights, __m256i offset)
+{
+	const __m256i round = _mm256_set1_epi32(128);
+	const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+	__m256i sum = _mm256_hadd_epi32(_mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(pixels)), weights),
+		_mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(pixels, 1)), weights));
+	sum = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(sum, round), 8), offset);
+	return _mm256_permutevar8x32_epi32(sum, order);
+}
+
+CPU_TARGET_AVX2
+static inline __m256i chromaAvx2(__m256i top, __m256i bottom, __m256i weightsU, __m256i weightsV, __m256i offset)
+{
+	const __m256i round = _mm256_set1_epi32(512);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	__m256i left = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(top)),
+		_mm256_cvtepu8_epi16(_mm256_castsi256_si128(bottom)));
+	__m256i right = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(top, 1)),
+		_mm256_cvtepu8_epi16(_mm256_extracti128_si256(bottom, 1)));
+	__m256i box = _mm256_add_epi16(_mm256_unpacklo_epi64(left, right), _mm256_unpackhi_epi64(left, right));
+	__m256i sum = _mm256_hadd_epi32(_mm256_madd_epi16(box, weightsU), _mm256_madd_epi16(box, weightsV));
+	sum = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(sum, round), 10), offset);
+	return _mm256_permutevar8x32_epi32(sum, order);
+}
+
+CPU_TARGET_AVX2
+static void packYuvRowsAvx2(const packYuvMatrix_t *matrix, const unsigned char *top, const unsigned char *bottom, uint32_t width,
+	unsigned char *lumaTop, unsigned char *lumaBottom, unsigned char *u, unsigned char *v, uint32_t chromaStep)
+{
+	const __m256i weights = _mm256_broadcastsi128_si256(loadWeightsSse41(matrix->luma));
+	const __m256i weightsU = _mm256_broadcastsi128_si256(loadWeightsSse41(matrix->u));
+	const __m256i weightsV = _mm256_broadcastsi128_si256(loadWeightsSse41(matrix->v));
+	const __m256i lumaOffset = _mm256_set1_epi32(matrix->offset[0]);
+	const __m256i chromaOffset = _mm256_setr_epi32(matrix->offset[1], matrix->offset[1], matrix->offset[2], matrix->offset[2],
+		matrix->offset[1], matrix->offset[1], matrix->offset[2], matrix->offset[2]);
+
+	uint32_t x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		__m256i t0 = _mm256_loadu_si256((const __m256i*)(top + (size_t)x * 4));
+		__m256i t1 = _mm256_loadu_si256((const __m256i*)(top + (size_t)x * 4 + 32));
+		__m256i b0 = _mm256_loadu_si256((const __m256i*)(bottom + (size_t)x * 4));
+		__m256i b1 = _mm256_loadu_si256((const __m256i*)(bottom + (size_t)x * 4 + 32));
+
+		__m256i y0 = lumaAvx2(t0, weights, lumaOffset);
+		__m256i y1 = lumaAvx2(t1, weights, lumaOffset);
+		storeLumaSse41(_mm256_castsi256_si128(y0), _mm256_extracti128_si256(y0, 1), lumaTop + x);
+		storeLumaSse41(_mm256_castsi256_si128(y1), _mm256_extracti128_si256(y1, 1), lumaTop + x + 8);
+		y0 = lumaAvx2(b0, weights, lumaOffset);
+		y1 = lumaAvx2(b1, weights, lumaOffset);
+		storeLumaSse41(_mm256_castsi256_si128(y0), _mm256_extracti128_si256(y0, 1), lumaBottom + x);
+		storeLumaSse41(_mm256_castsi256_si128(y1), _mm256_extracti128_si256(y1, 1), lumaBottom + x + 8);
+
+		// U0..U3 | V0..V3, then U4..U7 | V4..V7
+		__m256i c0 = chromaAvx2(t0, b0, weightsU, weightsV, chromaOffset);
+		__m256i c1 = chromaAvx2(t1, b1, weightsU, weightsV, chromaOffset);
+		size_t chroma = (size_t)(x / 2) * chromaStep;
+		storeChromaSse41(_mm256_castsi256_si128(c0), _mm256_extracti128_si256(c0, 1),
+			u + chroma, v + chroma, chromaStep);
+		chroma += 4 * chromaStep;
+		storeChromaSse41(_mm256_castsi256_si128(c1), _mm256_extracti128_si256(c1, 1),
+			u + chroma, v + chroma, chromaStep);
+	}
+	size_t chroma = (size_t)(x / 2) * chromaStep;
+	packYuvRowsScalar(matrix, top + (size_t)x * 4, bottom + (size_t)x * 4, width - x,
+		lumaTop + x, lumaBottom + x, u + chroma, v + chroma, chromaStep);
+}
+
+//***********************************************************************************
+void packYuvRows(const packYuvMatrix_t *matrix, const unsigned char *top, const unsigned char *bottom, uint32_t width,
+	unsigned char *lumaTop, unsigned char *lumaBottom, unsigned char *u, unsigned char *v, uint32_t chromaStep)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		packYuvRowsAvx2(matrix, top, bottom, width, lumaTop, lumaBottom, u, v, chromaStep);
+		break;
+	case CPU_SIMD_SSE41:
+		packYuvRowsSse41(matrix, top, bottom, width, lumaTop, lumaBottom, u, v, chromaStep);
+		break;
+	default:
+		packYuvRowsScalar(matrix, top, bottom, width, lumaTop, lumaBottom, u, v, chromaStep);
+		break;
+	}
+}
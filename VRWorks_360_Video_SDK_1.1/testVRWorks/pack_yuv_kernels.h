@@ -0,0 +1,95 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==== 4:2:0 output kernels ====
+// Split a stitched image of 4-byte pixels into the planes of an I420 or NV12
+// frame, two rows at a time. Luma is a weighted sum of each pixel's four
+// bytes, chroma of the 2x2 box of pixels over it, centred between them as
+// libyuv and most encoders' own converters take it:
+//   Y = ((l . p + 128) >> 8) + offset[0]
+//   U = ((u . (p00 + p01 + p10 + p11) + 512) >> 10) + offset[1]
+// and V as U, clamped to [0, 255]. The matrix is a parameter so the same
+// kernels convert RGBA (packYuvBt601) or merely split pixels that already
+// hold Y, U, V and alpha (packYuvSplit). All kernels give the same bits as
+// the scalar one, whatever the instruction set.
+
+typedef struct packYuvMatrix_st
+{
+	int16_t luma[4];            //!< Weights of the pixel's bytes, in 1/256ths
+	int16_t u[4];               //!< Weights of the 2x2 box's sums, in 1/1024ths
+	int16_t v[4];
+	int32_t offset[3];          //!< Added to Y, U and V after the shift
+} packYuvMatrix_t;
+
+// RGBA to BT.601 limited range, the inverse of the matrix the remap
+// kernels read 4:2:0 inputs with (remap_yuv_kernels.h)
+extern const packYuvMatrix_t packYuvBt601;
+
+// The same for BGRA, as panoramas stitched from BGR8 inputs come out
+extern const packYuvMatrix_t packYuvBt601Bgr;
+
+// Pixels of Y, U, V and alpha, as the remap kernels leave 4:2:0 samples
+// they are told not to convert
+extern const packYuvMatrix_t packYuvSplit;
+
+// Two rows of width pixels, width even, into a row of luma each and one row
+// of U and V. I420 writes U and V to their own planes, chromaStep 1; NV12
+// interleaves them, u and v one byte apart and chromaStep 2.
+void packYuvRows(const packYuvMatrix_t *matrix, const unsigned char *top, const unsigned char *bottom, uint32_t width,
+	unsigned char *lumaTop, unsigned char *lumaBottom, unsigned char *u, unsigned char *v, uint32_t chromaStep);
+
+// Plain C kernel: the tail of every SIMD row, and what kernelCheckRun()
+// compares packYuvRows() with
+void packYuvRowsScalar(const packYuvMatrix_t *matrix, const unsigned char *top, const unsigned char *bottom, uint32_t width,
+	unsigned char *lumaTop, unsigned char *lumaBottom, unsigned char *u, unsigned char *v, uint32_t chromaStep);
@@ -0,0 +1,593 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "pano_publisher.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "seqlock counters must be plain 32-bit words");
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "frame counter must be a plain 64-bit word");
+
+static const uint32_t NO_SLOT = 0xffffffffu;
+
+// The shared structs are plain C so other processes can read them; the
+// publisher and reader access the synchronizing fields atomically.
+template <typename T>
+static inline std::atomic<T>& asAtomic(T &value)
+{
+	return *reinterpret_cast<std::atomic<T>*>(&value);
+}
+
+template <typename T>
+static inline const std::atomic<T>& asAtomic(const T &value)
+{
+	return *reinterpret_cast<const std::atomic<T>*>(&value);
+}
+
+static inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// Planes of a frame in the format, and bytes per sample of each
+static uint32_t formatPlanes(panoPixelFormat format)
+{
+	switch (format)
+	{
+	case PANO_FORMAT_I420: return 3;
+	case PANO_FORMAT_NV12: return 2;
+	default: return 1;
+	}
+}
+
+static uint32_t sampleBytes(panoPixelFormat format, uint32_t plane)
+{
+	if (format == PANO_FORMAT_BGRA8 || format == PANO_FORMAT_RGBA8)
+		return 4;
+	return format == PANO_FORMAT_NV12 && plane == 1 ? 2 : 1;
+}
+
+uint64_t panoSteadyTimeUs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//***********************************************************************************
+PanoShmMapping::PanoShmMapping()
+	: m_data(nullptr), m_size(0), m_owner(false)
+#if defined(_WIN32) || defined(_WIN64)
+	, m_handle(nullptr)
+#endif
+{
+}
+
+PanoShmMapping::~PanoShmMapping()
+{
+	close();
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+
+bool
+PanoShmMapping::create(const std::string &name, size_t bytes)
+{
+	close();
+
+	uint64_t size = bytes;
+	HANDLE handle = CreateFileMappingA(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE,
+		(DWORD)(size >> 32), (DWORD)(size & 0xffffffffu), name.c_str());
+	if (handle == 0)
+	{
+		std::cerr << "CreateFileMapping failed with error " << GetLastError() << std::endl;
+		return false;
+	}
+
+	void *view = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+	if (view == 0)
+	{
+		std::cerr << "MapViewOfFile failed with error " << GetLastError() << std::endl;
+		CloseHandle(handle);
+		return false;
+	}
+
+	m_handle = handle;
+	m_data = (unsigned char *)view;
+	m_size = bytes;
+	m_name = name;
+	m_owner = true;
+	return true;
+}
+
+bool
+PanoShmMapping::open(const std::string &name)
+{
+	close();
+
+	HANDLE handle = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+	if (handle == 0)
+		return false;
+
+	void *view = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+	if (view == 0)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+
+	MEMORY_BASIC_INFORMATION info;
+	VirtualQuery(view, &info, sizeof(info));
+
+	m_handle = handle;
+	m_data = (unsigned char *)view;
+	m_size = info.RegionSize;
+	m_name = name;
+	m_owner = false;
+	return true;
+}
+
+void
+PanoShmMapping::close()
+{
+	if (m_data != nullptr)
+		UnmapViewOfFile(m_data);
+	if (m_handle != nullptr)
+		CloseHandle((HANDLE)m_handle);
+	m_data = nullptr;
+	m_handle = nullptr;
+	m_size = 0;
+	m_owner = false;
+}
+
+#else
+
+bool
+PanoShmMapping::create(const std::string &name, size_t bytes)
+{
+	close();
+
+	int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0666);
+	if (fd < 0)
+	{
+		perror("shm_open");
+		return false;
+	}
+
+	if (ftruncate(fd, (off_t)bytes) != 0)
+	{
+		perror("ftruncate");
+		::close(fd);
+		return false;
+	}
+
+	void *view = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED)
+	{
+		perror("mmap");
+		return false;
+	}
+
+	m_data = (unsigned char *)view;
+	m_size = bytes;
+	m_name = name;
+	m_owner = true;
+	return true;
+}
+
+bool
+PanoShmMapping::open(const std::string &name)
+{
+	close();
+
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void *view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED)
+		return false;
+
+	m_data = (unsigned char *)view;
+	m_size = (size_t)st.st_size;
+	m_name = name;
+	m_owner = false;
+	return true;
+}
+
+void
+PanoShmMapping::close()
+{
+	if (m_data != nullptr)
+		munmap(m_data, m_size);
+	if (m_owner)
+		shm_unlink(m_name.c_str());
+	m_data = nullptr;
+	m_size = 0;
+	m_owner = false;
+}
+
+#endif
+
+//***********************************************************************************
+PanoPublisher::PanoPublisher()
+	: m_header(nullptr), m_slots(nullptr), m_frameIndex(0),
+	  m_projection(PANO_PROJECTION_EQUIRECT), m_fovXDeg(360.0f), m_fovYDeg(180.0f),
+	  m_stabilization(PANO_STABILIZATION_NONE)
+{
+}
+
+void
+PanoPublisher::setProjection(panoProjection projection, float fovXDeg, float fovYDeg)
+{
+	m_projection = projection;
+	m_fovXDeg = fovXDeg;
+	m_fovYDeg = fovYDeg;
+}
+
+bool
+PanoPublisher::create(const std::string &name, uint32_t numSlots, size_t slotBytes)
+{
+	if (numSlots < 2)
+	{
+		std::cerr << "PanoPublisher needs at least two slots" << std::endl;
+		return false;
+	}
+
+	uint64_t header_bytes = alignUp(sizeof(panoShmHeader_t) + numSlots * sizeof(panoShmSlot_t), PANO_SHM_ALIGN);
+	uint64_t slot_bytes = alignUp(slotBytes, PANO_SHM_ALIGN);
+	uint64_t total_bytes = header_bytes + numSlots * slot_bytes;
+
+	if (!m_mapping.create(name, (size_t)total_bytes))
+		return false;
+
+	unsigned char *base = m_mapping.data();
+	memset(base, 0, (size_t)header_bytes);
+
+	m_header = (panoShmHeader_t *)base;
+	m_slots = (panoShmSlot_t *)(base + sizeof(panoShmHeader_t));
+
+	m_header->version = PANO_SHM_VERSION;
+	m_header->header_bytes = (uint32_t)header_bytes;
+	m_header->num_slots = numSlots;
+	m_header->slot_bytes = slot_bytes;
+	m_header->total_bytes = total_bytes;
+	m_header->latest_slot = NO_SLOT;
+	for (uint32_t slot = 0; slot < numSlots; slot++)
+		m_slots[slot].data_offset = header_bytes + slot * slot_bytes;
+
+	// Readers ignore the mapping until the magic is visible
+	asAtomic(m_header->magic).store(PANO_SHM_MAGIC, std::memory_order_release);
+	m_frameIndex = 0;
+	return true;
+}
+
+bool
+PanoPublisher::publish(const unsigned char *frame, uint32_t width, uint32_t height, uint32_t stride,
+	panoPixelFormat format, uint64_t timestampUs, const panoShmPose_t *pose, const panoShmPose_t *displayPose,
+	const char *orientationText)
+{
+	panoFrameLevel_t level = { frame, width, height, stride };
+	return publishLevels(&level, 1, format, timestampUs, pose, displayPose, orientationText);
+}
+
+bool
+PanoPublisher::publishLevels(const panoFrameLevel_t *levels, uint32_t numLevels,
+	panoPixelFormat format, uint64_t timestampUs, const panoShmPose_t *pose, const panoShmPose_t *displayPose,
+	const char *orientationText)
+{
+	if (m_header == nullptr)
+		return false;
+	if (numLevels < 1 || numLevels > PANO_SHM_MAX_LEVELS || formatPlanes(format) != 1)
+	{
+		std::cerr << "PanoPublisher publishes 1 to " << PANO_SHM_MAX_LEVELS << " levels of 4-byte pixels, not " << numLevels
+			<< " of format " << (int)format << std::endl;
+		return false;
+	}
+
+	panoShmLevel_t layout[PANO_SHM_MAX_LEVELS];
+	uint32_t rowBytes[PANO_SHM_MAX_LEVELS];
+	uint64_t data_bytes = 0;
+	for (uint32_t i = 0; i < numLevels; i++)
+	{
+		rowBytes[i] = levels[i].width * 4;
+		layout[i].width = levels[i].width;
+		layout[i].height = levels[i].height;
+		layout[i].stride = rowBytes[i];
+		layout[i].reserved = 0;
+		layout[i].offset = data_bytes;
+		layout[i].bytes = (uint64_t)layout[i].stride * levels[i].height;
+		data_bytes += layout[i].bytes;
+	}
+
+	panoShmPlane_t plane;
+	plane.width = layout[0].width;
+	plane.height = layout[0].height;
+	plane.stride = layout[0].stride;
+	plane.sample_bytes = 4;
+	plane.offset = 0;
+	plane.bytes = layout[0].bytes;
+	return writeSlot(levels, rowBytes, numLevels, data_bytes, layout, numLevels, &plane, 1,
+		format, timestampUs, pose, displayPose, orientationText);
+}
+
+bool
+PanoPublisher::publishPlanes(const panoFrameLevel_t *planes, uint32_t numPlanes,
+	panoPixelFormat format, uint64_t timestampUs, const panoShmPose_t *pose, const panoShmPose_t *displayPose,
+	const char *orientationText)
+{
+	if (m_header == nullptr)
+		return false;
+	if (numPlanes != formatPlanes(format))
+	{
+		std::cerr << "PanoPublisher expects " << formatPlanes(format) << " planes of format " << (int)format
+			<< ", not " << numPlanes << std::endl;
+		return false;
+	}
+
+	panoShmPlane_t layout[PANO_SHM_MAX_PLANES];
+	uint32_t rowBytes[PANO_SHM_MAX_PLANES];
+	uint64_t data_bytes = 0;
+	for (uint32_t i = 0; i < numPlanes; i++)
+	{
+		layout[i].sample_bytes = sampleBytes(format, i);
+		rowBytes[i] = planes[i].width * layout[i].sample_bytes;
+		layout[i].width = planes[i].width;
+		layout[i].height = planes[i].height;
+		layout[i].stride = rowBytes[i];
+		layout[i].offset = data_bytes;
+		layout[i].bytes = (uint64_t)layout[i].stride * planes[i].height;
+		data_bytes += layout[i].bytes;
+	}
+
+	// The frame is one level, its stride that of the first plane
+	panoShmLevel_t level;
+	level.width = layout[0].width;
+	level.height = layout[0].height;
+	level.stride = layout[0].stride;
+	level.reserved = 0;
+	level.offset = 0;
+	level.bytes = data_bytes;
+	return writeSlot(planes, rowBytes, numPlanes, data_bytes, &level, 1, layout, numPlanes,
+		format, timestampUs, pose, displayPose, orientationText);
+}
+
+// Copies the parts, levels or planes, one after another with their rows
+// packed, and describes them as levels and planes say
+bool
+PanoPublisher::writeSlot(const panoFrameLevel_t *parts, const uint32_t *rowBytes, uint32_t numParts, uint64_t dataBytes,
+	const panoShmLevel_t *levels, uint32_t numLevels, const panoShmPlane_t *planes, uint32_t numPlanes,
+	panoPixelFormat format, uint64_t timestampUs, const panoShmPose_t *pose, const panoShmPose_t *displayPose,
+	const char *orientationText)
+{
+	if (dataBytes > m_header->slot_bytes)
+	{
+		std::cerr << "Frame of " << dataBytes << " bytes does not fit a " << m_header->slot_bytes << " byte slot" << std::endl;
+		return false;
+	}
+
+	// Never write the slot readers are most likely copying from
+	uint32_t latest = asAtomic(m_header->latest_slot).load(std::memory_order_relaxed);
+	uint32_t target = latest == NO_SLOT ? 0 : (latest + 1) % m_header->num_slots;
+	panoShmSlot_t &slot = m_slots[target];
+	std::atomic<uint32_t> &seq = asAtomic(slot.seq);
+
+	uint32_t begin = seq.load(std::memory_order_relaxed) + 1;
+	seq.store(begin, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	unsigned char *dst = m_mapping.data() + slot.data_offset;
+	for (uint32_t i = 0; i < numParts; i++)
+	{
+		const panoFrameLevel_t &part = parts[i];
+		size_t bytes = (size_t)rowBytes[i] * part.height;
+		if (part.stride == rowBytes[i])
+		{
+			memcpy(dst, part.data, bytes);
+		}
+		else
+		{
+			for (uint32_t y = 0; y < part.height; y++)
+				memcpy(dst + (size_t)y * rowBytes[i], part.data + (size_t)y * part.stride, rowBytes[i]);
+		}
+		dst += bytes;
+	}
+
+	slot.format = format;
+	slot.width = levels[0].width;
+	slot.height = levels[0].height;
+	slot.stride = levels[0].stride;
+	slot.num_levels = numLevels;
+	slot.stabilization = m_stabilization;
+	memset(slot.levels, 0, sizeof(slot.levels));
+	memcpy(slot.levels, levels, numLevels * sizeof(panoShmLevel_t));
+	slot.num_planes = numPlanes;
+	memset(slot.planes, 0, sizeof(slot.planes));
+	memcpy(slot.planes, planes, numPlanes * sizeof(panoShmPlane_t));
+	slot.projection = m_projection;
+	slot.fov_x_deg = m_fovXDeg;
+	slot.fov_y_deg = m_fovYDeg;
+	slot.data_bytes = dataBytes;
+	slot.frame_index = m_frameIndex;
+	slot.timestamp_us = timestampUs;
+	if (pose != nullptr)
+		slot.pose = *pose;
+	else
+		memset(&slot.pose, 0, sizeof(slot.pose));
+	if (displayPose != nullptr)
+		slot.display_pose = *displayPose;
+	else
+		memset(&slot.display_pose, 0, sizeof(slot.display_pose));
+	memset(slot.orientation_text, 0, PANO_SHM_TEXT_LEN);
+	if (orientationText != nullptr)
+		strncpy(slot.orientation_text, orientationText, PANO_SHM_TEXT_LEN - 1);
+
+	seq.store(begin + 1, std::memory_order_release);
+
+	asAtomic(m_header->latest_slot).store(target, std::memory_order_release);
+	asAtomic(m_header->frames_published).store(m_frameIndex + 1, std::memory_order_release);
+	m_frameIndex++;
+	return true;
+}
+
+//***********************************************************************************
+PanoReader::PanoReader()
+	: m_header(nullptr), m_slots(nullptr)
+{
+}
+
+bool
+PanoReader::open(const std::string &name)
+{
+	if (!m_mapping.open(name))
+		return false;
+
+	if (m_mapping.size() < sizeof(panoShmHeader_t))
+	{
+		close();
+		return false;
+	}
+
+	const panoShmHeader_t *header = (const panoShmHeader_t *)m_mapping.data();
+	if (asAtomic(header->magic).load(std::memory_order_acquire) != PANO_SHM_MAGIC ||
+		header->version != PANO_SHM_VERSION || header->total_bytes > m_mapping.size())
+	{
+		close();
+		return false;
+	}
+
+	m_header = header;
+	m_slots = (const panoShmSlot_t *)(m_mapping.data() + sizeof(panoShmHeader_t));
+	return true;
+}
+
+uint64_t
+PanoReader::latestFrameIndex() const
+{
+	if (m_header == nullptr)
+		return UINT64_MAX;
+
+	uint64_t published = asAtomic(m_header->frames_published).load(std::memory_order_acquire);
+	return published == 0 ? UINT64_MAX : published - 1;
+}
+
+bool
+PanoReader::readLatest(unsigned char *dst, size_t dstBytes, panoFrameInfo_t *info, int maxRetries)
+{
+	if (m_header == nullptr)
+		return false;
+
+	for (int attempt = 0; attempt < maxRetries; attempt++)
+	{
+		uint32_t latest = asAtomic(m_header->latest_slot).load(std::memory_order_acquire);
+		if (latest == NO_SLOT || latest >= m_header->num_slots)
+			return false;
+
+		const panoShmSlot_t &slot = m_slots[latest];
+		const std::atomic<uint32_t> &seq = asAtomic(slot.seq);
+
+		uint32_t begin = seq.load(std::memory_order_acquire);
+		if (begin & 1)
+			continue;   // publisher is lapping this slot right now
+
+		uint64_t data_bytes = slot.data_bytes;
+		if (data_bytes > dstBytes || slot.data_offset + data_bytes > m_mapping.size())
+			return false;
+
+		panoFrameInfo_t copy;
+		copy.format = (panoPixelFormat)slot.format;
+		copy.width = slot.width;
+		copy.height = slot.height;
+		copy.stride = slot.stride;
+		copy.projection = (panoProjection)slot.projection;
+		copy.fov_x_deg = slot.fov_x_deg;
+		copy.fov_y_deg = slot.fov_y_deg;
+		copy.data_bytes = data_bytes;
+		copy.frame_index = slot.frame_index;
+		copy.timestamp_us = slot.timestamp_us;
+		copy.pose = slot.pose;
+		copy.display_pose = slot.display_pose;
+		memcpy(copy.orientation_text, slot.orientation_text, PANO_SHM_TEXT_LEN);
+		copy.num_levels = slot.num_levels;
+		memcpy(copy.levels, slot.levels, sizeof(copy.levels));
+		copy.stabilization = (panoStabilization)slot.stabilization;
+		copy.num_planes = slot.num_planes;
+		memcpy(copy.planes, slot.planes, sizeof(copy.planes));
+		memcpy(dst, m_mapping.data() + slot.data_offset, (size_t)data_bytes);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (seq.load(std::memory_order_relaxed) != begin)
+			continue;   // torn: the slot was rewritten while we copied
+
+		if (info != nullptr)
+			*info = copy;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,310 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+// ==== Shared memory layout ====
+// [panoShmHeader_t | panoShmSlot_t x num_slots | pad to PANO_SHM_ALIGN]
+// followed by num_slots frame buffers of slot_bytes each, PANO_SHM_ALIGN apart.
+// A frame buffer holds each level of the frame in turn, largest first, rows
+// packed; a 4:2:0 frame has one level, which holds each of its planes in
+// turn, as the slot's planes describe. All multi-byte fields are little
+// endian; the layout is the same for 32 and 64-bit readers.
+
+#define PANO_SHM_MAGIC      0x4f4e4150u     // "PANO"
+#define PANO_SHM_VERSION    5
+#define PANO_SHM_ALIGN      4096
+#define PANO_SHM_TEXT_LEN   32
+#define PANO_SHM_MAX_LEVELS 4
+#define PANO_SHM_MAX_PLANES 3
+
+#if defined(_WIN32) || defined(_WIN64)
+#define PANO_SHM_DEFAULT_NAME "vrworks_pano"
+#else
+#define PANO_SHM_DEFAULT_NAME "/vrworks_pano"
+#endif
+
+typedef enum
+{
+	PANO_FORMAT_BGRA8 = 0,      // 4 bytes per pixel, B G R A
+	PANO_FORMAT_RGBA8 = 1,      // 4 bytes per pixel, R G B A
+	PANO_FORMAT_I420 = 2,       // BT.601 limited range Y, then U and V at half the width and height
+	PANO_FORMAT_NV12 = 3,       // The same Y, then U and V interleaved, 2 bytes per chroma sample
+} panoPixelFormat;
+
+typedef enum
+{
+	PANO_PROJECTION_EQUIRECT = 0,       // full 360x180 panorama
+	PANO_PROJECTION_RECTILINEAR = 1,    // pinhole view along display_pose, fov_x/y_deg wide
+	PANO_PROJECTION_CUBEMAP = 2,        // 3x2 cube faces, laid out as in output_projection.h
+	PANO_PROJECTION_EAC = 3,            // the same faces, equi-angular
+} panoProjection;
+
+// What the stitcher undid of the rig's orientation; pose is the rig's either way
+typedef enum
+{
+	PANO_STABILIZATION_NONE = 0,        // the frame turns with the rig
+	PANO_STABILIZATION_HORIZON = 1,     // level, heading with the rig's
+	PANO_STABILIZATION_WORLD = 2,       // fixed to the world
+} panoStabilization;
+
+//! Head orientation attached to a frame
+typedef struct panoShmPose_st
+{
+	float quat[4];              //!< Unit quaternion w, x, y, z; Y-up, same basis as the rig
+	uint64_t timestamp_us;      //!< Time the orientation applies to, steady clock
+	uint32_t valid;             //!< 0 none, 1 interpolated, 2 extrapolated, 3 clamped (poseLookup)
+	uint32_t reserved;
+}
+panoShmPose_t;
+
+//! One resolution of a frame. Level 0 is the frame itself; further levels,
+//! if any, are smaller copies of it stitched at the same time.
+typedef struct panoShmLevel_st
+{
+	uint32_t width;             //!< Pixels
+	uint32_t height;            //!< Rows
+	uint32_t stride;            //!< Bytes between rows
+	uint32_t reserved;
+	uint64_t offset;            //!< Byte offset of the level from the start of the frame
+	uint64_t bytes;
+}
+panoShmLevel_t;
+
+//! One plane of level 0: the whole image for BGRA8 and RGBA8, Y, U and V
+//! for I420, Y and UV for NV12
+typedef struct panoShmPlane_st
+{
+	uint32_t width;             //!< Samples
+	uint32_t height;            //!< Rows
+	uint32_t stride;            //!< Bytes between rows
+	uint32_t sample_bytes;      //!< Bytes per sample: 4 for BGRA8 and RGBA8, 2 for NV12 UV, else 1
+	uint64_t offset;            //!< Byte offset of the plane from the start of the frame
+	uint64_t bytes;
+}
+panoShmPlane_t;
+
+//! Per-slot header. seq is a seqlock counter: odd while the publisher writes
+//! the slot, even when the slot holds a complete frame.
+typedef struct panoShmSlot_st
+{
+	uint32_t seq;
+	uint32_t format;            //!< panoPixelFormat
+	uint32_t width;             //!< Pixels
+	uint32_t height;            //!< Rows
+	uint32_t stride;            //!< Bytes between rows
+	uint32_t projection;        //!< panoProjection
+	uint64_t data_offset;       //!< Byte offset of the frame from the start of the mapping
+	uint64_t data_bytes;        //!< Valid bytes at data_offset, every level
+	uint64_t frame_index;       //!< Publisher frame counter
+	uint64_t timestamp_us;      //!< Capture time of the frame, steady clock (CLOCK_MONOTONIC / QPC)
+	panoShmPose_t pose;         //!< Orientation at capture time
+	panoShmPose_t display_pose; //!< Orientation predicted for when the frame is displayed
+	char orientation_text[PANO_SHM_TEXT_LEN];  //!< Orientation as received from the IMU server
+	float fov_x_deg;            //!< Field of view of a rectilinear frame, else 360
+	float fov_y_deg;            //!< Else 180
+	uint32_t num_levels;        //!< Valid entries in levels, at least 1
+	uint32_t stabilization;     //!< panoStabilization
+	panoShmLevel_t levels[PANO_SHM_MAX_LEVELS];  //!< levels[0] repeats width, height and stride
+	uint32_t num_planes;        //!< Valid entries in planes: 1 for BGRA8 and RGBA8, 3 for I420, 2 for NV12
+	uint32_t reserved;
+	panoShmPlane_t planes[PANO_SHM_MAX_PLANES];
+}
+panoShmSlot_t;
+
+typedef struct panoShmHeader_st
+{
+	uint32_t magic;             //!< PANO_SHM_MAGIC once the publisher has initialized the mapping
+	uint32_t version;           //!< PANO_SHM_VERSION
+	uint32_t header_bytes;      //!< Bytes before the first frame buffer
+	uint32_t num_slots;
+	uint64_t slot_bytes;        //!< Capacity of each frame buffer
+	uint64_t total_bytes;       //!< Size of the whole mapping
+	uint32_t latest_slot;       //!< Slot holding the most recent complete frame
+	uint32_t reserved;
+	uint64_t frames_published;
+}
+panoShmHeader_t;
+
+//! Frame metadata returned to readers
+typedef struct panoFrameInfo_st
+{
+	panoPixelFormat format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	panoProjection projection;
+	float fov_x_deg;
+	float fov_y_deg;
+	uint64_t data_bytes;
+	uint64_t frame_index;
+	uint64_t timestamp_us;
+	panoShmPose_t pose;
+	panoShmPose_t display_pose;
+	char orientation_text[PANO_SHM_TEXT_LEN];
+	uint32_t num_levels;
+	panoShmLevel_t levels[PANO_SHM_MAX_LEVELS];  //!< Offsets are from the start of the copied frame
+	panoStabilization stabilization;
+	uint32_t num_planes;
+	panoShmPlane_t planes[PANO_SHM_MAX_PLANES];  //!< Likewise
+}
+panoFrameInfo_t;
+
+//! One resolution of a frame to publish, or one plane of it
+typedef struct panoFrameLevel_st
+{
+	const unsigned char *data;
+	uint32_t width;             //!< Pixels, or samples of a plane
+	uint32_t height;
+	uint32_t stride;
+}
+panoFrameLevel_t;
+
+class PanoShmMapping
+{
+public:
+	PanoShmMapping();
+	~PanoShmMapping();
+
+	// Create (publisher) or open (reader) a named mapping of the given size
+	bool create(const std::string &name, size_t bytes);
+	bool open(const std::string &name);
+	void close();
+
+	unsigned char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	PanoShmMapping(const PanoShmMapping&);
+	PanoShmMapping& operator=(const PanoShmMapping&);
+
+	unsigned char *m_data;
+	size_t m_size;
+	std::string m_name;
+	bool m_owner;
+#if defined(_WIN32) || defined(_WIN64)
+	void *m_handle;
+#endif
+};
+
+// Writes frames into the next slot after the latest one; never waits for readers.
+class PanoPublisher
+{
+public:
+	PanoPublisher();
+
+	bool create(const std::string &name, uint32_t numSlots, size_t slotBytes);
+	void close() { m_mapping.close(); m_header = nullptr; }
+
+	// Projection of the frames published from now on; equirect by default
+	void setProjection(panoProjection projection, float fovXDeg, float fovYDeg);
+
+	// Stabilization of the frames published from now on; none by default
+	void setStabilization(panoStabilization stabilization) { m_stabilization = stabilization; }
+
+	bool publish(const unsigned char *frame, uint32_t width, uint32_t height, uint32_t stride,
+		panoPixelFormat format, uint64_t timestampUs, const panoShmPose_t *pose, const panoShmPose_t *displayPose,
+		const char *orientationText);
+
+	// A frame at several resolutions, largest first, all in the same slot so
+	// readers see them change together
+	bool publishLevels(const panoFrameLevel_t *levels, uint32_t numLevels,
+		panoPixelFormat format, uint64_t timestampUs, const panoShmPose_t *pose, const panoShmPose_t *displayPose,
+		const char *orientationText);
+
+	// A frame as its planes, as many as the format has: Y, U, V for I420,
+	// Y, UV for NV12, the image alone for the 4-byte formats
+	bool publishPlanes(const panoFrameLevel_t *planes, uint32_t numPlanes,
+		panoPixelFormat format, uint64_t timestampUs, const panoShmPose_t *pose, const panoShmPose_t *displayPose,
+		const char *orientationText);
+
+private:
+	bool writeSlot(const panoFrameLevel_t *parts, const uint32_t *rowBytes, uint32_t numParts, uint64_t dataBytes,
+		const panoShmLevel_t *levels, uint32_t numLevels, const panoShmPlane_t *planes, uint32_t numPlanes,
+		panoPixelFormat format, uint64_t timestampUs, const panoShmPose_t *pose, const panoShmPose_t *displayPose,
+		const char *orientationText);
+
+	PanoShmMapping m_mapping;
+	panoShmHeader_t *m_header;
+	panoShmSlot_t *m_slots;
+	uint64_t m_frameIndex;
+	panoProjection m_projection;
+	float m_fovXDeg;
+	float m_fovYDeg;
+	panoStabilization m_stabilization;
+};
+
+// Copies the latest complete frame out of the mapping without blocking the publisher.
+class PanoReader
+{
+public:
+	PanoReader();
+
+	bool open(const std::string &name);
+	void close() { m_mapping.close(); m_header = nullptr; }
+
+	// Copy the latest complete frame into dst. Returns false if nothing has been
+	// published yet, dst is too small, or the publisher kept overwriting the
+	// slot for maxRetries attempts.
+	bool readLatest(unsigned char *dst, size_t dstBytes, panoFrameInfo_t *info, int maxRetries = 16);
+
+	// frame_index of the latest complete frame, or UINT64_MAX if none
+	uint64_t latestFrameIndex() const;
+
+private:
+	PanoShmMapping m_mapping;
+	const panoShmHeader_t *m_header;
+	const panoShmSlot_t *m_slots;
+};
+
+uint64_t panoSteadyTimeUs();
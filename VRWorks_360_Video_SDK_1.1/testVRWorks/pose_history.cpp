@@ -0,0 +1,153 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "pose_history.h"
+
+PoseHistory::PoseHistory(size_t capacity, uint64_t maxExtrapolationUs, uint64_t velocityWindowUs)
+	: m_maxExtrapolationUs(maxExtrapolationUs), m_velocityWindowUs(velocityWindowUs), m_count(0)
+{
+	size_t size = 2;
+	while (size < capacity)
+		size <<= 1;
+	m_entries.reset(new Entry[size]);
+	m_mask = size - 1;
+	for (size_t i = 0; i < size; i++)
+		m_entries[i].seq.store(0, std::memory_order_relaxed);
+}
+
+void
+PoseHistory::push(uint64_t timeUs, const Quat &orientation)
+{
+	uint64_t n = m_count.load(std::memory_order_relaxed);
+	if (n > 0 && m_entries[(n - 1) & m_mask].sample.time_us > timeUs)
+		return;
+
+	Entry &entry = m_entries[n & m_mask];
+	entry.seq.store(2 * n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	entry.sample.time_us = timeUs;
+	entry.sample.orientation = orientation;
+	entry.seq.store(2 * n + 2, std::memory_order_release);
+
+	m_count.store(n + 1, std::memory_order_release);
+}
+
+bool
+PoseHistory::read(uint64_t n, PoseSample *sample) const
+{
+	const Entry &entry = m_entries[n & m_mask];
+	if (entry.seq.load(std::memory_order_acquire) != 2 * n + 2)
+		return false;
+	PoseSample copy = entry.sample;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (entry.seq.load(std::memory_order_relaxed) != 2 * n + 2)
+		return false;
+	*sample = copy;
+	return true;
+}
+
+poseLookup
+PoseHistory::lookup(uint64_t timeUs, Quat *orientation) const
+{
+	uint64_t count = m_count.load(std::memory_order_acquire);
+	PoseSample newer;
+	if (count == 0 || !read(count - 1, &newer))
+		return POSE_LOOKUP_NONE;
+
+	if (timeUs >= newer.time_us)
+	{
+		*orientation = newer.orientation;
+		if (timeUs == newer.time_us)
+			return POSE_LOOKUP_INTERPOLATED;
+
+		// Angular velocity over the last velocity window, in the world frame
+		PoseSample older;
+		bool found = false;
+		for (uint64_t n = count - 1; n-- > 0 && count - n <= m_mask;)
+		{
+			if (!read(n, &older))
+				break;
+			found = true;
+			if (newer.time_us - older.time_us >= m_velocityWindowUs)
+				break;
+		}
+		uint64_t ahead = timeUs - newer.time_us;
+		if (!found || older.time_us == newer.time_us || ahead > m_maxExtrapolationUs)
+			return POSE_LOOKUP_CLAMPED;
+
+		float v[3];
+		quatToRotationVector(quatMultiply(newer.orientation, quatConjugate(older.orientation)), v);
+		float scale = (float)ahead / (float)(newer.time_us - older.time_us);
+		v[0] *= scale;
+		v[1] *= scale;
+		v[2] *= scale;
+		*orientation = quatNormalize(quatMultiply(quatFromRotationVector(v), newer.orientation));
+		return POSE_LOOKUP_EXTRAPOLATED;
+	}
+
+	// Frames are looked up shortly after capture, so scan back from the newest
+	for (uint64_t n = count - 1; n-- > 0 && count - n <= m_mask;)
+	{
+		PoseSample older;
+		if (!read(n, &older))
+			break;
+
+		if (older.time_us <= timeUs)
+		{
+			uint64_t span = newer.time_us - older.time_us;
+			float t = span > 0 ? (float)(timeUs - older.time_us) / (float)span : 0.0f;
+			*orientation = quatSlerp(older.orientation, newer.orientation, t);
+			return POSE_LOOKUP_INTERPOLATED;
+		}
+		newer = older;
+	}
+
+	*orientation = newer.orientation;
+	return POSE_LOOKUP_CLAMPED;
+}
@@ -0,0 +1,109 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+
+#include "quaternion.h"
+
+typedef enum
+{
+	POSE_LOOKUP_NONE = 0,           // no samples yet
+	POSE_LOOKUP_INTERPOLATED,       // slerp between the two samples around the time
+	POSE_LOOKUP_EXTRAPOLATED,       // past the newest sample, by angular velocity
+	POSE_LOOKUP_CLAMPED,            // older than the history, or too far ahead to predict
+} poseLookup;
+
+struct PoseSample
+{
+	uint64_t time_us;               // steady clock
+	Quat orientation;
+};
+
+// Ring of timestamped orientations with one writer (the IMU thread) and any
+// number of lock-free readers. Readers that fall a full ring behind see the
+// overwritten entries as missing rather than torn.
+class PoseHistory
+{
+public:
+	// maxExtrapolationUs caps how far past the newest sample lookup() predicts;
+	// velocityWindowUs is the span the angular velocity is measured over.
+	explicit PoseHistory(size_t capacity = 1024, uint64_t maxExtrapolationUs = 50000, uint64_t velocityWindowUs = 10000);
+
+	// Samples must arrive in time order; older ones are dropped
+	void push(uint64_t timeUs, const Quat &orientation);
+
+	// Orientation at timeUs on the steady clock
+	poseLookup lookup(uint64_t timeUs, Quat *orientation) const;
+
+	uint64_t count() const { return m_count.load(std::memory_order_acquire); }
+
+private:
+	PoseHistory(const PoseHistory&);
+	PoseHistory& operator=(const PoseHistory&);
+
+	struct Entry
+	{
+		std::atomic<uint64_t> seq;  // 2n+1 while sample n is written, 2n+2 once complete
+		PoseSample sample;
+	};
+
+	// Copy sample n; false if it has been overwritten or is being written
+	bool read(uint64_t n, PoseSample *sample) const;
+
+	std::unique_ptr<Entry[]> m_entries;
+	size_t m_mask;
+	uint64_t m_maxExtrapolationUs;
+	uint64_t m_velocityWindowUs;
+	std::atomic<uint64_t> m_count;
+};
@@ -0,0 +1,555 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "pyramid_kernels.h"
+#include "cpu_features.h"
+
+#include <immintrin.h>
+#include <math.h>
+
+// One pixel of the decimated row, with the taps clamped to the source row
+static inline void decimatePixel(const float *src, uint32_t srcPixels, uint32_t x, float *dst)
+{
+	int last = (int)srcPixels - 1;
+	int center = 2 * (int)x;
+	const float *tap[5];
+	for (int k = 0; k < 5; k++)
+	{
+		int i = center + k - 2;
+		tap[k] = src + (size_t)(i < 0 ? 0 : (i > last ? last : i)) * 4;
+	}
+	for (int c = 0; c < 4; c++)
+		dst[c] = ((tap[0][c] + tap[4][c]) + 4.0f * (tap[1][c] + tap[3][c]) + 6.0f * tap[2][c]) * 0.0625f;
+}
+
+// The two output pixels of expanding source pixel i
+static inline void expandPixel(const float *src, uint32_t srcPixels, uint32_t i, float *dst)
+{
+	const float *a = src + (size_t)(i > 0 ? i - 1 : 0) * 4;
+	const float *b = src + (size_t)i * 4;
+	const float *c = src + (size_t)(i + 1 < srcPixels ? i + 1 : i) * 4;
+	for (int k = 0; k < 4; k++)
+	{
+		dst[k] = ((a[k] + c[k]) + 6.0f * b[k]) * 0.125f;
+		dst[k + 4] = (b[k] + c[k]) * 0.5f;
+	}
+}
+
+void pyramidLoadRowScalar(const unsigned char *src, uint32_t pixels, float *dst)
+{
+	for (uint32_t i = 0; i < pixels * 4; i++)
+		dst[i] = (float)src[i];
+}
+
+void pyramidStoreRowScalar(const float *src, uint32_t pixels, unsigned char *dst)
+{
+	for (uint32_t i = 0; i < pixels * 4; i++)
+	{
+		long value = lrintf(src[i]);
+		dst[i] = (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+	}
+}
+
+void pyramidFilterColumnsScalar(const float *const rows[5], uint32_t pixels, float *dst)
+{
+	for (uint32_t i = 0; i < pixels * 4; i++)
+		dst[i] = ((rows[0][i] + rows[4][i]) + 4.0f * (rows[1][i] + rows[3][i]) + 6.0f * rows[2][i]) * 0.0625f;
+}
+
+void pyramidDecimateRowScalar(const float *src, uint32_t dstPixels, float *dst)
+{
+	for (uint32_t x = 0; x < dstPixels; x++)
+		decimatePixel(src, dstPixels * 2, x, dst + (size_t)x * 4);
+}
+
+void pyramidExpandRowScalar(const float *src, uint32_t srcPixels, float *dst)
+{
+	for (uint32_t i = 0; i < srcPixels; i++)
+		expandPixel(src, srcPixels, i, dst + (size_t)i * 8);
+}
+
+void pyramidInterpolateColumnsScalar(const float *above, const float *row, const float *below,
+	uint32_t pixels, float *even, float *odd)
+{
+	for (uint32_t i = 0; i < pixels * 4; i++)
+	{
+		even[i] = ((above[i] + below[i]) + 6.0f * row[i]) * 0.125f;
+		odd[i] = (row[i] + below[i]) * 0.5f;
+	}
+}
+
+void pyramidAccumulateBandScalar(const float *gaussian, const float *expanded, const float *mask,
+	uint32_t pixels, float *band)
+{
+	for (uint32_t p = 0; p < pixels; p++)
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			size_t i = (size_t)p * 4 + c;
+			band[i] += mask[p] * (expanded != nullptr ? gaussian[i] - expanded[i] : gaussian[i]);
+		}
+}
+
+void pyramidAddRowScalar(const float *src, uint32_t pixels, float *dst)
+{
+	for (uint32_t i = 0; i < pixels * 4; i++)
+		dst[i] += src[i];
+}
+
+void pyramidSubtractRowScalar(const float *src, uint32_t pixels, float *dst)
+{
+	for (uint32_t i = 0; i < pixels * 4; i++)
+		dst[i] -= src[i];
+}
+
+//***********************************************************************************
+// SSE4.1: one RGBA pixel per register
+
+CPU_TARGET_SSE41
+static void pyramidLoadRowSse41(const unsigned char *src, uint32_t pixels, float *dst)
+{
+	for (uint32_t i = 0; i < pixels; i++)
+		_mm_storeu_ps(dst + (size_t)i * 4,
+			_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(const int*)(src + (size_t)i * 4)))));
+}
+
+// _mm_cvtps_epi32 rounds to nearest even, as lrintf() does; the packs saturate
+CPU_TARGET_SSE41
+static void pyramidStoreRowSse41(const float *src, uint32_t pixels, unsigned char *dst)
+{
+	uint32_t i = 0;
+	for (; i + 4 <= pixels; i += 4)
+	{
+		const float *s = src + (size_t)i * 4;
+		__m128i v0 = _mm_cvtps_epi32(_mm_loadu_ps(s + 0));
+		__m128i v1 = _mm_cvtps_epi32(_mm_loadu_ps(s + 4));
+		__m128i v2 = _mm_cvtps_epi32(_mm_loadu_ps(s + 8));
+		__m128i v3 = _mm_cvtps_epi32(_mm_loadu_ps(s + 12));
+		_mm_storeu_si128((__m128i*)(dst + (size_t)i * 4),
+			_mm_packus_epi16(_mm_packs_epi32(v0, v1), _mm_packs_epi32(v2, v3)));
+	}
+	pyramidStoreRowScalar(src + (size_t)i * 4, pixels - i, dst + (size_t)i * 4);
+}
+
+CPU_TARGET_SSE41
+static void pyramidFilterColumnsSse41(const float *const rows[5], uint32_t pixels, float *dst)
+{
+	const __m128 four = _mm_set1_ps(4.0f), six = _mm_set1_ps(6.0f), scale = _mm_set1_ps(0.0625f);
+	for (uint32_t i = 0; i < pixels * 4; i += 4)
+	{
+		__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(rows[0] + i), _mm_loadu_ps(rows[4] + i)),
+			_mm_mul_ps(four, _mm_add_ps(_mm_loadu_ps(rows[1] + i), _mm_loadu_ps(rows[3] + i))));
+		sum = _mm_add_ps(sum, _mm_mul_ps(six, _mm_loadu_ps(rows[2] + i)));
+		_mm_storeu_ps(dst + i, _mm_mul_ps(sum, scale));
+	}
+}
+
+CPU_TARGET_SSE41
+static void pyramidDecimateRowSse41(const float *src, uint32_t dstPixels, float *dst)
+{
+	const __m128 four = _mm_set1_ps(4.0f), six = _mm_set1_ps(6.0f), scale = _mm_set1_ps(0.0625f);
+	if (dstPixels < 3)
+	{
+		pyramidDecimateRowScalar(src, dstPixels, dst);
+		return;
+	}
+
+	decimatePixel(src, dstPixels * 2, 0, dst);
+	for (uint32_t x = 1; x + 1 < dstPixels; x++)
+	{
+		const float *s = src + (size_t)(2 * x - 2) * 4;
+		__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(s + 0), _mm_loadu_ps(s + 16)),
+			_mm_mul_ps(four, _mm_add_ps(_mm_loadu_ps(s + 4), _mm_loadu_ps(s + 12))));
+		sum = _mm_add_ps(sum, _mm_mul_ps(six, _mm_loadu_ps(s + 8)));
+		_mm_storeu_ps(dst + (size_t)x * 4, _mm_mul_ps(sum, scale));
+	}
+	decimatePixel(src, dstPixels * 2, dstPixels - 1, dst + (size_t)(dstPixels - 1) * 4);
+}
+
+CPU_TARGET_SSE41
+static void pyramidExpandRowSse41(const float *src, uint32_t srcPixels, float *dst)
+{
+	const __m128 six = _mm_set1_ps(6.0f), eighth = _mm_set1_ps(0.125f), half = _mm_set1_ps(0.5f);
+	if (srcPixels < 3)
+	{
+		pyramidExpandRowScalar(src, srcPixels, dst);
+		return;
+	}
+
+	expandPixel(src, srcPixels, 0, dst);
+	for (uint32_t i = 1; i + 1 < srcPixels; i++)
+	{
+		__m128 a = _mm_loadu_ps(src + (size_t)(i - 1) * 4);
+		__m128 b = _mm_loadu_ps(src + (size_t)i * 4);
+		__m128 c = _mm_loadu_ps(src + (size_t)(i + 1) * 4);
+		_mm_storeu_ps(dst + (size_t)i * 8, _mm_mul_ps(_mm_add_ps(_mm_add_ps(a, c), _mm_mul_ps(six, b)), eighth));
+		_mm_storeu_ps(dst + (size_t)i * 8 + 4, _mm_mul_ps(_mm_add_ps(b, c), half));
+	}
+	expandPixel(src, srcPixels, srcPixels - 1, dst + (size_t)(srcPixels - 1) * 8);
+}
+
+CPU_TARGET_SSE41
+static void pyramidInterpolateColumnsSse41(const float *above, const float *row, const float *below,
+	uint32_t pixels, float *even, float *odd)
+{
+	const __m128 six = _mm_set1_ps(6.0f), eighth = _mm_set1_ps(0.125f), half = _mm_set1_ps(0.5f);
+	for (uint32_t i = 0; i < pixels * 4; i += 4)
+	{
+		__m128 a = _mm_loadu_ps(above + i), b = _mm_loadu_ps(row + i), c = _mm_loadu_ps(below + i);
+		_mm_storeu_ps(even + i, _mm_mul_ps(_mm_add_ps(_mm_add_ps(a, c), _mm_mul_ps(six, b)), eighth));
+		_mm_storeu_ps(odd + i, _mm_mul_ps(_mm_add_ps(b, c), half));
+	}
+}
+
+CPU_TARGET_SSE41
+static void pyramidAccumulateBandSse41(const float *gaussian, const float *expanded, const float *mask,
+	uint32_t pixels, float *band)
+{
+	for (uint32_t p = 0; p < pixels; p++)
+	{
+		size_t i = (size_t)p * 4;
+		__m128 g = _mm_loadu_ps(gaussian + i);
+		if (expanded != nullptr)
+			g = _mm_sub_ps(g, _mm_loadu_ps(expanded + i));
+		_mm_storeu_ps(band + i, _mm_add_ps(_mm_loadu_ps(band + i), _mm_mul_ps(_mm_set1_ps(mask[p]), g)));
+	}
+}
+
+CPU_TARGET_SSE41
+static void pyramidAddRowSse41(const float *src, uint32_t pixels, float *dst)
+{
+	for (uint32_t i = 0; i < pixels * 4; i += 4)
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+}
+
+CPU_TARGET_SSE41
+static void pyramidSubtractRowSse41(const float *src, uint32_t pixels, float *dst)
+{
+	for (uint32_t i = 0; i < pixels * 4; i += 4)
+		_mm_storeu_ps(dst + i, _mm_sub_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+}
+
+//***********************************************************************************
+// AVX2: two RGBA pixels per register. Decimating and expanding pair up
+// pixels two apart, so the taps come from 128-bit lane swaps of plain loads.
+
+CPU_TARGET_AVX2
+static void pyramidFilterColumnsAvx2(const float *const rows[5], uint32_t pixels, float *dst)
+{
+	const __m256 four = _mm256_set1_ps(4.0f), six = _mm256_set1_ps(6.0f), scale = _mm256_set1_ps(0.0625f);
+	uint32_t i = 0;
+	for (; i + 8 <= pixels * 4; i += 8)
+	{
+		__m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(rows[0] + i), _mm256_loadu_ps(rows[4] + i)),
+			_mm256_mul_ps(four, _mm256_add_ps(_mm256_loadu_ps(rows[1] + i), _mm256_loadu_ps(rows[3] + i))));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(six, _mm256_loadu_ps(rows[2] + i)));
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(sum, scale));
+	}
+	if (i < pixels * 4)
+	{
+		const float *tail[5] = { rows[0] + i, rows[1] + i, rows[2] + i, rows[3] + i, rows[4] + i };
+		pyramidFilterColumnsScalar(tail, pixels - i / 4, dst + i);
+	}
+}
+
+// Output pixels x and x + 1 from source pixels 2x - 2 .. 2x + 4
+CPU_TARGET_AVX2
+static void pyramidDecimateRowAvx2(const float *src, uint32_t dstPixels, float *dst)
+{
+	const __m256 four = _mm256_set1_ps(4.0f), six = _mm256_set1_ps(6.0f), scale = _mm256_set1_ps(0.0625f);
+	if (dstPixels < 3)
+	{
+		pyramidDecimateRowScalar(src, dstPixels, dst);
+		return;
+	}
+
+	decimatePixel(src, dstPixels * 2, 0, dst);
+	uint32_t x = 1;
+	for (; x + 2 < dstPixels; x += 2)
+	{
+		const float *s = src + (size_t)(2 * x - 2) * 4;
+		__m256 l0 = _mm256_loadu_ps(s + 0);
+		__m256 l1 = _mm256_loadu_ps(s + 8);
+		__m256 l2 = _mm256_loadu_ps(s + 16);
+		__m256 l3 = _mm256_loadu_ps(s + 24);
+		__m256 t0 = _mm256_permute2f128_ps(l0, l1, 0x20);
+		__m256 t1 = _mm256_permute2f128_ps(l0, l1, 0x31);
+		__m256 t2 = _mm256_permute2f128_ps(l1, l2, 0x20);
+		__m256 t3 = _mm256_permute2f128_ps(l1, l2, 0x31);
+		__m256 t4 = _mm256_permute2f128_ps(l2, l3, 0x20);
+		__m256 sum = _mm256_add_ps(_mm256_add_ps(t0, t4), _mm256_mul_ps(four, _mm256_add_ps(t1, t3)));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(six, t2));
+		_mm256_storeu_ps(dst + (size_t)x * 4, _mm256_mul_ps(sum, scale));
+	}
+	for (; x < dstPixels; x++)
+		decimatePixel(src, dstPixels * 2, x, dst + (size_t)x * 4);
+}
+
+// Source pixels i and i + 1 expand to [even i, odd i, even i + 1, odd i + 1]
+CPU_TARGET_AVX2
+static void pyramidExpandRowAvx2(const float *src, uint32_t srcPixels, float *dst)
+{
+	const __m256 six = _mm256_set1_ps(6.0f), eighth = _mm256_set1_ps(0.125f), half = _mm256_set1_ps(0.5f);
+	if (srcPixels < 3)
+	{
+		pyramidExpandRowScalar(src, srcPixels, dst);
+		return;
+	}
+
+	expandPixel(src, srcPixels, 0, dst);
+	uint32_t i = 1;
+	for (; i + 2 < srcPixels; i += 2)
+	{
+		__m256 a = _mm256_loadu_ps(src + (size_t)(i - 1) * 4);
+		__m256 b = _mm256_loadu_ps(src + (size_t)i * 4);
+		__m256 c = _mm256_loadu_ps(src + (size_t)(i + 1) * 4);
+		__m256 even = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(a, c), _mm256_mul_ps(six, b)), eighth);
+		__m256 odd = _mm256_mul_ps(_mm256_add_ps(b, c), half);
+		_mm256_storeu_ps(dst + (size_t)i * 8, _mm256_permute2f128_ps(even, odd, 0x20));
+		_mm256_storeu_ps(dst + (size_t)i * 8 + 8, _mm256_permute2f128_ps(even, odd, 0x31));
+	}
+	for (; i < srcPixels; i++)
+		expandPixel(src, srcPixels, i, dst + (size_t)i * 8);
+}
+
+CPU_TARGET_AVX2
+static void pyramidInterpolateColumnsAvx2(const float *above, const float *row, const float *below,
+	uint32_t pixels, float *even, float *odd)
+{
+	const __m256 six = _mm256_set1_ps(6.0f), eighth = _mm256_set1_ps(0.125f), half = _mm256_set1_ps(0.5f);
+	uint32_t i = 0;
+	for (; i + 8 <= pixels * 4; i += 8)
+	{
+		__m256 a = _mm256_loadu_ps(above + i), b = _mm256_loadu_ps(row + i), c = _mm256_loadu_ps(below + i);
+		_mm256_storeu_ps(even + i, _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(a, c), _mm256_mul_ps(six, b)), eighth));
+		_mm256_storeu_ps(odd + i, _mm256_mul_ps(_mm256_add_ps(b, c), half));
+	}
+	if (i < pixels * 4)
+		pyramidInterpolateColumnsScalar(above + i, row + i, below + i, pixels - i / 4, even + i, odd + i);
+}
+
+// Eight pixels per iteration; each pair of pixels takes its two mask values
+// spread over the channels by one permute
+CPU_TARGET_AVX2
+static void pyramidAccumulateBandAvx2(const float *gaussian, const float *expanded, const float *mask,
+	uint32_t pixels, float *band)
+{
+	const __m256i spread[4] = {
+		_mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1), _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3),
+		_mm256_setr_epi32(4, 4, 4, 4, 5, 5, 5, 5), _mm256_setr_epi32(6, 6, 6, 6, 7, 7, 7, 7) };
+
+	uint32_t p = 0;
+	for (; p + 8 <= pixels; p += 8)
+	{
+		__m256 m = _mm256_loadu_ps(mask + p);
+		for (int k = 0; k < 4; k++)
+		{
+			size_t i = (size_t)(p + 2 * k) * 4;
+			__m256 g = _mm256_loadu_ps(gaussian + i);
+			if (expanded != nullptr)
+				g = _mm256_sub_ps(g, _mm256_loadu_ps(expanded + i));
+			__m256 w = _mm256_permutevar8x32_ps(m, spread[k]);
+			_mm256_storeu_ps(band + i, _mm256_add_ps(_mm256_loadu_ps(band + i), _mm256_mul_ps(w, g)));
+		}
+	}
+	pyramidAccumulateBandScalar(gaussian + (size_t)p * 4, expanded != nullptr ? expanded + (size_t)p * 4 : nullptr,
+		mask + p, pixels - p, band + (size_t)p * 4);
+}
+
+CPU_TARGET_AVX2
+static void pyramidAddRowAvx2(const float *src, uint32_t pixels, float *dst)
+{
+	uint32_t i = 0;
+	for (; i + 8 <= pixels * 4; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+	for (; i < pixels * 4; i++)
+		dst[i] += src[i];
+}
+
+CPU_TARGET_AVX2
+static void pyramidSubtractRowAvx2(const float *src, uint32_t pixels, float *dst)
+{
+	uint32_t i = 0;
+	for (; i + 8 <= pixels * 4; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_sub_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+	for (; i < pixels * 4; i++)
+		dst[i] -= src[i];
+}
+
+//***********************************************************************************
+// Loading and storing run once per row of a block and stay at SSE4.1
+
+void pyramidLoadRow(const unsigned char *src, uint32_t pixels, float *dst)
+{
+	if (cpuGetSimdLevel() >= CPU_SIMD_SSE41)
+		pyramidLoadRowSse41(src, pixels, dst);
+	else
+		pyramidLoadRowScalar(src, pixels, dst);
+}
+
+void pyramidStoreRow(const float *src, uint32_t pixels, unsigned char *dst)
+{
+	if (cpuGetSimdLevel() >= CPU_SIMD_SSE41)
+		pyramidStoreRowSse41(src, pixels, dst);
+	else
+		pyramidStoreRowScalar(src, pixels, dst);
+}
+
+void pyramidFilterColumns(const float *const rows[5], uint32_t pixels, float *dst)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		pyramidFilterColumnsAvx2(rows, pixels, dst);
+		break;
+	case CPU_SIMD_SSE41:
+		pyramidFilterColumnsSse41(rows, pixels, dst);
+		break;
+	default:
+		pyramidFilterColumnsScalar(rows, pixels, dst);
+		break;
+	}
+}
+
+void pyramidDecimateRow(const float *src, uint32_t dstPixels, float *dst)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		pyramidDecimateRowAvx2(src, dstPixels, dst);
+		break;
+	case CPU_SIMD_SSE41:
+		pyramidDecimateRowSse41(src, dstPixels, dst);
+		break;
+	default:
+		pyramidDecimateRowScalar(src, dstPixels, dst);
+		break;
+	}
+}
+
+void pyramidExpandRow(const float *src, uint32_t srcPixels, float *dst)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		pyramidExpandRowAvx2(src, srcPixels, dst);
+		break;
+	case CPU_SIMD_SSE41:
+		pyramidExpandRowSse41(src, srcPixels, dst);
+		break;
+	default:
+		pyramidExpandRowScalar(src, srcPixels, dst);
+		break;
+	}
+}
+
+void pyramidInterpolateColumns(const float *above, const float *row, const float *below,
+	uint32_t pixels, float *even, float *odd)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		pyramidInterpolateColumnsAvx2(above, row, below, pixels, even, odd);
+		break;
+	case CPU_SIMD_SSE41:
+		pyramidInterpolateColumnsSse41(above, row, below, pixels, even, odd);
+		break;
+	default:
+		pyramidInterpolateColumnsScalar(above, row, below, pixels, even, odd);
+		break;
+	}
+}
+
+void pyramidAccumulateBand(const float *gaussian, const float *expanded, const float *mask,
+	uint32_t pixels, float *band)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		pyramidAccumulateBandAvx2(gaussian, expanded, mask, pixels, band);
+		break;
+	case CPU_SIMD_SSE41:
+		pyramidAccumulateBandSse41(gaussian, expanded, mask, pixels, band);
+		break;
+	default:
+		pyramidAccumulateBandScalar(gaussian, expanded, mask, pixels, band);
+		break;
+	}
+}
+
+void pyramidAddRow(const float *src, uint32_t pixels, float *dst)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		pyramidAddRowAvx2(src, pixels, dst);
+		break;
+	case CPU_SIMD_SSE41:
+		pyramidAddRowSse41(src, pixels, dst);
+		break;
+	default:
+		pyramidAddRowScalar(src, pixels, dst);
+		break;
+	}
+}
+
+void pyramidSubtractRow(const float *src, uint32_t pixels, float *dst)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		pyramidSubtractRowAvx2(src, pixels, dst);
+		break;
+	case CPU_SIMD_SSE41:
+		pyramidSubtractRowSse41(src, pixels, dst);
+		break;
+	default:
+		pyramidSubtractRowScalar(src, pixels, dst);
+		break;
+	}
+}
@@ -0,0 +1,102 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==== Gaussian and Laplacian pyramid kernels ====
+// Rows of interleaved RGBA float pixels, as the multi-band blender
+// (multiband_blend.h) keeps its pyramids. Reducing filters with the binomial
+// 1 4 6 4 1 / 16 and keeps every second pixel; expanding interpolates back
+// with the same filter, which at the new pixels is 1 6 1 / 8 and 1 1 / 2.
+// Rows are clamped at both ends. All kernels give the same bits as the
+// scalar ones, whatever the instruction set.
+
+// 8-bit RGBA to float and back, rounding to nearest and saturating
+void pyramidLoadRow(const unsigned char *src, uint32_t pixels, float *dst);
+void pyramidStoreRow(const float *src, uint32_t pixels, unsigned char *dst);
+
+// Vertical 1 4 6 4 1 / 16 of five rows, the middle one being the output row
+void pyramidFilterColumns(const float *const rows[5], uint32_t pixels, float *dst);
+
+// Horizontal 1 4 6 4 1 / 16 at every second pixel of a 2 * dstPixels row
+void pyramidDecimateRow(const float *src, uint32_t dstPixels, float *dst);
+
+// A row twice as wide: dst[2i] = (src[i - 1] + 6 src[i] + src[i + 1]) / 8,
+// dst[2i + 1] = (src[i] + src[i + 1]) / 2
+void pyramidExpandRow(const float *src, uint32_t srcPixels, float *dst);
+
+// The same vertically: the two output rows around row, from its neighbours
+void pyramidInterpolateColumns(const float *above, const float *row, const float *below,
+	uint32_t pixels, float *even, float *odd);
+
+// band += mask * (gaussian - expanded), one mask value per pixel. A null
+// expanded adds mask * gaussian, for the coarsest level.
+void pyramidAccumulateBand(const float *gaussian, const float *expanded, const float *mask,
+	uint32_t pixels, float *band);
+
+// dst += src, dst -= src
+void pyramidAddRow(const float *src, uint32_t pixels, float *dst);
+void pyramidSubtractRow(const float *src, uint32_t pixels, float *dst);
+
+// Scalar kernels. The SIMD ones fall back on them for row tails and for rows
+// too short to vectorize; --verify_kernels checks the two agree.
+void pyramidLoadRowScalar(const unsigned char *src, uint32_t pixels, float *dst);
+void pyramidStoreRowScalar(const float *src, uint32_t pixels, unsigned char *dst);
+void pyramidFilterColumnsScalar(const float *const rows[5], uint32_t pixels, float *dst);
+void pyramidDecimateRowScalar(const float *src, uint32_t dstPixels, float *dst);
+void pyramidExpandRowScalar(const float *src, uint32_t srcPixels, float *dst);
+void pyramidInterpolateColumnsScalar(const float *above, const float *row, const float *below,
+	uint32_t pixels, float *even, float *odd);
+void pyramidAccumulateBandScalar(const float *gaussian, const float *expanded, const float *mask,
+	uint32_t pixels, float *band);
+void pyramidAddRowScalar(const float *src, uint32_t pixels, float *dst);
+void pyramidSubtractRowScalar(const float *src, uint32_t pixels, float *dst);
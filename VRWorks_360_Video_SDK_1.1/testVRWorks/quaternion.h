@@ -0,0 +1,184 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+// Unit quaternion in the rig basis (Y up, X right, Z in; see math_utility.h).
+// Rotations compose right to left: quatMultiply(a, b) applies b first.
+struct Quat
+{
+	float w, x, y, z;
+};
+
+static inline Quat quatIdentity()
+{
+	Quat q = { 1.0f, 0.0f, 0.0f, 0.0f };
+	return q;
+}
+
+static inline Quat quatMultiply(const Quat &a, const Quat &b)
+{
+	Quat q;
+	q.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+	q.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+	q.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+	q.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+	return q;
+}
+
+static inline Quat quatConjugate(const Quat &q)
+{
+	Quat c = { q.w, -q.x, -q.y, -q.z };
+	return c;
+}
+
+// Returns the identity for a degenerate (zero) quaternion
+static inline Quat quatNormalize(const Quat &q)
+{
+	float n = sqrtf(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+	if (!(n > 1e-12f))
+		return quatIdentity();
+	Quat u = { q.w / n, q.x / n, q.y / n, q.z / n };
+	return u;
+}
+
+// Right-handed rotation by angle radians about a unit axis
+static inline Quat quatFromAxisAngle(float ax, float ay, float az, float angle)
+{
+	float s = sinf(angle * 0.5f);
+	Quat q = { cosf(angle * 0.5f), ax * s, ay * s, az * s };
+	return q;
+}
+
+// Same rotation as math_util::cameraToWorldTransform(yaw, pitch, roll):
+// roll is applied first, then pitch, then yaw. Angles in radians.
+static inline Quat quatFromYawPitchRoll(float yaw, float pitch, float roll)
+{
+	Quat y = quatFromAxisAngle(0.0f, 1.0f, 0.0f, -yaw);     // X toward Z
+	Quat p = quatFromAxisAngle(1.0f, 0.0f, 0.0f, pitch);    // Y toward Z
+	Quat r = quatFromAxisAngle(0.0f, 0.0f, 1.0f, -roll);    // Y toward X
+	return quatMultiply(y, quatMultiply(p, r));
+}
+
+// 3x3 transform in the math_util layout, usable with transformVector3()
+static inline void quatToTransform(const Quat &q, float T[9])
+{
+	float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+	T[0] = 1.0f - 2.0f * (yy + zz);
+	T[1] = 2.0f * (xy + wz);
+	T[2] = 2.0f * (xz - wy);
+	T[3] = 2.0f * (xy - wz);
+	T[4] = 1.0f - 2.0f * (xx + zz);
+	T[5] = 2.0f * (yz + wx);
+	T[6] = 2.0f * (xz + wy);
+	T[7] = 2.0f * (yz - wx);
+	T[8] = 1.0f - 2.0f * (xx + yy);
+}
+
+// Shortest-path spherical interpolation, t in [0, 1]
+static inline Quat quatSlerp(const Quat &a, const Quat &b, float t)
+{
+	float dot = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+	float sign = dot < 0.0f ? -1.0f : 1.0f;
+	dot *= sign;
+
+	float ka, kb;
+	if (dot > 0.9995f)
+	{
+		// Nearly parallel; lerp is accurate and avoids dividing by sin(0)
+		ka = 1.0f - t;
+		kb = t;
+	}
+	else
+	{
+		float theta = acosf(dot);
+		float s = sinf(theta);
+		ka = sinf((1.0f - t) * theta) / s;
+		kb = sinf(t * theta) / s;
+	}
+	kb *= sign;
+
+	Quat q = { ka * a.w + kb * b.w, ka * a.x + kb * b.x, ka * a.y + kb * b.y, ka * a.z + kb * b.z };
+	return quatNormalize(q);
+}
+
+// Rotation vector (axis * angle, radians) of the shortest rotation equal to q
+static inline void quatToRotationVector(const Quat &q, float v[3])
+{
+	float sign = q.w < 0.0f ? -1.0f : 1.0f;
+	float s = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z);
+	float k = s > 1e-7f ? 2.0f * atan2f(s, sign * q.w) / s : 2.0f;
+	v[0] = sign * k * q.x;
+	v[1] = sign * k * q.y;
+	v[2] = sign * k * q.z;
+}
+
+static inline Quat quatFromRotationVector(const float v[3])
+{
+	float angle = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (angle < 1e-7f)
+		return quatNormalize(Quat{ 1.0f, 0.5f * v[0], 0.5f * v[1], 0.5f * v[2] });
+	return quatFromAxisAngle(v[0] / angle, v[1] / angle, v[2] / angle, angle);
+}
+
+static inline void quatRotate(const Quat &q, const float vin[3], float vout[3])
+{
+	float T[9];
+	quatToTransform(q, T);
+	float v0 = vin[0], v1 = vin[1], v2 = vin[2];
+	vout[0] = T[0] * v0 + T[3] * v1 + T[6] * v2;
+	vout[1] = T[1] * v0 + T[4] * v1 + T[7] * v2;
+	vout[2] = T[2] * v0 + T[5] * v1 + T[8] * v2;
+}
@@ -0,0 +1,262 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "remap_fused_kernels.h"
+#include "remap_samplers.h"
+#include "cpu_features.h"
+
+#include <immintrin.h>
+
+// Pixels from first to count; also the row tails of the SIMD kernels
+template <remapSourceFormat Format, bool KeepYuv, uint32_t Cameras, bool Copy>
+static void spanScalar(const remapSource_t *const *sources, const remapTaps_t *taps,
+	uint32_t first, uint32_t count, unsigned char *dst)
+{
+	for (uint32_t i = first; i < count; i++)
+	{
+		unsigned char *out = dst + i * 4;
+		uint32_t sample[4];
+		if (Copy)
+		{
+			remapSampleScalar<Format>(sources[0], taps[0].xy[i], taps[0].frac[i], KeepYuv, sample);
+			for (int c = 0; c < 4; c++)
+			{
+				uint32_t value = (((sample[c] * taps[0].gain[c] + REMAP_GAIN_ONE / 2) >> REMAP_GAIN_BITS) + 128) >> 8;
+				out[c] = (unsigned char)(value < 255 ? value : 255);
+			}
+			continue;
+		}
+
+		uint32_t sum[4] = { 0, 0, 0, 0 };
+		for (uint32_t k = 0; k < Cameras; k++)
+		{
+			const remapTaps_t &t = taps[k];
+			if ((int16_t)(t.xy[i] & 0xffff) < 0)
+				continue;
+			uint32_t w = (uint32_t)t.weight[i] + 1;
+			remapSampleScalar<Format>(sources[k], t.xy[i], t.frac[i], KeepYuv, sample);
+			for (int c = 0; c < 4; c++)
+				sum[c] += ((sample[c] * t.gain[c] + REMAP_GAIN_ONE / 2) >> REMAP_GAIN_BITS) * w;
+		}
+		for (int c = 0; c < 4; c++)
+		{
+			uint32_t value = (sum[c] + 0x8000) >> 16;
+			out[c] = (unsigned char)(value < 255 ? value : 255);
+		}
+	}
+}
+
+template <remapSourceFormat Format, bool KeepYuv, uint32_t Cameras, bool Copy>
+static void spanScalar(const remapSource_t *const *sources, const remapTaps_t *taps,
+	uint32_t count, unsigned char *dst)
+{
+	spanScalar<Format, KeepYuv, Cameras, Copy>(sources, taps, 0, count, dst);
+}
+
+//***********************************************************************************
+// Four pixels per iteration, the sums one vector of channels per pixel
+template <remapSourceFormat Format, bool KeepYuv, uint32_t Cameras, bool Copy>
+CPU_TARGET_SSE41
+static void spanSse41(const remapSource_t *const *sources, const remapTaps_t *taps,
+	uint32_t count, unsigned char *dst)
+{
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i round = _mm_set1_epi32(Copy ? 128 : 0x8000);
+
+	__m128i gain[Cameras];
+	for (uint32_t k = 0; k < Cameras; k++)
+		gain[k] = _mm_loadu_si128((const __m128i*)taps[k].gain);
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i sum[4], valid;
+		if (Copy)
+		{
+			remapSampleSse41<Format>(sources[0], taps[0].xy + i, taps[0].frac + i, KeepYuv, gain[0], sum, &valid);
+			for (int pixel = 0; pixel < 4; pixel++)
+				sum[pixel] = _mm_srli_epi32(_mm_add_epi32(sum[pixel], round), 8);
+		}
+		else
+		{
+			for (int pixel = 0; pixel < 4; pixel++)
+				sum[pixel] = _mm_setzero_si128();
+			for (uint32_t k = 0; k < Cameras; k++)
+			{
+				__m128i sample[4];
+				remapSampleSse41<Format>(sources[k], taps[k].xy + i, taps[k].frac + i, KeepYuv, gain[k], sample, &valid);
+				__m128i w = _mm_and_si128(valid, _mm_add_epi32(
+					_mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(const int*)(taps[k].weight + i))), one));
+				sum[0] = _mm_add_epi32(sum[0], _mm_mullo_epi32(sample[0], _mm_shuffle_epi32(w, 0x00)));
+				sum[1] = _mm_add_epi32(sum[1], _mm_mullo_epi32(sample[1], _mm_shuffle_epi32(w, 0x55)));
+				sum[2] = _mm_add_epi32(sum[2], _mm_mullo_epi32(sample[2], _mm_shuffle_epi32(w, 0xaa)));
+				sum[3] = _mm_add_epi32(sum[3], _mm_mullo_epi32(sample[3], _mm_shuffle_epi32(w, 0xff)));
+			}
+			for (int pixel = 0; pixel < 4; pixel++)
+				sum[pixel] = _mm_srli_epi32(_mm_add_epi32(sum[pixel], round), 16);
+		}
+		__m128i bytes = _mm_packus_epi16(_mm_packus_epi32(sum[0], sum[1]), _mm_packus_epi32(sum[2], sum[3]));
+		_mm_storeu_si128((__m128i*)(dst + i * 4), bytes);
+	}
+	spanScalar<Format, KeepYuv, Cameras, Copy>(sources, taps, i, count, dst);
+}
+
+// Eight pixels per iteration, the sums in the samplers' order [0 | 4],
+// [1 | 5], [2 | 6], [3 | 7], which the in-lane packs put back in pixel order
+template <remapSourceFormat Format, bool KeepYuv, uint32_t Cameras, bool Copy>
+CPU_TARGET_AVX2
+static void spanAvx2(const remapSource_t *const *sources, const remapTaps_t *taps,
+	uint32_t count, unsigned char *dst)
+{
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i round = _mm256_set1_epi32(Copy ? 128 : 0x8000);
+
+	__m256i gain[Cameras];
+	for (uint32_t k = 0; k < Cameras; k++)
+		gain[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)taps[k].gain));
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i sum[4], valid;
+		if (Copy)
+		{
+			remapSampleAvx2<Format>(sources[0], taps[0].xy + i, taps[0].frac + i, KeepYuv, gain[0], sum, &valid);
+			for (int k = 0; k < 4; k++)
+				sum[k] = _mm256_srli_epi32(_mm256_add_epi32(sum[k], round), 8);
+		}
+		else
+		{
+			for (int k = 0; k < 4; k++)
+				sum[k] = _mm256_setzero_si256();
+			for (uint32_t k = 0; k < Cameras; k++)
+			{
+				__m256i s[4];
+				remapSampleAvx2<Format>(sources[k], taps[k].xy + i, taps[k].frac + i, KeepYuv, gain[k], s, &valid);
+				__m256i w = _mm256_and_si256(valid, _mm256_add_epi32(
+					_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(taps[k].weight + i))), one));
+				sum[0] = _mm256_add_epi32(sum[0], _mm256_mullo_epi32(s[0], _mm256_shuffle_epi32(w, 0x00)));
+				sum[1] = _mm256_add_epi32(sum[1], _mm256_mullo_epi32(s[1], _mm256_shuffle_epi32(w, 0x55)));
+				sum[2] = _mm256_add_epi32(sum[2], _mm256_mullo_epi32(s[2], _mm256_shuffle_epi32(w, 0xaa)));
+				sum[3] = _mm256_add_epi32(sum[3], _mm256_mullo_epi32(s[3], _mm256_shuffle_epi32(w, 0xff)));
+			}
+			for (int k = 0; k < 4; k++)
+				sum[k] = _mm256_srli_epi32(_mm256_add_epi32(sum[k], round), 16);
+		}
+		__m256i bytes = _mm256_packus_epi16(_mm256_packus_epi32(sum[0], sum[1]), _mm256_packus_epi32(sum[2], sum[3]));
+		_mm256_storeu_si256((__m256i*)(dst + i * 4), bytes);
+	}
+	spanScalar<Format, KeepYuv, Cameras, Copy>(sources, taps, i, count, dst);
+}
+
+//***********************************************************************************
+template <remapSourceFormat Format, bool KeepYuv, uint32_t Cameras, bool Copy>
+static remapSpanKernel selectLevel(cpuSimdLevel level)
+{
+	switch (level)
+	{
+	case CPU_SIMD_AVX2:
+		return &spanAvx2<Format, KeepYuv, Cameras, Copy>;
+	case CPU_SIMD_SSE41:
+		return &spanSse41<Format, KeepYuv, Cameras, Copy>;
+	default:
+		return &spanScalar<Format, KeepYuv, Cameras, Copy>;
+	}
+}
+
+template <remapSourceFormat Format, bool KeepYuv>
+static remapSpanKernel selectCameras(uint32_t cameras, bool weighted, cpuSimdLevel level)
+{
+	switch (cameras)
+	{
+	case 1:
+		return weighted ? selectLevel<Format, KeepYuv, 1, false>(level) : selectLevel<Format, KeepYuv, 1, true>(level);
+	case 2:
+		return selectLevel<Format, KeepYuv, 2, false>(level);
+	case 3:
+		return selectLevel<Format, KeepYuv, 3, false>(level);
+	case 4:
+		return selectLevel<Format, KeepYuv, 4, false>(level);
+	default:
+		return nullptr;
+	}
+}
+
+static remapSpanKernel
+selectSpanKernel(remapSourceFormat format, bool keepYuv, uint32_t cameras, bool weighted, cpuSimdLevel level)
+{
+	switch (format)
+	{
+	case REMAP_SOURCE_RGBA8:
+		return selectCameras<REMAP_SOURCE_RGBA8, false>(cameras, weighted, level);
+	case REMAP_SOURCE_BGR8:
+		return selectCameras<REMAP_SOURCE_BGR8, false>(cameras, weighted, level);
+	case REMAP_SOURCE_I420:
+		return keepYuv ? selectCameras<REMAP_SOURCE_I420, true>(cameras, weighted, level) :
+			selectCameras<REMAP_SOURCE_I420, false>(cameras, weighted, level);
+	case REMAP_SOURCE_NV12:
+		return keepYuv ? selectCameras<REMAP_SOURCE_NV12, true>(cameras, weighted, level) :
+			selectCameras<REMAP_SOURCE_NV12, false>(cameras, weighted, level);
+	default:
+		return nullptr;
+	}
+}
+
+remapSpanKernel remapSelectSpanKernel(remapSourceFormat format, bool keepYuv, uint32_t cameras, bool weighted)
+{
+	return selectSpanKernel(format, keepYuv, cameras, weighted, cpuGetSimdLevel());
+}
+
+void remapSpanScalar(const remapSource_t *const *sources, const remapTaps_t *taps, uint32_t cameras,
+	uint32_t count, unsigned char *dst, bool weighted)
+{
+	remapSpanKernel kernel = selectSpanKernel(sources[0]->format, sources[0]->keepYuv != 0, cameras, weighted, CPU_SIMD_SCALAR);
+	if (kernel != nullptr)
+		kernel(sources, taps, count, dst);
+}
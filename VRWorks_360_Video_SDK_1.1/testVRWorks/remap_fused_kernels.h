@@ -0,0 +1,96 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include "remap_yuv_kernels.h"
+
+// ==== Single-pass remap of whole output spans ====
+// The row kernels remap one camera at a time: overlap pixels are cleared,
+// each camera's weighted samples added into 32-bit accumulators in memory,
+// and the sums resolved to 8 bits in a third pass. Where every camera's
+// share of an overlap span covers all of it (RemapSchedule::RUN_FUSED in
+// remap_lut.h), a span kernel instead samples all of them per pixel, from
+// the sources in their own format, and keeps the sums in registers until
+// the final pixel is written. Each kernel is an instance for one source
+// format, one camera count and whether the samples stay YUV, so the inner
+// loop holds neither branches nor calls. The sums and rounding are those of
+// accumulating and resolving, or of remapCopyRow() for one camera, so the
+// output has the same bits either way. One camera's pixels are copied at full
+// weight unless the kernel is weighted, as it must be once vignetting makes
+// the weights of lone pixels less than full too; at full weight both give
+// the same bits.
+
+#define REMAP_SPAN_MAX_CAMERAS 4
+
+// One camera's table entries and gains for a span
+typedef struct remapTaps_st
+{
+	const uint32_t *xy;
+	const uint16_t *frac;
+	const uint8_t *weight;  //!< Unused for one camera unless the kernel is weighted
+	const uint32_t *gain;   //!< 4 channel gains, alpha included
+} remapTaps_t;
+
+// Write count output pixels to dst from sources[c] through taps[c] for each
+// camera. Pixels of a single camera must all be valid.
+typedef void (*remapSpanKernel)(const remapSource_t *const *sources, const remapTaps_t *taps,
+	uint32_t count, unsigned char *dst);
+
+// The kernel for spans of 1 to REMAP_SPAN_MAX_CAMERAS cameras whose sources
+// are all of format, for the instruction set selected now; nullptr for any
+// other number of cameras. keepYuv applies to 4:2:0 sources only; weighted
+// makes one camera's kernel apply its weights rather than copy.
+remapSpanKernel remapSelectSpanKernel(remapSourceFormat format, bool keepYuv, uint32_t cameras,
+	bool weighted = false);
+
+// The span through the scalar kernel, as --verify_kernels checks the
+// selected one against; the format and keepYuv are those of sources[0]
+void remapSpanScalar(const remapSource_t *const *sources, const remapTaps_t *taps, uint32_t cameras,
+	uint32_t count, unsigned char *dst, bool weighted = false);
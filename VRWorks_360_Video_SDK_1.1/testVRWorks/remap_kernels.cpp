@@ -0,0 +1,311 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "remap_kernels.h"
+#include "remap_samplers.h"
+#include "cpu_features.h"
+
+#include <immintrin.h>
+
+void remapAccumulateRowScalar(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	for (uint32_t i = 0; i < count; i++, acc += 4)
+	{
+		int x = (int16_t)(xy[i] & 0xffff);
+		int y = (int16_t)(xy[i] >> 16);
+		if (x < 0)
+			continue;
+		uint32_t fx = frac[i] & 0xff;
+		uint32_t fy = frac[i] >> 8;
+		uint32_t w = (uint32_t)weight[i] + 1;
+
+		const unsigned char *p0 = src + (size_t)y * pitch + (size_t)x * 4;
+		const unsigned char *p1 = p0 + pitch;
+		for (int c = 0; c < 4; c++)
+		{
+			uint32_t top = p0[c] * (256 - fx) + p0[c + 4] * fx;
+			uint32_t bottom = p1[c] * (256 - fx) + p1[c + 4] * fx;
+			uint32_t sample = (top * (256 - fy) + bottom * fy + 128) >> 8;
+			acc[c] += ((sample * gain[c] + REMAP_GAIN_ONE / 2) >> REMAP_GAIN_BITS) * w;
+		}
+	}
+}
+
+void remapResolveRowScalar(const uint32_t *acc, uint32_t count, unsigned char *dst)
+{
+	for (uint32_t i = 0; i < count * 4; i++)
+	{
+		uint32_t value = (acc[i] + 0x8000) >> 16;
+		dst[i] = (unsigned char)(value < 255 ? value : 255);
+	}
+}
+
+void remapCopyRowScalar(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	for (uint32_t i = 0; i < count; i++, dst += 4)
+	{
+		int x = (int16_t)(xy[i] & 0xffff);
+		int y = (int16_t)(xy[i] >> 16);
+		uint32_t fx = frac[i] & 0xff;
+		uint32_t fy = frac[i] >> 8;
+
+		const unsigned char *p0 = src + (size_t)y * pitch + (size_t)x * 4;
+		const unsigned char *p1 = p0 + pitch;
+		for (int c = 0; c < 4; c++)
+		{
+			uint32_t top = p0[c] * (256 - fx) + p0[c + 4] * fx;
+			uint32_t bottom = p1[c] * (256 - fx) + p1[c + 4] * fx;
+			uint32_t sample = (top * (256 - fy) + bottom * fy + 128) >> 8;
+			uint32_t value = (((sample * gain[c] + REMAP_GAIN_ONE / 2) >> REMAP_GAIN_BITS) + 128) >> 8;
+			dst[c] = (unsigned char)(value < 255 ? value : 255);
+		}
+	}
+}
+
+//***********************************************************************************
+// Four pixels per iteration, sampled as remap_samplers.h describes
+CPU_TARGET_SSE41
+static void remapAccumulateRowSse41(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	const __m128i channelGain = _mm_loadu_si128((const __m128i*)gain);
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i sample[4], valid;
+		remapSampleRgbaSse41(src, pitch, xy + i, frac + i, channelGain, sample, &valid);
+		__m128i w = _mm_and_si128(valid, _mm_add_epi32(
+			_mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(const int*)(weight + i))), _mm_set1_epi32(1)));
+
+		__m128i sum[4];
+		sum[0] = _mm_mullo_epi32(sample[0], _mm_shuffle_epi32(w, 0x00));
+		sum[1] = _mm_mullo_epi32(sample[1], _mm_shuffle_epi32(w, 0x55));
+		sum[2] = _mm_mullo_epi32(sample[2], _mm_shuffle_epi32(w, 0xaa));
+		sum[3] = _mm_mullo_epi32(sample[3], _mm_shuffle_epi32(w, 0xff));
+		for (int pixel = 0; pixel < 4; pixel++)
+		{
+			__m128i *a = (__m128i*)(acc + (i + pixel) * 4);
+			_mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), sum[pixel]));
+		}
+	}
+	remapAccumulateRowScalar(src, pitch, xy + i, frac + i, weight + i, gain, count - i, acc + i * 4);
+}
+
+CPU_TARGET_SSE41
+static void remapCopyRowSse41(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	const __m128i round = _mm_set1_epi32(128);
+	const __m128i channelGain = _mm_loadu_si128((const __m128i*)gain);
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i sample[4], valid;
+		remapSampleRgbaSse41(src, pitch, xy + i, frac + i, channelGain, sample, &valid);
+		for (int pixel = 0; pixel < 4; pixel++)
+			sample[pixel] = _mm_srli_epi32(_mm_add_epi32(sample[pixel], round), 8);
+		__m128i bytes = _mm_packus_epi16(_mm_packus_epi32(sample[0], sample[1]), _mm_packus_epi32(sample[2], sample[3]));
+		_mm_storeu_si128((__m128i*)(dst + i * 4), bytes);
+	}
+	remapCopyRowScalar(src, pitch, xy + i, frac + i, gain, count - i, dst + i * 4);
+}
+
+// Eight pixels per iteration, the samples coming out of the gathers as
+// [0 | 4], [1 | 5], [2 | 6], [3 | 7]; they are swapped back into pixel order
+// before the adds
+CPU_TARGET_AVX2
+static void remapAccumulateRowAvx2(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	const __m256i channelGain = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)gain));
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i s[4], valid;
+		remapSampleRgbaAvx2(src, pitch, xy + i, frac + i, channelGain, s, &valid);
+		__m256i w = _mm256_and_si256(valid, _mm256_add_epi32(
+			_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(weight + i))), _mm256_set1_epi32(1)));
+
+		__m256i s0 = _mm256_mullo_epi32(s[0], _mm256_shuffle_epi32(w, 0x00));
+		__m256i s1 = _mm256_mullo_epi32(s[1], _mm256_shuffle_epi32(w, 0x55));
+		__m256i s2 = _mm256_mullo_epi32(s[2], _mm256_shuffle_epi32(w, 0xaa));
+		__m256i s3 = _mm256_mullo_epi32(s[3], _mm256_shuffle_epi32(w, 0xff));
+
+		__m256i *a = (__m256i*)(acc + i * 4);
+		_mm256_storeu_si256(a + 0, _mm256_add_epi32(_mm256_loadu_si256(a + 0), _mm256_permute2x128_si256(s0, s1, 0x20)));
+		_mm256_storeu_si256(a + 1, _mm256_add_epi32(_mm256_loadu_si256(a + 1), _mm256_permute2x128_si256(s2, s3, 0x20)));
+		_mm256_storeu_si256(a + 2, _mm256_add_epi32(_mm256_loadu_si256(a + 2), _mm256_permute2x128_si256(s0, s1, 0x31)));
+		_mm256_storeu_si256(a + 3, _mm256_add_epi32(_mm256_loadu_si256(a + 3), _mm256_permute2x128_si256(s2, s3, 0x31)));
+	}
+	remapAccumulateRowScalar(src, pitch, xy + i, frac + i, weight + i, gain, count - i, acc + i * 4);
+}
+
+// The packs work within lanes, which puts [0 | 4], [1 | 5], ... straight
+// back into pixel order
+CPU_TARGET_AVX2
+static void remapCopyRowAvx2(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	const __m256i round = _mm256_set1_epi32(128);
+	const __m256i channelGain = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)gain));
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i s[4], valid;
+		remapSampleRgbaAvx2(src, pitch, xy + i, frac + i, channelGain, s, &valid);
+		for (int k = 0; k < 4; k++)
+			s[k] = _mm256_srli_epi32(_mm256_add_epi32(s[k], round), 8);
+		__m256i bytes = _mm256_packus_epi16(_mm256_packus_epi32(s[0], s[1]), _mm256_packus_epi32(s[2], s[3]));
+		_mm256_storeu_si256((__m256i*)(dst + i * 4), bytes);
+	}
+	remapCopyRowScalar(src, pitch, xy + i, frac + i, gain, count - i, dst + i * 4);
+}
+
+void remapAccumulateRow(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		remapAccumulateRowAvx2(src, pitch, xy, frac, weight, gain, count, acc);
+		break;
+	case CPU_SIMD_SSE41:
+		remapAccumulateRowSse41(src, pitch, xy, frac, weight, gain, count, acc);
+		break;
+	default:
+		remapAccumulateRowScalar(src, pitch, xy, frac, weight, gain, count, acc);
+		break;
+	}
+}
+
+void remapCopyRow(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		remapCopyRowAvx2(src, pitch, xy, frac, gain, count, dst);
+		break;
+	case CPU_SIMD_SSE41:
+		remapCopyRowSse41(src, pitch, xy, frac, gain, count, dst);
+		break;
+	default:
+		remapCopyRowScalar(src, pitch, xy, frac, gain, count, dst);
+		break;
+	}
+}
+
+//***********************************************************************************
+// Eight pixels per iteration. The packs interleave the two lanes, leaving
+// pixels in the order 0 2 4 6 1 3 5 7; one dword permute restores it.
+CPU_TARGET_AVX2
+static void remapResolveRowAvx2(const uint32_t *acc, uint32_t count, unsigned char *dst)
+{
+	const __m256i round = _mm256_set1_epi32(0x8000);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256i *a = (const __m256i*)(acc + i * 4);
+		__m256i v0 = _mm256_srli_epi32(_mm256_add_epi32(_mm256_loadu_si256(a + 0), round), 16);
+		__m256i v1 = _mm256_srli_epi32(_mm256_add_epi32(_mm256_loadu_si256(a + 1), round), 16);
+		__m256i v2 = _mm256_srli_epi32(_mm256_add_epi32(_mm256_loadu_si256(a + 2), round), 16);
+		__m256i v3 = _mm256_srli_epi32(_mm256_add_epi32(_mm256_loadu_si256(a + 3), round), 16);
+		__m256i bytes = _mm256_packus_epi16(_mm256_packus_epi32(v0, v1), _mm256_packus_epi32(v2, v3));
+		_mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_permutevar8x32_epi32(bytes, order));
+	}
+	remapResolveRowScalar(acc + i * 4, count - i, dst + i * 4);
+}
+
+// Four pixels per iteration
+CPU_TARGET_SSE41
+static void remapResolveRowSse41(const uint32_t *acc, uint32_t count, unsigned char *dst)
+{
+	const __m128i round = _mm_set1_epi32(0x8000);
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128i *a = (const __m128i*)(acc + i * 4);
+		__m128i v0 = _mm_srli_epi32(_mm_add_epi32(_mm_loadu_si128(a + 0), round), 16);
+		__m128i v1 = _mm_srli_epi32(_mm_add_epi32(_mm_loadu_si128(a + 1), round), 16);
+		__m128i v2 = _mm_srli_epi32(_mm_add_epi32(_mm_loadu_si128(a + 2), round), 16);
+		__m128i v3 = _mm_srli_epi32(_mm_add_epi32(_mm_loadu_si128(a + 3), round), 16);
+		__m128i bytes = _mm_packus_epi16(_mm_packus_epi32(v0, v1), _mm_packus_epi32(v2, v3));
+		_mm_storeu_si128((__m128i*)(dst + i * 4), bytes);
+	}
+	remapResolveRowScalar(acc + i * 4, count - i, dst + i * 4);
+}
+
+void remapResolveRow(const uint32_t *acc, uint32_t count, unsigned char *dst)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		remapResolveRowAvx2(acc, count, dst);
+		break;
+	case CPU_SIMD_SSE41:
+		remapResolveRowSse41(acc, count, dst);
+		break;
+	default:
+		remapResolveRowScalar(acc, count, dst);
+		break;
+	}
+}
@@ -0,0 +1,101 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==== Fixed-point bilinear remap of RGBA8 images ====
+// Each output pixel of a packed remap table (PackedRemapTables in
+// remap_lut.h) is, per camera:
+//   xy      int16 x | int16 y << 16, top left of the 2x2 source block;
+//           x < 0 where the camera does not contribute
+//   frac    8-bit horizontal | 8-bit vertical << 8 position in the block
+//   weight  blend weight - 1, in 1/256ths; a pixel's weights sum to 256, or
+//           less where vignetting scales them (remap_lut.h)
+// and, per camera and channel, a gain in 1/4096ths below 4.0. The kernels
+// accumulate, per channel,
+//   top = p00 * (256 - fx) + p01 * fx
+//   bot = p10 * (256 - fx) + p11 * fx
+//   s = (top * (256 - fy) + bot * fy + 128) >> 8
+//   acc += ((s * gain + 2048) >> 12) * weight
+// and remapResolveRow() rounds acc back to 8 bits, saturating. A gain of
+// REMAP_GAIN_ONE leaves the samples untouched. All kernels give the same bits
+// as the scalar ones, whatever the instruction set.
+
+#define REMAP_WEIGHT_ONE 256
+#define REMAP_GAIN_BITS 12
+#define REMAP_GAIN_ONE (1 << REMAP_GAIN_BITS)
+
+// Add count pixels of one camera into acc (4 uint32 per pixel). Source rows
+// are pitch bytes apart; the table guarantees x + 1 and y + 1 are inside the
+// image. gain holds 4 channel gains, alpha included. Selects an AVX2, SSE4.1
+// or scalar kernel at runtime.
+void remapAccumulateRow(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc);
+
+// Round count accumulated pixels to RGBA8
+void remapResolveRow(const uint32_t *acc, uint32_t count, unsigned char *dst);
+
+// Write count pixels seen by one camera alone straight to dst, the same
+// bits as accumulating them at full weight and resolving. Every pixel must
+// be valid.
+void remapCopyRow(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst);
+
+// Scalar kernels. The SIMD ones finish each row with them, and
+// kernel_check.cpp compares the two on noise at every instruction set.
+void remapAccumulateRowScalar(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc);
+void remapResolveRowScalar(const uint32_t *acc, uint32_t count, unsigned char *dst);
+void remapCopyRowScalar(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst);
@@ -0,0 +1,1733 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "remap_lut.h"
+#include "camera_model.h"
+#include "output_projection.h"
+#include "remap_kernels.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static inline size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// FNV-1a, 64 bit
+static void hashBytes(uint64_t &hash, const void *data, size_t bytes)
+{
+	const unsigned char *p = (const unsigned char*)data;
+	for (size_t i = 0; i < bytes; i++)
+	{
+		hash ^= p[i];
+		hash *= 0x100000001b3ull;
+	}
+}
+
+template <typename T>
+static void hashValue(uint64_t &hash, const T &value)
+{
+	hashBytes(hash, &value, sizeof(value));
+}
+
+static bool writePgm(const std::string &path, const unsigned char *pixels, uint32_t width, uint32_t height)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+	fprintf(file, "P5\n%u %u\n255\n", width, height);
+	bool ok = fwrite(pixels, 1, (size_t)width * height, file) == (size_t)width * height;
+	return fclose(file) == 0 && ok;
+}
+
+// The camera furthest from its edge gets full weight; others fade in over
+// the feather width as their margin approaches it, so the seam falls where
+// two cameras are equally far from their edges. margins are in output
+// pixels, negative for cameras that do not see the pixel.
+static void blendWeights(const float *margin, uint32_t count, float featherPx, float *weight)
+{
+	float best = -1.0f;
+	for (uint32_t c = 0; c < count; c++)
+		if (margin[c] > best)
+			best = margin[c];
+
+	float total = 0.0f;
+	for (uint32_t c = 0; c < count; c++)
+	{
+		weight[c] = 0.0f;
+		if (margin[c] < 0.0f)
+			continue;
+		float w = 1.0f - (best - margin[c]) / featherPx;
+		if (w > 0.0f)
+		{
+			weight[c] = w;
+			total += w;
+		}
+	}
+	if (total > 0.0f)
+		for (uint32_t c = 0; c < count; c++)
+			weight[c] /= total;
+}
+
+//***********************************************************************************
+void
+RemapSpans::reset(uint32_t firstRow)
+{
+	m_firstRow = firstRow;
+	m_rowStart.assign(1, 0);
+	m_spans.clear();
+}
+
+const remapSpan_t*
+RemapSpans::row(uint32_t y, uint32_t *count) const
+{
+	if (y < m_firstRow || y - m_firstRow + 1 >= m_rowStart.size())
+	{
+		*count = 0;
+		return nullptr;
+	}
+	uint32_t first = m_rowStart[y - m_firstRow];
+	*count = m_rowStart[y - m_firstRow + 1] - first;
+	return m_spans.data() + first;
+}
+
+size_t
+RemapSpans::pixels() const
+{
+	size_t total = 0;
+	for (size_t i = 0; i < m_spans.size(); i++)
+		total += m_spans[i].end - m_spans[i].begin;
+	return total;
+}
+
+//***********************************************************************************
+RemapTables::RemapTables() :
+	m_blob(nullptr),
+	m_projection(CPUSS_PROJECTION_EQUIRECTANGULAR)
+{
+	memset(&m_mapping, 0, sizeof(m_mapping));
+}
+
+uint64_t
+RemapTables::key(const nvssVideoStitcherProperties_t &props, const nvstitchVideoRigProperties_t &rig)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	hashValue(hash, (uint32_t)REMAP_LUT_VERSION);
+	hashValue(hash, (uint32_t)props.projection);
+	hashValue(hash, props.pano_width);
+	hashValue(hash, props.feather_width);
+	hashValue(hash, rig.num_cameras);
+	for (uint32_t i = 0; i < rig.num_cameras; i++)
+	{
+		// Only the fields the projection reads, so padding and unused
+		// members never change the key
+		const nvstitchCameraProperties_t &camera = rig.cameras[i];
+		hashValue(hash, camera.image_size.x);
+		hashValue(hash, camera.image_size.y);
+		hashValue(hash, camera.principal_point.x);
+		hashValue(hash, camera.principal_point.y);
+		hashValue(hash, camera.focal_length);
+		hashValue(hash, (uint32_t)camera.distortion_type);
+		hashValue(hash, (uint32_t)camera.camera_layout);
+		hashBytes(hash, camera.distortion_coefficients, sizeof(camera.distortion_coefficients));
+		hashValue(hash, camera.fisheye_radius);
+		hashBytes(hash, camera.extrinsics.rotation, sizeof(camera.extrinsics.rotation));
+	}
+	return hash;
+}
+
+// The file of a cache key in dir
+static std::string
+cacheFile(const std::string &dir, const char *prefix, uint64_t key)
+{
+	char name[40];
+	snprintf(name, sizeof(name), "%s_%016llx.lut", prefix, (unsigned long long)key);
+	if (dir.empty())
+		return name;
+	char last = dir[dir.size() - 1];
+	if (last == '/' || last == '\\')
+		return dir + name;
+	return dir + "/" + name;
+}
+
+std::string
+RemapTables::cachePath(const std::string &dir, uint64_t key)
+{
+	return cacheFile(dir, "remap", key);
+}
+
+uint64_t
+RemapTables::layoutKey(uint64_t tablesKey, float featherWidth, const LensVignetting *vignetting,
+	uint32_t numCameras, size_t tileBudget, uint32_t maxRun, uint32_t maxFused)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	hashValue(hash, (uint32_t)REMAP_LAYOUT_VERSION);
+	hashValue(hash, tablesKey);
+	hashValue(hash, featherWidth);
+	hashValue(hash, numCameras);
+	hashValue(hash, (uint32_t)(vignetting != nullptr));
+	for (uint32_t i = 0; vignetting != nullptr && i < numCameras; i++)
+	{
+		// The rest of a model follows from the rig, which tablesKey covers
+		hashValue(hash, (uint32_t)vignetting[i].enabled());
+		hashBytes(hash, vignetting[i].coefficients(), VIGNETTING_COEFFICIENTS * sizeof(float));
+	}
+	hashValue(hash, (uint64_t)tileBudget);
+	hashValue(hash, maxRun);
+	hashValue(hash, maxFused);
+	return hash;
+}
+
+std::string
+RemapTables::layoutCachePath(const std::string &dir, uint64_t key)
+{
+	return cacheFile(dir, "layout", key);
+}
+
+void
+RemapTables::allocate(uint32_t panoWidth, uint32_t panoHeight, cpussProjection projection,
+	float rigDiameter, uint64_t key, const std::vector<remapLutCamera_t> &cameras)
+{
+	uint32_t numCameras = (uint32_t)cameras.size();
+	size_t headerBytes = alignUp(sizeof(remapLutHeader_t) + numCameras * sizeof(remapLutCamera_t), REMAP_LUT_ALIGN);
+
+	std::vector<remapLutCamera_t> entries(cameras);
+	size_t offset = headerBytes;
+	for (uint32_t c = 0; c < numCameras; c++)
+	{
+		size_t pixels = (size_t)entries[c].map_size_x * entries[c].map_size_y;
+		entries[c].matrix_offset = offset;
+		offset = alignUp(offset + pixels * 2 * sizeof(float), REMAP_LUT_ALIGN);
+		entries[c].weight_offset = offset;
+		offset = alignUp(offset + pixels * sizeof(float), REMAP_LUT_ALIGN);
+	}
+
+	// Over-allocate so the blob itself starts REMAP_LUT_ALIGN aligned
+	m_file.close();
+	m_storage.assign(offset + REMAP_LUT_ALIGN, 0);
+	size_t misalign = (size_t)(uintptr_t)m_storage.data() % REMAP_LUT_ALIGN;
+	unsigned char *blob = m_storage.data() + (misalign ? REMAP_LUT_ALIGN - misalign : 0);
+
+	remapLutHeader_t header;
+	memset(&header, 0, sizeof(header));
+	header.magic = REMAP_LUT_MAGIC;
+	header.version = REMAP_LUT_VERSION;
+	header.header_bytes = (uint32_t)headerBytes;
+	header.num_cameras = numCameras;
+	header.pano_width = panoWidth;
+	header.pano_height = panoHeight;
+	header.rig_diameter = rigDiameter;
+	header.projection = (uint32_t)projection;
+	header.key = key;
+	header.total_bytes = offset;
+	memcpy(blob, &header, sizeof(header));
+	if (numCameras > 0)
+		memcpy(blob + sizeof(header), entries.data(), numCameras * sizeof(remapLutCamera_t));
+
+	bind(blob, offset);
+}
+
+bool
+RemapTables::bind(const unsigned char *blob, size_t bytes)
+{
+	if (bytes < sizeof(remapLutHeader_t))
+		return false;
+
+	remapLutHeader_t header;
+	memcpy(&header, blob, sizeof(header));
+	if (header.magic != REMAP_LUT_MAGIC || header.version != REMAP_LUT_VERSION)
+		return false;
+	if (header.total_bytes != bytes || header.header_bytes > bytes ||
+		sizeof(header) + (size_t)header.num_cameras * sizeof(remapLutCamera_t) > header.header_bytes)
+		return false;
+	if (header.pano_width == 0 || header.pano_height == 0)
+		return false;
+
+	std::vector<nvstitchCameraMappingMatrix_t> matrices(header.num_cameras);
+	std::vector<const float*> weights(header.num_cameras);
+	for (uint32_t c = 0; c < header.num_cameras; c++)
+	{
+		remapLutCamera_t entry;
+		memcpy(&entry, blob + sizeof(header) + c * sizeof(remapLutCamera_t), sizeof(entry));
+
+		size_t pixels = (size_t)entry.map_size_x * entry.map_size_y;
+		if (entry.map_offset_x + (uint64_t)entry.map_size_x > header.pano_width ||
+			entry.map_offset_y + (uint64_t)entry.map_size_y > header.pano_height)
+			return false;
+		if (entry.matrix_offset % REMAP_LUT_ALIGN != 0 || entry.weight_offset % REMAP_LUT_ALIGN != 0 ||
+			entry.matrix_offset < header.header_bytes || entry.weight_offset < header.header_bytes ||
+			entry.matrix_offset + pixels * 2 * sizeof(float) > bytes ||
+			entry.weight_offset + pixels * sizeof(float) > bytes)
+			return false;
+
+		nvstitchCameraMappingMatrix_t &matrix = matrices[c];
+		matrix.map_offset.x = entry.map_offset_x;
+		matrix.map_offset.y = entry.map_offset_y;
+		matrix.map_size.x = entry.map_size_x;
+		matrix.map_size.y = entry.map_size_y;
+		matrix.input_size.x = entry.input_size_x;
+		matrix.input_size.y = entry.input_size_y;
+		matrix.layout = (nvstitchCameraLayout)entry.layout;
+		// nvstitchCameraMapping_t has no const; the tables are read-only
+		// once built, and mapped read-only when loaded
+		matrix.matrix = (float*)(blob + entry.matrix_offset);
+		weights[c] = (const float*)(blob + entry.weight_offset);
+	}
+
+	m_blob = blob;
+	m_matrices.swap(matrices);
+	m_weights.swap(weights);
+	m_spans.assign(header.num_cameras, RemapSpans());
+	m_mapping.version = NVSTITCH_VERSION;
+	m_mapping.num_cameras = header.num_cameras;
+	m_mapping.reference_resolution.x = header.pano_width;
+	m_mapping.reference_resolution.y = header.pano_height;
+	m_mapping.rig_diameter = header.rig_diameter;
+	m_mapping.matrices = m_matrices.empty() ? nullptr : m_matrices.data();
+	m_projection = (cpussProjection)header.projection;
+	return true;
+}
+
+// Turn a row of directions by a math_util transform, in place
+static void
+rotateDirections(const float T[9], float *dirs, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float *d = dirs + (size_t)i * 3;
+		float x = d[0], y = d[1], z = d[2];
+		d[0] = T[0] * x + T[3] * y + T[6] * z;
+		d[1] = T[1] * x + T[4] * y + T[7] * z;
+		d[2] = T[2] * x + T[5] * y + T[8] * z;
+	}
+}
+
+//***********************************************************************************
+nvstitchResult
+RemapTables::build(const nvssVideoStitcherProperties_t &props, const nvstitchVideoRigProperties_t &rig, ThreadPool &pool,
+	const float *rotation)
+{
+	OutputProjection projection;
+	nvstitchResult result = projection.init((cpussProjection)props.projection, props.pano_width);
+	if (result != NVSTITCH_SUCCESS)
+		return result;
+	if (rig.num_cameras == 0 || rig.cameras == nullptr)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	if (rig.num_cameras > REMAP_LUT_MAX_CAMERAS)
+		return NVSTITCH_VIDEO_UNSUPPORTED_RIG;
+
+	uint32_t numCameras = rig.num_cameras;
+	std::vector<CameraModel> models(numCameras);
+	for (uint32_t c = 0; c < numCameras; c++)
+	{
+		result = models[c].init(rig.cameras[c]);
+		if (result != NVSTITCH_SUCCESS)
+			return result;
+	}
+
+	uint32_t width = projection.width();
+	uint32_t height = projection.height();
+	float featherPx = props.feather_width > 1.0f ? props.feather_width : 1.0f;
+	float marginScale = projection.pixelsPerRadian();
+
+	// First pass: the spans of each row each camera sees, and from them its
+	// bounding box
+	std::vector<std::vector<remapSpan_t>> rowSpans((size_t)numCameras * height);
+	pool.parallelFor(height, [&](size_t y) {
+		std::vector<float> dirs((size_t)width * 3);
+		projection.rowDirections((uint32_t)y, dirs.data());
+		if (rotation != nullptr)
+			rotateDirections(rotation, dirs.data(), width);
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const float *dir = dirs.data() + (size_t)x * 3;
+			for (uint32_t c = 0; c < numCameras; c++)
+			{
+				float u, v, margin;
+				if (!models[c].project(dir, &u, &v, &margin))
+					continue;
+				std::vector<remapSpan_t> &spans = rowSpans[(size_t)c * height + y];
+				if (!spans.empty() && spans.back().end == x)
+					spans.back().end = x + 1;
+				else
+					spans.push_back({ x, x + 1 });
+			}
+		}
+	});
+
+	std::vector<remapLutCamera_t> entries(numCameras);
+	for (uint32_t c = 0; c < numCameras; c++)
+	{
+		uint32_t x0 = width, x1 = 0, y0 = height, y1 = 0;
+		for (uint32_t y = 0; y < height; y++)
+		{
+			const std::vector<remapSpan_t> &spans = rowSpans[(size_t)c * height + y];
+			if (spans.empty())
+				continue;
+			if (spans.front().begin < x0)
+				x0 = spans.front().begin;
+			if (spans.back().end > x1)
+				x1 = spans.back().end;
+			if (y < y0)
+				y0 = y;
+			y1 = y + 1;
+		}
+
+		remapLutCamera_t &entry = entries[c];
+		memset(&entry, 0, sizeof(entry));
+		if (x0 < x1)
+		{
+			entry.map_offset_x = x0;
+			entry.map_offset_y = y0;
+			entry.map_size_x = x1 - x0;
+			entry.map_size_y = y1 - y0;
+		}
+		entry.input_size_x = rig.cameras[c].image_size.x;
+		entry.input_size_y = rig.cameras[c].image_size.y;
+		entry.layout = (uint32_t)rig.cameras[c].camera_layout;
+	}
+
+	// Diameter of the circle through the camera centers, as the rig XML
+	// gives translations in centimeters
+	float center[3] = { 0.0f, 0.0f, 0.0f };
+	for (uint32_t c = 0; c < numCameras; c++)
+		for (int i = 0; i < 3; i++)
+			center[i] += rig.cameras[c].extrinsics.translation[i] / (float)numCameras;
+	float radius = 0.0f;
+	for (uint32_t c = 0; c < numCameras; c++)
+	{
+		const float *t = rig.cameras[c].extrinsics.translation;
+		float dx = t[0] - center[0], dy = t[1] - center[1], dz = t[2] - center[2];
+		float r = sqrtf(dx * dx + dy * dy + dz * dz);
+		if (r > radius)
+			radius = r;
+	}
+	float rigDiameter = rig.rig_diameter > 0.0f ? rig.rig_diameter : 2.0f * radius;
+
+	allocate(width, height, (cpussProjection)props.projection, rigDiameter, rotation != nullptr ? 0 : key(props, rig), entries);
+	for (uint32_t c = 0; c < numCameras; c++)
+	{
+		RemapSpans &spans = m_spans[c];
+		spans.reset(entries[c].map_offset_y);
+		for (uint32_t y = entries[c].map_offset_y; y < entries[c].map_offset_y + entries[c].map_size_y; y++)
+		{
+			const std::vector<remapSpan_t> &row = rowSpans[(size_t)c * height + y];
+			for (size_t i = 0; i < row.size(); i++)
+				spans.add(row[i].begin, row[i].end);
+			spans.endRow();
+		}
+	}
+
+	// Second pass: coordinates and blend weights of every camera box pixel,
+	// projecting only where the spans say the camera sees
+	pool.parallelFor(height, [&](size_t y) {
+		float u[REMAP_LUT_MAX_CAMERAS], v[REMAP_LUT_MAX_CAMERAS];
+		float margin[REMAP_LUT_MAX_CAMERAS], weight[REMAP_LUT_MAX_CAMERAS];
+		uint32_t active[REMAP_LUT_MAX_CAMERAS];
+		const remapSpan_t *span[REMAP_LUT_MAX_CAMERAS];
+		const remapSpan_t *spanEnd[REMAP_LUT_MAX_CAMERAS];
+
+		uint32_t numActive = 0;
+		for (uint32_t c = 0; c < numCameras; c++)
+		{
+			const std::vector<remapSpan_t> &row = rowSpans[(size_t)c * height + y];
+			if (row.empty())
+				continue;
+			span[numActive] = row.data();
+			spanEnd[numActive] = row.data() + row.size();
+			active[numActive++] = c;
+		}
+		if (numActive == 0)
+			return;
+
+		std::vector<float> dirs((size_t)width * 3);
+		projection.rowDirections((uint32_t)y, dirs.data());
+		if (rotation != nullptr)
+			rotateDirections(rotation, dirs.data(), width);
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const float *dir = dirs.data() + (size_t)x * 3;
+			for (uint32_t i = 0; i < numActive; i++)
+			{
+				while (span[i] != spanEnd[i] && span[i]->end <= x)
+					span[i]++;
+				margin[i] = -1.0f;
+				if (span[i] != spanEnd[i] && span[i]->begin <= x &&
+					models[active[i]].project(dir, &u[i], &v[i], &margin[i]))
+					margin[i] *= marginScale;
+			}
+			blendWeights(margin, numActive, featherPx, weight);
+
+			for (uint32_t i = 0; i < numActive; i++)
+			{
+				const nvstitchCameraMappingMatrix_t &matrix = m_matrices[active[i]];
+				if (x < matrix.map_offset.x || x >= matrix.map_offset.x + matrix.map_size.x)
+					continue;
+				size_t index = (size_t)(y - matrix.map_offset.y) * matrix.map_size.x + (x - matrix.map_offset.x);
+				float *uv = matrix.matrix + index * 2;
+				uv[0] = margin[i] >= 0.0f ? u[i] : -1.0f;
+				uv[1] = margin[i] >= 0.0f ? v[i] : -1.0f;
+				((float*)m_weights[active[i]])[index] = weight[i];
+			}
+		}
+	});
+
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+RemapTables::build(const nvstitchCameraMapping_t &mapping, float featherWidth)
+{
+	if (mapping.num_cameras == 0 || mapping.matrices == nullptr)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	if (mapping.num_cameras > REMAP_LUT_MAX_CAMERAS)
+		return NVSTITCH_VIDEO_UNSUPPORTED_RIG;
+
+	uint32_t width = mapping.reference_resolution.x;
+	uint32_t height = mapping.reference_resolution.y;
+	if (width == 0 || height == 0)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+
+	uint32_t numCameras = mapping.num_cameras;
+	std::vector<remapLutCamera_t> entries(numCameras);
+	for (uint32_t c = 0; c < numCameras; c++)
+	{
+		const nvstitchCameraMappingMatrix_t &source = mapping.matrices[c];
+		if (source.map_offset.x + (uint64_t)source.map_size.x > width ||
+			source.map_offset.y + (uint64_t)source.map_size.y > height ||
+			source.input_size.x < 2 || source.input_size.y < 2 ||
+			(source.matrix == nullptr && source.map_size.x * (uint64_t)source.map_size.y > 0))
+			return NVSTITCH_ERROR_BAD_PARAMETER;
+
+		remapLutCamera_t &entry = entries[c];
+		memset(&entry, 0, sizeof(entry));
+		entry.map_offset_x = source.map_offset.x;
+		entry.map_offset_y = source.map_offset.y;
+		entry.map_size_x = source.map_size.x;
+		entry.map_size_y = source.map_size.y;
+		entry.input_size_x = source.input_size.x;
+		entry.input_size_y = source.input_size.y;
+		entry.layout = (uint32_t)source.layout;
+	}
+
+	// Not from a rig, so no cache key
+	allocate(width, height, CPUSS_PROJECTION_EQUIRECTANGULAR, mapping.rig_diameter, 0, entries);
+
+	// Margins first, into the weight tables: chamfer distance, in output
+	// pixels, from each mapped pixel to the nearest unmapped one or to a box
+	// edge that is not also a panorama edge
+	for (uint32_t c = 0; c < numCameras; c++)
+	{
+		const nvstitchCameraMappingMatrix_t &source = mapping.matrices[c];
+		nvstitchCameraMappingMatrix_t &matrix = m_matrices[c];
+		float *distance = (float*)m_weights[c];
+		uint32_t w = matrix.map_size.x;
+		uint32_t h = matrix.map_size.y;
+		float maxU = (float)(matrix.input_size.x - 1);
+		float maxV = (float)(matrix.input_size.y - 1);
+		const float far = (float)(width + height);
+
+		for (size_t i = 0; i < (size_t)w * h; i++)
+		{
+			float u = source.matrix[i * 2];
+			float v = source.matrix[i * 2 + 1];
+			bool mapped = u >= 0.0f && v >= 0.0f && u <= maxU && v <= maxV;
+			matrix.matrix[i * 2] = mapped ? u : -1.0f;
+			matrix.matrix[i * 2 + 1] = mapped ? v : -1.0f;
+			distance[i] = mapped ? far : 0.0f;
+		}
+
+		float edgeLeft = matrix.map_offset.x > 0 ? 0.0f : far;
+		float edgeRight = matrix.map_offset.x + w < width ? 0.0f : far;
+		float edgeTop = matrix.map_offset.y > 0 ? 0.0f : far;
+		float edgeBottom = matrix.map_offset.y + h < height ? 0.0f : far;
+		const float STRAIGHT = 1.0f, DIAGONAL = 1.41421356f;
+
+		for (uint32_t y = 0; y < h; y++)
+			for (uint32_t x = 0; x < w; x++)
+			{
+				float &d = distance[(size_t)y * w + x];
+				float left = x > 0 ? distance[(size_t)y * w + x - 1] : edgeLeft;
+				float up = y > 0 ? distance[(size_t)(y - 1) * w + x] : edgeTop;
+				float upLeft = x > 0 && y > 0 ? distance[(size_t)(y - 1) * w + x - 1] : (x > 0 ? edgeTop : edgeLeft);
+				float upRight = x + 1 < w && y > 0 ? distance[(size_t)(y - 1) * w + x + 1] : (y > 0 ? edgeRight : edgeTop);
+				d = fminf(d, fminf(left, up) + STRAIGHT);
+				d = fminf(d, fminf(upLeft, upRight) + DIAGONAL);
+			}
+		for (uint32_t y = h; y-- > 0;)
+			for (uint32_t x = w; x-- > 0;)
+			{
+				float &d = distance[(size_t)y * w + x];
+				float right = x + 1 < w ? distance[(size_t)y * w + x + 1] : edgeRight;
+				float down = y + 1 < h ? distance[(size_t)(y + 1) * w + x] : edgeBottom;
+				float downRight = x + 1 < w && y + 1 < h ? distance[(size_t)(y + 1) * w + x + 1] : (x + 1 < w ? edgeBottom : edgeRight);
+				float downLeft = x > 0 && y + 1 < h ? distance[(size_t)(y + 1) * w + x - 1] : (y + 1 < h ? edgeLeft : edgeBottom);
+				d = fminf(d, fminf(right, down) + STRAIGHT);
+				d = fminf(d, fminf(downRight, downLeft) + DIAGONAL);
+			}
+	}
+
+	// Then weights, pixel by pixel across the cameras covering it. Mapped
+	// pixels start half a pixel inside the edge.
+	float featherPx = featherWidth > 1.0f ? featherWidth : 1.0f;
+	std::vector<float> margin(numCameras), weight(numCameras);
+	std::vector<float*> cell(numCameras);
+	for (uint32_t y = 0; y < height; y++)
+		for (uint32_t x = 0; x < width; x++)
+		{
+			bool any = false;
+			for (uint32_t c = 0; c < numCameras; c++)
+			{
+				const nvstitchCameraMappingMatrix_t &matrix = m_matrices[c];
+				cell[c] = nullptr;
+				margin[c] = -1.0f;
+				if (x < matrix.map_offset.x || x >= matrix.map_offset.x + matrix.map_size.x ||
+					y < matrix.map_offset.y || y >= matrix.map_offset.y + matrix.map_size.y)
+					continue;
+				size_t index = (size_t)(y - matrix.map_offset.y) * matrix.map_size.x + (x - matrix.map_offset.x);
+				cell[c] = (float*)m_weights[c] + index;
+				if (*cell[c] > 0.0f)
+				{
+					margin[c] = *cell[c] - 0.5f;
+					any = true;
+				}
+			}
+			if (!any)
+				continue;
+			blendWeights(margin.data(), numCameras, featherPx, weight.data());
+			for (uint32_t c = 0; c < numCameras; c++)
+				if (cell[c] != nullptr)
+					*cell[c] = weight[c];
+		}
+
+	findSpans();
+	return NVSTITCH_SUCCESS;
+}
+
+// Spans from the matrices, where the build that made them is not at hand
+void
+RemapTables::findSpans()
+{
+	for (uint32_t c = 0; c < numCameras(); c++)
+	{
+		const nvstitchCameraMappingMatrix_t &matrix = m_matrices[c];
+		RemapSpans &spans = m_spans[c];
+		spans.reset(matrix.map_offset.y);
+		for (uint32_t y = 0; y < matrix.map_size.y; y++)
+		{
+			const float *uv = matrix.matrix + (size_t)y * matrix.map_size.x * 2;
+			for (uint32_t x = 0; x < matrix.map_size.x;)
+			{
+				if (uv[x * 2] < 0.0f)
+				{
+					x++;
+					continue;
+				}
+				uint32_t begin = x;
+				while (x < matrix.map_size.x && uv[x * 2] >= 0.0f)
+					x++;
+				spans.add(matrix.map_offset.x + begin, matrix.map_offset.x + x);
+			}
+			spans.endRow();
+		}
+	}
+}
+
+bool
+RemapTables::writeCoverage(const std::string &prefix) const
+{
+	uint32_t width = panoWidth(), height = panoHeight();
+	std::vector<unsigned char> count((size_t)width * height, 0);
+	for (uint32_t c = 0; c < numCameras(); c++)
+	{
+		std::vector<unsigned char> mask((size_t)width * height, 0);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			uint32_t numSpans;
+			const remapSpan_t *spans = m_spans[c].row(y, &numSpans);
+			for (uint32_t i = 0; i < numSpans; i++)
+				for (uint32_t x = spans[i].begin; x < spans[i].end; x++)
+				{
+					mask[(size_t)y * width + x] = 255;
+					count[(size_t)y * width + x]++;
+				}
+		}
+		if (!writePgm(prefix + "_cam" + std::to_string(c) + ".pgm", mask.data(), width, height))
+			return false;
+	}
+
+	for (size_t i = 0; i < count.size(); i++)
+		count[i] = (unsigned char)(count[i] * 255 / (numCameras() > 0 ? numCameras() : 1));
+	return writePgm(prefix + "_count.pgm", count.data(), width, height);
+}
+
+//***********************************************************************************
+bool
+RemapTables::load(const std::string &path, uint64_t key)
+{
+	// A missing file is the usual cache miss, not worth MappedFile's error
+	FILE *probe = fopen(path.c_str(), "rb");
+	if (probe == nullptr)
+		return false;
+	fclose(probe);
+
+	// Views point into the mapping, so drop the current tables first; they
+	// stay empty if the file does not match
+	m_storage.clear();
+	m_storage.shrink_to_fit();
+	m_blob = nullptr;
+	m_matrices.clear();
+	m_weights.clear();
+	m_spans.clear();
+	memset(&m_mapping, 0, sizeof(m_mapping));
+	if (!m_file.open(path))
+		return false;
+
+	remapLutHeader_t header;
+	bool ok = m_file.size() >= sizeof(header);
+	if (ok)
+	{
+		memcpy(&header, m_file.data(), sizeof(header));
+		ok = header.key == key && bind(m_file.data(), m_file.size());
+	}
+	if (!ok)
+		m_file.close();
+	else
+		findSpans();
+	return ok;
+}
+
+bool
+RemapTables::save(const std::string &path) const
+{
+	if (m_blob == nullptr)
+		return false;
+
+	remapLutHeader_t header;
+	memcpy(&header, m_blob, sizeof(header));
+
+	// Write aside and rename, so a reader never maps a half-written file
+	std::string temp = path + ".tmp";
+	FILE *file = fopen(temp.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+	bool ok = fwrite(m_blob, 1, (size_t)header.total_bytes, file) == header.total_bytes;
+	ok = fclose(file) == 0 && ok;
+	if (ok)
+	{
+		remove(path.c_str());
+		ok = rename(temp.c_str(), path.c_str()) == 0;
+	}
+	if (!ok)
+		remove(temp.c_str());
+	return ok;
+}
+
+nvstitchResult
+RemapTables::loadOrBuild(const std::string &dir, const nvssVideoStitcherProperties_t &props,
+	const nvstitchVideoRigProperties_t &rig, size_t tileBudget, ThreadPool &pool)
+{
+	if (dir.empty())
+		return build(props, rig, pool);
+
+	std::string path = cachePath(dir, key(props, rig));
+	if (load(path, key(props, rig)))
+		return NVSTITCH_SUCCESS;
+
+	nvstitchResult result = build(props, rig, pool);
+	if (result != NVSTITCH_SUCCESS)
+		return result;
+
+	// Vignetting only scales the weights, so the shape holds with or without it
+	PackedRemapTables packed;
+	if (packed.build(*this, pool) == NVSTITCH_SUCCESS)
+	{
+		RemapSchedule schedule;
+		schedule.buildTiled(packed, tileBudget, pool);
+		setTileShape(tileBudget, schedule.tileWidth(), schedule.tileHeight());
+	}
+	if (!save(path))
+		fprintf(stderr, "Could not write remap table cache %s\n", path.c_str());
+	return result;
+}
+
+uint64_t
+RemapTables::cacheKey() const
+{
+	if (m_blob == nullptr)
+		return 0;
+
+	remapLutHeader_t header;
+	memcpy(&header, m_blob, sizeof(header));
+	return header.key;
+}
+
+bool
+RemapTables::tileShape(size_t budgetBytes, uint32_t *width, uint32_t *height) const
+{
+	if (m_blob == nullptr)
+		return false;
+
+	remapLutHeader_t header;
+	memcpy(&header, m_blob, sizeof(header));
+	if (header.tile_budget != budgetBytes || header.tile_width == 0 || header.tile_height == 0 ||
+		header.tile_width > header.pano_width || header.tile_height > header.pano_height)
+		return false;
+	*width = header.tile_width;
+	*height = header.tile_height;
+	return true;
+}
+
+// Built tables only; a loaded cache file is mapped read-only
+void
+RemapTables::setTileShape(size_t budgetBytes, uint32_t width, uint32_t height)
+{
+	if (m_blob == nullptr || fromCache())
+		return;
+
+	remapLutHeader_t header;
+	memcpy(&header, m_blob, sizeof(header));
+	header.tile_budget = budgetBytes;
+	header.tile_width = width;
+	header.tile_height = height;
+	memcpy(const_cast<unsigned char*>(m_blob), &header, sizeof(header));
+}
+
+//***********************************************************************************
+RemapLayoutWriter::RemapLayoutWriter() :
+	m_file(nullptr),
+	m_offset(0),
+	m_section(-1),
+	m_ok(false)
+{
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+RemapLayoutWriter::~RemapLayoutWriter()
+{
+	if (m_file != nullptr)
+	{
+		fclose(m_file);
+		remove((m_path + ".tmp").c_str());
+	}
+}
+
+bool
+RemapLayoutWriter::open(const std::string &path, uint64_t key)
+{
+	m_path = path;
+	m_file = fopen((path + ".tmp").c_str(), "wb");
+	if (m_file == nullptr)
+		return false;
+	memset(&m_header, 0, sizeof(m_header));
+	m_header.magic = REMAP_LAYOUT_MAGIC;
+	m_header.version = REMAP_LAYOUT_VERSION;
+	m_header.key = key;
+	m_offset = 0;
+	m_section = -1;
+	m_ok = true;
+
+	// The header is written again by finish(), with the sections filled in
+	write(&m_header, sizeof(m_header));
+	return m_ok;
+}
+
+void
+RemapLayoutWriter::write(const void *data, size_t bytes)
+{
+	if (m_ok && bytes > 0)
+		m_ok = fwrite(data, 1, bytes, m_file) == bytes;
+	m_offset += bytes;
+}
+
+void
+RemapLayoutWriter::pad(size_t alignment)
+{
+	static const unsigned char zeros[REMAP_LUT_ALIGN] = {};
+	write(zeros, (size_t)(alignUp(m_offset, alignment) - m_offset));
+}
+
+void
+RemapLayoutWriter::beginSection(remapLayoutSection section)
+{
+	endSection();
+	pad(REMAP_LUT_ALIGN);
+	m_section = (int)section;
+	m_header.section_offset[section] = m_offset;
+}
+
+void
+RemapLayoutWriter::endSection()
+{
+	if (m_section >= 0)
+		m_header.section_bytes[m_section] = m_offset - m_header.section_offset[m_section];
+	m_section = -1;
+}
+
+bool
+RemapLayoutWriter::finish()
+{
+	if (m_file == nullptr)
+		return false;
+	endSection();
+	m_header.total_bytes = m_offset;
+	bool ok = m_ok && fseek(m_file, 0, SEEK_SET) == 0 && fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+	ok = fclose(m_file) == 0 && ok;
+	m_file = nullptr;
+
+	std::string temp = m_path + ".tmp";
+	if (ok)
+	{
+		remove(m_path.c_str());
+		ok = rename(temp.c_str(), m_path.c_str()) == 0;
+	}
+	if (!ok)
+		remove(temp.c_str());
+	return ok;
+}
+
+bool
+RemapLayoutReader::open(const std::string &path, uint64_t key)
+{
+	m_header = nullptr;
+	m_pos = m_end = nullptr;
+
+	// A missing file is the usual cache miss, not worth MappedFile's error
+	FILE *probe = fopen(path.c_str(), "rb");
+	if (probe == nullptr)
+		return false;
+	fclose(probe);
+	if (!m_file.open(path))
+		return false;
+
+	const remapLayoutHeader_t *header = (const remapLayoutHeader_t*)m_file.data();
+	bool ok = m_file.size() >= sizeof(*header) && header->magic == REMAP_LAYOUT_MAGIC &&
+		header->version == REMAP_LAYOUT_VERSION && header->key == key && header->total_bytes == m_file.size();
+	for (int i = 0; ok && i < REMAP_LAYOUT_SECTIONS; i++)
+		ok = header->section_offset[i] % REMAP_LUT_ALIGN == 0 && header->section_offset[i] <= header->total_bytes &&
+			header->section_bytes[i] <= header->total_bytes - header->section_offset[i];
+	if (!ok)
+	{
+		m_file.close();
+		return false;
+	}
+	m_header = header;
+	return true;
+}
+
+bool
+RemapLayoutReader::beginSection(remapLayoutSection section)
+{
+	if (m_header == nullptr || m_header->section_offset[section] == 0)
+		return fail();
+	m_pos = m_file.data() + m_header->section_offset[section];
+	m_end = m_pos + m_header->section_bytes[section];
+	return true;
+}
+
+bool
+RemapLayoutReader::read(void *data, size_t bytes)
+{
+	if (m_pos == nullptr || bytes > (size_t)(m_end - m_pos))
+		return fail();
+	if (bytes > 0)
+		memcpy(data, m_pos, bytes);
+	m_pos += bytes;
+	return true;
+}
+
+bool
+RemapLayoutReader::skip(size_t bytes)
+{
+	if (m_pos == nullptr || bytes > (size_t)(m_end - m_pos))
+		return fail();
+	m_pos += bytes;
+	return true;
+}
+
+//***********************************************************************************
+// Top left of the 2x2 block around coordinate t in [0, size - 1], and the
+// 8-bit position in it. The block stays inside the image, so the far edge
+// rounds to 255/256 of the last pixel.
+static inline void
+packCoordinate(float t, uint32_t size, int *base, uint32_t *frac)
+{
+	int i = (int)t;
+	if (i > (int)size - 2)
+		i = (int)size - 2;
+	int f = (int)((t - (float)i) * 256.0f + 0.5f);
+	*base = i;
+	*frac = (uint32_t)(f > 255 ? 255 : f);
+}
+
+void
+PackedRemapTables::packEntry(const nvstitchCameraMappingMatrix_t &matrix, size_t index, uint32_t *xy, uint16_t *frac)
+{
+	const float *uv = matrix.matrix + index * 2;
+	int bx, by;
+	uint32_t fx, fy;
+	packCoordinate(uv[0], matrix.input_size.x, &bx, &fx);
+	packCoordinate(uv[1], matrix.input_size.y, &by, &fy);
+	*xy = (uint32_t)(uint16_t)bx | ((uint32_t)(uint16_t)by << 16);
+	*frac = (uint16_t)(fx | fy << 8);
+}
+
+nvstitchResult
+PackedRemapTables::build(const RemapTables &tables, ThreadPool &pool, const LensVignetting *vignetting)
+{
+	uint32_t numCameras = tables.numCameras();
+	if (numCameras > REMAP_LUT_MAX_CAMERAS)
+		return NVSTITCH_VIDEO_UNSUPPORTED_RIG;
+
+	m_cameras.assign(numCameras, Camera());
+	m_panoWidth = tables.panoWidth();
+	m_panoHeight = tables.panoHeight();
+	for (uint32_t c = 0; c < numCameras; c++)
+	{
+		const nvstitchCameraMappingMatrix_t &matrix = tables.matrix(c);
+		if (matrix.input_size.x < 2 || matrix.input_size.y < 2 ||
+			matrix.input_size.x > 32767 || matrix.input_size.y > 32767)
+			return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+
+		Camera &camera = m_cameras[c];
+		camera.map_offset_x = matrix.map_offset.x;
+		camera.map_offset_y = matrix.map_offset.y;
+		camera.map_size_x = matrix.map_size.x;
+		camera.map_size_y = matrix.map_size.y;
+		size_t pixels = (size_t)matrix.map_size.x * matrix.map_size.y;
+		camera.xy.assign(pixels, 0xffffffffu);
+		camera.frac.assign(pixels, 0);
+		camera.weight.assign(pixels, 0);
+		camera.spans = tables.spans(c);
+	}
+
+	// Weights are quantized across all cameras of a pixel at once, so they
+	// still sum to exactly REMAP_WEIGHT_ONE; the camera with the largest share
+	// absorbs the rounding. Vignetting then scales each down on its own.
+	// Cameras that see a pixel at zero weight keep its entry, flagged.
+	pool.parallelFor(tables.panoHeight(), [&](size_t row) {
+		uint32_t y = (uint32_t)row;
+		uint32_t active[REMAP_LUT_MAX_CAMERAS];
+		uint32_t numActive = 0;
+		for (uint32_t c = 0; c < numCameras; c++)
+		{
+			const Camera &camera = m_cameras[c];
+			if (y >= camera.map_offset_y && y < camera.map_offset_y + camera.map_size_y && camera.map_size_x > 0)
+				active[numActive++] = c;
+		}
+
+		size_t index[REMAP_LUT_MAX_CAMERAS];
+		int quantized[REMAP_LUT_MAX_CAMERAS];
+		for (uint32_t x = 0; x < tables.panoWidth(); x++)
+		{
+			int total = 0;
+			int largest = -1;
+			float largestWeight = 0.0f;
+			for (uint32_t i = 0; i < numActive; i++)
+			{
+				const Camera &camera = m_cameras[active[i]];
+				quantized[i] = 0;
+				index[i] = SIZE_MAX;
+				if (x < camera.map_offset_x || x >= camera.map_offset_x + camera.map_size_x)
+					continue;
+				index[i] = (size_t)(y - camera.map_offset_y) * camera.map_size_x + (x - camera.map_offset_x);
+				float w = tables.weights(active[i])[index[i]];
+				if (w <= 0.0f)
+					continue;
+				quantized[i] = (int)(w * REMAP_WEIGHT_ONE + 0.5f);
+				total += quantized[i];
+				if (w > largestWeight)
+				{
+					largestWeight = w;
+					largest = (int)i;
+				}
+			}
+			if (largest < 0)
+				continue;
+			quantized[largest] += REMAP_WEIGHT_ONE - total;
+
+			for (uint32_t i = 0; i < numActive; i++)
+			{
+				const nvstitchCameraMappingMatrix_t &matrix = tables.matrix(active[i]);
+				Camera &camera = m_cameras[active[i]];
+				int w = quantized[i];
+				if (w <= 0)
+				{
+					if (index[i] != SIZE_MAX && matrix.matrix[index[i] * 2] >= 0.0f)
+					{
+						packEntry(matrix, index[i], &camera.xy[index[i]], &camera.frac[index[i]]);
+						camera.xy[index[i]] |= REMAP_XY_UNWEIGHTED;
+					}
+					continue;
+				}
+				if (w > REMAP_WEIGHT_ONE)
+					w = REMAP_WEIGHT_ONE;
+
+				if (vignetting != nullptr && vignetting[active[i]].enabled())
+				{
+					const float *uv = matrix.matrix + index[i] * 2;
+					w = (int)(w * vignetting[active[i]].share(uv[0], uv[1]) + 0.5f);
+					w = w < 1 ? 1 : w;
+				}
+
+				packEntry(matrix, index[i], &camera.xy[index[i]], &camera.frac[index[i]]);
+				camera.weight[index[i]] = (uint8_t)(w - 1);
+			}
+		}
+	});
+
+	return NVSTITCH_SUCCESS;
+}
+
+void
+PackedRemapTables::save(RemapLayoutWriter &writer) const
+{
+	writer.beginSection(REMAP_LAYOUT_PACKED);
+	writer.value(m_panoWidth);
+	writer.value(m_panoHeight);
+	writer.value((uint32_t)m_cameras.size());
+	for (const Camera &camera : m_cameras)
+	{
+		writer.value(camera.map_offset_x);
+		writer.value(camera.map_offset_y);
+		writer.value(camera.map_size_x);
+		writer.value(camera.map_size_y);
+		writer.array(camera.xy);
+		writer.array(camera.frac);
+		writer.array(camera.weight);
+	}
+}
+
+bool
+PackedRemapTables::load(RemapLayoutReader &reader, const RemapTables &tables)
+{
+	uint32_t numCameras = 0;
+	bool ok = reader.beginSection(REMAP_LAYOUT_PACKED) && reader.value(m_panoWidth) && reader.value(m_panoHeight) &&
+		reader.value(numCameras) && m_panoWidth == tables.panoWidth() && m_panoHeight == tables.panoHeight() &&
+		numCameras == tables.numCameras();
+	m_cameras.assign(ok ? numCameras : 0, Camera());
+	for (uint32_t c = 0; ok && c < numCameras; c++)
+	{
+		const nvstitchCameraMappingMatrix_t &matrix = tables.matrix(c);
+		Camera &camera = m_cameras[c];
+		ok = reader.value(camera.map_offset_x) && reader.value(camera.map_offset_y) &&
+			reader.value(camera.map_size_x) && reader.value(camera.map_size_y) &&
+			reader.array(camera.xy) && reader.array(camera.frac) && reader.array(camera.weight);
+		size_t pixels = (size_t)matrix.map_size.x * matrix.map_size.y;
+		ok = ok && camera.map_offset_x == matrix.map_offset.x && camera.map_offset_y == matrix.map_offset.y &&
+			camera.map_size_x == matrix.map_size.x && camera.map_size_y == matrix.map_size.y &&
+			camera.xy.size() == pixels && camera.frac.size() == pixels && camera.weight.size() == pixels;
+		camera.spans = tables.spans(c);
+	}
+	if (!ok)
+		m_cameras.clear();
+	return ok;
+}
+
+//***********************************************************************************
+// Source bounding box of one camera over a run of output pixels, in 2x2
+// block coordinates; empty while minX > maxX
+struct SourceBox
+{
+	int16_t minX, maxX, minY, maxY;
+
+	void clear() { minX = minY = 32767; maxX = maxY = -1; }
+	bool empty() const { return minX > maxX; }
+	void add(const SourceBox &other)
+	{
+		if (other.minX < minX) minX = other.minX;
+		if (other.maxX > maxX) maxX = other.maxX;
+		if (other.minY < minY) minY = other.minY;
+		if (other.maxY > maxY) maxY = other.maxY;
+	}
+};
+
+// Boxes are gathered over spans of this many output pixels of one row;
+// tile widths are multiples of it
+static const uint32_t FOOTPRINT_SPAN = 8;
+static const size_t CACHE_LINE = 64;
+
+// Per camera, the source box of every FOOTPRINT_SPAN run of every row
+static void
+gatherSourceBoxes(const PackedRemapTables &tables, ThreadPool &pool, std::vector<SourceBox> &boxes)
+{
+	uint32_t spans = (tables.panoWidth() + FOOTPRINT_SPAN - 1) / FOOTPRINT_SPAN;
+	uint32_t height = tables.panoHeight();
+	boxes.resize((size_t)tables.numCameras() * height * spans);
+
+	pool.parallelFor(height, [&](size_t y) {
+		for (uint32_t c = 0; c < tables.numCameras(); c++)
+		{
+			const PackedRemapTables::Camera &camera = tables.camera(c);
+			SourceBox *row = &boxes[((size_t)c * height + y) * spans];
+			for (uint32_t s = 0; s < spans; s++)
+				row[s].clear();
+			if (y < camera.map_offset_y || y >= camera.map_offset_y + camera.map_size_y)
+				continue;
+
+			const uint32_t *xy = &camera.xy[(size_t)(y - camera.map_offset_y) * camera.map_size_x];
+			for (uint32_t i = 0; i < camera.map_size_x; i++)
+			{
+				int16_t bx = (int16_t)(xy[i] & 0xffff);
+				int16_t by = (int16_t)(xy[i] >> 16);
+				if (bx < 0)
+					continue;
+				SourceBox &box = row[(camera.map_offset_x + i) / FOOTPRINT_SPAN];
+				if (bx < box.minX) box.minX = bx;
+				if (bx > box.maxX) box.maxX = bx;
+				if (by < box.minY) box.minY = by;
+				if (by > box.maxY) box.maxY = by;
+			}
+		}
+	});
+}
+
+// Bytes one tile touches: the 7-byte table entries, the 4-byte output
+// pixels and, per camera, the source cache lines. An output row follows a
+// curve through a fisheye image, so source lines are counted row by row
+// from the span boxes rather than from one box around the whole tile.
+static size_t
+tileFootprint(const PackedRemapTables &tables, const std::vector<SourceBox> &boxes, const remapTile_t &tile)
+{
+	uint32_t spans = (tables.panoWidth() + FOOTPRINT_SPAN - 1) / FOOTPRINT_SPAN;
+	uint32_t height = tables.panoHeight();
+	size_t area = (size_t)(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+	size_t bytes = area * 4;
+
+	// Source rows the tile reaches, each with the span of lines it reaches
+	std::vector<SourceBox> rows;
+	for (uint32_t c = 0; c < tables.numCameras(); c++)
+	{
+		SourceBox extent;
+		extent.clear();
+		rows.clear();
+		for (uint32_t y = tile.y0; y < tile.y1; y++)
+		{
+			const SourceBox *row = &boxes[((size_t)c * height + y) * spans];
+			for (uint32_t s = tile.x0 / FOOTPRINT_SPAN; s < (tile.x1 + FOOTPRINT_SPAN - 1) / FOOTPRINT_SPAN; s++)
+			{
+				const SourceBox &box = row[s];
+				if (box.empty())
+					continue;
+				extent.add(box);
+				if ((size_t)box.maxY + 2 > rows.size())
+				{
+					size_t old = rows.size();
+					rows.resize((size_t)box.maxY + 2);
+					for (size_t i = old; i < rows.size(); i++)
+						rows[i].clear();
+				}
+				// The 2x2 taps reach one pixel right and down
+				SourceBox reach = box;
+				reach.maxX++;
+				for (int sy = box.minY; sy <= box.maxY + 1; sy++)
+					rows[sy].add(reach);
+			}
+		}
+		if (extent.empty())
+			continue;
+
+		size_t lines = 0;
+		for (int sy = extent.minY; sy <= extent.maxY + 1; sy++)
+			if (!rows[sy].empty())
+				lines += (size_t)rows[sy].maxX * 4 / CACHE_LINE - (size_t)rows[sy].minX * 4 / CACHE_LINE + 1;
+		bytes += lines * CACHE_LINE + area * 7;
+	}
+	return bytes;
+}
+
+static void
+measureFootprints(const PackedRemapTables &tables, const std::vector<SourceBox> &boxes,
+	const std::vector<remapTile_t> &tiles, ThreadPool &pool, size_t *mean, size_t *max)
+{
+	std::vector<size_t> footprints(tiles.size());
+	pool.parallelFor(tiles.size(), [&](size_t t) {
+		footprints[t] = tileFootprint(tables, boxes, tiles[t]);
+	});
+	size_t total = 0;
+	*max = 0;
+	for (size_t footprint : footprints)
+	{
+		total += footprint;
+		*max = std::max(*max, footprint);
+	}
+	*mean = tiles.empty() ? 0 : total / tiles.size();
+}
+
+// Bands of tiles top to bottom, every other band right to left, so each
+// tile starts next to the one before it
+static void
+cutTiles(uint32_t width, uint32_t height, uint32_t tileWidth, uint32_t tileHeight, std::vector<remapTile_t> &tiles)
+{
+	tiles.clear();
+	uint32_t columns = (width + tileWidth - 1) / tileWidth;
+	for (uint32_t y = 0, band = 0; y < height; y += tileHeight, band++)
+		for (uint32_t i = 0; i < columns; i++)
+		{
+			uint32_t x = (band & 1 ? columns - 1 - i : i) * tileWidth;
+			remapTile_t tile;
+			tile.x0 = x;
+			tile.y0 = y;
+			tile.x1 = std::min(x + tileWidth, width);
+			tile.y1 = std::min(y + tileHeight, height);
+			tiles.push_back(tile);
+		}
+}
+
+RemapSchedule::RemapSchedule() :
+	m_tileWidth(0),
+	m_tileHeight(0),
+	m_meanFootprint(0),
+	m_maxFootprint(0),
+	m_copyPixels(0),
+	m_overlapPixels(0),
+	m_fusedPixels(0)
+{
+}
+
+void
+RemapSchedule::buildRows(const PackedRemapTables &tables, ThreadPool &pool)
+{
+	buildShape(tables, tables.panoWidth(), 1, pool);
+}
+
+void
+RemapSchedule::buildShape(const PackedRemapTables &tables, uint32_t tileWidth, uint32_t tileHeight, ThreadPool &pool)
+{
+	m_tileWidth = tileWidth;
+	m_tileHeight = tileHeight;
+	cutTiles(tables.panoWidth(), tables.panoHeight(), m_tileWidth, m_tileHeight, m_tiles);
+
+	std::vector<SourceBox> boxes;
+	gatherSourceBoxes(tables, pool, boxes);
+	measureFootprints(tables, boxes, m_tiles, pool, &m_meanFootprint, &m_maxFootprint);
+}
+
+void
+RemapSchedule::buildTiled(const PackedRemapTables &tables, size_t budgetBytes, ThreadPool &pool)
+{
+	std::vector<SourceBox> boxes;
+	gatherSourceBoxes(tables, pool, boxes);
+
+	// Of the shapes whose 90th percentile footprint fits, the one that
+	// touches the fewest bytes per output pixel. A band of full-width rows
+	// fits whenever one row does, yet it runs in the same order as the rows
+	// and saves nothing; tall tiles reuse source lines between rows. Every
+	// narrower tile cuts the runs once more, so among shapes within 1/16 of
+	// the fewest bytes the widest wins. If nothing fits, the shape with the
+	// smallest footprint is used anyway.
+	uint32_t width = tables.panoWidth();
+	uint32_t height = tables.panoHeight();
+	const uint32_t widths[] = { width, 512, 256, 128, 64, 32 };
+	const uint32_t heights[] = { 64, 32, 16, 8, 4, 2, 1 };
+
+	struct Shape
+	{
+		uint32_t width, height;
+		size_t percentile;          // 90th percentile footprint
+		size_t perPixel;            // all footprints over all pixels, in 1/256 bytes
+	};
+	std::vector<Shape> shapes;
+	std::vector<size_t> footprints;
+	for (uint32_t tileWidth : widths)
+	{
+		if (tileWidth > width || (tileWidth != width && tileWidth * 2 > width))
+			continue;
+		for (uint32_t tileHeight : heights)
+		{
+			// Narrow tiles only pay off with a few rows to share
+			if (tileHeight > height || (tileWidth != width && tileHeight < 8))
+				continue;
+
+			cutTiles(width, height, tileWidth, tileHeight, m_tiles);
+			footprints.resize(m_tiles.size());
+			pool.parallelFor(m_tiles.size(), [&](size_t t) {
+				footprints[t] = tileFootprint(tables, boxes, m_tiles[t]);
+			});
+			Shape shape;
+			shape.width = tileWidth;
+			shape.height = tileHeight;
+			shape.perPixel = 0;
+			for (size_t footprint : footprints)
+				shape.perPixel += footprint;
+			shape.perPixel = shape.perPixel * 256 / ((size_t)width * height);
+			std::nth_element(footprints.begin(), footprints.begin() + footprints.size() * 9 / 10, footprints.end());
+			shape.percentile = footprints[footprints.size() * 9 / 10];
+			shapes.push_back(shape);
+		}
+	}
+
+	const Shape *best = nullptr;
+	size_t fewest = SIZE_MAX;
+	for (const Shape &shape : shapes)
+		if (shape.percentile <= budgetBytes)
+			fewest = std::min(fewest, shape.perPixel);
+	for (const Shape &shape : shapes)
+	{
+		if (fewest == SIZE_MAX)
+		{
+			if (best == nullptr || shape.percentile < best->percentile)
+				best = &shape;
+		}
+		else if (shape.percentile <= budgetBytes && shape.perPixel <= fewest + fewest / 16)
+		{
+			// Shapes come widest first
+			if (best == nullptr || (shape.width == best->width && shape.perPixel < best->perPixel))
+				best = &shape;
+		}
+	}
+
+	m_tileWidth = best->width;
+	m_tileHeight = best->height;
+	cutTiles(width, height, m_tileWidth, m_tileHeight, m_tiles);
+	measureFootprints(tables, boxes, m_tiles, pool, &m_meanFootprint, &m_maxFootprint);
+}
+
+static inline bool seesEntry(const PackedRemapTables::Camera &camera, size_t entry)
+{
+	return (int16_t)(camera.xy[entry] & 0xffff) >= 0;
+}
+
+// Calls visit(kind, camera, y, x, count, entry) for each run of a tile, per
+// row and per maxRun block: first the block's overlap spans, then per camera
+// its copy runs and its blend runs, each blend run one overlap span trimmed
+// to the entries that contribute. Only the cameras' spans are read.
+// sources is scratch of maxRun entries.
+template <typename Visit>
+static void
+forEachRun(const PackedRemapTables &tables, const remapTile_t &tile, uint32_t maxRun,
+	std::vector<uint8_t> &sources, Visit visit)
+{
+	sources.resize(maxRun);
+	for (uint32_t y = tile.y0; y < tile.y1; y++)
+		for (uint32_t x0 = tile.x0; x0 < tile.x1; x0 += maxRun)
+		{
+			uint32_t x1 = std::min(x0 + maxRun, tile.x1);
+			uint8_t *count = sources.data() - x0;
+
+			// Cameras seeing each pixel of the block
+			std::fill(sources.begin(), sources.begin() + (x1 - x0), 0);
+			for (uint32_t c = 0; c < tables.numCameras(); c++)
+			{
+				const PackedRemapTables::Camera &camera = tables.camera(c);
+				size_t row = (size_t)(y - camera.map_offset_y) * camera.map_size_x - camera.map_offset_x;
+				uint32_t numSpans;
+				const remapSpan_t *spans = camera.spans.row(y, &numSpans);
+				for (uint32_t i = 0; i < numSpans; i++)
+				{
+					uint32_t end = std::min(x1, spans[i].end);
+					for (uint32_t x = std::max(x0, spans[i].begin); x < end; x++)
+						count[x] += seesEntry(camera, row + x);
+				}
+			}
+
+			for (uint32_t x = x0; x < x1;)
+			{
+				if (count[x] < 2)
+				{
+					x++;
+					continue;
+				}
+				uint32_t start = x;
+				while (x < x1 && count[x] >= 2)
+					x++;
+				visit(RemapSchedule::RUN_OVERLAP, 0, y, start, x - start, 0);
+			}
+
+			for (uint32_t c = 0; c < tables.numCameras(); c++)
+			{
+				const PackedRemapTables::Camera &camera = tables.camera(c);
+				size_t row = (size_t)(y - camera.map_offset_y) * camera.map_size_x - camera.map_offset_x;
+				uint32_t numSpans;
+				const remapSpan_t *spans = camera.spans.row(y, &numSpans);
+
+				for (uint32_t i = 0; i < numSpans; i++)
+				{
+					uint32_t end = std::min(x1, spans[i].end);
+					for (uint32_t x = std::max(x0, spans[i].begin); x < end;)
+					{
+						if (count[x] != 1 || !seesEntry(camera, row + x))
+						{
+							x++;
+							continue;
+						}
+						uint32_t start = x;
+						while (x < end && count[x] == 1 && seesEntry(camera, row + x))
+							x++;
+						visit(RemapSchedule::RUN_COPY, c, y, start, x - start, row + start);
+					}
+				}
+
+				for (uint32_t i = 0; i < numSpans; i++)
+				{
+					uint32_t end = std::min(x1, spans[i].end);
+					for (uint32_t x = std::max(x0, spans[i].begin); x < end;)
+					{
+						if (count[x] < 2)
+						{
+							x++;
+							continue;
+						}
+						uint32_t start = x;
+						while (x < end && count[x] >= 2)
+							x++;
+						uint32_t stop = x;
+						while (start < stop && !seesEntry(camera, row + start))
+							start++;
+						while (stop > start && !seesEntry(camera, row + stop - 1))
+							stop--;
+						if (start < stop)
+							visit(RemapSchedule::RUN_BLEND, c, y, start, stop - start, row + start);
+					}
+				}
+			}
+		}
+}
+
+// Reorders the runs of one block as layout() describes, fusing each overlap
+// span whose intersecting blend runs, 2 to maxFused of them, all match it
+// exactly. Returns the pixels fused.
+static size_t
+fuseBlock(RemapSchedule::Run *begin, RemapSchedule::Run *end, uint32_t maxFused,
+	std::vector<RemapSchedule::Run> &order, std::vector<uint8_t> &placed)
+{
+	RemapSchedule::Run *spansEnd = begin;
+	while (spansEnd != end && spansEnd->kind == RemapSchedule::RUN_OVERLAP)
+		spansEnd++;
+
+	size_t fused = 0;
+	order.clear();
+	placed.assign(end - spansEnd, 0);
+	for (const RemapSchedule::Run *span = begin; span != spansEnd; span++)
+	{
+		uint32_t cameras = 0;
+		bool whole = true;
+		for (const RemapSchedule::Run *run = spansEnd; run != end; run++)
+			if (run->kind == RemapSchedule::RUN_BLEND && run->x < span->x + span->count && run->x + run->count > span->x)
+			{
+				cameras++;
+				whole = whole && run->x == span->x && run->count == span->count;
+			}
+		if (!whole || cameras < 2 || cameras > maxFused)
+			continue;
+
+		order.push_back(*span);
+		order.back().kind = RemapSchedule::RUN_FUSED;
+		order.back().camera = (uint16_t)cameras;
+		for (const RemapSchedule::Run *run = spansEnd; run != end; run++)
+			if (run->kind == RemapSchedule::RUN_BLEND && run->x == span->x)
+			{
+				order.push_back(*run);
+				placed[run - spansEnd] = 1;
+			}
+		fused += span->count;
+	}
+	size_t fusedRuns = order.size();
+	for (const RemapSchedule::Run *span = begin; span != spansEnd; span++)
+	{
+		bool isFused = false;
+		for (size_t i = 0; i < fusedRuns && !isFused; i++)
+			isFused = order[i].kind == RemapSchedule::RUN_FUSED && order[i].x == span->x;
+		if (!isFused)
+			order.push_back(*span);
+	}
+	for (const RemapSchedule::Run *run = spansEnd; run != end; run++)
+		if (!placed[run - spansEnd])
+			order.push_back(*run);
+	std::copy(order.begin(), order.end(), begin);
+	return fused;
+}
+
+void
+RemapSchedule::layout(const PackedRemapTables &tables, uint32_t maxRun, uint32_t maxFused, ThreadPool &pool)
+{
+	size_t numTiles = m_tiles.size();
+	std::vector<size_t> runCounts(numTiles), entryCounts(numTiles);
+	std::vector<size_t> copyCounts(numTiles), overlapCounts(numTiles);
+	pool.parallelFor(numTiles, [&](size_t t) {
+		size_t runs = 0, entries = 0, copies = 0, overlaps = 0;
+		std::vector<uint8_t> sources;
+		forEachRun(tables, m_tiles[t], maxRun, sources, [&](RunKind kind, uint32_t, uint32_t, uint32_t, uint32_t count, size_t) {
+			runs++;
+			if (kind == RUN_OVERLAP)
+				overlaps += count;
+			else
+				entries += count;
+			if (kind == RUN_COPY)
+				copies += count;
+		});
+		runCounts[t] = runs;
+		entryCounts[t] = entries;
+		copyCounts[t] = copies;
+		overlapCounts[t] = overlaps;
+	});
+
+	std::vector<size_t> entryStart(numTiles + 1, 0);
+	m_tileRuns.assign(numTiles + 1, 0);
+	m_copyPixels = 0;
+	m_overlapPixels = 0;
+	m_fusedPixels = 0;
+	for (size_t t = 0; t < numTiles; t++)
+	{
+		m_tileRuns[t + 1] = m_tileRuns[t] + runCounts[t];
+		entryStart[t + 1] = entryStart[t] + entryCounts[t];
+		m_copyPixels += copyCounts[t];
+		m_overlapPixels += overlapCounts[t];
+	}
+	m_runs.resize(m_tileRuns[numTiles]);
+	m_xy.resize(entryStart[numTiles]);
+	m_frac.resize(entryStart[numTiles]);
+	m_weight.resize(entryStart[numTiles]);
+
+	std::vector<size_t> fusedCounts(numTiles, 0);
+	pool.parallelFor(numTiles, [&](size_t t) {
+		Run *run = &m_runs[m_tileRuns[t]];
+		size_t offset = entryStart[t];
+		std::vector<uint8_t> sources;
+		forEachRun(tables, m_tiles[t], maxRun, sources, [&](RunKind kind, uint32_t c, uint32_t y, uint32_t x, uint32_t count, size_t entry) {
+			run->camera = (uint16_t)c;
+			run->kind = (uint16_t)kind;
+			run->y = y;
+			run->x = x;
+			run->count = count;
+			run->offset = offset;
+			run++;
+			if (kind == RUN_OVERLAP)
+				return;
+
+			const PackedRemapTables::Camera &camera = tables.camera(c);
+			memcpy(&m_xy[offset], &camera.xy[entry], count * sizeof(uint32_t));
+			memcpy(&m_frac[offset], &camera.frac[entry], count * sizeof(uint16_t));
+			memcpy(&m_weight[offset], &camera.weight[entry], count * sizeof(uint8_t));
+			offset += count;
+		});
+
+		const remapTile_t &tile = m_tiles[t];
+		Run *block = &m_runs[m_tileRuns[t]];
+		Run *tileEnd = &m_runs[m_tileRuns[t + 1]];
+		std::vector<Run> order;
+		std::vector<uint8_t> placed;
+		while (block != tileEnd)
+		{
+			Run *blockEnd = block + 1;
+			uint32_t column = (block->x - tile.x0) / maxRun;
+			while (blockEnd != tileEnd && blockEnd->y == block->y && (blockEnd->x - tile.x0) / maxRun == column)
+				blockEnd++;
+			fusedCounts[t] += fuseBlock(block, blockEnd, maxFused, order, placed);
+			block = blockEnd;
+		}
+	});
+	for (size_t t = 0; t < numTiles; t++)
+		m_fusedPixels += fusedCounts[t];
+}
+
+void
+RemapSchedule::save(RemapLayoutWriter &writer) const
+{
+	writer.beginSection(REMAP_LAYOUT_SCHEDULE);
+	writer.value(m_tileWidth);
+	writer.value(m_tileHeight);
+	writer.value((uint64_t)m_meanFootprint);
+	writer.value((uint64_t)m_maxFootprint);
+	writer.value((uint64_t)m_copyPixels);
+	writer.value((uint64_t)m_overlapPixels);
+	writer.value((uint64_t)m_fusedPixels);
+	writer.array(m_tiles);
+	writer.array(m_tileRuns);
+	writer.array(m_runs);
+	writer.array(m_xy);
+	writer.array(m_frac);
+	writer.array(m_weight);
+}
+
+// Every tile and run inside the panorama, and every run's entries and fused
+// blend runs inside the arrays and its tile
+bool
+RemapSchedule::load(RemapLayoutReader &reader, const RemapTables &tables)
+{
+	uint64_t meanFootprint, maxFootprint, copyPixels, overlapPixels, fusedPixels;
+	bool ok = reader.beginSection(REMAP_LAYOUT_SCHEDULE) && reader.value(m_tileWidth) && reader.value(m_tileHeight) &&
+		reader.value(meanFootprint) && reader.value(maxFootprint) && reader.value(copyPixels) &&
+		reader.value(overlapPixels) && reader.value(fusedPixels) && reader.array(m_tiles) && reader.array(m_tileRuns) &&
+		reader.array(m_runs) && reader.array(m_xy) && reader.array(m_frac) && reader.array(m_weight);
+	ok = ok && !m_tiles.empty() && m_tileRuns.size() == m_tiles.size() + 1 && m_tileRuns[0] == 0 &&
+		m_tileRuns.back() == m_runs.size() && m_frac.size() == m_xy.size() && m_weight.size() == m_xy.size();
+	for (size_t t = 0; ok && t < m_tiles.size(); t++)
+	{
+		const remapTile_t &tile = m_tiles[t];
+		ok = tile.x0 < tile.x1 && tile.x1 <= tables.panoWidth() && tile.y0 < tile.y1 && tile.y1 <= tables.panoHeight() &&
+			m_tileRuns[t] <= m_tileRuns[t + 1];
+		for (size_t r = m_tileRuns[t]; ok && r < m_tileRuns[t + 1]; r++)
+		{
+			const Run &run = m_runs[r];
+			ok = run.kind <= RUN_FUSED && run.y >= tile.y0 && run.y < tile.y1 && run.x >= tile.x0 &&
+				run.count <= tile.x1 - run.x;
+			if (run.kind == RUN_FUSED)
+				ok = ok && run.camera < m_tileRuns[t + 1] - r;
+			else if (run.kind != RUN_OVERLAP)
+				ok = ok && run.camera < tables.numCameras() && run.offset <= m_xy.size() &&
+					run.count <= m_xy.size() - run.offset;
+		}
+	}
+	if (!ok)
+	{
+		*this = RemapSchedule();
+		return false;
+	}
+	m_meanFootprint = (size_t)meanFootprint;
+	m_maxFootprint = (size_t)maxFootprint;
+	m_copyPixels = (size_t)copyPixels;
+	m_overlapPixels = (size_t)overlapPixels;
+	m_fusedPixels = (size_t)fusedPixels;
+	return true;
+}
@@ -0,0 +1,560 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "nvss_video.h"
+#include "cpu_stitcher.h"
+#include "mapped_file.h"
+
+class LensVignetting;
+class ThreadPool;
+
+// ==== Remap table layout ====
+// One blob, identical in memory and in the cache file:
+// [remapLutHeader_t | remapLutCamera_t x num_cameras | pad to REMAP_LUT_ALIGN]
+// followed, per camera, by its coordinate matrix and its weights, each
+// REMAP_LUT_ALIGN aligned. A camera's tables cover only the bounding box of
+// the output pixels it sees (map_offset, map_size), row by row.
+//
+// The matrix holds a (u, v) float pair per pixel, as nvstitchCameraMapping_t
+// does: the source position in pixels, pixel centers on integers, or
+// (-1, -1) where the camera does not contribute. The weights are that
+// camera's share of the pixel; over all cameras they sum to 1 wherever any
+// camera sees the pixel.
+
+#define REMAP_LUT_MAGIC     0x544c5256u     // "VRLT"
+#define REMAP_LUT_VERSION   3
+#define REMAP_LUT_ALIGN     64
+#define REMAP_LUT_MAX_CAMERAS 32
+
+typedef struct remapLutCamera_st
+{
+	uint32_t map_offset_x;      //!< Top left of the table in the panorama
+	uint32_t map_offset_y;
+	uint32_t map_size_x;        //!< Table size in pixels
+	uint32_t map_size_y;
+	uint32_t input_size_x;      //!< Camera image size
+	uint32_t input_size_y;
+	uint32_t layout;            //!< nvstitchCameraLayout
+	uint32_t reserved;
+	uint64_t matrix_offset;     //!< Byte offset of the (u, v) pairs from the start of the blob
+	uint64_t weight_offset;     //!< Byte offset of the weights
+}
+remapLutCamera_t;
+
+typedef struct remapLutHeader_st
+{
+	uint32_t magic;             //!< REMAP_LUT_MAGIC
+	uint32_t version;           //!< REMAP_LUT_VERSION
+	uint32_t header_bytes;      //!< Bytes before the first table
+	uint32_t num_cameras;
+	uint32_t pano_width;
+	uint32_t pano_height;
+	float rig_diameter;
+	uint32_t projection;        //!< cpussProjection of the panorama
+	uint64_t key;               //!< RemapTables::key() of the inputs the tables were built from
+	uint64_t total_bytes;       //!< Size of the whole blob
+	uint64_t tile_budget;       //!< Cache budget the tile shape was chosen for; 0 if none was
+	uint32_t tile_width;        //!< RemapSchedule::buildTiled() shape for these tables
+	uint32_t tile_height;
+}
+remapLutHeader_t;
+
+// ==== Layout cache file layout ====
+// What the stitcher lays out from a set of tables, kept beside their cache
+// file so a warm start reads it back instead:
+// [remapLayoutHeader_t | pad to REMAP_LUT_ALIGN]
+// followed by the sections the header lists, each REMAP_LUT_ALIGN aligned.
+// A section is a sequence of values and arrays in the writer's own struct
+// layout; an array is its byte count, a uint64_t, then its bytes, padded to
+// 8. The key covers everything the sections were made from; the version
+// covers their structs.
+
+#define REMAP_LAYOUT_MAGIC      0x4c4c5256u     // "VRLL"
+#define REMAP_LAYOUT_VERSION    1
+
+typedef enum
+{
+	REMAP_LAYOUT_PACKED = 0,        // PackedRemapTables
+	REMAP_LAYOUT_SCHEDULE = 1,      // the tiled RemapSchedule
+	REMAP_LAYOUT_BLOCKS = 2,        // MultiBandBlender
+	REMAP_LAYOUT_SECTIONS = 3,
+} remapLayoutSection;
+
+typedef struct remapLayoutHeader_st
+{
+	uint32_t magic;             //!< REMAP_LAYOUT_MAGIC
+	uint32_t version;           //!< REMAP_LAYOUT_VERSION
+	uint64_t key;               //!< RemapTables::layoutKey() of what the sections were made from
+	uint64_t total_bytes;       //!< Size of the whole file
+	uint64_t section_offset[REMAP_LAYOUT_SECTIONS];     //!< Byte offset of each section; 0 if absent
+	uint64_t section_bytes[REMAP_LAYOUT_SECTIONS];
+}
+remapLayoutHeader_t;
+
+// Writes a layout cache file one section at a time. The file is written
+// aside and renamed into place by finish(), so a reader never maps a
+// half-written one; one never finished is removed.
+class RemapLayoutWriter
+{
+public:
+	RemapLayoutWriter();
+	~RemapLayoutWriter();
+
+	bool open(const std::string &path, uint64_t key);
+	void beginSection(remapLayoutSection section);
+
+	template <typename T>
+	void value(const T &v)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "layout cache values are written as bytes");
+		write(&v, sizeof(v));
+	}
+
+	template <typename T>
+	void array(const std::vector<T> &values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "layout cache arrays are written as bytes");
+		uint64_t bytes = (uint64_t)values.size() * sizeof(T);
+		write(&bytes, sizeof(bytes));
+		write(values.data(), (size_t)bytes);
+		pad(8);
+	}
+
+	bool finish();
+
+private:
+	RemapLayoutWriter(const RemapLayoutWriter&);
+	RemapLayoutWriter& operator=(const RemapLayoutWriter&);
+
+	void write(const void *data, size_t bytes);
+	void pad(size_t alignment);
+	void endSection();
+
+	FILE *m_file;
+	std::string m_path;
+	remapLayoutHeader_t m_header;
+	uint64_t m_offset;
+	int m_section;              // being written, or -1
+	bool m_ok;
+};
+
+// Reads sections of a mapped layout cache file back. Once a read runs past
+// its section, every later read of the section fails too, so checking the
+// last is enough.
+class RemapLayoutReader
+{
+public:
+	RemapLayoutReader() : m_header(nullptr), m_pos(nullptr), m_end(nullptr) {}
+
+	// False if the file is missing, damaged or was made from other inputs
+	bool open(const std::string &path, uint64_t key);
+
+	// False if the file has no such section
+	bool beginSection(remapLayoutSection section);
+
+	template <typename T>
+	bool value(T &v)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "layout cache values are read as bytes");
+		return read(&v, sizeof(v));
+	}
+
+	template <typename T>
+	bool array(std::vector<T> &values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "layout cache arrays are read as bytes");
+		uint64_t bytes;
+		if (!read(&bytes, sizeof(bytes)) || bytes % sizeof(T) != 0 || bytes > (uint64_t)(m_end - m_pos))
+			return fail();
+		values.resize((size_t)(bytes / sizeof(T)));
+		return read(values.data(), (size_t)bytes) && skip((8 - bytes % 8) % 8);
+	}
+
+private:
+	bool read(void *data, size_t bytes);
+	bool skip(size_t bytes);
+	bool fail() { m_pos = m_end = nullptr; return false; }
+
+	MappedFile m_file;
+	const remapLayoutHeader_t *m_header;
+	const unsigned char *m_pos;     // next byte of the section, or nullptr once a read failed
+	const unsigned char *m_end;
+};
+
+// Columns [begin, end) of a panorama row that a camera sees
+typedef struct remapSpan_st
+{
+	uint32_t begin;
+	uint32_t end;
+}
+remapSpan_t;
+
+// Where a camera sees, row by row: the parts of each row inside its fisheye
+// circle and image. A fisheye looking back across the panorama's left and
+// right edges sees two parts of a row, and its box spans the whole width;
+// the spans still cover only what it sees.
+class RemapSpans
+{
+public:
+	RemapSpans() : m_firstRow(0), m_rowStart(1, 0) {}
+
+	// Start over with rows from firstRow on, each added by endRow()
+	void reset(uint32_t firstRow);
+	void add(uint32_t begin, uint32_t end) { m_spans.push_back({ begin, end }); }
+	void endRow() { m_rowStart.push_back((uint32_t)m_spans.size()); }
+
+	// Spans of panorama row y, in column order; none outside the rows added
+	const remapSpan_t* row(uint32_t y, uint32_t *count) const;
+
+	// Pixels in all spans
+	size_t pixels() const;
+
+private:
+	uint32_t m_firstRow;
+	std::vector<uint32_t> m_rowStart;
+	std::vector<remapSpan_t> m_spans;
+};
+
+// Calls visit(begin, end) for each part of row y that both a and b see
+template <typename Visit>
+void remapForEachOverlap(const RemapSpans &a, const RemapSpans &b, uint32_t y, Visit visit)
+{
+	uint32_t countA, countB;
+	const remapSpan_t *spansA = a.row(y, &countA);
+	const remapSpan_t *spansB = b.row(y, &countB);
+	uint32_t i = 0, j = 0;
+	while (i < countA && j < countB)
+	{
+		uint32_t begin = spansA[i].begin > spansB[j].begin ? spansA[i].begin : spansB[j].begin;
+		uint32_t end = spansA[i].end < spansB[j].end ? spansA[i].end : spansB[j].end;
+		if (begin < end)
+			visit(begin, end);
+		if (spansA[i].end < spansB[j].end)
+			i++;
+		else
+			j++;
+	}
+}
+
+// Per-camera remap tables and blend weights for one output projection
+// (output_projection.h). Built from the rig once, then kept in a cache file
+// named by a hash of everything they depend on, so later runs map the file
+// instead of rebuilding.
+class RemapTables
+{
+public:
+	RemapTables();
+
+	// Hash of the stitcher and rig properties the tables depend on
+	static uint64_t key(const nvssVideoStitcherProperties_t &props, const nvstitchVideoRigProperties_t &rig);
+	static std::string cachePath(const std::string &dir, uint64_t key);
+
+	// Hash of what the layouts of tables with key tablesKey are made from:
+	// the feather width, the vignetting models, if any, one per camera, the
+	// tile budget and RemapSchedule::layout()'s run limits. The tables' key
+	// covers the feather width already, but the blocks follow it on their
+	// own.
+	static uint64_t layoutKey(uint64_t tablesKey, float featherWidth, const LensVignetting *vignetting,
+		uint32_t numCameras, size_t tileBudget, uint32_t maxRun, uint32_t maxFused);
+	static std::string layoutCachePath(const std::string &dir, uint64_t key);
+
+	// Project every panorama pixel through each camera's lens model. The
+	// panorama is props.projection at props.pano_width. A rotation, a
+	// math_util 3x3 transform, turns every panorama direction before it is
+	// projected, giving the tables of the rig turned by its inverse; they
+	// have key 0, as the key does not cover it.
+	nvstitchResult build(const nvssVideoStitcherProperties_t &props, const nvstitchVideoRigProperties_t &rig, ThreadPool &pool,
+		const float *rotation = nullptr);
+
+	// Take coordinates from an existing mapping, e.g. one exported by the
+	// calibration tools; it is equirectangular, as in nvss. Blend weights
+	// come from each pixel's distance to the edge of its camera's mapped area.
+	nvstitchResult build(const nvstitchCameraMapping_t &mapping, float featherWidth);
+
+	// Map a cache file; false, with no tables, if it is missing, damaged or
+	// was built from other inputs
+	bool load(const std::string &path, uint64_t key);
+	bool save(const std::string &path) const;
+
+	// load() from dir, or build() and save() there. An empty dir skips the
+	// cache. Built tables are saved with the tile shape
+	// RemapSchedule::buildTiled() picks for them at tileBudget bytes, so
+	// later runs skip the search.
+	nvstitchResult loadOrBuild(const std::string &dir, const nvssVideoStitcherProperties_t &props,
+		const nvstitchVideoRigProperties_t &rig, size_t tileBudget, ThreadPool &pool);
+
+	// The tile shape saved with the tables, if it was picked for budgetBytes;
+	// another cache size needs another search
+	bool tileShape(size_t budgetBytes, uint32_t *width, uint32_t *height) const;
+
+	bool fromCache() const { return m_file.data() != nullptr; }
+
+	// key() of the inputs the tables were built from; 0 for rotated tables
+	// and those from a mapping, which are never cached
+	uint64_t cacheKey() const;
+
+	uint32_t numCameras() const { return m_mapping.num_cameras; }
+	uint32_t panoWidth() const { return m_mapping.reference_resolution.x; }
+	uint32_t panoHeight() const { return m_mapping.reference_resolution.y; }
+	cpussProjection projection() const { return m_projection; }
+
+	// Whether the panorama's last column continues into its first
+	bool wrapsAround() const { return m_projection == CPUSS_PROJECTION_EQUIRECTANGULAR; }
+
+	// Views of the tables in the nvss layout; valid while this object lives
+	const nvstitchCameraMapping_t& mapping() const { return m_mapping; }
+	const nvstitchCameraMappingMatrix_t& matrix(uint32_t camera) const { return m_matrices[camera]; }
+	const float* weights(uint32_t camera) const { return m_weights[camera]; }
+
+	// The pixels of its box each camera sees. Built with the tables, or
+	// found again in the matrix when they are loaded or come from a mapping.
+	const RemapSpans& spans(uint32_t camera) const { return m_spans[camera]; }
+
+	// Debug dump of the spans: prefix_camN.pgm, white where camera N sees,
+	// and prefix_count.pgm, brighter where more cameras do
+	bool writeCoverage(const std::string &prefix) const;
+
+private:
+	RemapTables(const RemapTables&);
+	RemapTables& operator=(const RemapTables&);
+
+	// Lay out a blob for the given camera tables and point the views into it
+	void allocate(uint32_t panoWidth, uint32_t panoHeight, cpussProjection projection,
+		float rigDiameter, uint64_t key, const std::vector<remapLutCamera_t> &cameras);
+	bool bind(const unsigned char *blob, size_t bytes);
+	void findSpans();
+	void setTileShape(size_t budgetBytes, uint32_t width, uint32_t height);
+
+	std::vector<unsigned char> m_storage;   // built tables
+	MappedFile m_file;                      // or tables mapped from the cache
+	const unsigned char *m_blob;
+
+	nvstitchCameraMapping_t m_mapping;
+	cpussProjection m_projection;
+	std::vector<nvstitchCameraMappingMatrix_t> m_matrices;
+	std::vector<const float*> m_weights;
+	std::vector<RemapSpans> m_spans;
+};
+
+// RemapTables in the fixed-point form the remap kernels (remap_kernels.h)
+// read: 7 bytes per table pixel instead of 12. Rebuilt from the float tables
+// whenever they are loaded, so the cache file keeps the nvss layout.
+//
+// A pixel a camera sees at zero weight keeps its xy and frac, with
+// REMAP_XY_UNWEIGHTED set in xy: x is then negative, so the kernels and
+// the schedules pass over it, but the multi-band blend, which samples
+// cameras past their blend weights, finds it.
+#define REMAP_XY_UNWEIGHTED 0x8000u
+
+class PackedRemapTables
+{
+public:
+	struct Camera
+	{
+		uint32_t map_offset_x;
+		uint32_t map_offset_y;
+		uint32_t map_size_x;
+		uint32_t map_size_y;
+		std::vector<uint32_t> xy;
+		std::vector<uint16_t> frac;
+		std::vector<uint8_t> weight;
+		RemapSpans spans;           // as in RemapTables; outside them, xy is never valid
+	};
+
+	PackedRemapTables() : m_panoWidth(0), m_panoHeight(0) {}
+
+	// Sources must be under 32768 pixels on a side. With vignetting, one
+	// model per camera, each weight is scaled by its sample's share of the
+	// camera's peak correction (camera_model.h), so a pixel's weights sum to
+	// less than REMAP_WEIGHT_ONE and the gains must make up the peak. Every
+	// weight stays at least 1, so the same entries are valid either way.
+	nvstitchResult build(const RemapTables &tables, ThreadPool &pool, const LensVignetting *vignetting = nullptr);
+
+	// The REMAP_LAYOUT_PACKED section of a layout cache file. load() takes
+	// the spans from tables, which must be those the section was packed
+	// from, and fails if the section does not fit them.
+	void save(RemapLayoutWriter &writer) const;
+	bool load(RemapLayoutReader &reader, const RemapTables &tables);
+
+	// xy and frac of one table pixel the camera sees, whatever its weight
+	static void packEntry(const nvstitchCameraMappingMatrix_t &matrix, size_t index, uint32_t *xy, uint16_t *frac);
+
+	// Whether the camera sees a table pixel at all, and its xy for the
+	// kernels, the zero-weight flag cleared
+	static bool seenEntry(const Camera &camera, size_t entry, uint32_t *xy)
+	{
+		uint32_t packed = camera.xy[entry];
+		*xy = packed & ~REMAP_XY_UNWEIGHTED;
+		return packed != 0xffffffffu;
+	}
+
+	uint32_t numCameras() const { return (uint32_t)m_cameras.size(); }
+	uint32_t panoWidth() const { return m_panoWidth; }
+	uint32_t panoHeight() const { return m_panoHeight; }
+	const Camera& camera(uint32_t camera) const { return m_cameras[camera]; }
+
+private:
+	std::vector<Camera> m_cameras;
+	uint32_t m_panoWidth;
+	uint32_t m_panoHeight;
+};
+
+// ==== Remap traversal order ====
+// An equirectangular row crosses a fisheye image along a curve, so walking
+// the output row by row touches far more source rows than fit in cache. A
+// tiled schedule cuts the output into tiles whose source footprint, with
+// their share of the tables and output, fits a cache budget, and orders them
+// so consecutive tiles are neighbours. The budget is a share of L2; where a
+// whole band of rows already fits, the band is the tile.
+
+typedef struct remapTile_st
+{
+	uint32_t x0, y0;            //!< Top left, in panorama pixels
+	uint32_t x1, y1;            //!< Bottom right, exclusive
+}
+remapTile_t;
+
+class RemapSchedule
+{
+public:
+	RemapSchedule();
+
+	// Full-width rows, top to bottom
+	void buildRows(const PackedRemapTables &tables, ThreadPool &pool);
+
+	// Tiles of a given shape, such as one buildTiled() chose for other
+	// tables of the same rig
+	void buildShape(const PackedRemapTables &tables, uint32_t tileWidth, uint32_t tileHeight, ThreadPool &pool);
+
+	// The tile shape that touches the fewest bytes per output pixel while
+	// its footprint mostly fits budgetBytes
+	void buildTiled(const PackedRemapTables &tables, size_t budgetBytes, ThreadPool &pool);
+
+	const std::vector<remapTile_t>& tiles() const { return m_tiles; }
+	uint32_t tileWidth() const { return m_tileWidth; }
+	uint32_t tileHeight() const { return m_tileHeight; }
+
+	// Estimated bytes a tile touches: source cache lines, tables and output
+	size_t meanFootprint() const { return m_meanFootprint; }
+	size_t maxFootprint() const { return m_maxFootprint; }
+
+	// Most of a panorama is seen by one camera only. Those pixels are
+	// remapped straight into the output; only pixels several cameras share
+	// go through the weighted accumulation. Overlap spans that each of their
+	// cameras' blend runs covers whole are instead blended in one pass
+	// (remap_fused_kernels.h).
+	enum RunKind
+	{
+		RUN_OVERLAP = 0,        // pixels more than one camera sees; no entries
+		RUN_COPY = 1,           // one camera's pixels that no other camera sees
+		RUN_BLEND = 2,          // one camera's share of an overlap span
+		RUN_FUSED = 3,          // an overlap span whose camera field counts the blend runs after it
+	};
+
+	// Part of a row of a tile
+	struct Run
+	{
+		uint16_t camera;
+		uint16_t kind;          // RunKind
+		uint32_t y;
+		uint32_t x;
+		uint32_t count;
+		size_t offset;          // into xy(), frac() and weight()
+	};
+
+	// Copy the packed entries into tile order, so the remap reads them front
+	// to back. Runs are sorted by row, then by maxRun-aligned column block
+	// within the tile, and never cross a block. A block starts with its fused
+	// spans of up to maxFused cameras, each followed by its blend runs, then
+	// its other overlap spans, then each camera's copy and remaining blend
+	// runs.
+	void layout(const PackedRemapTables &tables, uint32_t maxRun, uint32_t maxFused, ThreadPool &pool);
+
+	// The REMAP_LAYOUT_SCHEDULE section of a layout cache file, tiles and
+	// runs as layout() left them; load() fails if it does not fit tables
+	void save(RemapLayoutWriter &writer) const;
+	bool load(RemapLayoutReader &reader, const RemapTables &tables);
+
+	// Output pixels in copy runs and in overlap spans, and those of the
+	// overlap spans that are fused
+	size_t copyPixels() const { return m_copyPixels; }
+	size_t overlapPixels() const { return m_overlapPixels; }
+	size_t fusedPixels() const { return m_fusedPixels; }
+
+	const Run* tileRunsBegin(size_t tile) const { return m_runs.data() + m_tileRuns[tile]; }
+	const Run* tileRunsEnd(size_t tile) const { return m_runs.data() + m_tileRuns[tile + 1]; }
+	const uint32_t* xy() const { return m_xy.data(); }
+	const uint16_t* frac() const { return m_frac.data(); }
+	const uint8_t* weight() const { return m_weight.data(); }
+
+private:
+	std::vector<remapTile_t> m_tiles;
+	uint32_t m_tileWidth;
+	uint32_t m_tileHeight;
+	size_t m_meanFootprint;
+	size_t m_maxFootprint;
+	size_t m_copyPixels;
+	size_t m_overlapPixels;
+	size_t m_fusedPixels;
+
+	std::vector<size_t> m_tileRuns;
+	std::vector<Run> m_runs;
+	std::vector<uint32_t> m_xy;
+	std::vector<uint16_t> m_frac;
+	std::vector<uint8_t> m_weight;
+};
@@ -0,0 +1,618 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include "remap_yuv_kernels.h"
+#include "cpu_features.h"
+
+#include <immintrin.h>
+
+// ==== Per-format samplers of the remap kernels ====
+// One bilinear sample per table entry, 8.8 fixed point per channel, as
+// remap_kernels.h and remap_yuv_kernels.h describe. The row kernels of every
+// source format and the fused span kernels (remap_fused_kernels.h) share
+// them. They are inline so each kernel gets its own copy, with the format
+// and whether to keep YUV folded in wherever the caller has them as
+// constants. The SIMD samplers apply the channel gains and set valid in the
+// lanes of the pixels the camera sees; the scalar ones leave the gains to
+// the kernel.
+
+static const int32_t REMAP_SAMPLE_MAX = 255 * 256;
+
+static inline uint32_t remapClampSample(int32_t value)
+{
+	return (uint32_t)(value < 0 ? 0 : (value > REMAP_SAMPLE_MAX ? REMAP_SAMPLE_MAX : value));
+}
+
+// One plane's bilinear sample in 8.8, from the block at p; step is the byte
+// distance between horizontal neighbours
+static inline uint32_t remapBilinear(const unsigned char *p, size_t step, size_t pitch, uint32_t fx, uint32_t fy)
+{
+	uint32_t top = p[0] * (256 - fx) + p[step] * fx;
+	uint32_t bottom = p[pitch] * (256 - fx) + p[pitch + step] * fx;
+	return (top * (256 - fy) + bottom * fy + 128) >> 8;
+}
+
+static inline void remapYuvToRgba(int32_t y, int32_t u, int32_t v, uint32_t rgba[4])
+{
+	int32_t c = 298 * (y - 16 * 256) + 128;
+	int32_t d = u - 128 * 256;
+	int32_t e = v - 128 * 256;
+	rgba[0] = remapClampSample((c + 409 * e) >> 8);
+	rgba[1] = remapClampSample((c - 100 * d - 208 * e) >> 8);
+	rgba[2] = remapClampSample((c + 516 * d) >> 8);
+	rgba[3] = REMAP_SAMPLE_MAX;
+}
+
+// Largest chroma positions, in 1/256ths, that leave a 2x2 block in the plane
+static inline int32_t remapChromaLimit(uint32_t size)
+{
+	return (int32_t)((size - 1) << 8) - 1;
+}
+
+// RGBA8 or BGR8 at one table entry, 4 or 3 bytes a pixel; BGR8 is opaque
+static inline void remapSamplePacked(const unsigned char *src, size_t pitch, uint32_t pixelBytes,
+	uint32_t xy, uint16_t frac, uint32_t sample[4])
+{
+	uint32_t fx = frac & 0xff;
+	uint32_t fy = frac >> 8;
+	const unsigned char *p = src + (size_t)(xy >> 16) * pitch + (size_t)(xy & 0xffff) * pixelBytes;
+	for (uint32_t c = 0; c < 3; c++)
+		sample[c] = remapBilinear(p + c, pixelBytes, pitch, fx, fy);
+	sample[3] = pixelBytes == 4 ? remapBilinear(p + 3, 4, pitch, fx, fy) : REMAP_SAMPLE_MAX;
+}
+
+// 4:2:0 at one table entry, converted to RGBA unless keepYuv
+static inline void remapSampleYuv(const remapSource_t *src, uint32_t xy, uint16_t frac,
+	bool nv12, bool keepYuv, uint32_t sample[4])
+{
+	uint32_t x = xy & 0xffff;
+	uint32_t y = xy >> 16;
+	uint32_t fx = frac & 0xff;
+	uint32_t fy = frac >> 8;
+	size_t lumaPitch = src->pitch[0];
+	size_t chromaPitch = src->pitch[1];
+	uint32_t luma = remapBilinear(src->plane[0] + (size_t)y * lumaPitch + x, 1, lumaPitch, fx, fy);
+
+	int32_t cx = (int32_t)(((x << 8) | fx) >> 1);
+	int32_t cy = (int32_t)(((y << 8) | fy) >> 1) - 64;
+	int32_t maxX = remapChromaLimit(src->chromaWidth);
+	int32_t maxY = remapChromaLimit(src->chromaHeight);
+	cx = cx < maxX ? cx : maxX;
+	cy = cy < 0 ? 0 : (cy < maxY ? cy : maxY);
+	uint32_t cfx = (uint32_t)cx & 0xff;
+	uint32_t cfy = (uint32_t)cy & 0xff;
+
+	uint32_t u, v;
+	if (nv12)
+	{
+		const unsigned char *p = src->plane[1] + (size_t)(cy >> 8) * chromaPitch + (size_t)(cx >> 8) * 2;
+		u = remapBilinear(p, 2, chromaPitch, cfx, cfy);
+		v = remapBilinear(p + 1, 2, chromaPitch, cfx, cfy);
+	}
+	else
+	{
+		size_t offset = (size_t)(cy >> 8) * chromaPitch + (size_t)(cx >> 8);
+		u = remapBilinear(src->plane[1] + offset, 1, chromaPitch, cfx, cfy);
+		v = remapBilinear(src->plane[2] + offset, 1, chromaPitch, cfx, cfy);
+	}
+	if (keepYuv)
+	{
+		sample[0] = luma;
+		sample[1] = u;
+		sample[2] = v;
+		sample[3] = REMAP_SAMPLE_MAX;
+	}
+	else
+		remapYuvToRgba((int32_t)luma, (int32_t)u, (int32_t)v, sample);
+}
+
+// Any source format at one table entry the camera sees
+template <remapSourceFormat Format>
+static inline void remapSampleScalar(const remapSource_t *src, uint32_t xy, uint16_t frac, bool keepYuv, uint32_t sample[4])
+{
+	if (Format == REMAP_SOURCE_RGBA8 || Format == REMAP_SOURCE_BGR8)
+		remapSamplePacked(src->plane[0], src->pitch[0], Format == REMAP_SOURCE_RGBA8 ? 4 : 3, xy, frac, sample);
+	else
+		remapSampleYuv(src, xy, frac, Format == REMAP_SOURCE_NV12, keepYuv, sample);
+}
+
+//***********************************************************************************
+// SSE4.1: four pixels per call, one per 32-bit lane, the samples of each
+// pixel in one vector. For the packed formats the vertical step runs as
+// _mm_madd_epi16 over (top, bottom) pairs, with both biased by -32768 so they
+// fit signed 16 bits; the bias comes back as a constant 32768 * 256.
+CPU_TARGET_SSE41
+static inline void remapBilinearPixelsSse41(__m128i p00, __m128i p01, __m128i p10, __m128i p11,
+	const uint16_t *frac, __m128i gain, __m128i sample[4])
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c256 = _mm_set1_epi32(256);
+	const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+	const __m128i unbias = _mm_set1_epi32(32768 * 256 + 128);
+	const __m128i gainRound = _mm_set1_epi32(REMAP_GAIN_ONE / 2);
+
+	__m128i f = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)frac));
+	__m128i fx = _mm_and_si128(f, _mm_set1_epi32(0xff));
+	__m128i fy = _mm_srli_epi32(f, 8);
+
+	// fx and 256 - fx as 16 bits in every channel of their pixel
+	__m128i fx2 = _mm_or_si128(fx, _mm_slli_epi32(fx, 16));
+	__m128i ifx = _mm_sub_epi32(c256, fx);
+	__m128i ifx2 = _mm_or_si128(ifx, _mm_slli_epi32(ifx, 16));
+	// (256 - fy, fy) pairs for the madd
+	__m128i fyPair = _mm_or_si128(_mm_sub_epi32(c256, fy), _mm_slli_epi32(fy, 16));
+
+	for (int half = 0; half < 2; half++)
+	{
+		__m128i a00 = half ? _mm_unpackhi_epi8(p00, zero) : _mm_unpacklo_epi8(p00, zero);
+		__m128i a01 = half ? _mm_unpackhi_epi8(p01, zero) : _mm_unpacklo_epi8(p01, zero);
+		__m128i a10 = half ? _mm_unpackhi_epi8(p10, zero) : _mm_unpacklo_epi8(p10, zero);
+		__m128i a11 = half ? _mm_unpackhi_epi8(p11, zero) : _mm_unpacklo_epi8(p11, zero);
+		__m128i wx = half ? _mm_unpackhi_epi32(fx2, fx2) : _mm_unpacklo_epi32(fx2, fx2);
+		__m128i wix = half ? _mm_unpackhi_epi32(ifx2, ifx2) : _mm_unpacklo_epi32(ifx2, ifx2);
+
+		__m128i top = _mm_add_epi16(_mm_mullo_epi16(a00, wix), _mm_mullo_epi16(a01, wx));
+		__m128i bottom = _mm_add_epi16(_mm_mullo_epi16(a10, wix), _mm_mullo_epi16(a11, wx));
+		top = _mm_xor_si128(top, bias16);
+		bottom = _mm_xor_si128(bottom, bias16);
+
+		// Two pixels: 2 * half and 2 * half + 1
+		for (int k = 0; k < 2; k++)
+		{
+			int pixel = 2 * half + k;
+			__m128i pair = k ? _mm_unpackhi_epi16(top, bottom) : _mm_unpacklo_epi16(top, bottom);
+			__m128i vy;
+			switch (pixel)
+			{
+			case 0: vy = _mm_shuffle_epi32(fyPair, 0x00); break;
+			case 1: vy = _mm_shuffle_epi32(fyPair, 0x55); break;
+			case 2: vy = _mm_shuffle_epi32(fyPair, 0xaa); break;
+			default: vy = _mm_shuffle_epi32(fyPair, 0xff); break;
+			}
+			__m128i s = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(pair, vy), unbias), 8);
+			sample[pixel] = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(s, gain), gainRound), REMAP_GAIN_BITS);
+		}
+	}
+}
+
+// Byte offsets of four blocks, pixelBytes apart across; 0 where invalid
+CPU_TARGET_SSE41
+static inline __m128i remapBlockOffsetsSse41(const uint32_t *xy, size_t pitch, int pixelShift, int pixelBytes, __m128i *valid)
+{
+	__m128i packed = _mm_loadu_si128((const __m128i*)xy);
+	__m128i x = _mm_srai_epi32(_mm_slli_epi32(packed, 16), 16);
+	__m128i y = _mm_srai_epi32(packed, 16);
+	*valid = _mm_cmpgt_epi32(x, _mm_set1_epi32(-1));
+	__m128i across = pixelShift ? _mm_slli_epi32(x, pixelShift) : _mm_mullo_epi32(x, _mm_set1_epi32(pixelBytes));
+	return _mm_and_si128(*valid, _mm_add_epi32(across, _mm_mullo_epi32(y, _mm_set1_epi32((int)pitch))));
+}
+
+CPU_TARGET_SSE41
+static inline __m128i remapLoadTapsSse41(const unsigned char *base, const uint32_t o[4])
+{
+	return _mm_setr_epi32(*(const int*)(base + o[0]), *(const int*)(base + o[1]),
+		*(const int*)(base + o[2]), *(const int*)(base + o[3]));
+}
+
+CPU_TARGET_SSE41
+static inline void remapSampleRgbaSse41(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, __m128i gain, __m128i sample[4], __m128i *valid)
+{
+	uint32_t o[4];
+	_mm_storeu_si128((__m128i*)o, remapBlockOffsetsSse41(xy, pitch, 2, 4, valid));
+	__m128i p00 = remapLoadTapsSse41(src, o);
+	__m128i p01 = remapLoadTapsSse41(src + 4, o);
+	__m128i p10 = remapLoadTapsSse41(src + pitch, o);
+	__m128i p11 = remapLoadTapsSse41(src + pitch + 4, o);
+	remapBilinearPixelsSse41(p00, p01, p10, p11, frac, gain, sample);
+}
+
+// A block's left pixel is the dword at its offset with the next pixel's
+// first byte swapped for alpha, the right one the dword two bytes on,
+// shifted down a byte; neither reads past the block
+CPU_TARGET_SSE41
+static inline void remapSampleBgrSse41(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, __m128i gain, __m128i sample[4], __m128i *valid)
+{
+	const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+
+	uint32_t o[4];
+	_mm_storeu_si128((__m128i*)o, remapBlockOffsetsSse41(xy, pitch, 0, 3, valid));
+	__m128i p00 = _mm_or_si128(remapLoadTapsSse41(src, o), alpha);
+	__m128i p01 = _mm_or_si128(_mm_srli_epi32(remapLoadTapsSse41(src + 2, o), 8), alpha);
+	__m128i p10 = _mm_or_si128(remapLoadTapsSse41(src + pitch, o), alpha);
+	__m128i p11 = _mm_or_si128(_mm_srli_epi32(remapLoadTapsSse41(src + pitch + 2, o), 8), alpha);
+	remapBilinearPixelsSse41(p00, p01, p10, p11, frac, gain, sample);
+}
+
+// For the 4:2:0 planes each plane is worked on as a vector of the four
+// pixels' samples. A dword load at a block's offset holds its left and right
+// taps, spread to (left, right) 16-bit pairs for the horizontal
+// _mm_madd_epi16. After conversion the R, G, B and A vectors are transposed
+// to one vector of channels per pixel, as the packed formats produce them.
+
+// Bilinear 8.8 samples from (left, right) pairs of the top and bottom rows
+CPU_TARGET_SSE41
+static inline __m128i remapBilinearPlaneSse41(__m128i top, __m128i bottom, __m128i fx, __m128i fy)
+{
+	const __m128i c256 = _mm_set1_epi32(256);
+	__m128i fxPair = _mm_or_si128(_mm_sub_epi32(c256, fx), _mm_slli_epi32(fx, 16));
+	__m128i t = _mm_madd_epi16(top, fxPair);
+	__m128i b = _mm_madd_epi16(bottom, fxPair);
+	return _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(t, _mm_sub_epi32(c256, fy)),
+		_mm_mullo_epi32(b, fy)), _mm_set1_epi32(128)), 8);
+}
+
+CPU_TARGET_SSE41
+static inline void remapYuvToRgbaSse41(__m128i y, __m128i u, __m128i v, __m128i gain, bool keepYuv, __m128i sample[4])
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i maxSample = _mm_set1_epi32(REMAP_SAMPLE_MAX);
+	const __m128i gainRound = _mm_set1_epi32(REMAP_GAIN_ONE / 2);
+
+	__m128i r = y, g = u, b = v;
+	if (!keepYuv)
+	{
+		__m128i c = _mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(y, _mm_set1_epi32(16 * 256)), _mm_set1_epi32(298)),
+			_mm_set1_epi32(128));
+		__m128i d = _mm_sub_epi32(u, _mm_set1_epi32(128 * 256));
+		__m128i e = _mm_sub_epi32(v, _mm_set1_epi32(128 * 256));
+		r = _mm_srai_epi32(_mm_add_epi32(c, _mm_mullo_epi32(e, _mm_set1_epi32(409))), 8);
+		g = _mm_srai_epi32(_mm_sub_epi32(_mm_sub_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(100))),
+			_mm_mullo_epi32(e, _mm_set1_epi32(208))), 8);
+		b = _mm_srai_epi32(_mm_add_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(516))), 8);
+		r = _mm_min_epi32(_mm_max_epi32(r, zero), maxSample);
+		g = _mm_min_epi32(_mm_max_epi32(g, zero), maxSample);
+		b = _mm_min_epi32(_mm_max_epi32(b, zero), maxSample);
+	}
+
+	__m128i rg0 = _mm_unpacklo_epi32(r, g);
+	__m128i ba0 = _mm_unpacklo_epi32(b, maxSample);
+	__m128i rg1 = _mm_unpackhi_epi32(r, g);
+	__m128i ba1 = _mm_unpackhi_epi32(b, maxSample);
+	sample[0] = _mm_unpacklo_epi64(rg0, ba0);
+	sample[1] = _mm_unpackhi_epi64(rg0, ba0);
+	sample[2] = _mm_unpacklo_epi64(rg1, ba1);
+	sample[3] = _mm_unpackhi_epi64(rg1, ba1);
+	for (int k = 0; k < 4; k++)
+		sample[k] = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(sample[k], gain), gainRound), REMAP_GAIN_BITS);
+}
+
+// Pixels the camera does not see sample the block at (0, 0), which keeps
+// their chroma positions in range too
+CPU_TARGET_SSE41
+static inline void remapSampleYuvSse41(const remapSource_t *src, const uint32_t *xy, const uint16_t *frac,
+	bool nv12, bool keepYuv, __m128i gain, __m128i sample[4], __m128i *valid)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i byteMask = _mm_set1_epi32(0xff);
+	const __m128i pairMask = _mm_set1_epi32(0x00ff00ff);
+	const __m128i spread = _mm_setr_epi8(0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1, 12, -1, 13, -1);
+	const unsigned char *luma = src->plane[0];
+	size_t lumaPitch = src->pitch[0];
+	size_t chromaPitch = src->pitch[1];
+
+	__m128i packed = _mm_loadu_si128((const __m128i*)xy);
+	*valid = _mm_cmpgt_epi32(_mm_srai_epi32(_mm_slli_epi32(packed, 16), 16), _mm_set1_epi32(-1));
+	packed = _mm_and_si128(packed, *valid);
+	__m128i x = _mm_and_si128(packed, _mm_set1_epi32(0xffff));
+	__m128i y = _mm_srli_epi32(packed, 16);
+	__m128i f = _mm_and_si128(*valid, _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)frac)));
+	__m128i fx = _mm_and_si128(f, byteMask);
+	__m128i fy = _mm_srli_epi32(f, 8);
+
+	uint32_t o[4];
+	_mm_storeu_si128((__m128i*)o, _mm_add_epi32(_mm_mullo_epi32(y, _mm_set1_epi32((int)lumaPitch)), x));
+	__m128i lumaSample = remapBilinearPlaneSse41(_mm_shuffle_epi8(remapLoadTapsSse41(luma, o), spread),
+		_mm_shuffle_epi8(remapLoadTapsSse41(luma + lumaPitch, o), spread), fx, fy);
+
+	__m128i cx = _mm_srli_epi32(_mm_or_si128(_mm_slli_epi32(x, 8), fx), 1);
+	__m128i cy = _mm_sub_epi32(_mm_srli_epi32(_mm_or_si128(_mm_slli_epi32(y, 8), fy), 1), _mm_set1_epi32(64));
+	cx = _mm_min_epi32(cx, _mm_set1_epi32(remapChromaLimit(src->chromaWidth)));
+	cy = _mm_min_epi32(_mm_max_epi32(cy, zero), _mm_set1_epi32(remapChromaLimit(src->chromaHeight)));
+	__m128i cfx = _mm_and_si128(cx, byteMask);
+	__m128i cfy = _mm_and_si128(cy, byteMask);
+	__m128i rowOffset = _mm_mullo_epi32(_mm_srli_epi32(cy, 8), _mm_set1_epi32((int)chromaPitch));
+
+	__m128i u, v;
+	if (nv12)
+	{
+		const unsigned char *uv = src->plane[1];
+		_mm_storeu_si128((__m128i*)o, _mm_add_epi32(rowOffset, _mm_slli_epi32(_mm_srli_epi32(cx, 8), 1)));
+		__m128i top = remapLoadTapsSse41(uv, o);
+		__m128i bottom = remapLoadTapsSse41(uv + chromaPitch, o);
+		u = remapBilinearPlaneSse41(_mm_and_si128(top, pairMask), _mm_and_si128(bottom, pairMask), cfx, cfy);
+		v = remapBilinearPlaneSse41(_mm_and_si128(_mm_srli_epi32(top, 8), pairMask),
+			_mm_and_si128(_mm_srli_epi32(bottom, 8), pairMask), cfx, cfy);
+	}
+	else
+	{
+		const unsigned char *planeU = src->plane[1];
+		const unsigned char *planeV = src->plane[2];
+		_mm_storeu_si128((__m128i*)o, _mm_add_epi32(rowOffset, _mm_srli_epi32(cx, 8)));
+		u = remapBilinearPlaneSse41(_mm_shuffle_epi8(remapLoadTapsSse41(planeU, o), spread),
+			_mm_shuffle_epi8(remapLoadTapsSse41(planeU + chromaPitch, o), spread), cfx, cfy);
+		v = remapBilinearPlaneSse41(_mm_shuffle_epi8(remapLoadTapsSse41(planeV, o), spread),
+			_mm_shuffle_epi8(remapLoadTapsSse41(planeV + chromaPitch, o), spread), cfx, cfy);
+	}
+	remapYuvToRgbaSse41(lumaSample, u, v, gain, keepYuv, sample);
+}
+
+template <remapSourceFormat Format>
+CPU_TARGET_SSE41
+static inline void remapSampleSse41(const remapSource_t *src, const uint32_t *xy, const uint16_t *frac,
+	bool keepYuv, __m128i gain, __m128i sample[4], __m128i *valid)
+{
+	if (Format == REMAP_SOURCE_RGBA8)
+		remapSampleRgbaSse41(src->plane[0], src->pitch[0], xy, frac, gain, sample, valid);
+	else if (Format == REMAP_SOURCE_BGR8)
+		remapSampleBgrSse41(src->plane[0], src->pitch[0], xy, frac, gain, sample, valid);
+	else
+		remapSampleYuvSse41(src, xy, frac, Format == REMAP_SOURCE_NV12, keepYuv, gain, sample, valid);
+}
+
+//***********************************************************************************
+// AVX2: as SSE4.1, eight pixels per call with the taps fetched by gathers.
+// Lanes work on pixels 0-3 and 4-7, so the samples come out as [0 | 4],
+// [1 | 5], [2 | 6], [3 | 7].
+CPU_TARGET_AVX2
+static inline void remapBilinearPixelsAvx2(__m256i p00, __m256i p01, __m256i p10, __m256i p11,
+	const uint16_t *frac, __m256i gain, __m256i sample[4])
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i c256 = _mm256_set1_epi32(256);
+	const __m256i bias16 = _mm256_set1_epi16((short)0x8000);
+	const __m256i unbias = _mm256_set1_epi32(32768 * 256 + 128);
+	const __m256i gainRound = _mm256_set1_epi32(REMAP_GAIN_ONE / 2);
+
+	__m256i f = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)frac));
+	__m256i fx = _mm256_and_si256(f, _mm256_set1_epi32(0xff));
+	__m256i fy = _mm256_srli_epi32(f, 8);
+
+	__m256i fx2 = _mm256_or_si256(fx, _mm256_slli_epi32(fx, 16));
+	__m256i ifx = _mm256_sub_epi32(c256, fx);
+	__m256i ifx2 = _mm256_or_si256(ifx, _mm256_slli_epi32(ifx, 16));
+	__m256i fyPair = _mm256_or_si256(_mm256_sub_epi32(c256, fy), _mm256_slli_epi32(fy, 16));
+
+	// Pixels [0 1 | 4 5], then [2 3 | 6 7]
+	__m256i top[2], bottom[2];
+	{
+		__m256i wx = _mm256_unpacklo_epi32(fx2, fx2);
+		__m256i wix = _mm256_unpacklo_epi32(ifx2, ifx2);
+		top[0] = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(p00, zero), wix),
+			_mm256_mullo_epi16(_mm256_unpacklo_epi8(p01, zero), wx));
+		bottom[0] = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(p10, zero), wix),
+			_mm256_mullo_epi16(_mm256_unpacklo_epi8(p11, zero), wx));
+	}
+	{
+		__m256i wx = _mm256_unpackhi_epi32(fx2, fx2);
+		__m256i wix = _mm256_unpackhi_epi32(ifx2, ifx2);
+		top[1] = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(p00, zero), wix),
+			_mm256_mullo_epi16(_mm256_unpackhi_epi8(p01, zero), wx));
+		bottom[1] = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(p10, zero), wix),
+			_mm256_mullo_epi16(_mm256_unpackhi_epi8(p11, zero), wx));
+	}
+	for (int h = 0; h < 2; h++)
+	{
+		top[h] = _mm256_xor_si256(top[h], bias16);
+		bottom[h] = _mm256_xor_si256(bottom[h], bias16);
+	}
+
+	sample[0] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(
+		_mm256_unpacklo_epi16(top[0], bottom[0]), _mm256_shuffle_epi32(fyPair, 0x00)), unbias), 8);
+	sample[1] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(
+		_mm256_unpackhi_epi16(top[0], bottom[0]), _mm256_shuffle_epi32(fyPair, 0x55)), unbias), 8);
+	sample[2] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(
+		_mm256_unpacklo_epi16(top[1], bottom[1]), _mm256_shuffle_epi32(fyPair, 0xaa)), unbias), 8);
+	sample[3] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(
+		_mm256_unpackhi_epi16(top[1], bottom[1]), _mm256_shuffle_epi32(fyPair, 0xff)), unbias), 8);
+	for (int k = 0; k < 4; k++)
+		sample[k] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(sample[k], gain), gainRound), REMAP_GAIN_BITS);
+}
+
+CPU_TARGET_AVX2
+static inline __m256i remapBlockOffsetsAvx2(const uint32_t *xy, size_t pitch, int pixelShift, int pixelBytes, __m256i *valid)
+{
+	__m256i packed = _mm256_loadu_si256((const __m256i*)xy);
+	__m256i x = _mm256_srai_epi32(_mm256_slli_epi32(packed, 16), 16);
+	__m256i y = _mm256_srai_epi32(packed, 16);
+	*valid = _mm256_cmpgt_epi32(x, _mm256_set1_epi32(-1));
+	__m256i across = pixelShift ? _mm256_slli_epi32(x, pixelShift) : _mm256_mullo_epi32(x, _mm256_set1_epi32(pixelBytes));
+	return _mm256_and_si256(*valid, _mm256_add_epi32(across, _mm256_mullo_epi32(y, _mm256_set1_epi32((int)pitch))));
+}
+
+CPU_TARGET_AVX2
+static inline void remapSampleRgbaAvx2(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, __m256i gain, __m256i sample[4], __m256i *valid)
+{
+	__m256i offset = remapBlockOffsetsAvx2(xy, pitch, 2, 4, valid);
+	__m256i p00 = _mm256_i32gather_epi32((const int*)src, offset, 1);
+	__m256i p01 = _mm256_i32gather_epi32((const int*)(src + 4), offset, 1);
+	__m256i p10 = _mm256_i32gather_epi32((const int*)(src + pitch), offset, 1);
+	__m256i p11 = _mm256_i32gather_epi32((const int*)(src + pitch + 4), offset, 1);
+	remapBilinearPixelsAvx2(p00, p01, p10, p11, frac, gain, sample);
+}
+
+CPU_TARGET_AVX2
+static inline void remapSampleBgrAvx2(const unsigned char *src, size_t pitch,
+	const uint32_t *xy, const uint16_t *frac, __m256i gain, __m256i sample[4], __m256i *valid)
+{
+	const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+
+	__m256i offset = remapBlockOffsetsAvx2(xy, pitch, 0, 3, valid);
+	__m256i p00 = _mm256_or_si256(_mm256_i32gather_epi32((const int*)src, offset, 1), alpha);
+	__m256i p01 = _mm256_or_si256(_mm256_srli_epi32(_mm256_i32gather_epi32((const int*)(src + 2), offset, 1), 8), alpha);
+	__m256i p10 = _mm256_or_si256(_mm256_i32gather_epi32((const int*)(src + pitch), offset, 1), alpha);
+	__m256i p11 = _mm256_or_si256(_mm256_srli_epi32(_mm256_i32gather_epi32((const int*)(src + pitch + 2), offset, 1), 8),
+		alpha);
+	remapBilinearPixelsAvx2(p00, p01, p10, p11, frac, gain, sample);
+}
+
+CPU_TARGET_AVX2
+static inline __m256i remapBilinearPlaneAvx2(__m256i top, __m256i bottom, __m256i fx, __m256i fy)
+{
+	const __m256i c256 = _mm256_set1_epi32(256);
+	__m256i fxPair = _mm256_or_si256(_mm256_sub_epi32(c256, fx), _mm256_slli_epi32(fx, 16));
+	__m256i t = _mm256_madd_epi16(top, fxPair);
+	__m256i b = _mm256_madd_epi16(bottom, fxPair);
+	return _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(t, _mm256_sub_epi32(c256, fy)),
+		_mm256_mullo_epi32(b, fy)), _mm256_set1_epi32(128)), 8);
+}
+
+CPU_TARGET_AVX2
+static inline void remapYuvToRgbaAvx2(__m256i y, __m256i u, __m256i v, __m256i gain, bool keepYuv, __m256i sample[4])
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i maxSample = _mm256_set1_epi32(REMAP_SAMPLE_MAX);
+	const __m256i gainRound = _mm256_set1_epi32(REMAP_GAIN_ONE / 2);
+
+	__m256i r = y, g = u, b = v;
+	if (!keepYuv)
+	{
+		__m256i c = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(y, _mm256_set1_epi32(16 * 256)),
+			_mm256_set1_epi32(298)), _mm256_set1_epi32(128));
+		__m256i d = _mm256_sub_epi32(u, _mm256_set1_epi32(128 * 256));
+		__m256i e = _mm256_sub_epi32(v, _mm256_set1_epi32(128 * 256));
+		r = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_mullo_epi32(e, _mm256_set1_epi32(409))), 8);
+		g = _mm256_srai_epi32(_mm256_sub_epi32(_mm256_sub_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(100))),
+			_mm256_mullo_epi32(e, _mm256_set1_epi32(208))), 8);
+		b = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(516))), 8);
+		r = _mm256_min_epi32(_mm256_max_epi32(r, zero), maxSample);
+		g = _mm256_min_epi32(_mm256_max_epi32(g, zero), maxSample);
+		b = _mm256_min_epi32(_mm256_max_epi32(b, zero), maxSample);
+	}
+
+	__m256i rg0 = _mm256_unpacklo_epi32(r, g);
+	__m256i ba0 = _mm256_unpacklo_epi32(b, maxSample);
+	__m256i rg1 = _mm256_unpackhi_epi32(r, g);
+	__m256i ba1 = _mm256_unpackhi_epi32(b, maxSample);
+	sample[0] = _mm256_unpacklo_epi64(rg0, ba0);
+	sample[1] = _mm256_unpackhi_epi64(rg0, ba0);
+	sample[2] = _mm256_unpacklo_epi64(rg1, ba1);
+	sample[3] = _mm256_unpackhi_epi64(rg1, ba1);
+	for (int k = 0; k < 4; k++)
+		sample[k] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(sample[k], gain), gainRound), REMAP_GAIN_BITS);
+}
+
+CPU_TARGET_AVX2
+static inline void remapSampleYuvAvx2(const remapSource_t *src, const uint32_t *xy, const uint16_t *frac,
+	bool nv12, bool keepYuv, __m256i gain, __m256i sample[4], __m256i *valid)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i byteMask = _mm256_set1_epi32(0xff);
+	const __m256i pairMask = _mm256_set1_epi32(0x00ff00ff);
+	const __m256i spread = _mm256_setr_epi8(0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1, 12, -1, 13, -1,
+		0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1, 12, -1, 13, -1);
+	const int *luma = (const int*)src->plane[0];
+	const int *lumaBelow = (const int*)(src->plane[0] + src->pitch[0]);
+	size_t chromaPitch = src->pitch[1];
+
+	__m256i packed = _mm256_loadu_si256((const __m256i*)xy);
+	*valid = _mm256_cmpgt_epi32(_mm256_srai_epi32(_mm256_slli_epi32(packed, 16), 16), _mm256_set1_epi32(-1));
+	packed = _mm256_and_si256(packed, *valid);
+	__m256i x = _mm256_and_si256(packed, _mm256_set1_epi32(0xffff));
+	__m256i y = _mm256_srli_epi32(packed, 16);
+	__m256i f = _mm256_and_si256(*valid, _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)frac)));
+	__m256i fx = _mm256_and_si256(f, byteMask);
+	__m256i fy = _mm256_srli_epi32(f, 8);
+
+	__m256i offset = _mm256_add_epi32(_mm256_mullo_epi32(y, _mm256_set1_epi32((int)src->pitch[0])), x);
+	__m256i lumaSample = remapBilinearPlaneAvx2(_mm256_shuffle_epi8(_mm256_i32gather_epi32(luma, offset, 1), spread),
+		_mm256_shuffle_epi8(_mm256_i32gather_epi32(lumaBelow, offset, 1), spread), fx, fy);
+
+	__m256i cx = _mm256_srli_epi32(_mm256_or_si256(_mm256_slli_epi32(x, 8), fx), 1);
+	__m256i cy = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_or_si256(_mm256_slli_epi32(y, 8), fy), 1),
+		_mm256_set1_epi32(64));
+	cx = _mm256_min_epi32(cx, _mm256_set1_epi32(remapChromaLimit(src->chromaWidth)));
+	cy = _mm256_min_epi32(_mm256_max_epi32(cy, zero), _mm256_set1_epi32(remapChromaLimit(src->chromaHeight)));
+	__m256i cfx = _mm256_and_si256(cx, byteMask);
+	__m256i cfy = _mm256_and_si256(cy, byteMask);
+	__m256i rowOffset = _mm256_mullo_epi32(_mm256_srli_epi32(cy, 8), _mm256_set1_epi32((int)chromaPitch));
+
+	__m256i u, v;
+	if (nv12)
+	{
+		const int *uv = (const int*)src->plane[1];
+		const int *uvBelow = (const int*)(src->plane[1] + chromaPitch);
+		offset = _mm256_add_epi32(rowOffset, _mm256_slli_epi32(_mm256_srli_epi32(cx, 8), 1));
+		__m256i top = _mm256_i32gather_epi32(uv, offset, 1);
+		__m256i bottom = _mm256_i32gather_epi32(uvBelow, offset, 1);
+		u = remapBilinearPlaneAvx2(_mm256_and_si256(top, pairMask), _mm256_and_si256(bottom, pairMask), cfx, cfy);
+		v = remapBilinearPlaneAvx2(_mm256_and_si256(_mm256_srli_epi32(top, 8), pairMask),
+			_mm256_and_si256(_mm256_srli_epi32(bottom, 8), pairMask), cfx, cfy);
+	}
+	else
+	{
+		const int *planeU = (const int*)src->plane[1];
+		const int *planeUBelow = (const int*)(src->plane[1] + chromaPitch);
+		const int *planeV = (const int*)src->plane[2];
+		const int *planeVBelow = (const int*)(src->plane[2] + chromaPitch);
+		offset = _mm256_add_epi32(rowOffset, _mm256_srli_epi32(cx, 8));
+		u = remapBilinearPlaneAvx2(_mm256_shuffle_epi8(_mm256_i32gather_epi32(planeU, offset, 1), spread),
+			_mm256_shuffle_epi8(_mm256_i32gather_epi32(planeUBelow, offset, 1), spread), cfx, cfy);
+		v = remapBilinearPlaneAvx2(_mm256_shuffle_epi8(_mm256_i32gather_epi32(planeV, offset, 1), spread),
+			_mm256_shuffle_epi8(_mm256_i32gather_epi32(planeVBelow, offset, 1), spread), cfx, cfy);
+	}
+	remapYuvToRgbaAvx2(lumaSample, u, v, gain, keepYuv, sample);
+}
+
+template <remapSourceFormat Format>
+CPU_TARGET_AVX2
+static inline void remapSampleAvx2(const remapSource_t *src, const uint32_t *xy, const uint16_t *frac,
+	bool keepYuv, __m256i gain, __m256i sample[4], __m256i *valid)
+{
+	if (Format == REMAP_SOURCE_RGBA8)
+		remapSampleRgbaAvx2(src->plane[0], src->pitch[0], xy, frac, gain, sample, valid);
+	else if (Format == REMAP_SOURCE_BGR8)
+		remapSampleBgrAvx2(src->plane[0], src->pitch[0], xy, frac, gain, sample, valid);
+	else
+		remapSampleYuvAvx2(src, xy, frac, Format == REMAP_SOURCE_NV12, keepYuv, gain, sample, valid);
+}
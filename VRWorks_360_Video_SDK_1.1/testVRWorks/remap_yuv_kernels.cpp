@@ -0,0 +1,376 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "remap_yuv_kernels.h"
+#include "remap_samplers.h"
+#include "cpu_features.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+// The I420, NV12 and BGR8 kernels are one template over the format, which
+// remap_samplers.h folds into the sampling; the public functions below pick
+// the instance for a source.
+
+template <remapSourceFormat Format>
+static void accumulateRowScalar(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	bool keepYuv = src->keepYuv != 0;
+	for (uint32_t i = 0; i < count; i++, acc += 4)
+	{
+		if ((int16_t)(xy[i] & 0xffff) < 0)
+			continue;
+		uint32_t w = (uint32_t)weight[i] + 1;
+		uint32_t sample[4];
+		remapSampleScalar<Format>(src, xy[i], frac[i], keepYuv, sample);
+		for (int c = 0; c < 4; c++)
+			acc[c] += ((sample[c] * gain[c] + REMAP_GAIN_ONE / 2) >> REMAP_GAIN_BITS) * w;
+	}
+}
+
+template <remapSourceFormat Format>
+static void copyRowScalar(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	bool keepYuv = src->keepYuv != 0;
+	for (uint32_t i = 0; i < count; i++, dst += 4)
+	{
+		uint32_t sample[4];
+		remapSampleScalar<Format>(src, xy[i], frac[i], keepYuv, sample);
+		for (int c = 0; c < 4; c++)
+		{
+			uint32_t value = (((sample[c] * gain[c] + REMAP_GAIN_ONE / 2) >> REMAP_GAIN_BITS) + 128) >> 8;
+			dst[c] = (unsigned char)(value < 255 ? value : 255);
+		}
+	}
+}
+
+//***********************************************************************************
+// Four pixels per iteration
+template <remapSourceFormat Format>
+CPU_TARGET_SSE41
+static void accumulateRowSse41(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	const __m128i channelGain = _mm_loadu_si128((const __m128i*)gain);
+	bool keepYuv = src->keepYuv != 0;
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i sample[4], valid;
+		remapSampleSse41<Format>(src, xy + i, frac + i, keepYuv, channelGain, sample, &valid);
+		__m128i w = _mm_and_si128(valid, _mm_add_epi32(
+			_mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(const int*)(weight + i))), _mm_set1_epi32(1)));
+
+		__m128i sum[4];
+		sum[0] = _mm_mullo_epi32(sample[0], _mm_shuffle_epi32(w, 0x00));
+		sum[1] = _mm_mullo_epi32(sample[1], _mm_shuffle_epi32(w, 0x55));
+		sum[2] = _mm_mullo_epi32(sample[2], _mm_shuffle_epi32(w, 0xaa));
+		sum[3] = _mm_mullo_epi32(sample[3], _mm_shuffle_epi32(w, 0xff));
+		for (int pixel = 0; pixel < 4; pixel++)
+		{
+			__m128i *a = (__m128i*)(acc + (i + pixel) * 4);
+			_mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), sum[pixel]));
+		}
+	}
+	accumulateRowScalar<Format>(src, xy + i, frac + i, weight + i, gain, count - i, acc + i * 4);
+}
+
+template <remapSourceFormat Format>
+CPU_TARGET_SSE41
+static void copyRowSse41(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	const __m128i round = _mm_set1_epi32(128);
+	const __m128i channelGain = _mm_loadu_si128((const __m128i*)gain);
+	bool keepYuv = src->keepYuv != 0;
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i sample[4], valid;
+		remapSampleSse41<Format>(src, xy + i, frac + i, keepYuv, channelGain, sample, &valid);
+		for (int pixel = 0; pixel < 4; pixel++)
+			sample[pixel] = _mm_srli_epi32(_mm_add_epi32(sample[pixel], round), 8);
+		__m128i bytes = _mm_packus_epi16(_mm_packus_epi32(sample[0], sample[1]), _mm_packus_epi32(sample[2], sample[3]));
+		_mm_storeu_si128((__m128i*)(dst + i * 4), bytes);
+	}
+	copyRowScalar<Format>(src, xy + i, frac + i, gain, count - i, dst + i * 4);
+}
+
+// Eight pixels per iteration, the samples coming out as [0 | 4], [1 | 5],
+// [2 | 6], [3 | 7] as in the RGBA8 AVX2 kernels
+template <remapSourceFormat Format>
+CPU_TARGET_AVX2
+static void accumulateRowAvx2(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	const __m256i channelGain = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)gain));
+	bool keepYuv = src->keepYuv != 0;
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i s[4], valid;
+		remapSampleAvx2<Format>(src, xy + i, frac + i, keepYuv, channelGain, s, &valid);
+		__m256i w = _mm256_and_si256(valid, _mm256_add_epi32(
+			_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(weight + i))), _mm256_set1_epi32(1)));
+
+		__m256i s0 = _mm256_mullo_epi32(s[0], _mm256_shuffle_epi32(w, 0x00));
+		__m256i s1 = _mm256_mullo_epi32(s[1], _mm256_shuffle_epi32(w, 0x55));
+		__m256i s2 = _mm256_mullo_epi32(s[2], _mm256_shuffle_epi32(w, 0xaa));
+		__m256i s3 = _mm256_mullo_epi32(s[3], _mm256_shuffle_epi32(w, 0xff));
+
+		__m256i *a = (__m256i*)(acc + i * 4);
+		_mm256_storeu_si256(a + 0, _mm256_add_epi32(_mm256_loadu_si256(a + 0), _mm256_permute2x128_si256(s0, s1, 0x20)));
+		_mm256_storeu_si256(a + 1, _mm256_add_epi32(_mm256_loadu_si256(a + 1), _mm256_permute2x128_si256(s2, s3, 0x20)));
+		_mm256_storeu_si256(a + 2, _mm256_add_epi32(_mm256_loadu_si256(a + 2), _mm256_permute2x128_si256(s0, s1, 0x31)));
+		_mm256_storeu_si256(a + 3, _mm256_add_epi32(_mm256_loadu_si256(a + 3), _mm256_permute2x128_si256(s2, s3, 0x31)));
+	}
+	accumulateRowScalar<Format>(src, xy + i, frac + i, weight + i, gain, count - i, acc + i * 4);
+}
+
+template <remapSourceFormat Format>
+CPU_TARGET_AVX2
+static void copyRowAvx2(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	const __m256i round = _mm256_set1_epi32(128);
+	const __m256i channelGain = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)gain));
+	bool keepYuv = src->keepYuv != 0;
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i s[4], valid;
+		remapSampleAvx2<Format>(src, xy + i, frac + i, keepYuv, channelGain, s, &valid);
+		for (int k = 0; k < 4; k++)
+			s[k] = _mm256_srli_epi32(_mm256_add_epi32(s[k], round), 8);
+		__m256i bytes = _mm256_packus_epi16(_mm256_packus_epi32(s[0], s[1]), _mm256_packus_epi32(s[2], s[3]));
+		_mm256_storeu_si256((__m256i*)(dst + i * 4), bytes);
+	}
+	copyRowScalar<Format>(src, xy + i, frac + i, gain, count - i, dst + i * 4);
+}
+
+template <remapSourceFormat Format>
+static void accumulateRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		accumulateRowAvx2<Format>(src, xy, frac, weight, gain, count, acc);
+		break;
+	case CPU_SIMD_SSE41:
+		accumulateRowSse41<Format>(src, xy, frac, weight, gain, count, acc);
+		break;
+	default:
+		accumulateRowScalar<Format>(src, xy, frac, weight, gain, count, acc);
+		break;
+	}
+}
+
+template <remapSourceFormat Format>
+static void copyRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		copyRowAvx2<Format>(src, xy, frac, gain, count, dst);
+		break;
+	case CPU_SIMD_SSE41:
+		copyRowSse41<Format>(src, xy, frac, gain, count, dst);
+		break;
+	default:
+		copyRowScalar<Format>(src, xy, frac, gain, count, dst);
+		break;
+	}
+}
+
+//***********************************************************************************
+void remapAccumulateYuvRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	if (src->format == REMAP_SOURCE_NV12)
+		accumulateRow<REMAP_SOURCE_NV12>(src, xy, frac, weight, gain, count, acc);
+	else
+		accumulateRow<REMAP_SOURCE_I420>(src, xy, frac, weight, gain, count, acc);
+}
+
+void remapCopyYuvRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	if (src->format == REMAP_SOURCE_NV12)
+		copyRow<REMAP_SOURCE_NV12>(src, xy, frac, gain, count, dst);
+	else
+		copyRow<REMAP_SOURCE_I420>(src, xy, frac, gain, count, dst);
+}
+
+void remapAccumulateYuvRowScalar(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	if (src->format == REMAP_SOURCE_NV12)
+		accumulateRowScalar<REMAP_SOURCE_NV12>(src, xy, frac, weight, gain, count, acc);
+	else
+		accumulateRowScalar<REMAP_SOURCE_I420>(src, xy, frac, weight, gain, count, acc);
+}
+
+void remapCopyYuvRowScalar(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	if (src->format == REMAP_SOURCE_NV12)
+		copyRowScalar<REMAP_SOURCE_NV12>(src, xy, frac, gain, count, dst);
+	else
+		copyRowScalar<REMAP_SOURCE_I420>(src, xy, frac, gain, count, dst);
+}
+
+void remapAccumulateBgrRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	accumulateRow<REMAP_SOURCE_BGR8>(src, xy, frac, weight, gain, count, acc);
+}
+
+void remapCopyBgrRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	copyRow<REMAP_SOURCE_BGR8>(src, xy, frac, gain, count, dst);
+}
+
+void remapAccumulateBgrRowScalar(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	accumulateRowScalar<REMAP_SOURCE_BGR8>(src, xy, frac, weight, gain, count, acc);
+}
+
+void remapCopyBgrRowScalar(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	copyRowScalar<REMAP_SOURCE_BGR8>(src, xy, frac, gain, count, dst);
+}
+
+//***********************************************************************************
+void remapAccumulateSourceRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc)
+{
+	switch (src->format)
+	{
+	case REMAP_SOURCE_RGBA8:
+		remapAccumulateRow(src->plane[0], src->pitch[0], xy, frac, weight, gain, count, acc);
+		break;
+	case REMAP_SOURCE_BGR8:
+		remapAccumulateBgrRow(src, xy, frac, weight, gain, count, acc);
+		break;
+	default:
+		remapAccumulateYuvRow(src, xy, frac, weight, gain, count, acc);
+		break;
+	}
+}
+
+void remapCopySourceRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst)
+{
+	switch (src->format)
+	{
+	case REMAP_SOURCE_RGBA8:
+		remapCopyRow(src->plane[0], src->pitch[0], xy, frac, gain, count, dst);
+		break;
+	case REMAP_SOURCE_BGR8:
+		remapCopyBgrRow(src, xy, frac, gain, count, dst);
+		break;
+	default:
+		remapCopyYuvRow(src, xy, frac, gain, count, dst);
+		break;
+	}
+}
+
+void remapSourcePixel(const remapSource_t *src, uint32_t x, uint32_t y, unsigned char rgba[4])
+{
+	if (src->format == REMAP_SOURCE_RGBA8)
+	{
+		memcpy(rgba, src->plane[0] + (size_t)y * src->pitch[0] + (size_t)x * 4, 4);
+		return;
+	}
+	if (src->format == REMAP_SOURCE_BGR8)
+	{
+		memcpy(rgba, src->plane[0] + (size_t)y * src->pitch[0] + (size_t)x * 3, 3);
+		rgba[3] = 255;
+		return;
+	}
+
+	uint32_t cx = x >> 1 < src->chromaWidth ? x >> 1 : src->chromaWidth - 1;
+	uint32_t cy = y >> 1 < src->chromaHeight ? y >> 1 : src->chromaHeight - 1;
+	const unsigned char *chroma = src->plane[1] + (size_t)cy * src->pitch[1];
+	int32_t u, v;
+	if (src->format == REMAP_SOURCE_NV12)
+	{
+		u = chroma[cx * 2];
+		v = chroma[cx * 2 + 1];
+	}
+	else
+	{
+		u = chroma[cx];
+		v = src->plane[2][(size_t)cy * src->pitch[1] + cx];
+	}
+	uint32_t sample[4];
+	remapYuvToRgba(src->plane[0][(size_t)y * src->pitch[0] + x] << 8, u << 8, v << 8, sample);
+	for (int c = 0; c < 4; c++)
+		rgba[c] = (unsigned char)((sample[c] + 128) >> 8);
+}
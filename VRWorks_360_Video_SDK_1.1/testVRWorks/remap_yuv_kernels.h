@@ -0,0 +1,142 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include "remap_kernels.h"
+
+// ==== Bilinear remap of 4:2:0 YUV images ====
+// Decoders hand over planar luma and half-size chroma; sampling them in place
+// saves expanding every frame to RGBA first. The kernels take the same tables
+// as the RGBA8 ones in remap_kernels.h: the luma position comes straight from
+// the table, and the chroma position is half of it, sited as H.264 and MPEG-2
+// place chroma (on even luma columns, halfway between luma rows) and clamped
+// to the chroma plane, in 1/256ths of a chroma pixel:
+//   cx = (x * 256 + fx) / 2
+//   cy = (y * 256 + fy) / 2 - 64
+// Each plane is interpolated to 8.8 fixed point as the RGBA8 channels are,
+// and the three converted with the integer BT.601 limited-range matrix
+//   c = 298 * (Y - 16 * 256) + 128,  d = U - 128 * 256,  e = V - 128 * 256
+//   R = (c + 409 * e) >> 8
+//   G = (c - 100 * d - 208 * e) >> 8
+//   B = (c + 516 * d) >> 8
+// clamped to [0, 255 * 256], alpha at 255 * 256. Gains, weights and rounding
+// then follow the RGBA8 kernels, so the accumulators, the blender and the
+// output see RGBA whatever the input. Sources marked keepYuv skip the
+// matrix and leave Y, U, V and alpha in the channels instead, for 4:2:0
+// output made from 4:2:0 inputs (pack_yuv_kernels.h). As with the RGBA8
+// kernels, all give the same bits as the scalar ones.
+//
+// BGR8 sources are the 3-byte frames capture cards and OpenCV deliver,
+// sampled in place as well instead of being expanded to RGBA first. They
+// come out as B, G, R and an opaque alpha, in that order, so a panorama
+// stitched from them is BGRA.
+
+typedef enum
+{
+	REMAP_SOURCE_RGBA8 = 0,
+	REMAP_SOURCE_I420 = 1,
+	REMAP_SOURCE_NV12 = 2,
+	REMAP_SOURCE_BGR8 = 3,
+} remapSourceFormat;
+
+// Bytes the kernels may read past the end of a row, the last row included;
+// 4:2:0 planes must be allocated with them
+#define REMAP_SOURCE_ROW_SLACK 2
+
+// One camera's image as the kernels read it
+typedef struct remapSource_st
+{
+	remapSourceFormat format;
+	const unsigned char *plane[3];  //!< RGBA8, BGR8: the image; I420: Y, U, V; NV12: Y, interleaved UV
+	size_t pitch[2];                //!< Luma (or RGBA8, BGR8) pitch, then the pitch of the chroma planes
+	uint32_t chromaWidth;           //!< Chroma plane size in samples, at least 2 x 2
+	uint32_t chromaHeight;
+	uint32_t keepYuv;               //!< 4:2:0 only: 1 leaves the samples as Y, U, V, alpha, unconverted
+} remapSource_t;
+
+// remapAccumulateRow() and remapCopyRow() for any source, picking the RGBA8,
+// BGR8 or YUV kernel by its format
+void remapAccumulateSourceRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc);
+void remapCopySourceRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst);
+
+// RGBA8 of the pixel at (x, y) and the chroma sample over it, for
+// statistics; converted whether or not the source is keepYuv. BGR8 sources
+// give B, G, R, 255.
+void remapSourcePixel(const remapSource_t *src, uint32_t x, uint32_t y, unsigned char rgba[4]);
+
+// The 4:2:0 kernels, selected at runtime as the RGBA8 ones
+void remapAccumulateYuvRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc);
+void remapCopyYuvRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst);
+
+// The BGR8 kernels, selected the same way
+void remapAccumulateBgrRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc);
+void remapCopyBgrRow(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst);
+
+// The 4:2:0 and BGR8 kernels forced to scalar, for kernelCheckRun(); the
+// SIMD kernels finish their rows with the same code
+void remapAccumulateYuvRowScalar(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc);
+void remapCopyYuvRowScalar(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst);
+void remapAccumulateBgrRowScalar(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint8_t *weight, const uint32_t *gain,
+	uint32_t count, uint32_t *acc);
+void remapCopyBgrRowScalar(const remapSource_t *src,
+	const uint32_t *xy, const uint16_t *frac, const uint32_t *gain, uint32_t count, unsigned char *dst);
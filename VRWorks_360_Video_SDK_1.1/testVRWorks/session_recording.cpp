@@ -0,0 +1,334 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "session_recording.h"
+#include "pano_publisher.h"
+
+#include <atomic>
+#include <iostream>
+#include <string.h>
+#include <thread>
+
+using std::chrono::steady_clock;
+
+// Header bytes reserved ahead of the first record
+static const uint32_t RECORDING_HEADER_BYTES = 64;
+
+// IMU traffic received up to this long after a frame's capture is delivered
+// before the frame, as the live pipeline has those samples by the time it
+// publishes. Keeps pose interpolation the same in fast replay.
+static const uint64_t IMU_LOOKAHEAD_US = 100000;
+
+static_assert(sizeof(recordingFileHeader_t) <= RECORDING_HEADER_BYTES, "file header must fit before the first record");
+static_assert(sizeof(recordingRecordHeader_t) % RECORDING_ALIGN == 0, "payloads must stay aligned");
+
+static inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static inline uint64_t recordBytes(uint64_t payloadBytes)
+{
+	return alignUp(sizeof(recordingRecordHeader_t) + payloadBytes, RECORDING_ALIGN);
+}
+
+//***********************************************************************************
+SessionRecorder::SessionRecorder()
+	: m_header(nullptr), m_pending(0), m_failed(false)
+{
+}
+
+bool
+SessionRecorder::create(const std::string &path, size_t initialBytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	size_t bytes = initialBytes > RECORDING_HEADER_BYTES * 2 ? initialBytes : RECORDING_HEADER_BYTES * 2;
+	if (!m_file.create(path, bytes))
+		return false;
+
+	m_header = (recordingFileHeader_t*)m_file.data();
+	memset(m_header, 0, RECORDING_HEADER_BYTES);
+	m_header->version = RECORDING_VERSION;
+	m_header->header_bytes = RECORDING_HEADER_BYTES;
+	m_header->start_us = panoSteadyTimeUs();
+	m_header->magic = RECORDING_MAGIC;
+	m_pending = 0;
+	m_failed = false;
+	return true;
+}
+
+void
+SessionRecorder::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_header)
+		return;
+
+	size_t length = (size_t)(m_header->header_bytes + m_header->data_bytes);
+	m_header = nullptr;
+	m_file.close(length);
+}
+
+unsigned char*
+SessionRecorder::beginRecord(recordingRecordType type, uint32_t event, size_t payloadBytes, uint64_t timeUs)
+{
+	if (!m_header || m_failed)
+		return nullptr;
+
+	uint64_t offset = m_header->header_bytes + m_header->data_bytes;
+	uint64_t end = offset + recordBytes(payloadBytes);
+	if (end > m_file.size())
+	{
+		size_t bytes = m_file.size();
+		while (bytes < end)
+			bytes *= 2;
+		if (!m_file.grow(bytes))
+		{
+			// Keep the recording up to here rather than a torn record
+			std::cerr << "Recording full at " << offset << " bytes, no longer recording" << std::endl;
+			m_header = (recordingFileHeader_t*)m_file.data();
+			m_failed = true;
+			return nullptr;
+		}
+		m_header = (recordingFileHeader_t*)m_file.data();
+	}
+
+	recordingRecordHeader_t *record = (recordingRecordHeader_t*)(m_file.data() + offset);
+	record->type = type;
+	record->event = event;
+	record->payload_bytes = payloadBytes;
+	record->timestamp_us = timeUs;
+	m_pending = end - m_header->header_bytes;
+	return (unsigned char*)(record + 1);
+}
+
+void
+SessionRecorder::commitRecord(recordingRecordType type)
+{
+	if (type == RECORDING_RECORD_FRAME)
+		m_header->frame_count++;
+	else
+		m_header->imu_count++;
+
+	// A reader of a live recording sees only complete records
+	reinterpret_cast<std::atomic<uint64_t>*>(&m_header->data_bytes)->store(m_pending, std::memory_order_release);
+}
+
+bool
+SessionRecorder::appendFrame(const cv::Mat &frame, uint64_t captureTimeUs)
+{
+	if (frame.empty() || frame.depth() != CV_8U)
+		return false;
+
+	recordingFrameHeader_t info;
+	info.width = (uint32_t)frame.cols;
+	info.height = (uint32_t)frame.rows;
+	info.channels = (uint32_t)frame.channels();
+	info.stride = info.width * info.channels;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	unsigned char *payload = beginRecord(RECORDING_RECORD_FRAME, 0,
+		sizeof(info) + (size_t)info.stride * info.height, captureTimeUs);
+	if (!payload)
+		return false;
+
+	memcpy(payload, &info, sizeof(info));
+	payload += sizeof(info);
+	for (uint32_t y = 0; y < info.height; y++)
+		memcpy(payload + (size_t)y * info.stride, frame.ptr(y), info.stride);
+
+	commitRecord(RECORDING_RECORD_FRAME);
+	return true;
+}
+
+bool
+SessionRecorder::appendImu(orientationEvent event, const char *data, size_t bytes, uint64_t receiveTimeUs)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	unsigned char *payload = beginRecord(RECORDING_RECORD_IMU, event, bytes, receiveTimeUs);
+	if (!payload)
+		return false;
+
+	if (bytes > 0)
+		memcpy(payload, data, bytes);
+
+	commitRecord(RECORDING_RECORD_IMU);
+	return true;
+}
+
+uint64_t
+SessionRecorder::frameCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_header ? m_header->frame_count : 0;
+}
+
+uint64_t
+SessionRecorder::dataBytes() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_header ? m_header->data_bytes : 0;
+}
+
+//***********************************************************************************
+ReplayFrameSource::ReplayFrameSource(bool fast)
+	: m_header(nullptr), m_fast(fast), m_started(false), m_offsetUs(0),
+	m_frameOffset(0), m_imuOffset(0), m_frameCount(0), m_lastCaptureUs(0)
+{
+}
+
+bool
+ReplayFrameSource::open(const std::string &path)
+{
+	m_header = nullptr;
+	if (!m_file.open(path))
+		return false;
+
+	const recordingFileHeader_t *header = (const recordingFileHeader_t*)m_file.data();
+	if (m_file.size() < sizeof(*header) || header->magic != RECORDING_MAGIC || header->version != RECORDING_VERSION)
+	{
+		std::cerr << path << " is not a version " << RECORDING_VERSION << " recording" << std::endl;
+		m_file.close();
+		return false;
+	}
+	if (header->header_bytes + header->data_bytes > m_file.size())
+	{
+		std::cerr << path << " is truncated" << std::endl;
+		m_file.close();
+		return false;
+	}
+
+	m_header = header;
+	m_started = false;
+	m_frameOffset = 0;
+	m_imuOffset = 0;
+	m_frameCount = 0;
+	return true;
+}
+
+bool
+ReplayFrameSource::next(recordingRecordType type, uint64_t &offset, const recordingRecordHeader_t **record) const
+{
+	while (offset + sizeof(recordingRecordHeader_t) <= m_header->data_bytes)
+	{
+		const recordingRecordHeader_t *r =
+			(const recordingRecordHeader_t*)(m_file.data() + m_header->header_bytes + offset);
+		if (offset + recordBytes(r->payload_bytes) > m_header->data_bytes)
+			return false;
+		if (r->type == (uint32_t)type)
+		{
+			*record = r;
+			return true;
+		}
+		offset += recordBytes(r->payload_bytes);
+	}
+	return false;
+}
+
+bool
+ReplayFrameSource::read(cv::Mat &frame)
+{
+	if (!m_header)
+		return false;
+
+	const recordingRecordHeader_t *record = nullptr;
+	bool more = next(RECORDING_RECORD_FRAME, m_frameOffset, &record);
+	uint64_t recordedUs = more ? record->timestamp_us : UINT64_MAX;
+
+	// Replay time runs from the first frame
+	if (!m_started && more)
+	{
+		m_offsetUs = (int64_t)panoSteadyTimeUs() - (int64_t)recordedUs;
+		m_started = true;
+	}
+
+	if (more && !m_fast)
+	{
+		uint64_t due = (uint64_t)((int64_t)recordedUs + m_offsetUs);
+		uint64_t now = panoSteadyTimeUs();
+		if (due > now)
+			std::this_thread::sleep_for(std::chrono::microseconds(due - now));
+	}
+
+	// IMU traffic around this frame, or all that is left at the end
+	const recordingRecordHeader_t *imu = nullptr;
+	while (next(RECORDING_RECORD_IMU, m_imuOffset, &imu) &&
+		(!more || imu->timestamp_us <= recordedUs + IMU_LOOKAHEAD_US))
+	{
+		if (m_imuSink)
+			m_imuSink((orientationEvent)imu->event, (const char*)(imu + 1), (size_t)imu->payload_bytes,
+				(uint64_t)((int64_t)imu->timestamp_us + m_offsetUs));
+		m_imuOffset += recordBytes(imu->payload_bytes);
+	}
+
+	if (!more)
+		return false;
+
+	const recordingFrameHeader_t *info = (const recordingFrameHeader_t*)(record + 1);
+	const unsigned char *rows = (const unsigned char*)(info + 1);
+	frame.create((int)info->height, (int)info->width, CV_8UC(info->channels));
+	size_t rowBytes = (size_t)info->width * info->channels;
+	for (uint32_t y = 0; y < info->height; y++)
+		memcpy(frame.ptr(y), rows + (size_t)y * info->stride, rowBytes);
+
+	m_lastCaptureUs = (uint64_t)((int64_t)recordedUs + m_offsetUs);
+	m_frameOffset += recordBytes(record->payload_bytes);
+	m_frameCount++;
+	return true;
+}
+
+bool
+ReplayFrameSource::lastCaptureTime(steady_clock::time_point *time) const
+{
+	if (m_frameCount == 0)
+		return false;
+	*time = steady_clock::time_point(std::chrono::microseconds(m_lastCaptureUs));
+	return true;
+}
@@ -0,0 +1,174 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include "frame_pipeline.h"
+#include "mapped_file.h"
+#include "orientation_service.h"
+
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+// ==== Recording file layout ====
+// [recordingFileHeader_t, padded to header_bytes]
+// followed by data_bytes of records, each a recordingRecordHeader_t and its
+// payload, RECORDING_ALIGN apart. Records are appended in the order they
+// happened; data_bytes only ever covers complete records, so a recording cut
+// short by a crash replays up to its last committed record.
+
+#define RECORDING_MAGIC     0x43525256u     // "VRRC"
+#define RECORDING_VERSION   1
+#define RECORDING_ALIGN     8
+
+typedef enum
+{
+	RECORDING_RECORD_FRAME = 1,     // recordingFrameHeader_t, then tightly packed rows
+	RECORDING_RECORD_IMU = 2,       // bytes as received from the IMU server
+} recordingRecordType;
+
+typedef struct recordingFileHeader_st
+{
+	uint32_t magic;             //!< RECORDING_MAGIC
+	uint32_t version;           //!< RECORDING_VERSION
+	uint32_t header_bytes;      //!< Bytes before the first record
+	uint32_t reserved;
+	uint64_t data_bytes;        //!< Bytes of complete records after the header
+	uint64_t frame_count;
+	uint64_t imu_count;
+	uint64_t start_us;          //!< Steady clock when recording started
+}
+recordingFileHeader_t;
+
+typedef struct recordingRecordHeader_st
+{
+	uint32_t type;              //!< recordingRecordType
+	uint32_t event;             //!< IMU records: orientationEvent
+	uint64_t payload_bytes;     //!< Bytes following this header, before padding
+	uint64_t timestamp_us;      //!< Frames: capture time; IMU: receive time. Steady clock
+}
+recordingRecordHeader_t;
+
+typedef struct recordingFrameHeader_st
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;          //!< Bytes per pixel, 3 for decoded BGR
+	uint32_t stride;            //!< Bytes per row, width * channels
+}
+recordingFrameHeader_t;
+
+// Appends decoded frames and raw IMU traffic of a live session to a
+// recording. Frames arrive on the capture thread and IMU packets on the
+// orientation service thread, so appends are serialized.
+class SessionRecorder
+{
+public:
+	SessionRecorder();
+	~SessionRecorder() { close(); }
+
+	// initialBytes is only a starting size; the file doubles as it fills
+	bool create(const std::string &path, size_t initialBytes);
+	void close();
+
+	bool appendFrame(const cv::Mat &frame, uint64_t captureTimeUs);
+	bool appendImu(orientationEvent event, const char *data, size_t bytes, uint64_t receiveTimeUs);
+
+	uint64_t frameCount() const;
+	uint64_t dataBytes() const;
+
+private:
+	// Reserve a record and return its payload, growing the file if needed
+	unsigned char* beginRecord(recordingRecordType type, uint32_t event, size_t payloadBytes, uint64_t timeUs);
+	void commitRecord(recordingRecordType type);
+
+	mutable std::mutex m_mutex;
+	MappedFile m_file;
+	recordingFileHeader_t *m_header;
+	uint64_t m_pending;         // data_bytes once the record being written commits
+	bool m_failed;
+};
+
+// Plays a recording back through the pipeline in place of the camera. Frames
+// keep their recorded spacing (or come as fast as the pipeline takes them)
+// and report their recorded capture time, shifted to the replay clock. IMU
+// traffic is handed to the sink, usually OrientationService::inject, on the
+// capture thread as the frames it surrounds are read.
+class ReplayFrameSource : public FrameSource
+{
+public:
+	typedef std::function<void(orientationEvent event, const char *data, size_t bytes, uint64_t receiveTimeUs)> ImuSink;
+
+	ReplayFrameSource(bool fast);
+
+	bool open(const std::string &path);
+	void setImuSink(const ImuSink &sink) { m_imuSink = sink; }
+
+	bool read(cv::Mat &frame);
+	bool lastCaptureTime(std::chrono::steady_clock::time_point *time) const;
+
+	uint64_t frameCount() const { return m_frameCount; }
+
+private:
+	// Next record of the given type at or after offset; false at the end
+	bool next(recordingRecordType type, uint64_t &offset, const recordingRecordHeader_t **record) const;
+
+	MappedFile m_file;
+	const recordingFileHeader_t *m_header;
+	ImuSink m_imuSink;
+	bool m_fast;
+	bool m_started;
+	int64_t m_offsetUs;         // replay clock minus recording clock
+	uint64_t m_frameOffset;     // next frame record to read
+	uint64_t m_imuOffset;       // next IMU record to deliver
+	uint64_t m_frameCount;
+	uint64_t m_lastCaptureUs;
+};
@@ -0,0 +1,900 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "stitch_session.h"
+#include "app.h"
+#include "color_convert.h"
+#include "cpu_stitcher.h"
+#include "frame_trace.h"
+
+#include <iostream>
+#include <chrono>
+#include <string.h>
+#include "cuda.h"
+#include "cuda_runtime.h"
+
+using std::chrono::high_resolution_clock;
+
+static double elapsedMs(const high_resolution_clock::time_point &start)
+{
+	return std::chrono::duration<double, std::milli>(high_resolution_clock::now() - start).count();
+}
+
+//***********************************************************************************
+// VRWorks backend: one nvssVideo instance for the lifetime of the session
+class NvssStitchBackend : public StitchBackend
+{
+public:
+	NvssStitchBackend() : m_stitcher(nullptr), m_numEyes(1) {}
+
+	~NvssStitchBackend()
+	{
+		for (size_t camera = 0; camera < m_staging.size(); camera++)
+			cudaFreeHost(m_staging[camera]);
+		if (m_stitcher != nullptr)
+			nvssVideoDestroyInstance(m_stitcher);
+	}
+
+	nvstitchResult init(const appParams *params)
+	{
+		int num_gpus = 0;
+		cudaGetDeviceCount(&num_gpus);
+
+		m_gpus.reserve(num_gpus);
+		for (int gpu = 0; gpu < num_gpus; ++gpu)
+		{
+			cudaDeviceProp prop;
+			cudaGetDeviceProperties(&prop, gpu);
+
+			// Require minimum compute 5.2
+			if (prop.major > 5 || (prop.major == 5 && prop.minor >= 2))
+			{
+				m_gpus.push_back(gpu);
+
+				// Multi-GPU not yet supported for mono, so just take the first GPU
+				if (!params->stereo_flag)
+					break;
+			}
+		}
+
+		if (m_gpus.empty())
+		{
+			std::cerr << "No CUDA device with compute capability 5.2 or higher found" << std::endl;
+			return NVSTITCH_ERROR_INVALID_DEVICE;
+		}
+		if (params->projection != CPUSS_PROJECTION_EQUIRECTANGULAR)
+		{
+			std::cerr << "VRWorks stitch backend only supports equirectangular output" << std::endl;
+			return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+		}
+
+		nvssVideoStitcherProperties_t stitcher_props{ 0 };
+		stitcher_props.version = NVSTITCH_VERSION;
+		stitcher_props.projection = NVSTITCH_PANORAMA_PROJECTION_EQUIRECTANGULAR;
+		stitcher_props.pano_width = params->pano_width;
+		stitcher_props.quality = params->quality;
+		stitcher_props.num_gpus = (uint32_t)m_gpus.size();
+		stitcher_props.ptr_gpus = m_gpus.data();
+
+		if (params->stereo_flag)
+		{
+			stitcher_props.pipeline = NVSTITCH_STITCHER_PIPELINE_STEREO;
+			stitcher_props.stereo_ipd = 6.3f;
+		}
+		else
+		{
+			stitcher_props.pipeline = NVSTITCH_STITCHER_PIPELINE_MONO;
+			stitcher_props.feather_width = params->feather_width;
+		}
+		m_numEyes = params->stereo_flag ? 2 : 1;
+
+		RETURN_NVSS_ERROR(nvssVideoCreateInstance(&stitcher_props, &params->rig_properties, &m_stitcher));
+
+		m_inputs.resize(params->rig_properties.num_cameras);
+		m_staging.resize(params->rig_properties.num_cameras, nullptr);
+		for (uint32_t camera = 0; camera < params->rig_properties.num_cameras; camera++)
+		{
+			RETURN_NVSS_ERROR(nvssVideoGetInputBuffer(m_stitcher, camera, &m_inputs[camera]));
+
+			// Pinned staging lets the upload DMA straight from the converted image
+			void *staging = nullptr;
+			if (cudaMallocHost(&staging, m_inputs[camera].row_bytes * m_inputs[camera].height) != cudaSuccess)
+				return NVSTITCH_ERROR_OUT_OF_SYSTEM_MEMORY;
+			m_staging[camera] = (unsigned char *)staging;
+		}
+
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult mapInput(uint32_t camera, unsigned char **ptr, size_t *pitch)
+	{
+		if (camera >= m_inputs.size())
+			return NVSTITCH_ERROR_BAD_INDEX;
+
+		*ptr = m_staging[camera];
+		*pitch = m_inputs[camera].row_bytes;
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult commitInput(uint32_t camera)
+	{
+		if (camera >= m_inputs.size())
+			return NVSTITCH_ERROR_BAD_INDEX;
+
+		return uploadInput(camera, m_staging[camera], m_inputs[camera].row_bytes);
+	}
+
+	nvstitchResult uploadInput(uint32_t camera, const unsigned char *rgba, size_t pitch)
+	{
+		if (camera >= m_inputs.size())
+			return NVSTITCH_ERROR_BAD_INDEX;
+
+		const nvstitchImageBuffer_t &input = m_inputs[camera];
+		if (cudaMemcpy2D(input.dev_ptr, input.pitch,
+			rgba, pitch,
+			input.row_bytes, input.height,
+			cudaMemcpyHostToDevice) != cudaSuccess)
+		{
+			std::cout << "Error copying RGBA image bitmap to CUDA buffer, camera " << camera << std::endl;
+			return NVSTITCH_ERROR_CUDA_ERROR;
+		}
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult stitch()
+	{
+		RETURN_NVSS_ERROR(nvssVideoStitch(m_stitcher));
+
+		// Stitching is asynchronous; wait so the caller's timing is meaningful
+		cudaStreamSynchronize(cudaStreamDefault);
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult downloadOutput(nvstitchEye eye, unsigned char *dst, size_t pitch)
+	{
+		nvstitchImageBuffer_t output_image;
+		RETURN_NVSS_ERROR(nvssVideoGetOutputBuffer(m_stitcher, eye, &output_image));
+
+		if (cudaMemcpy2D(dst, pitch,
+			output_image.dev_ptr, output_image.pitch,
+			output_image.row_bytes, output_image.height,
+			cudaMemcpyDeviceToHost) != cudaSuccess)
+		{
+			std::cout << "Error copying output panorama from CUDA buffer" << std::endl;
+			return NVSTITCH_ERROR_CUDA_ERROR;
+		}
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult getOutputSize(size_t *width, size_t *height)
+	{
+		nvstitchImageBuffer_t output_image;
+		RETURN_NVSS_ERROR(nvssVideoGetOutputBuffer(m_stitcher, m_numEyes == 2 ? NVSTITCH_EYE_LEFT : NVSTITCH_EYE_MONO, &output_image));
+		*width = output_image.width;
+		*height = output_image.height;
+		return NVSTITCH_SUCCESS;
+	}
+
+private:
+	nvssVideoHandle m_stitcher;
+	std::vector<int> m_gpus;
+	std::vector<nvstitchImageBuffer_t> m_inputs;
+	std::vector<unsigned char *> m_staging;
+	int m_numEyes;
+};
+
+//***********************************************************************************
+// Host backend: keeps the input and output images in system memory and builds
+// a preview panorama by giving each camera an equal share of the output
+// columns. Used to exercise and benchmark the session without a GPU.
+class HostStitchBackend : public StitchBackend
+{
+public:
+	HostStitchBackend() : m_panoWidth(0), m_panoHeight(0) {}
+
+	nvstitchResult init(const appParams *params)
+	{
+		if (params->stereo_flag)
+		{
+			std::cerr << "Host stitch backend only supports the mono pipeline" << std::endl;
+			return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+		}
+		if (params->projection != CPUSS_PROJECTION_EQUIRECTANGULAR)
+		{
+			std::cerr << "Host stitch backend only supports equirectangular output" << std::endl;
+			return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+		}
+
+		const nvstitchVideoRigProperties_t &rig = params->rig_properties;
+		if (rig.num_cameras == 0 || params->pano_width < rig.num_cameras)
+			return NVSTITCH_ERROR_BAD_PARAMETER;
+
+		m_panoWidth = params->pano_width;
+		m_panoHeight = params->pano_width / 2;
+		m_output.assign((size_t)m_panoWidth * m_panoHeight * 4, 0);
+
+		m_inputs.resize(rig.num_cameras);
+		m_inputWidth.resize(rig.num_cameras);
+		m_rowIndex.resize(rig.num_cameras);
+		m_colCamera.resize(m_panoWidth);
+		m_colIndex.resize(m_panoWidth);
+
+		for (uint32_t camera = 0; camera < rig.num_cameras; camera++)
+		{
+			uint32_t width = rig.cameras[camera].image_size.x;
+			uint32_t height = rig.cameras[camera].image_size.y;
+			m_inputWidth[camera] = width;
+			m_inputs[camera].assign((size_t)width * height * 4, 0);
+
+			m_rowIndex[camera].resize(m_panoHeight);
+			for (uint32_t y = 0; y < m_panoHeight; y++)
+				m_rowIndex[camera][y] = (uint32_t)(((uint64_t)y * height) / m_panoHeight);
+		}
+
+		// Precompute the source column of every output column once
+		for (uint32_t x = 0; x < m_panoWidth; x++)
+		{
+			uint32_t camera = (uint32_t)(((uint64_t)x * rig.num_cameras) / m_panoWidth);
+			uint32_t first = (uint32_t)(((uint64_t)camera * m_panoWidth + rig.num_cameras - 1) / rig.num_cameras);
+			uint32_t last = (uint32_t)(((uint64_t)(camera + 1) * m_panoWidth + rig.num_cameras - 1) / rig.num_cameras);
+			m_colCamera[x] = camera;
+			m_colIndex[x] = (uint32_t)(((uint64_t)(x - first) * m_inputWidth[camera]) / (last - first));
+		}
+
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult uploadInput(uint32_t camera, const unsigned char *rgba, size_t pitch)
+	{
+		if (camera >= m_inputs.size())
+			return NVSTITCH_ERROR_BAD_INDEX;
+
+		size_t row_bytes = (size_t)m_inputWidth[camera] * 4;
+		size_t height = m_inputs[camera].size() / row_bytes;
+		for (size_t y = 0; y < height; y++)
+			memcpy(&m_inputs[camera][y * row_bytes], rgba + y * pitch, row_bytes);
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult mapInput(uint32_t camera, unsigned char **ptr, size_t *pitch)
+	{
+		if (camera >= m_inputs.size())
+			return NVSTITCH_ERROR_BAD_INDEX;
+
+		*ptr = m_inputs[camera].data();
+		*pitch = (size_t)m_inputWidth[camera] * 4;
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult commitInput(uint32_t camera)
+	{
+		// Input already lives where stitch() reads it
+		return camera < m_inputs.size() ? NVSTITCH_SUCCESS : NVSTITCH_ERROR_BAD_INDEX;
+	}
+
+	nvstitchResult stitch()
+	{
+		for (uint32_t y = 0; y < m_panoHeight; y++)
+		{
+			uint32_t *dst = (uint32_t *)&m_output[(size_t)y * m_panoWidth * 4];
+			for (uint32_t x = 0; x < m_panoWidth; x++)
+			{
+				uint32_t camera = m_colCamera[x];
+				const uint32_t *src = (const uint32_t *)m_inputs[camera].data();
+				dst[x] = src[(size_t)m_rowIndex[camera][y] * m_inputWidth[camera] + m_colIndex[x]];
+			}
+		}
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult downloadOutput(nvstitchEye eye, unsigned char *dst, size_t pitch)
+	{
+		if (eye != NVSTITCH_EYE_MONO)
+			return NVSTITCH_ERROR_BAD_PARAMETER;
+
+		size_t row_bytes = (size_t)m_panoWidth * 4;
+		for (uint32_t y = 0; y < m_panoHeight; y++)
+			memcpy(dst + y * pitch, &m_output[y * row_bytes], row_bytes);
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult getOutputSize(size_t *width, size_t *height)
+	{
+		*width = m_panoWidth;
+		*height = m_panoHeight;
+		return NVSTITCH_SUCCESS;
+	}
+
+private:
+	uint32_t m_panoWidth;
+	uint32_t m_panoHeight;
+	std::vector<std::vector<unsigned char> > m_inputs;
+	std::vector<unsigned char> m_output;
+	std::vector<uint32_t> m_inputWidth;
+	std::vector<std::vector<uint32_t> > m_rowIndex;
+	std::vector<uint32_t> m_colCamera;
+	std::vector<uint32_t> m_colIndex;
+};
+
+//***********************************************************************************
+// CPU backend: the cpussVideo stitcher, driven like the VRWorks one. Its
+// buffers are in system memory, and its kernels sample BGR and 4:2:0 frames
+// as they are, so they are copied in unconverted.
+class CpuStitchBackend : public StitchBackend
+{
+public:
+	CpuStitchBackend() : m_stitcher(nullptr) {}
+
+	~CpuStitchBackend()
+	{
+		if (m_stitcher != nullptr)
+			cpussVideoDestroyInstance(m_stitcher);
+	}
+
+	nvstitchResult init(const appParams *params)
+	{
+		if (params->stereo_flag)
+		{
+			std::cerr << "CPU stitch backend only supports the mono pipeline" << std::endl;
+			return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+		}
+
+		nvssVideoStitcherProperties_t stitcher_props{ 0 };
+		stitcher_props.version = NVSTITCH_VERSION;
+		stitcher_props.format = NVSS_STITCHER_FORMAT_RGBA8UI;
+		stitcher_props.pipeline = NVSTITCH_STITCHER_PIPELINE_MONO;
+		stitcher_props.projection = (nvstitchPanoramaProjectionType)params->projection;
+		stitcher_props.pano_width = params->pano_width;
+		stitcher_props.quality = params->quality;
+		stitcher_props.feather_width = params->feather_width;
+
+		const char *cacheDir = params->lut_cache_dir.empty() ? nullptr : params->lut_cache_dir.c_str();
+		RETURN_NVSS_ERROR(cpussVideoCreateInstanceWithCache(&stitcher_props, &params->rig_properties, cacheDir, &m_stitcher));
+		if (!params->cam_vignetting.empty())
+			RETURN_NVSS_ERROR(cpussVideoSetVignetting(m_stitcher, params->cam_vignetting.data()));
+		if (params->feather_blend)
+			RETURN_NVSS_ERROR(cpussVideoSetBlendMode(m_stitcher, CPUSS_BLEND_FEATHER));
+		RETURN_NVSS_ERROR(cpussVideoSetGainCompensation(m_stitcher, (cpussGainMode)params->gain_mode, params->gain_smoothing));
+		if (!params->coverage_dump.empty())
+			RETURN_NVSS_ERROR(cpussVideoWriteCoverage(m_stitcher, params->coverage_dump.c_str()));
+		if (params->output_levels > 1)
+			RETURN_NVSS_ERROR(cpussVideoSetOutputLevels(m_stitcher, params->output_levels));
+		if (params->stabilize_mode != CPUSS_STABILIZE_OFF)
+			RETURN_NVSS_ERROR(cpussVideoSetStabilization(m_stitcher, (cpussStabilizeMode)params->stabilize_mode,
+				params->stabilize_tolerance_deg));
+		// stitchFrameFormat and cpussInputFormat number the 4:2:0 formats alike
+		RETURN_NVSS_ERROR(cpussVideoSetInputFormat(m_stitcher, params->input_format == STITCH_FRAME_BGR ?
+			CPUSS_INPUT_BGR8 : (cpussInputFormat)params->input_format));
+		if (params->output_format != STITCH_OUTPUT_RGBA)
+			RETURN_NVSS_ERROR(cpussVideoSetOutputFormat(m_stitcher, (cpussOutputFormat)params->output_format));
+
+		m_inputs.resize(params->rig_properties.num_cameras);
+		for (uint32_t camera = 0; camera < params->rig_properties.num_cameras; camera++)
+			RETURN_NVSS_ERROR(cpussVideoGetInputPlanes(m_stitcher, camera, &m_inputs[camera]));
+
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult uploadInput(uint32_t camera, const unsigned char *rgba, size_t pitch)
+	{
+		if (camera >= m_inputs.size())
+			return NVSTITCH_ERROR_BAD_INDEX;
+		if (m_inputs[camera].format != CPUSS_INPUT_RGBA8)
+			return NVSTITCH_ERROR_BAD_STATE;
+
+		const nvstitchImageBuffer_t &input = m_inputs[camera].planes[0];
+		for (size_t y = 0; y < input.height; y++)
+			memcpy((unsigned char *)input.dev_ptr + y * input.pitch, rgba + y * pitch, input.row_bytes);
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult mapInput(uint32_t camera, unsigned char **ptr, size_t *pitch)
+	{
+		if (camera >= m_inputs.size())
+			return NVSTITCH_ERROR_BAD_INDEX;
+		if (m_inputs[camera].format != CPUSS_INPUT_RGBA8)
+			return NVSTITCH_ERROR_BAD_STATE;
+
+		*ptr = (unsigned char *)m_inputs[camera].planes[0].dev_ptr;
+		*pitch = m_inputs[camera].planes[0].pitch;
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult uploadInputPlanes(uint32_t camera, const unsigned char *const *planes, const size_t *pitches)
+	{
+		if (camera >= m_inputs.size())
+			return NVSTITCH_ERROR_BAD_INDEX;
+		if (m_inputs[camera].format == CPUSS_INPUT_RGBA8)
+			return NVSTITCH_ERROR_BAD_STATE;
+
+		const cpussInputPlanes_t &input = m_inputs[camera];
+		for (uint32_t index = 0; index < input.num_planes; index++)
+		{
+			const nvstitchImageBuffer_t &plane = input.planes[index];
+			for (size_t y = 0; y < plane.height; y++)
+				memcpy((unsigned char *)plane.dev_ptr + y * plane.pitch, planes[index] + y * pitches[index], plane.row_bytes);
+		}
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult commitInput(uint32_t camera)
+	{
+		return camera < m_inputs.size() ? NVSTITCH_SUCCESS : NVSTITCH_ERROR_BAD_INDEX;
+	}
+
+	nvstitchResult stitch()
+	{
+		return cpussVideoStitch(m_stitcher);
+	}
+
+	// Copied out by the stitcher, which turns a stabilized panorama by the
+	// rig's yaw on the way
+	nvstitchResult downloadOutput(nvstitchEye eye, unsigned char *dst, size_t pitch)
+	{
+		if (eye != NVSTITCH_EYE_MONO)
+			return NVSTITCH_ERROR_BAD_PARAMETER;
+		return cpussVideoCopyOutput(m_stitcher, 0, dst, pitch);
+	}
+
+	nvstitchResult downloadOutputLevel(uint32_t level, unsigned char *dst, size_t pitch)
+	{
+		return cpussVideoCopyOutput(m_stitcher, level, dst, pitch);
+	}
+
+	nvstitchResult downloadOutputPlanes(unsigned char *const *planes, const size_t *pitches)
+	{
+		void *dst[3] = { planes[0], planes[1], planes[2] };
+		return cpussVideoCopyOutputPlanes(m_stitcher, dst, pitches);
+	}
+
+	// The luma plane has the panorama's size in every output format
+	nvstitchResult getOutputSize(size_t *width, size_t *height)
+	{
+		cpussOutputPlanes_t output;
+		RETURN_NVSS_ERROR(cpussVideoGetOutputPlanes(m_stitcher, &output));
+		*width = output.planes[0].width;
+		*height = output.planes[0].height;
+		return NVSTITCH_SUCCESS;
+	}
+
+	nvstitchResult setRigOrientation(const float orientation[4])
+	{
+		return cpussVideoSetRigOrientation(m_stitcher, orientation);
+	}
+
+private:
+	cpussVideoHandle m_stitcher;
+	std::vector<cpussInputPlanes_t> m_inputs;
+};
+
+//***********************************************************************************
+StitchSession::StitchSession()
+	: m_outputWidth(0), m_outputHeight(0), m_outputLevels(1), m_numEyes(1), m_frameFormat(STITCH_FRAME_BGR),
+	m_convertsFrames(true), m_outputFormat(STITCH_OUTPUT_RGBA),
+	m_lastUploadMs(0.0), m_lastStitchMs(0.0), m_lastDownloadMs(0.0)
+{
+}
+
+StitchSession::~StitchSession()
+{
+	release();
+}
+
+void
+StitchSession::release()
+{
+	m_backend.reset();
+	m_output.clear();
+	m_inputWidth.clear();
+	m_inputHeight.clear();
+	m_outputWidth = m_outputHeight = 0;
+	m_outputLevels = 1;
+	m_frameFormat = STITCH_FRAME_BGR;
+	m_outputFormat = STITCH_OUTPUT_RGBA;
+}
+
+nvstitchResult
+StitchSession::init(const appParams *params, stitchBackendType backend)
+{
+	release();
+
+	if (params->rig_properties.num_cameras != 2)
+	{
+		std::cerr << "StitchSession expects a two camera side-by-side rig, got "
+			<< params->rig_properties.num_cameras << " cameras" << std::endl;
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	}
+	if (params->output_levels > 1 && backend != STITCH_BACKEND_CPU)
+	{
+		std::cerr << "Only the CPU stitch backend writes reduced output levels" << std::endl;
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	}
+	if (params->stabilize_mode != 0 && backend != STITCH_BACKEND_CPU)
+	{
+		std::cerr << "Only the CPU stitch backend stabilizes the panorama" << std::endl;
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	}
+	if (params->input_format != STITCH_FRAME_BGR && backend != STITCH_BACKEND_CPU)
+	{
+		std::cerr << "Only the CPU stitch backend takes 4:2:0 frames" << std::endl;
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	}
+	if (params->output_format != STITCH_OUTPUT_RGBA && (backend != STITCH_BACKEND_CPU || params->output_levels > 1))
+	{
+		std::cerr << "Only the CPU stitch backend writes 4:2:0 panoramas, and then without output levels" << std::endl;
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	}
+
+	std::unique_ptr<StitchBackend> impl;
+	if (backend == STITCH_BACKEND_HOST)
+		impl.reset(new HostStitchBackend());
+	else if (backend == STITCH_BACKEND_CPU)
+		impl.reset(new CpuStitchBackend());
+	else
+		impl.reset(new NvssStitchBackend());
+
+	RETURN_NVSS_ERROR(impl->init(params));
+
+	size_t width = 0, height = 0;
+	RETURN_NVSS_ERROR(impl->getOutputSize(&width, &height));
+
+	m_numEyes = params->stereo_flag ? 2 : 1;
+	m_outputWidth = (uint32_t)width;
+	m_outputHeight = (uint32_t)height;
+	m_outputLevels = params->output_levels > 1 ? params->output_levels : 1;
+	m_frameFormat = (stitchFrameFormat)params->input_format;
+	m_convertsFrames = m_frameFormat == STITCH_FRAME_BGR && backend != STITCH_BACKEND_CPU;
+	m_outputFormat = (stitchOutputFormat)params->output_format;
+	m_output.resize(outputBytes());
+
+	m_inputWidth.resize(params->rig_properties.num_cameras);
+	m_inputHeight.resize(params->rig_properties.num_cameras);
+	for (uint32_t camera = 0; camera < params->rig_properties.num_cameras; camera++)
+	{
+		m_inputWidth[camera] = params->rig_properties.cameras[camera].image_size.x;
+		m_inputHeight[camera] = params->rig_properties.cameras[camera].image_size.y;
+	}
+
+	m_backend = std::move(impl);
+	return NVSTITCH_SUCCESS;
+}
+
+size_t
+StitchSession::outputLevelOffset(uint32_t level) const
+{
+	if (level > 0 && m_outputFormat != STITCH_OUTPUT_RGBA)
+		return outputPlaneOffset(outputPlanes());
+
+	size_t offset = 0;
+	for (uint32_t below = 0; below < level; below++)
+		offset += (size_t)outputLevelWidth(below) * 4 * outputLevelHeight(below);
+	return offset;
+}
+
+uint32_t
+StitchSession::outputPlanes() const
+{
+	switch (m_outputFormat)
+	{
+	case STITCH_OUTPUT_I420: return 3;
+	case STITCH_OUTPUT_NV12: return 2;
+	default: return 1;
+	}
+}
+
+// I420 chroma rows are half as long as the luma rows, NV12 rows as long
+size_t
+StitchSession::planePitch(uint32_t plane, size_t pitch) const
+{
+	return plane > 0 && m_outputFormat == STITCH_OUTPUT_I420 ? pitch / 2 : pitch;
+}
+
+size_t
+StitchSession::outputPlanePitch(uint32_t plane) const
+{
+	return planePitch(plane, outputPitch());
+}
+
+size_t
+StitchSession::outputPlaneOffset(uint32_t plane) const
+{
+	size_t offset = 0;
+	for (uint32_t below = 0; below < plane; below++)
+		offset += outputPlanePitch(below) * outputPlaneHeight(below);
+	return offset;
+}
+
+nvstitchResult
+StitchSession::convertInput(uint32_t camera, const cv::Mat &image, unsigned char *dst, size_t dstPitch) const
+{
+	if (camera >= numCameras())
+		return NVSTITCH_ERROR_BAD_INDEX;
+
+	if (!image.data || dst == nullptr)
+	{
+		std::cout << "Error reading input image, camera " << camera << std::endl;
+		return NVSTITCH_ERROR_NULL_POINTER;
+	}
+
+	// Verify image resolution matches rig descriptor
+	if ((uint32_t)image.cols != m_inputWidth[camera] || (uint32_t)image.rows != m_inputHeight[camera])
+	{
+		std::cout << "Error: resolution mismatch between input camera " << camera << " and rig descriptor\n";
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	}
+
+	if (image.type() != CV_8UC3)
+	{
+		std::cout << "Error: expected 8-bit 3 channel input, camera " << camera << std::endl;
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	}
+
+	// Read the eye straight out of the side-by-side frame. Byte order is kept
+	// as decoded (B, G, R, 255), matching what the shared memory reader expects.
+	convertBgrToRgba(image.data, image.step[0], dst, dstPitch,
+		m_inputWidth[camera], m_inputHeight[camera], false);
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+StitchSession::convertInput(uint32_t camera, const cv::Mat &image, cv::Mat &rgba) const
+{
+	if (camera >= numCameras())
+		return NVSTITCH_ERROR_BAD_INDEX;
+
+	// No-op when rgba was preallocated at the camera resolution
+	rgba.create(m_inputHeight[camera], m_inputWidth[camera], CV_8UC4);
+	return convertInput(camera, image, rgba.data, rgba.step[0]);
+}
+
+nvstitchResult
+StitchSession::stitchAndDownload(unsigned char *dst, size_t dstPitch)
+{
+	auto start = high_resolution_clock::now();
+	{
+		TraceScope trace(TRACE_STITCH);
+		RETURN_NVSS_ERROR(m_backend->stitch());
+	}
+	m_lastStitchMs = elapsedMs(start);
+
+	start = high_resolution_clock::now();
+	if (m_outputFormat != STITCH_OUTPUT_RGBA)
+	{
+		// The planes follow each other in dst, as in output()
+		TraceScope trace(TRACE_DOWNLOAD);
+		unsigned char *planes[3] = { nullptr, nullptr, nullptr };
+		size_t pitches[3] = { 0, 0, 0 };
+		unsigned char *plane = dst;
+		for (uint32_t index = 0; index < outputPlanes(); index++)
+		{
+			planes[index] = plane;
+			pitches[index] = planePitch(index, dstPitch);
+			plane += pitches[index] * outputPlaneHeight(index);
+		}
+		RETURN_NVSS_ERROR(m_backend->downloadOutputPlanes(planes, pitches));
+		m_lastDownloadMs = elapsedMs(start);
+		return NVSTITCH_SUCCESS;
+	}
+
+	size_t eye_bytes = (size_t)m_outputHeight * dstPitch;
+	{
+		TraceScope trace(TRACE_DOWNLOAD);
+		for (int eye = 0; eye < m_numEyes; eye++)
+		{
+			nvstitchEye which = m_numEyes == 2 ? nvstitchEye(eye) : NVSTITCH_EYE_MONO;
+			RETURN_NVSS_ERROR(m_backend->downloadOutput(which, dst + eye * eye_bytes, dstPitch));
+		}
+		size_t offset = m_numEyes * eye_bytes;
+		for (uint32_t level = 1; level < m_outputLevels; level++)
+		{
+			size_t pitch = (size_t)outputLevelWidth(level) * 4;
+			RETURN_NVSS_ERROR(m_backend->downloadOutputLevel(level, dst + offset, pitch));
+			offset += pitch * outputLevelHeight(level);
+		}
+	}
+	m_lastDownloadMs = elapsedMs(start);
+
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+StitchSession::stitchRgba(const cv::Mat *rgba, unsigned char *dst, size_t dstPitch)
+{
+	if (!m_backend)
+		return NVSTITCH_ERROR_BAD_STATE;
+
+	auto start = high_resolution_clock::now();
+	{
+		TraceScope trace(TRACE_UPLOAD);
+		for (uint32_t camera = 0; camera < numCameras(); camera++)
+			RETURN_NVSS_ERROR(m_backend->uploadInput(camera, rgba[camera].data, rgba[camera].step[0]));
+	}
+	m_lastUploadMs = elapsedMs(start);
+
+	return stitchAndDownload(dst, dstPitch);
+}
+
+// A 4:2:0 frame comes from the decoder as one image of 3/2 the height: the
+// luma rows, then each chroma plane at half the width and height, packed.
+// A BGR frame's eyes are its halves.
+nvstitchResult
+StitchSession::splitPlanes(const cv::Mat &frame, cv::Mat planes[2][3]) const
+{
+	if (m_convertsFrames)
+		return NVSTITCH_ERROR_BAD_STATE;
+
+	if (m_frameFormat == STITCH_FRAME_BGR)
+	{
+		if (frame.type() != CV_8UC3)
+		{
+			std::cout << "Error: expected a side-by-side 8-bit 3 channel frame" << std::endl;
+			return NVSTITCH_ERROR_BAD_PARAMETER;
+		}
+		int eyeWidth = frame.cols / 2;
+		for (int camera = 0; camera < 2; camera++)
+		{
+			planes[camera][0] = frame.colRange(camera * eyeWidth, (camera + 1) * eyeWidth);
+			planes[camera][1] = cv::Mat();
+			planes[camera][2] = cv::Mat();
+		}
+		return NVSTITCH_SUCCESS;
+	}
+
+	int width = frame.cols;
+	int height = frame.rows / 3 * 2;
+	if (frame.type() != CV_8UC1 || !frame.isContinuous() || frame.rows != height / 2 * 3 ||
+		width % 4 != 0 || height % 2 != 0)
+	{
+		std::cout << "Error: expected a side-by-side " << (m_frameFormat == STITCH_FRAME_I420 ? "I420" : "NV12")
+			<< " frame of even eye width and height" << std::endl;
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	}
+
+	unsigned char *chroma = const_cast<unsigned char *>(frame.data) + (size_t)width * height;
+	size_t chromaBytes = (size_t)(width / 2) * (height / 2);
+	cv::Mat luma = frame(cv::Range(0, height), cv::Range::all());
+	cv::Mat u, v;
+	if (m_frameFormat == STITCH_FRAME_I420)
+	{
+		u = cv::Mat(height / 2, width / 2, CV_8UC1, chroma, width / 2);
+		v = cv::Mat(height / 2, width / 2, CV_8UC1, chroma + chromaBytes, width / 2);
+	}
+	else
+	{
+		u = cv::Mat(height / 2, width / 2, CV_8UC2, chroma, width);
+	}
+
+	// Views only; the pixel data stays in frame
+	int eyeWidth = width / 2;
+	for (int camera = 0; camera < 2; camera++)
+	{
+		planes[camera][0] = luma.colRange(camera * eyeWidth, (camera + 1) * eyeWidth);
+		planes[camera][1] = u.colRange(camera * eyeWidth / 2, (camera + 1) * eyeWidth / 2);
+		planes[camera][2] = v.empty() ? cv::Mat() : v.colRange(camera * eyeWidth / 2, (camera + 1) * eyeWidth / 2);
+	}
+	return NVSTITCH_SUCCESS;
+}
+
+nvstitchResult
+StitchSession::stitchPlanes(const cv::Mat planes[2][3], unsigned char *dst, size_t dstPitch)
+{
+	if (!m_backend)
+		return NVSTITCH_ERROR_BAD_STATE;
+
+	auto start = high_resolution_clock::now();
+	{
+		TraceScope trace(TRACE_UPLOAD);
+		for (uint32_t camera = 0; camera < numCameras(); camera++)
+		{
+			const cv::Mat &luma = planes[camera][0];
+			if ((uint32_t)luma.cols != m_inputWidth[camera] || (uint32_t)luma.rows != m_inputHeight[camera])
+			{
+				std::cout << "Error: resolution mismatch between input camera " << camera << " and rig descriptor\n";
+				return NVSTITCH_ERROR_BAD_PARAMETER;
+			}
+			if (m_frameFormat == STITCH_FRAME_BGR && luma.type() != CV_8UC3)
+			{
+				std::cout << "Error: expected 8-bit 3 channel input, camera " << camera << std::endl;
+				return NVSTITCH_ERROR_BAD_PARAMETER;
+			}
+
+			const unsigned char *data[3];
+			size_t pitches[3];
+			for (int plane = 0; plane < 3; plane++)
+			{
+				data[plane] = planes[camera][plane].data;
+				pitches[plane] = planes[camera][plane].empty() ? 0 : planes[camera][plane].step[0];
+			}
+			RETURN_NVSS_ERROR(m_backend->uploadInputPlanes(camera, data, pitches));
+		}
+	}
+	m_lastUploadMs = elapsedMs(start);
+
+	return stitchAndDownload(dst, dstPitch);
+}
+
+nvstitchResult
+StitchSession::setRigOrientation(const float orientation[4])
+{
+	if (!m_backend)
+		return NVSTITCH_ERROR_BAD_STATE;
+	return m_backend->setRigOrientation(orientation);
+}
+
+nvstitchResult
+StitchSession::stitchFrame(const cv::Mat &left, const cv::Mat &right)
+{
+	if (!m_backend || m_frameFormat != STITCH_FRAME_BGR)
+		return NVSTITCH_ERROR_BAD_STATE;
+
+	// Eyes the backend reads as they are are copied in whole
+	if (!m_convertsFrames)
+	{
+		cv::Mat planes[2][3] = { { left, cv::Mat(), cv::Mat() }, { right, cv::Mat(), cv::Mat() } };
+		return stitchPlanes(planes, m_output.data(), outputPitch());
+	}
+
+	// Convert each eye directly into the backend's input (or its pinned staging)
+	auto start = high_resolution_clock::now();
+	const cv::Mat *eyes[2] = { &left, &right };
+	{
+		TraceScope trace(TRACE_UPLOAD);
+		for (uint32_t camera = 0; camera < 2; camera++)
+		{
+			unsigned char *input = nullptr;
+			size_t pitch = 0;
+			RETURN_NVSS_ERROR(m_backend->mapInput(camera, &input, &pitch));
+			RETURN_NVSS_ERROR(convertInput(camera, *eyes[camera], input, pitch));
+			RETURN_NVSS_ERROR(m_backend->commitInput(camera));
+		}
+	}
+	m_lastUploadMs = elapsedMs(start);
+
+	return stitchAndDownload(m_output.data(), outputPitch());
+}
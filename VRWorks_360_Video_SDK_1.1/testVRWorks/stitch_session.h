@@ -0,0 +1,232 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "nvss_video.h"
+
+typedef struct _appParams appParams;
+
+// Which implementation a StitchSession drives
+typedef enum
+{
+	STITCH_BACKEND_NVSS = 0,	// VRWorks nvss_video on a CUDA device
+	STITCH_BACKEND_HOST,		// in-process host backend, needs no GPU
+	STITCH_BACKEND_CPU,			// CPU stitcher using the rig's lens models, needs no GPU
+} stitchBackendType;
+
+// Layout of the side-by-side frames the session is fed
+typedef enum
+{
+	STITCH_FRAME_BGR = 0,		// CV_8UC3, converted to RGBA per camera except by the CPU backend
+	STITCH_FRAME_I420,			// CV_8UC1 of 3/2 the height: Y, then the U and V planes; CPU backend only
+	STITCH_FRAME_NV12,			// CV_8UC1 of 3/2 the height: Y, then interleaved UV; CPU backend only
+} stitchFrameFormat;
+
+// Layout of the panorama the session writes, numbered as cpussOutputFormat
+typedef enum
+{
+	STITCH_OUTPUT_RGBA = 0,		// 4 bytes a pixel, in the byte order of the input
+	STITCH_OUTPUT_I420,			// Y, then the U and V planes at half the width and height; CPU backend only
+	STITCH_OUTPUT_NV12,			// Y, then interleaved UV at half the height; CPU backend only
+} stitchOutputFormat;
+
+// A stitcher implementation behind StitchSession. Buffers are owned by the
+// backend and stay valid from init() until the backend is destroyed.
+class StitchBackend
+{
+public:
+	virtual ~StitchBackend() {}
+
+	virtual nvstitchResult init(const appParams *params) = 0;
+
+	// Copy a tightly packed or pitched host RGBA image into the camera input buffer
+	virtual nvstitchResult uploadInput(uint32_t camera, const unsigned char *rgba, size_t pitch) = 0;
+
+	// Host-writable image for a camera input: the input buffer itself for host
+	// backends, or a pinned staging image that commitInput() copies to the device
+	virtual nvstitchResult mapInput(uint32_t camera, unsigned char **ptr, size_t *pitch) = 0;
+	virtual nvstitchResult commitInput(uint32_t camera) = 0;
+
+	// Copy one camera's 4:2:0 planes (Y, U, V or Y, UV) into its input; only
+	// the backends that take YUV override this
+	virtual nvstitchResult uploadInputPlanes(uint32_t camera, const unsigned char *const *planes, const size_t *pitches)
+	{
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	}
+
+	virtual nvstitchResult stitch() = 0;
+
+	// Copy the output panorama of one eye into host memory
+	virtual nvstitchResult downloadOutput(nvstitchEye eye, unsigned char *dst, size_t pitch) = 0;
+
+	// Copy a reduced output level, 1 and up, into host memory; only the
+	// backends that stitch them override this
+	virtual nvstitchResult downloadOutputLevel(uint32_t level, unsigned char *dst, size_t pitch)
+	{
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	}
+
+	// Copy the 4:2:0 planes of the panorama (Y, U, V or Y, UV) into host
+	// memory; only the backends that write them override this
+	virtual nvstitchResult downloadOutputPlanes(unsigned char *const *planes, const size_t *pitches)
+	{
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	}
+
+	virtual nvstitchResult getOutputSize(size_t *width, size_t *height) = 0;
+
+	// Rig to world rotation for the next stitch, w, x, y, z; only the
+	// backends that stabilize override this
+	virtual nvstitchResult setRigOrientation(const float orientation[4])
+	{
+		return NVSTITCH_ERROR_UNSUPPORTED_CONFIG;
+	}
+};
+
+// Long-lived stitcher: the backend instance, the host staging images and the
+// stacked output panorama are created once and reused for every frame.
+class StitchSession
+{
+public:
+	StitchSession();
+	~StitchSession();
+
+	nvstitchResult init(const appParams *params, stitchBackendType backend);
+	void release();
+
+	bool isInitialized() const { return m_backend != nullptr; }
+
+	// Stitch one left/right camera pair; the result is available via output()
+	nvstitchResult stitchFrame(const cv::Mat &left, const cv::Mat &right);
+
+	// Split form of stitchFrame for pipelined callers: convertInput() may run
+	// on any thread, stitchRgba() uploads already converted images, stitches
+	// and downloads the stacked panorama into dst.
+	nvstitchResult convertInput(uint32_t camera, const cv::Mat &image, unsigned char *dst, size_t dstPitch) const;
+	nvstitchResult convertInput(uint32_t camera, const cv::Mat &image, cv::Mat &rgba) const;
+	nvstitchResult stitchRgba(const cv::Mat *rgba, unsigned char *dst, size_t dstPitch);
+
+	// The same for frames the backend reads as they are, unless
+	// convertsFrames(): 4:2:0, and BGR on the CPU backend. splitPlanes()
+	// takes views of each camera's planes out of a side-by-side frame (a BGR
+	// frame has one), and stitchPlanes() copies them into the backend's
+	// inputs, stitches and downloads. stitchFrame() is BGR only.
+	stitchFrameFormat frameFormat() const { return m_frameFormat; }
+	bool convertsFrames() const { return m_convertsFrames; }
+	nvstitchResult splitPlanes(const cv::Mat &frame, cv::Mat planes[2][3]) const;
+	nvstitchResult stitchPlanes(const cv::Mat planes[2][3], unsigned char *dst, size_t dstPitch);
+
+	// CPU backend with stabilize_mode set: where the rig points for the next
+	// stitch, a unit quaternion w, x, y, z
+	nvstitchResult setRigOrientation(const float orientation[4]);
+
+	uint32_t numCameras() const { return (uint32_t)m_inputWidth.size(); }
+	uint32_t inputWidth(uint32_t camera) const { return m_inputWidth[camera]; }
+	uint32_t inputHeight(uint32_t camera) const { return m_inputHeight[camera]; }
+
+	// Stacked output panorama (left over right eye for stereo), RGBA, or with
+	// output_format set the 4:2:0 planes one after another, the luma rows
+	// outputPitch() apart and the chroma rows as outputPlanePitch() says
+	const unsigned char* output() const { return m_output.data(); }
+	stitchOutputFormat outputFormat() const { return m_outputFormat; }
+	uint32_t outputWidth() const { return m_outputWidth; }
+	uint32_t outputHeight() const { return m_outputHeight * m_numEyes; }
+	size_t outputPitch() const { return m_outputFormat == STITCH_OUTPUT_RGBA ? m_outputWidth * 4 : m_outputWidth; }
+
+	// Planes of the panorama: 1 for RGBA, 3 for I420, 2 for NV12. Offsets and
+	// pitches are for a panorama outputPitch() apart.
+	uint32_t outputPlanes() const;
+	uint32_t outputPlaneHeight(uint32_t plane) const { return plane == 0 ? outputHeight() : outputHeight() / 2; }
+	size_t outputPlanePitch(uint32_t plane) const;
+	size_t outputPlaneOffset(uint32_t plane) const;
+
+	// Output levels, CPU backend only: level 0 is the stacked panorama, each
+	// further level half the width and height of the one before. They follow
+	// the panorama in output() and in stitchRgba's dst, rows packed; offsets
+	// are for a panorama outputPitch() apart. outputBytes() holds them all.
+	uint32_t outputLevels() const { return m_outputLevels; }
+	uint32_t outputLevelWidth(uint32_t level) const { return m_outputWidth >> level; }
+	uint32_t outputLevelHeight(uint32_t level) const { return level == 0 ? outputHeight() : m_outputHeight >> level; }
+	size_t outputLevelOffset(uint32_t level) const;
+	size_t outputBytes() const { return outputLevelOffset(m_outputLevels); }
+
+	// Wall time of the last stitchFrame call, split into its phases
+	double lastUploadMs() const { return m_lastUploadMs; }
+	double lastStitchMs() const { return m_lastStitchMs; }
+	double lastDownloadMs() const { return m_lastDownloadMs; }
+
+private:
+	StitchSession(const StitchSession&);
+	StitchSession& operator=(const StitchSession&);
+
+	nvstitchResult stitchAndDownload(unsigned char *dst, size_t dstPitch);
+	size_t planePitch(uint32_t plane, size_t pitch) const;
+
+	std::unique_ptr<StitchBackend> m_backend;
+	std::vector<unsigned char> m_output;
+	std::vector<uint32_t> m_inputWidth;
+	std::vector<uint32_t> m_inputHeight;
+	uint32_t m_outputWidth;
+	uint32_t m_outputHeight;
+	uint32_t m_outputLevels;
+	int m_numEyes;
+	stitchFrameFormat m_frameFormat;
+	bool m_convertsFrames;
+	stitchOutputFormat m_outputFormat;
+
+	double m_lastUploadMs;
+	double m_lastStitchMs;
+	double m_lastDownloadMs;
+};
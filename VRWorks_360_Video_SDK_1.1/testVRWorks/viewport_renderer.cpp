@@ -0,0 +1,437 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "viewport_renderer.h"
+#include "cpu_features.h"
+#include "fast_math.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+// Everything a kernel needs for one frame. The world-space ray through output
+// pixel (i, j) is rowBase(j) + i * step, unnormalized.
+struct ViewportSetup
+{
+	float col0[3];      // view +X, +Y, +Z in world space
+	float col1[3];
+	float col2[3];
+	float a0, da;       // image plane x of column 0, and per column
+	float b0, db;       // image plane y of row 0, and per row
+	float uScale, uOffset;  // longitude / latitude to 24.8 fixed-point panorama pixels
+	float vScale, vOffset;
+	int32_t panoWidth;
+	int32_t panoHeight;
+	int32_t panoStride;     // in pixels
+};
+
+static void
+setupViewport(uint32_t width, uint32_t height, float tanX, float tanY, const Quat &orientation,
+	uint32_t panoWidth, uint32_t panoHeight, size_t panoPitch, ViewportSetup *setup)
+{
+	float T[9];
+	quatToTransform(quatNormalize(orientation), T);
+	for (int k = 0; k < 3; k++)
+	{
+		setup->col0[k] = T[k];
+		setup->col1[k] = T[3 + k];
+		setup->col2[k] = T[6 + k];
+	}
+
+	setup->da = 2.0f * tanX / width;
+	setup->a0 = (1.0f / width - 1.0f) * tanX;
+	setup->db = -2.0f * tanY / height;
+	setup->b0 = (1.0f - 1.0f / height) * tanY;
+
+	// Pixel centers: longitude -pi maps to u = -0.5, latitude +pi/2 to v = -0.5
+	setup->uScale = 256.0f * panoWidth / (float)(2.0 * M_PI);
+	setup->uOffset = 256.0f * (panoWidth * 0.5f - 0.5f);
+	setup->vScale = -256.0f * panoHeight / (float)M_PI;
+	setup->vOffset = 256.0f * (panoHeight * 0.5f - 0.5f);
+
+	setup->panoWidth = (int32_t)panoWidth;
+	setup->panoHeight = (int32_t)panoHeight;
+	setup->panoStride = (int32_t)(panoPitch / 4);
+}
+
+static inline void
+rowRay(const ViewportSetup &setup, uint32_t y, float base[3], float step[3])
+{
+	float b = setup.b0 + (float)y * setup.db;
+	for (int k = 0; k < 3; k++)
+	{
+		base[k] = setup.col1[k] * b + setup.col2[k] + setup.col0[k] * setup.a0;
+		step[k] = setup.col0[k] * setup.da;
+	}
+}
+
+//***********************************************************************************
+// Scalar kernel. Every operation is mirrored one to one by the SIMD kernels so
+// all three produce identical output.
+
+static inline uint32_t
+lerp8(uint32_t a, uint32_t b, uint32_t f)
+{
+	return (a * (256 - f) + b * f) >> 8;
+}
+
+static inline void
+samplePixel(const ViewportSetup &setup, const uint32_t *pano, const float base[3], const float step[3],
+	uint32_t x, unsigned char *dst)
+{
+	float fx = (float)x;
+	float dx = base[0] + fx * step[0];
+	float dy = base[1] + fx * step[1];
+	float dz = base[2] + fx * step[2];
+
+	float lon = fastAtan2(dx, dz);
+	float lat = fastAtan2(dy, sqrtf(dx * dx + dz * dz));
+	int32_t u = (int32_t)floorf(lon * setup.uScale + setup.uOffset);
+	int32_t v = (int32_t)floorf(lat * setup.vScale + setup.vOffset);
+
+	int32_t ix = u >> 8, wx = u & 255;
+	int32_t iy = v >> 8, wy = v & 255;
+	int32_t x0 = ix < 0 ? ix + setup.panoWidth : ix;
+	x0 = x0 >= setup.panoWidth ? x0 - setup.panoWidth : x0;
+	int32_t x1 = x0 + 1 >= setup.panoWidth ? 0 : x0 + 1;
+	int32_t y0 = iy < 0 ? 0 : (iy > setup.panoHeight - 1 ? setup.panoHeight - 1 : iy);
+	int32_t y1 = iy + 1 < 0 ? 0 : (iy + 1 > setup.panoHeight - 1 ? setup.panoHeight - 1 : iy + 1);
+
+	uint32_t p00 = pano[y0 * setup.panoStride + x0];
+	uint32_t p01 = pano[y0 * setup.panoStride + x1];
+	uint32_t p10 = pano[y1 * setup.panoStride + x0];
+	uint32_t p11 = pano[y1 * setup.panoStride + x1];
+
+	for (int c = 0; c < 4; c++)
+	{
+		uint32_t top = lerp8((p00 >> (8 * c)) & 255, (p01 >> (8 * c)) & 255, wx);
+		uint32_t bottom = lerp8((p10 >> (8 * c)) & 255, (p11 >> (8 * c)) & 255, wx);
+		dst[c] = (unsigned char)lerp8(top, bottom, wy);
+	}
+}
+
+static void
+renderRowsScalar(const ViewportSetup &setup, const uint32_t *pano, uint32_t width, uint32_t height,
+	unsigned char *dst, size_t dstPitch)
+{
+	for (uint32_t y = 0; y < height; y++)
+	{
+		float base[3], step[3];
+		rowRay(setup, y, base, step);
+		unsigned char *d = dst + y * dstPitch;
+		for (uint32_t x = 0; x < width; x++)
+			samplePixel(setup, pano, base, step, x, d + 4 * x);
+	}
+}
+
+//***********************************************************************************
+// SSE4.1: coordinates 4 pixels at a time, texels fetched one by one
+
+CPU_TARGET_SSE41
+static inline __m128 fastAtan2Sse41(__m128 y, __m128 x)
+{
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	__m128 ax = _mm_andnot_ps(signMask, x);
+	__m128 ay = _mm_andnot_ps(signMask, y);
+	__m128 mn = _mm_min_ps(ax, ay);
+	__m128 mx = _mm_max_ps(ax, ay);
+	__m128 a = _mm_div_ps(mn, _mm_max_ps(mx, _mm_set1_ps(ATAN_TINY)));
+	__m128 s = _mm_mul_ps(a, a);
+	__m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ATAN_C5), s), _mm_set1_ps(ATAN_C4));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C3));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C2));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C1));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C0));
+	r = _mm_mul_ps(r, a);
+	r = _mm_blendv_ps(r, _mm_sub_ps(_mm_set1_ps((float)(M_PI / 2)), r), _mm_cmpgt_ps(ay, ax));
+	r = _mm_blendv_ps(r, _mm_sub_ps(_mm_set1_ps((float)M_PI), r), _mm_cmplt_ps(x, _mm_setzero_ps()));
+	return _mm_xor_ps(r, _mm_and_ps(_mm_cmplt_ps(y, _mm_setzero_ps()), signMask));
+}
+
+// ((a * (256 - f) + b * f) >> 8) per 16-bit lane; the sum never exceeds 65280
+CPU_TARGET_SSE41
+static inline __m128i lerp16Sse41(__m128i a, __m128i b, __m128i f)
+{
+	__m128i g = _mm_sub_epi16(_mm_set1_epi16(256), f);
+	return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, g), _mm_mullo_epi16(b, f)), 8);
+}
+
+// Bilinear blend of 4 pixels; wx and wy hold one 8-bit weight per 32-bit lane
+CPU_TARGET_SSE41
+static inline __m128i bilerpSse41(__m128i p00, __m128i p01, __m128i p10, __m128i p11, __m128i wx, __m128i wy)
+{
+	const __m128i zero = _mm_setzero_si128();
+	wx = _mm_or_si128(wx, _mm_slli_epi32(wx, 16));
+	wy = _mm_or_si128(wy, _mm_slli_epi32(wy, 16));
+	__m128i wxLo = _mm_unpacklo_epi32(wx, wx), wxHi = _mm_unpackhi_epi32(wx, wx);
+	__m128i wyLo = _mm_unpacklo_epi32(wy, wy), wyHi = _mm_unpackhi_epi32(wy, wy);
+
+	__m128i lo = lerp16Sse41(
+		lerp16Sse41(_mm_unpacklo_epi8(p00, zero), _mm_unpacklo_epi8(p01, zero), wxLo),
+		lerp16Sse41(_mm_unpacklo_epi8(p10, zero), _mm_unpacklo_epi8(p11, zero), wxLo), wyLo);
+	__m128i hi = lerp16Sse41(
+		lerp16Sse41(_mm_unpackhi_epi8(p00, zero), _mm_unpackhi_epi8(p01, zero), wxHi),
+		lerp16Sse41(_mm_unpackhi_epi8(p10, zero), _mm_unpackhi_epi8(p11, zero), wxHi), wyHi);
+	return _mm_packus_epi16(lo, hi);
+}
+
+CPU_TARGET_SSE41
+static void
+renderRowsSse41(const ViewportSetup &setup, const uint32_t *pano, uint32_t width, uint32_t height,
+	unsigned char *dst, size_t dstPitch)
+{
+	const __m128i width0 = _mm_set1_epi32(setup.panoWidth);
+	const __m128i lastRow = _mm_set1_epi32(setup.panoHeight - 1);
+	const __m128i stride = _mm_set1_epi32(setup.panoStride);
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i low8 = _mm_set1_epi32(255);
+	const __m128i zero = _mm_setzero_si128();
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		float base[3], step[3];
+		rowRay(setup, y, base, step);
+		unsigned char *d = dst + y * dstPitch;
+
+		uint32_t x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128 fx = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32((int)x), _mm_setr_epi32(0, 1, 2, 3)));
+			__m128 dx = _mm_add_ps(_mm_set1_ps(base[0]), _mm_mul_ps(fx, _mm_set1_ps(step[0])));
+			__m128 dy = _mm_add_ps(_mm_set1_ps(base[1]), _mm_mul_ps(fx, _mm_set1_ps(step[1])));
+			__m128 dz = _mm_add_ps(_mm_set1_ps(base[2]), _mm_mul_ps(fx, _mm_set1_ps(step[2])));
+
+			__m128 lon = fastAtan2Sse41(dx, dz);
+			__m128 lat = fastAtan2Sse41(dy, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz))));
+			__m128i u = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(_mm_mul_ps(lon, _mm_set1_ps(setup.uScale)), _mm_set1_ps(setup.uOffset))));
+			__m128i v = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(_mm_mul_ps(lat, _mm_set1_ps(setup.vScale)), _mm_set1_ps(setup.vOffset))));
+
+			__m128i ix = _mm_srai_epi32(u, 8), wx = _mm_and_si128(u, low8);
+			__m128i iy = _mm_srai_epi32(v, 8), wy = _mm_and_si128(v, low8);
+			__m128i x0 = _mm_add_epi32(ix, _mm_and_si128(_mm_cmplt_epi32(ix, zero), width0));
+			x0 = _mm_sub_epi32(x0, _mm_andnot_si128(_mm_cmplt_epi32(x0, width0), width0));
+			__m128i x1 = _mm_add_epi32(x0, one);
+			x1 = _mm_andnot_si128(_mm_cmpeq_epi32(x1, width0), x1);
+			__m128i y0 = _mm_min_epi32(_mm_max_epi32(iy, zero), lastRow);
+			__m128i y1 = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(iy, one), zero), lastRow);
+			__m128i row0 = _mm_mullo_epi32(y0, stride);
+			__m128i row1 = _mm_mullo_epi32(y1, stride);
+
+			uint32_t i00[4], i01[4], i10[4], i11[4];
+			_mm_storeu_si128((__m128i *)i00, _mm_add_epi32(row0, x0));
+			_mm_storeu_si128((__m128i *)i01, _mm_add_epi32(row0, x1));
+			_mm_storeu_si128((__m128i *)i10, _mm_add_epi32(row1, x0));
+			_mm_storeu_si128((__m128i *)i11, _mm_add_epi32(row1, x1));
+
+			__m128i p00 = _mm_setr_epi32(pano[i00[0]], pano[i00[1]], pano[i00[2]], pano[i00[3]]);
+			__m128i p01 = _mm_setr_epi32(pano[i01[0]], pano[i01[1]], pano[i01[2]], pano[i01[3]]);
+			__m128i p10 = _mm_setr_epi32(pano[i10[0]], pano[i10[1]], pano[i10[2]], pano[i10[3]]);
+			__m128i p11 = _mm_setr_epi32(pano[i11[0]], pano[i11[1]], pano[i11[2]], pano[i11[3]]);
+
+			_mm_storeu_si128((__m128i *)(d + 4 * x), bilerpSse41(p00, p01, p10, p11, wx, wy));
+		}
+		for (; x < width; x++)
+			samplePixel(setup, pano, base, step, x, d + 4 * x);
+	}
+}
+
+//***********************************************************************************
+// AVX2: 8 pixels per iteration with hardware gathers
+
+CPU_TARGET_AVX2
+static inline __m256 fastAtan2Avx2(__m256 y, __m256 x)
+{
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	__m256 ax = _mm256_andnot_ps(signMask, x);
+	__m256 ay = _mm256_andnot_ps(signMask, y);
+	__m256 mn = _mm256_min_ps(ax, ay);
+	__m256 mx = _mm256_max_ps(ax, ay);
+	__m256 a = _mm256_div_ps(mn, _mm256_max_ps(mx, _mm256_set1_ps(ATAN_TINY)));
+	__m256 s = _mm256_mul_ps(a, a);
+	__m256 r = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ATAN_C5), s), _mm256_set1_ps(ATAN_C4));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN_C3));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN_C2));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN_C1));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN_C0));
+	r = _mm256_mul_ps(r, a);
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps((float)(M_PI / 2)), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps((float)M_PI), r), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+	return _mm256_xor_ps(r, _mm256_and_ps(_mm256_cmp_ps(y, _mm256_setzero_ps(), _CMP_LT_OQ), signMask));
+}
+
+CPU_TARGET_AVX2
+static inline __m256i lerp16Avx2(__m256i a, __m256i b, __m256i f)
+{
+	__m256i g = _mm256_sub_epi16(_mm256_set1_epi16(256), f);
+	return _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(a, g), _mm256_mullo_epi16(b, f)), 8);
+}
+
+// Same as bilerpSse41 within each 128-bit lane
+CPU_TARGET_AVX2
+static inline __m256i bilerpAvx2(__m256i p00, __m256i p01, __m256i p10, __m256i p11, __m256i wx, __m256i wy)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	wx = _mm256_or_si256(wx, _mm256_slli_epi32(wx, 16));
+	wy = _mm256_or_si256(wy, _mm256_slli_epi32(wy, 16));
+	__m256i wxLo = _mm256_unpacklo_epi32(wx, wx), wxHi = _mm256_unpackhi_epi32(wx, wx);
+	__m256i wyLo = _mm256_unpacklo_epi32(wy, wy), wyHi = _mm256_unpackhi_epi32(wy, wy);
+
+	__m256i lo = lerp16Avx2(
+		lerp16Avx2(_mm256_unpacklo_epi8(p00, zero), _mm256_unpacklo_epi8(p01, zero), wxLo),
+		lerp16Avx2(_mm256_unpacklo_epi8(p10, zero), _mm256_unpacklo_epi8(p11, zero), wxLo), wyLo);
+	__m256i hi = lerp16Avx2(
+		lerp16Avx2(_mm256_unpackhi_epi8(p00, zero), _mm256_unpackhi_epi8(p01, zero), wxHi),
+		lerp16Avx2(_mm256_unpackhi_epi8(p10, zero), _mm256_unpackhi_epi8(p11, zero), wxHi), wyHi);
+	return _mm256_packus_epi16(lo, hi);
+}
+
+CPU_TARGET_AVX2
+static void
+renderRowsAvx2(const ViewportSetup &setup, const uint32_t *pano, uint32_t width, uint32_t height,
+	unsigned char *dst, size_t dstPitch)
+{
+	const __m256i width0 = _mm256_set1_epi32(setup.panoWidth);
+	const __m256i lastRow = _mm256_set1_epi32(setup.panoHeight - 1);
+	const __m256i stride = _mm256_set1_epi32(setup.panoStride);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i low8 = _mm256_set1_epi32(255);
+	const __m256i zero = _mm256_setzero_si256();
+	const int *texels = (const int *)pano;
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		float base[3], step[3];
+		rowRay(setup, y, base, step);
+		unsigned char *d = dst + y * dstPitch;
+
+		uint32_t x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			__m256 fx = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32((int)x), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+			__m256 dx = _mm256_add_ps(_mm256_set1_ps(base[0]), _mm256_mul_ps(fx, _mm256_set1_ps(step[0])));
+			__m256 dy = _mm256_add_ps(_mm256_set1_ps(base[1]), _mm256_mul_ps(fx, _mm256_set1_ps(step[1])));
+			__m256 dz = _mm256_add_ps(_mm256_set1_ps(base[2]), _mm256_mul_ps(fx, _mm256_set1_ps(step[2])));
+
+			__m256 lon = fastAtan2Avx2(dx, dz);
+			__m256 lat = fastAtan2Avx2(dy, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz))));
+			__m256i u = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(lon, _mm256_set1_ps(setup.uScale)), _mm256_set1_ps(setup.uOffset))));
+			__m256i v = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(lat, _mm256_set1_ps(setup.vScale)), _mm256_set1_ps(setup.vOffset))));
+
+			__m256i ix = _mm256_srai_epi32(u, 8), wx = _mm256_and_si256(u, low8);
+			__m256i iy = _mm256_srai_epi32(v, 8), wy = _mm256_and_si256(v, low8);
+			__m256i x0 = _mm256_add_epi32(ix, _mm256_and_si256(_mm256_cmpgt_epi32(zero, ix), width0));
+			x0 = _mm256_sub_epi32(x0, _mm256_andnot_si256(_mm256_cmpgt_epi32(width0, x0), width0));
+			__m256i x1 = _mm256_add_epi32(x0, one);
+			x1 = _mm256_andnot_si256(_mm256_cmpeq_epi32(x1, width0), x1);
+			__m256i y0 = _mm256_min_epi32(_mm256_max_epi32(iy, zero), lastRow);
+			__m256i y1 = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(iy, one), zero), lastRow);
+			__m256i row0 = _mm256_mullo_epi32(y0, stride);
+			__m256i row1 = _mm256_mullo_epi32(y1, stride);
+
+			__m256i p00 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row0, x0), 4);
+			__m256i p01 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row0, x1), 4);
+			__m256i p10 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, x0), 4);
+			__m256i p11 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, x1), 4);
+
+			_mm256_storeu_si256((__m256i *)(d + 4 * x), bilerpAvx2(p00, p01, p10, p11, wx, wy));
+		}
+		for (; x < width; x++)
+			samplePixel(setup, pano, base, step, x, d + 4 * x);
+	}
+}
+
+//***********************************************************************************
+ViewportRenderer::ViewportRenderer()
+	: m_width(0), m_height(0), m_fovXDeg(0.0f), m_fovYDeg(0.0f), m_tanX(0.0f), m_tanY(0.0f)
+{
+}
+
+bool
+ViewportRenderer::init(uint32_t width, uint32_t height, float fovXDeg)
+{
+	if (width == 0 || height == 0 || !(fovXDeg > 0.0f && fovXDeg < 179.0f))
+		return false;
+
+	m_width = width;
+	m_height = height;
+	m_fovXDeg = fovXDeg;
+	m_tanX = tanf(fovXDeg * (float)(M_PI / 360.0));
+	m_tanY = m_tanX * height / width;
+	m_fovYDeg = 2.0f * atanf(m_tanY) * (float)(180.0 / M_PI);
+	return true;
+}
+
+void
+ViewportRenderer::render(const unsigned char *pano, uint32_t panoWidth, uint32_t panoHeight, size_t panoPitch,
+	const Quat &orientation, unsigned char *dst, size_t dstPitch) const
+{
+	ViewportSetup setup;
+	setupViewport(m_width, m_height, m_tanX, m_tanY, orientation, panoWidth, panoHeight, panoPitch, &setup);
+
+	switch (cpuGetSimdLevel())
+	{
+	case CPU_SIMD_AVX2:
+		renderRowsAvx2(setup, (const uint32_t *)pano, m_width, m_height, dst, dstPitch);
+		break;
+	case CPU_SIMD_SSE41:
+		renderRowsSse41(setup, (const uint32_t *)pano, m_width, m_height, dst, dstPitch);
+		break;
+	default:
+		renderRowsScalar(setup, (const uint32_t *)pano, m_width, m_height, dst, dstPitch);
+		break;
+	}
+}
+
+void
+ViewportRenderer::renderScalar(const unsigned char *pano, uint32_t panoWidth, uint32_t panoHeight, size_t panoPitch,
+	const Quat &orientation, unsigned char *dst, size_t dstPitch) const
+{
+	ViewportSetup setup;
+	setupViewport(m_width, m_height, m_tanX, m_tanY, orientation, panoWidth, panoHeight, panoPitch, &setup);
+	renderRowsScalar(setup, (const uint32_t *)pano, m_width, m_height, dst, dstPitch);
+}
@@ -0,0 +1,93 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "quaternion.h"
+
+// Renders a rectilinear (pinhole) view out of an equirectangular panorama of
+// 4-byte pixels, so a client can be sent just what it looks at.
+// Panorama convention: the center column looks along +Z, columns increase
+// toward +X, the top row is +Y. The view looks along orientation * +Z with
+// +X to the right and +Y up, matching quatFromYawPitchRoll().
+class ViewportRenderer
+{
+public:
+	ViewportRenderer();
+
+	// fovXDeg is the horizontal field of view; the vertical one follows from
+	// the aspect ratio with square pixels
+	bool init(uint32_t width, uint32_t height, float fovXDeg);
+
+	// Bilinear sampling with 8-bit weights, wrapping horizontally. panoPitch
+	// must be a multiple of 4. Selects an AVX2, SSE4.1 or scalar kernel.
+	void render(const unsigned char *pano, uint32_t panoWidth, uint32_t panoHeight, size_t panoPitch,
+		const Quat &orientation, unsigned char *dst, size_t dstPitch) const;
+
+	// render() on the scalar kernel at any instruction set level, which
+	// --verify_kernels expects it to match bit for bit
+	void renderScalar(const unsigned char *pano, uint32_t panoWidth, uint32_t panoHeight, size_t panoPitch,
+		const Quat &orientation, unsigned char *dst, size_t dstPitch) const;
+
+	uint32_t width() const { return m_width; }
+	uint32_t height() const { return m_height; }
+	float fovXDeg() const { return m_fovXDeg; }
+	float fovYDeg() const { return m_fovYDeg; }
+
+private:
+	uint32_t m_width;
+	uint32_t m_height;
+	float m_fovXDeg;
+	float m_fovYDeg;
+	float m_tanX;       // half-width of the image plane at unit distance
+	float m_tanY;
+};
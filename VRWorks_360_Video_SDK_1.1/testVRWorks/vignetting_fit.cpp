@@ -0,0 +1,364 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#include "vignetting_fit.h"
+#include "remap_lut.h"
+
+#include <iostream>
+#include <math.h>
+
+// Nearest source pixel of panorama pixel (x, y), which the camera sees, and
+// its radius under the camera's lens
+static uint32_t
+nearestPixel(const nvstitchCameraMappingMatrix_t &matrix, const LensVignetting &lens,
+	uint32_t x, uint32_t y, float *radius)
+{
+	const float *uv = matrix.matrix +
+		((size_t)(y - matrix.map_offset.y) * matrix.map_size.x + (x - matrix.map_offset.x)) * 2;
+	*radius = lens.radius(uv[0], uv[1]);
+	int u = (int)(uv[0] + 0.5f);
+	int v = (int)(uv[1] + 0.5f);
+	u = u < (int)matrix.input_size.x - 1 ? u : (int)matrix.input_size.x - 1;
+	v = v < (int)matrix.input_size.y - 1 ? v : (int)matrix.input_size.y - 1;
+	return (uint32_t)u | (uint32_t)v << 16;
+}
+
+// Solve the n x n system a x = a[.][n], n up to VIGNETTING_COEFFICIENTS,
+// by elimination with partial pivoting; false if it is singular next to its
+// largest pivot
+static bool
+solveSystem(double a[VIGNETTING_COEFFICIENTS][VIGNETTING_COEFFICIENTS + 1], int n, double *x)
+{
+	double largest = 0.0;
+	for (int col = 0; col < n; col++)
+	{
+		int pivot = col;
+		for (int row = col + 1; row < n; row++)
+			if (fabs(a[row][col]) > fabs(a[pivot][col]))
+				pivot = row;
+		for (int c = 0; c <= n; c++)
+		{
+			double swap = a[col][c];
+			a[col][c] = a[pivot][c];
+			a[pivot][c] = swap;
+		}
+		largest = fabs(a[col][col]) > largest ? fabs(a[col][col]) : largest;
+		if (!(fabs(a[col][col]) > largest * 1e-12))
+			return false;
+		for (int row = col + 1; row < n; row++)
+		{
+			double factor = a[row][col] / a[col][col];
+			for (int c = col; c <= n; c++)
+				a[row][c] -= factor * a[col][c];
+		}
+	}
+	for (int row = n; row-- > 0;)
+	{
+		double sum = a[row][n];
+		for (int c = row + 1; c < n; c++)
+			sum -= a[row][c] * x[c];
+		x[row] = sum / a[row][row];
+	}
+	return true;
+}
+
+// Condition number of the leading n x n block of a symmetric positive
+// semidefinite matrix, its rows and columns scaled to a unit diagonal, from
+// the eigenvalues that cyclic Jacobi rotations leave on the diagonal
+static double
+conditionNumber(const double m[VIGNETTING_COEFFICIENTS][VIGNETTING_COEFFICIENTS], int n)
+{
+	double a[VIGNETTING_COEFFICIENTS][VIGNETTING_COEFFICIENTS];
+	for (int i = 0; i < n; i++)
+	{
+		if (!(m[i][i] > 0.0))
+			return HUGE_VAL;
+		for (int j = 0; j < n; j++)
+			a[i][j] = m[i][j] / sqrt(m[i][i] * m[j][j]);
+	}
+
+	for (int sweep = 0; sweep < 32; sweep++)
+	{
+		double off = 0.0;
+		for (int p = 0; p < n; p++)
+			for (int q = p + 1; q < n; q++)
+				off += a[p][q] * a[p][q];
+		if (off < 1e-30)
+			break;
+		for (int p = 0; p < n; p++)
+		{
+			for (int q = p + 1; q < n; q++)
+			{
+				if (a[p][q] == 0.0)
+					continue;
+				double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				double c = 1.0 / sqrt(t * t + 1.0), s = t * c;
+				for (int k = 0; k < n; k++)
+				{
+					double kp = a[k][p], kq = a[k][q];
+					a[k][p] = c * kp - s * kq;
+					a[k][q] = s * kp + c * kq;
+				}
+				for (int k = 0; k < n; k++)
+				{
+					double pk = a[p][k], qk = a[q][k];
+					a[p][k] = c * pk - s * qk;
+					a[q][k] = s * pk + c * qk;
+				}
+			}
+		}
+	}
+
+	double smallest = a[0][0], largest = a[0][0];
+	for (int i = 1; i < n; i++)
+	{
+		smallest = a[i][i] < smallest ? a[i][i] : smallest;
+		largest = a[i][i] > largest ? a[i][i] : largest;
+	}
+	return smallest > 0.0 ? largest / smallest : HUGE_VAL;
+}
+
+//***********************************************************************************
+VignettingFit::VignettingFit() :
+	m_xx(),
+	m_xy(),
+	m_yy(0.0),
+	m_used(0)
+{
+}
+
+nvstitchResult
+VignettingFit::build(const RemapTables &tables, const nvstitchVideoRigProperties_t &rig, uint32_t maxSamples)
+{
+	uint32_t numCameras = tables.numCameras();
+	if (rig.num_cameras != numCameras)
+		return NVSTITCH_ERROR_BAD_PARAMETER;
+	std::vector<LensVignetting> lenses(numCameras);
+	for (uint32_t camera = 0; camera < numCameras; camera++)
+	{
+		nvstitchResult result = lenses[camera].init(rig.cameras[camera], nullptr);
+		if (result != NVSTITCH_SUCCESS)
+			return result;
+	}
+
+	m_pairs.clear();
+	m_samples.clear();
+	for (int i = 0; i < VIGNETTING_COEFFICIENTS; i++)
+	{
+		for (int j = 0; j < VIGNETTING_COEFFICIENTS; j++)
+			m_xx[i][j] = 0.0;
+		m_xy[i] = 0.0;
+	}
+	m_yy = 0.0;
+	m_used = 0;
+
+	// One grid over the panorama, as the gain compensator lays out its own
+	size_t overlap = 0;
+	for (uint32_t a = 0; a < numCameras; a++)
+		for (uint32_t b = a + 1; b < numCameras; b++)
+			for (uint32_t y = 0; y < tables.panoHeight(); y++)
+				remapForEachOverlap(tables.spans(a), tables.spans(b), y,
+					[&](uint32_t begin, uint32_t end) { overlap += end - begin; });
+	uint32_t stride = 1;
+	while ((overlap + (size_t)stride * stride - 1) / ((size_t)stride * stride) > maxSamples)
+		stride++;
+
+	uint32_t start = stride / 2;
+	for (uint32_t a = 0; a < numCameras; a++)
+	{
+		for (uint32_t b = a + 1; b < numCameras; b++)
+		{
+			Pair pair = { { a, b }, m_samples.size(), 0 };
+			for (uint32_t y = start; y < tables.panoHeight(); y += stride)
+			{
+				remapForEachOverlap(tables.spans(a), tables.spans(b), y, [&](uint32_t begin, uint32_t end) {
+					uint32_t x = begin + (stride - begin % stride + start) % stride;
+					for (; x < end; x += stride)
+					{
+						Sample sample;
+						float ra, rb;
+						sample.xy[0] = nearestPixel(tables.matrix(a), lenses[a], x, y, &ra);
+						sample.xy[1] = nearestPixel(tables.matrix(b), lenses[b], x, y, &rb);
+						float pa = ra * ra, pb = rb * rb;
+						for (int n = 0; n < VIGNETTING_COEFFICIENTS; n++)
+						{
+							sample.x[n] = pa - pb;
+							pa *= ra * ra;
+							pb *= rb * rb;
+						}
+						m_samples.push_back(sample);
+					}
+				});
+			}
+			pair.numSamples = m_samples.size() - pair.firstSample;
+			if (pair.numSamples > 0)
+				m_pairs.push_back(pair);
+		}
+	}
+	return NVSTITCH_SUCCESS;
+}
+
+// Each pair's samples are summed on their own, then centered on the pair's
+// means as they are added, which subtracts its exposure difference
+void
+VignettingFit::addFrame(const remapSource_t *sources)
+{
+	const int n = VIGNETTING_COEFFICIENTS;
+	for (const Pair &pair : m_pairs)
+	{
+		double count = 0.0, sy = 0.0, syy = 0.0;
+		double sx[n] = {}, sxy[n] = {}, sxx[n][n] = {};
+		for (size_t s = pair.firstSample; s < pair.firstSample + pair.numSamples; s++)
+		{
+			const Sample &sample = m_samples[s];
+			int luma[2];
+			bool usable = true;
+			for (int side = 0; side < 2; side++)
+			{
+				unsigned char rgba[4];
+				remapSourcePixel(&sources[pair.camera[side]], sample.xy[side] & 0xffff, sample.xy[side] >> 16, rgba);
+				luma[side] = (rgba[0] + rgba[1] + rgba[2] + 1) / 3;
+				usable = usable && luma[side] >= VIGNETTING_FIT_MIN_LEVEL && luma[side] <= VIGNETTING_FIT_MAX_LEVEL;
+			}
+			if (!usable)
+				continue;
+
+			// Camera a is the one corrected by r_a, so y is ln I_b - ln I_a
+			double y = log((double)luma[1]) - log((double)luma[0]);
+			count += 1.0;
+			sy += y;
+			syy += y * y;
+			for (int i = 0; i < n; i++)
+			{
+				sx[i] += sample.x[i];
+				sxy[i] += sample.x[i] * y;
+				for (int j = 0; j < n; j++)
+					sxx[i][j] += (double)sample.x[i] * sample.x[j];
+			}
+		}
+		if (count < 2.0)
+			continue;
+
+		m_yy += syy - sy * sy / count;
+		for (int i = 0; i < n; i++)
+		{
+			m_xy[i] += sxy[i] - sx[i] * sy / count;
+			for (int j = 0; j < n; j++)
+				m_xx[i][j] += sxx[i][j] - sx[i] * sx[j] / count;
+		}
+		m_used += (size_t)count;
+	}
+}
+
+bool
+VignettingFit::solve(float coefficients[VIGNETTING_COEFFICIENTS], float *rms, uint32_t *terms) const
+{
+	const int n = VIGNETTING_COEFFICIENTS;
+	if (m_used <= (size_t)n)
+		return false;
+
+	// As many leading terms as the samples tell apart
+	int fitted = n;
+	while (fitted > 1 && conditionNumber(m_xx, fitted) > VIGNETTING_FIT_MAX_CONDITION)
+		fitted--;
+	if (terms != nullptr)
+		*terms = (uint32_t)fitted;
+
+	double a[n][n + 1];
+	for (int i = 0; i < fitted; i++)
+	{
+		for (int j = 0; j < fitted; j++)
+			a[i][j] = m_xx[i][j];
+		a[i][fitted] = m_xy[i];
+	}
+	double g[n] = {};
+	if (!solveSystem(a, fitted, g))
+		return false;
+	if (rms != nullptr)
+	{
+		double residual = m_yy;
+		for (int i = 0; i < fitted; i++)
+			residual -= g[i] * m_xy[i];
+		*rms = (float)sqrt((residual > 0.0 ? residual : 0.0) / (double)m_used);
+	}
+
+	// The exponential refitted as the polynomial over the image circle
+	const int steps = 64;
+	double b[n][n + 1] = {};
+	for (int k = 0; k < steps; k++)
+	{
+		double r2 = (k + 0.5) / steps;
+		r2 *= r2;
+		double basis[n], power = r2, exponent = 0.0;
+		for (int i = 0; i < n; i++)
+		{
+			basis[i] = power;
+			exponent += g[i] * power;
+			power *= r2;
+		}
+		double target = exp(exponent) - 1.0;
+		for (int i = 0; i < n; i++)
+		{
+			for (int j = 0; j < n; j++)
+				b[i][j] += basis[i] * basis[j];
+			b[i][n] += basis[i] * target;
+		}
+	}
+	double v[n];
+	if (!solveSystem(b, n, v))
+		return false;
+	for (int i = 0; i < n; i++)
+	{
+		if (!(fabs(v[i]) < 1e6))
+			return false;
+		coefficients[i] = (float)v[i];
+	}
+	return true;
+}
@@ -0,0 +1,134 @@
+/*
+* Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+*
+* NOTICE TO LICENSEE:
+*
+* This source code and/or documentation ("Licensed Deliverables") are
+* subject to NVIDIA intellectual property rights under U.S. and
+* international Copyright laws.
+*
+* These Licensed Deliverables contained herein is PROPRIETARY and
+* CONFIDENTIAL to NVIDIA and is being provided under the terms and
+* conditions of a form of NVIDIA software license agreement by and
+* between NVIDIA and Licensee ("License Agreement") or electronically
+* accepted by Licensee.  Notwithstanding any terms or conditions to
+* the contrary in the License Agreement, reproduction or disclosure
+* of the Licensed Deliverables to any third party without the express
+* written consent of NVIDIA is prohibited.
+*
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, NVIDIA MAKES NO REPRESENTATION ABOUT THE
+* SUITABILITY OF THESE LICENSED DELIVERABLES FOR ANY PURPOSE.  IT IS
+* PROVIDED "AS IS" WITHOUT EXPRESS OR IMPLIED WARRANTY OF ANY KIND.
+* NVIDIA DISCLAIMS ALL WARRANTIES WITH REGARD TO THESE LICENSED
+* DELIVERABLES, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY,
+* NONINFRINGEMENT, AND FITNESS FOR A PARTICULAR PURPOSE.
+* NOTWITHSTANDING ANY TERMS OR CONDITIONS TO THE CONTRARY IN THE
+* LICENSE AGREEMENT, IN NO EVENT SHALL NVIDIA BE LIABLE FOR ANY
+* SPECIAL, INDIRECT, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, OR ANY
+* DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+* WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+* ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+* OF THESE LICENSED DELIVERABLES.
+*
+* U.S. Government End Users.  These Licensed Deliverables are a
+* "commercial item" as that term is defined at 48 C.F.R. 2.101 (OCT
+* 1995), consisting of "commercial computer software" and "commercial
+* computer software documentation" as such terms are used in 48
+* C.F.R. 12.212 (SEPT 1995) and is provided to the U.S. Government
+* only as a commercial end item.  Consistent with 48 C.F.R.12.212 and
+* 48 C.F.R. 227.7202-1 through 227.7202-4 (JUNE 1995), all
+* U.S. Government End Users acquire the Licensed Deliverables with
+* only those rights set forth herein.
+*
+* Any use of the Licensed Deliverables in individual and commercial
+* software must include, in the user documentation and internal
+* comments to the code, the above Disclaimer and U.S. Government End
+* Users Notice.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "camera_model.h"
+#include "remap_yuv_kernels.h"
+
+class RemapTables;
+
+// ==== Lens vignetting fit ====
+// Where two cameras overlap they see the same scene, one near the middle of
+// its lens and the other nearer the edge, so the ratio of their brightness
+// measures how the lens falls off between the two radii. With the falloff
+// as a correction f(r) = exp(a1 r^2 + a2 r^4 + a3 r^6), at a point seen at
+// r_i and r_j
+//   ln I_j - ln I_i = c_ij + sum_n a_n (r_i^2n - r_j^2n)
+// where c_ij is the pair's difference in exposure. Each frame's samples are
+// centered per pair, which takes c_ij out, and added to one least-squares
+// system in a1..a3 over every pair and frame. The cameras of a rig share a
+// lens type, and an overlap sees each camera over a narrow band of radii,
+// so one falloff is fitted for the whole rig; it is then refitted as the
+// 1 + v1 r^2 + v2 r^4 + v3 r^6 of LensVignetting.
+//
+// How many of a1..a3 the overlaps can tell apart depends on the rig. Where
+// every overlap sits at about the same radius in both cameras, as with two
+// back-to-back fisheyes, the powers of r are nearly collinear there, and a
+// full fit follows the noise wherever it extrapolates. The higher terms are
+// then left out, down to a1 alone, until the system's condition number,
+// with each term scaled to unit variance, is under
+// VIGNETTING_FIT_MAX_CONDITION.
+
+#define VIGNETTING_FIT_SAMPLES 16384    // over all overlaps, per frame
+#define VIGNETTING_FIT_MIN_LEVEL 8      // samples darker or brighter than this
+#define VIGNETTING_FIT_MAX_LEVEL 247    // in either camera are left out
+#define VIGNETTING_FIT_MAX_CONDITION 1e5
+
+class VignettingFit
+{
+public:
+	VignettingFit();
+
+	// Lay out a sample grid over the cameras' overlaps and clear the sums;
+	// the rig must be the one the tables were built from
+	nvstitchResult build(const RemapTables &tables, const nvstitchVideoRigProperties_t &rig,
+		uint32_t maxSamples = VIGNETTING_FIT_SAMPLES);
+
+	// Add the overlaps of one set of camera images, one source per camera
+	void addFrame(const remapSource_t *sources);
+
+	// Samples added so far
+	size_t numSamples() const { return m_used; }
+
+	// Solve for the rig's coefficients; false if the samples do not pin
+	// down even a1. rms, if given, is the residual in natural log units, and
+	// terms the number of a1..a3 the overlaps allowed to be fitted.
+	bool solve(float coefficients[VIGNETTING_COEFFICIENTS], float *rms = nullptr, uint32_t *terms = nullptr) const;
+
+private:
+	// Nearest source pixels of two cameras at one panorama position, and
+	// the difference of their radii's powers, r_a^2n - r_b^2n
+	struct Sample
+	{
+		uint32_t xy[2];         // int16 x | int16 y << 16, as in the packed tables
+		float x[VIGNETTING_COEFFICIENTS];
+	};
+
+	// Overlapping cameras a < b and their samples
+	struct Pair
+	{
+		uint32_t camera[2];
+		size_t firstSample;     // into m_samples
+		size_t numSamples;
+	};
+
+	std::vector<Pair> m_pairs;
+	std::vector<Sample> m_samples;
+
+	// Normal equations of the centered samples: x x^T, x y and y y
+	double m_xx[VIGNETTING_COEFFICIENTS][VIGNETTING_COEFFICIENTS];
+	double m_xy[VIGNETTING_COEFFICIENTS];
+	double m_yy;
+	size_t m_used;
+};
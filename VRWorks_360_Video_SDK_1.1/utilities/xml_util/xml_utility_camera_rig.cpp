@@ -438,6 +438,49 @@ namespace xmlutil
     return true;
   }
 
+  static const char* const vignettingAttrs[3] = { "v1", "v2", "v3" };
+
+  bool readCameraVignettingXml(const std::string& xmlPath, std::vector<float>& coefficients)
+  {
+    rapidxml::xml_document<> doc;
+    std::string xmFileString;
+    if (!getXmlFileString(xmlPath, xmFileString))
+    {
+      displayError("Unable to open xml file: " + xmlPath);
+      return false;
+    }
+    try
+    {
+      doc.parse<0>((char*)xmFileString.c_str());
+    }
+    catch (const rapidxml::parse_error& e)
+    {
+      std::cerr << "Parsing error with xml:" << xmlPath << "\n";
+      std::cerr << "Parse error was: " << e.what() << "\n";
+      return false;
+    }
+
+    rapidxml::xml_node<> *camRigNode = findCameraRigNode(&doc);
+    if (!isNodePresent(camRigNode, "no rig node found with cameras."))
+      return false;
+
+    coefficients.clear();
+    for (rapidxml::xml_node<>* currCamNode = camRigNode->first_node("camera"); currCamNode;
+      currCamNode = currCamNode->next_sibling("camera"))
+    {
+      rapidxml::xml_node<>* opticsNode = currCamNode->first_node("optics");
+      rapidxml::xml_node<>* vignettingNode = opticsNode ? opticsNode->first_node("vignetting") : nullptr;
+      for (int i = 0; i < 3; i++)
+      {
+        if (vignettingNode && isAttrPresent(vignettingNode, vignettingAttrs[i]))
+          coefficients.push_back(getAttrValueFloat(vignettingNode, vignettingAttrs[i]));
+        else
+          coefficients.push_back(0.f);
+      }
+    }
+    return true;
+  }
+
   std::string getCameraLayoutString(nvstitchCameraLayout camLayout)
   {
     if (camLayout == nvstitchCameraLayout::NVSTITCH_CAMERA_LAYOUT_EQUATORIAL)
@@ -579,6 +622,68 @@ namespace xmlutil
     return true;
   }
 
+  bool writeCameraVignettingXml(const std::string& xmlPath, const std::string& outPath, const std::vector<float>& coefficients)
+  {
+    rapidxml::xml_document<> doc;
+    std::string xmFileString;
+    if (!getXmlFileString(xmlPath, xmFileString))
+    {
+      displayError("Unable to open xml file: " + xmlPath);
+      return false;
+    }
+    try
+    {
+      // Comments and the declaration are kept, so the copy differs only in the vignetting
+      doc.parse<rapidxml::parse_comment_nodes | rapidxml::parse_declaration_node>((char*)xmFileString.c_str());
+    }
+    catch (const rapidxml::parse_error& e)
+    {
+      std::cerr << "Parsing error with xml:" << xmlPath << "\n";
+      std::cerr << "Parse error was: " << e.what() << "\n";
+      return false;
+    }
+
+    rapidxml::xml_node<> *camRigNode = findCameraRigNode(&doc);
+    if (!isNodePresent(camRigNode, "no rig node found with cameras."))
+      return false;
+
+    size_t camCount = 0;
+    for (rapidxml::xml_node<>* currCamNode = camRigNode->first_node("camera"); currCamNode;
+      currCamNode = currCamNode->next_sibling("camera"))
+    {
+      if ((camCount + 1) * 3 > coefficients.size())
+      {
+        displayError("Fewer vignetting coefficients than cameras in " + xmlPath);
+        return false;
+      }
+
+      // <optics>
+      rapidxml::xml_node<>* opticsNode = currCamNode->first_node("optics");
+      if (!opticsNode)
+        opticsNode = appendNewNode(&doc, currCamNode, "optics");
+      rapidxml::xml_node<>* vignettingNode = opticsNode->first_node("vignetting");
+      if (vignettingNode)
+        opticsNode->remove_node(vignettingNode);
+
+      // <vignetting>
+      vignettingNode = appendNewNode(&doc, opticsNode, "vignetting");
+      for (int i = 0; i < 3; i++)
+        appendNewAttribute(&doc, vignettingNode, vignettingAttrs[i], coefficients[camCount * 3 + i]);
+      camCount++;
+    }
+
+    std::ofstream fout;
+    fout.open(outPath, std::ios::trunc);
+    if (!fout.is_open())
+    {
+      std::cerr << "Error: Cannot open output XML file:" << outPath << "\n";
+      return false;
+    }
+    fout << doc;
+    fout.close();
+    return true;
+  }
+
   bool splitString(const std::string& in, std::vector<std::string>& splitStr, char delim)
   {
     splitStr.clear();
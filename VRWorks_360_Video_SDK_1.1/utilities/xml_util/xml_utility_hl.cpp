@@ -851,6 +851,43 @@ namespace xmlutil
     return true;
   }
 
+  bool readOutputProjectionTypeXml(const std::string& stitcherPropertiesXmlPath, std::string& type)
+  {
+    rapidxml::xml_document<> doc;
+    std::string xmFileString;
+    if (!getXmlFileString(stitcherPropertiesXmlPath, xmFileString))
+    {
+      displayError("Unable to open xml file: " + stitcherPropertiesXmlPath);
+      return false;
+    }
+    try
+    {
+      doc.parse<0>((char*)xmFileString.c_str());
+    }
+    catch (const rapidxml::parse_error& e)
+    {
+      std::cerr << "Parsing error with xml:" << stitcherPropertiesXmlPath << "\n";
+      std::cerr << "Parse error was: " << e.what() << "\n";
+      return false;
+    }
+
+    //<stitcher_properties>
+    rapidxml::xml_node<>* stitcherPropertiesNode = findStitcherPropertiesNode(&doc);
+    if (!isNodePresent(stitcherPropertiesNode, "stitcher_properties node not found.")) { return false; }
+
+    //<output_video_properties>
+    rapidxml::xml_node<>* outputVideoPropertiesNode = stitcherPropertiesNode->first_node("output_video_properties");
+    if (!isNodePresent(outputVideoPropertiesNode, "output_video_properties node not found.")) { return false; }
+
+    //<output_video_projection>
+    rapidxml::xml_node<>* outputVideoProjectionNode = outputVideoPropertiesNode->first_node("output_video_projection");
+    if (!isNodePresent(outputVideoProjectionNode, "output_video_projection node not found.")) { return false; }
+    if (!isAttrPresent(outputVideoProjectionNode, "type", "type attribute missing.")) { return false; }
+
+    type = getAttrValueString(outputVideoProjectionNode, "type");
+    return true;
+  }
+
   bool writeRigXml(
     const std::string& xmlPath,
     const nvstitchVideoRigProperties_t* videoRigProperties, const nvstitchPayload_t mediaPayloadArray[],
@@ -78,6 +78,10 @@ namespace xmlutil
     nvstitchStitcherProperties_t* stitcherProperties, std::vector<std::string>& payloadFilenames, 
     const std::string& inputAudioFeedXmlPath = std::string());
 
+  // The type attribute of <output_video_projection>, unchecked, for
+  // projections the SDK does not know
+  bool readOutputProjectionTypeXml(const std::string& stitcherPropertiesXmlPath, std::string& type);
+
 
   // Write to XML
   bool writeRigXml(
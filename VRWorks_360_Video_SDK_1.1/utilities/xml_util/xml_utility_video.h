@@ -68,9 +68,17 @@ namespace xmlutil
   // Read from Xml
   bool readCameraRigXml(const std::string& xmlPath, std::vector<nvstitchCameraProperties_t>& cameraProperties, nvstitchVideoRigProperties_t* videoRigProperties);
 
+  // Lens vignetting, 3 coefficients per camera in rig order, from each camera's
+  // <optics><vignetting v1="" v2="" v3=""/>; cameras without one get zeros
+  bool readCameraVignettingXml(const std::string& xmlPath, std::vector<float>& coefficients);
+
   // Write to XML
   bool writeCameraRigXml(const std::string& xmlPath, const nvstitchVideoRigProperties_t* videoRigProperties);
 
+  // Copy the rig in xmlPath to outPath, with each camera's vignetting node
+  // set from coefficients and everything else kept as it is
+  bool writeCameraVignettingXml(const std::string& xmlPath, const std::string& outPath, const std::vector<float>& coefficients);
+
   // Append camera rig to the root node
   bool appendCameraRigToRigNode(const nvstitchVideoRigProperties_t* videoRigProperties, rapidxml::xml_document<>* doc, rapidxml::xml_node<>* rig);
 